@@ -50,13 +50,24 @@ analyzer::analyzer() {
     _windowing      = -1;
     _speed          = -1;
     fpos            = 0;
+    unpublished     = 0;
+    publish_interval = 0;
     _draw_upper     = 0;
     sanitize        = true;
     recreate_plan   = true;
     
     spline_buffer = (int*) calloc(200, sizeof(int));
     
-    fft_buffer = (float*) calloc(max_fft_buffer_size, sizeof(float));
+    fft_bufferL = (float*) calloc(max_fft_cache_size, sizeof(float));
+    fft_bufferR = (float*) calloc(max_fft_cache_size, sizeof(float));
+    for (int i = 0; i < 3; i++) {
+        snapshotL[i] = (float*) calloc(max_fft_cache_size, sizeof(float));
+        snapshotR[i] = (float*) calloc(max_fft_cache_size, sizeof(float));
+        snapshot_frames[i] = 0;
+    }
+    snapshot_back   = 0;
+    snapshot_middle = 1;
+    snapshot_front  = 2;
     
     fft_inL = (float*) calloc(max_fft_cache_size, sizeof(float));
     fft_outL = (float*) calloc(max_fft_cache_size, sizeof(float));
@@ -91,11 +102,17 @@ analyzer::~analyzer()
     free(fft_outL);
     free(fft_inR);
     free(fft_inL);
-    free(fft_buffer);
+    for (int i = 0; i < 3; i++) {
+        free(snapshotR[i]);
+        free(snapshotL[i]);
+    }
+    free(fft_bufferR);
+    free(fft_bufferL);
     free(spline_buffer);
 }
 void analyzer::set_sample_rate(uint32_t sr) {
     srate = sr;
+    publish_interval = sr / 100;
 }
 
 void analyzer::set_params(float resolution, float offset, int accuracy, int hold, int smoothing, int mode, int scale, int post, int speed, int windowing, int view, int freeze)
@@ -137,32 +154,65 @@ void analyzer::set_params(float resolution, float offset, int accuracy, int hold
         redraw_graph = true;
     }
 }
-void analyzer::process(float L, float R) {
-    fft_buffer[fpos] = L;
-    fft_buffer[fpos + 1] = R;
-    fpos += 2;
-    fpos %= (max_fft_buffer_size - 2);
+void analyzer::process(const float *L, const float *R, uint32_t count) {
+    while(count) {
+        uint32_t len = std::min<uint32_t>(count, max_fft_cache_size - fpos);
+        memcpy(fft_bufferL + fpos, L, len * sizeof(float));
+        memcpy(fft_bufferR + fpos, R, len * sizeof(float));
+        fpos = (fpos + len) & (max_fft_cache_size - 1);
+        unpublished += len;
+        L += len;
+        R += len;
+        count -= len;
+    }
+    publish();
+}
+
+void analyzer::publish() {
+    // a plain triple buffer: the newest window always replaces the middle
+    // one, whether the GUI has taken it or not, so the display never lags
+    // by more than the interval
+    if (unpublished < publish_interval)
+        return;
+    unpublished = 0;
+    int frames = std::max(0, std::min(_accuracy, max_fft_cache_size));
+    int start = (fpos - frames) & (max_fft_cache_size - 1);
+    int len = std::min(frames, max_fft_cache_size - start);
+    float *L = snapshotL[snapshot_back], *R = snapshotR[snapshot_back];
+    memcpy(L, fft_bufferL + start, len * sizeof(float));
+    memcpy(R, fft_bufferR + start, len * sizeof(float));
+    memcpy(L + len, fft_bufferL, (frames - len) * sizeof(float));
+    memcpy(R + len, fft_bufferR, (frames - len) * sizeof(float));
+    snapshot_frames[snapshot_back] = frames;
+    snapshot_back = snapshot_middle.exchange(snapshot_back | snapshot_fresh, std::memory_order_acq_rel) & 3;
+}
+
+void analyzer::fetch_snapshot() const {
+    if (snapshot_middle.load(std::memory_order_acquire) & snapshot_fresh)
+        snapshot_front = snapshot_middle.exchange(snapshot_front, std::memory_order_acq_rel) & 3;
 }
 
 bool analyzer::do_fft(int subindex, int points) const
 {
     if (recreate_plan) {
+        fft.set_order(std::max(_acc, 0) + 7);
         lintrans = -1;
         recreate_plan = false;
         sanitize = true;
     }
     if (sanitize) {
-        // null the overall buffer
-        dsp::zero(fft_inL,     max_fft_cache_size);
-        dsp::zero(fft_inR,     max_fft_cache_size);
-        dsp::zero(fft_outL,    max_fft_cache_size);
-        dsp::zero(fft_outR,    max_fft_cache_size);
-        dsp::zero(fft_holdL,   max_fft_cache_size);
-        dsp::zero(fft_holdR,   max_fft_cache_size);
-        dsp::zero(fft_smoothL, max_fft_cache_size);
-        dsp::zero(fft_smoothR, max_fft_cache_size);
-        dsp::zero(fft_deltaL,  max_fft_cache_size);
-        dsp::zero(fft_deltaR,  max_fft_cache_size);
+        // null the part of the buffers used by the current FFT size
+        int size = std::max(0, std::min(_accuracy, max_fft_cache_size));
+        dsp::zero(fft_inL,     size);
+        dsp::zero(fft_inR,     size);
+        dsp::zero(fft_outL,    size);
+        dsp::zero(fft_outR,    size);
+        dsp::zero(fft_holdL,   size);
+        dsp::zero(fft_holdR,   size);
+        dsp::zero(fft_smoothL, size);
+        dsp::zero(fft_smoothR, size);
+        dsp::zero(fft_deltaL,  size);
+        dsp::zero(fft_deltaR,  size);
         dsp::zero(spline_buffer, 200);
         analyzer_phase_drawn = 0;
         sanitize = false;
@@ -186,19 +236,19 @@ bool analyzer::do_fft(int subindex, int points) const
         // like smoothing, delta and hold
         // #####################################################################
         if(!((int)analyzer_phase_drawn % __speed)) {
-            // seems we have to do a fft, so let's read the latest data from the
-            // buffer to send it to fft afterwards
+            // seems we have to do a fft, so let's take the latest snapshot
+            // published by the audio thread to send it to fft afterwards
             // we want to remember old fft_out values for smoothing as well
             // and we fill the hold buffer in this (extra) cycle
+            fetch_snapshot();
+            const float *snapL = snapshotL[snapshot_front];
+            const float *snapR = snapshotR[snapshot_front];
+            // the snapshot may be shorter than the window right after
+            // the accuracy has been changed, pad the oldest part with silence
+            int missing = _accuracy - snapshot_frames[snapshot_front];
             for(int i = 0; i < _accuracy; i++) {
-                // go to the right position back in time according to accuracy
-                // settings and cycling in the main buffer
-                int _fpos = (fpos - _accuracy * 2 \
-                    + (i * 2)) % max_fft_buffer_size;
-                if(_fpos < 0)
-                    _fpos = max_fft_buffer_size + _fpos;
-                float L = fft_buffer[_fpos];
-                float R = fft_buffer[_fpos + 1];
+                float L = i < missing ? 0.f : snapL[i - missing];
+                float R = i < missing ? 0.f : snapR[i - missing];
                 float win = 0.54 - 0.46 * cos(2 * M_PI * i / _accuracy);
                 L *= win;
                 R *= win;
@@ -345,11 +395,11 @@ bool analyzer::do_fft(int subindex, int points) const
             // run fft
             // this takes our latest buffer and returns an array with
             // non-normalized
-            fft.execute_r2r(_acc + 7, fft_inL, fft_outL, fft_temp, false);
+            fft.execute_r2r(fft_inL, fft_outL);
             //run fft for for right channel too. it is needed for stereo image 
             //and stereo difference modes
             if(_mode >= 3) {
-                fft.execute_r2r(_acc + 7, fft_inR, fft_outR, fft_temp, false);
+                fft.execute_r2r(fft_inR, fft_outR);
             }
             // ...and set some values for later use
             analyzer_phase_drawn = 0;     
@@ -23,8 +23,12 @@
 #include <calf/giface.h>
 #include <limits.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <math.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 using namespace calf_plugins;
 using namespace dsp;
@@ -365,6 +369,204 @@ void reverb::process(float &left, float &right)
     left = out_left, right = out_right;
 }
 
+/// Line lengths of fdn_reverb in ms, before scaling by the room type
+static const float fdn_line_ms[fdn_reverb::LINES] = { 29.7, 37.1, 41.1, 43.7, 53.0, 59.9, 67.1, 73.3 };
+static const float fdn_room_scale[] = { 0.4, 0.7, 1.0, 1.35, 1.15, 0.55 };
+
+fdn_reverb::fdn_reverb()
+{
+    type = 2;
+    time = 1.0;
+    hf_decay = 0.5;
+    cutoff = 9000;
+    diffusion = 1.f;
+    for (int i = 0; i < LINES; i++) {
+        // left feeds and taps the even lines, right the odd ones; the output
+        // taps are louder to match the level of dsp::reverb
+        float sign = (i & 2) ? -1.f : 1.f;
+        in_l[i] = (i & 1) ? 0.f : 0.5f * sign;
+        in_r[i] = (i & 1) ? 0.5f * sign : 0.f;
+        out_l[i] = (i & 1) ? 0.f : 0.85f * sign;
+        out_r[i] = (i & 1) ? 0.85f * sign : 0.f;
+    }
+    setup(44100);
+}
+
+void fdn_reverb::setup(int sample_rate)
+{
+    sr = sample_rate;
+    mod_dphase = 2 * M_PI * 0.6 / sr;
+    update_times();
+    reset();
+}
+
+void fdn_reverb::update_times()
+{
+    float scale = fdn_room_scale[std::max(0, std::min(type, (int)(sizeof(fdn_room_scale) / sizeof(fdn_room_scale[0])) - 1))];
+    mod_depth = 0.00025 * sr;
+    for (int i = 0; i < LINES; i++) {
+        // the delay must not be shorter than a block, even when modulated
+        float d = floorf(fdn_line_ms[i] * scale * 0.001 * sr);
+        delay[i] = dsp::clip<float>(d, BLOCK + 2 + mod_depth, MAX_DELAY - 2 - mod_depth);
+    }
+    update_decay();
+}
+
+void fdn_reverb::update_decay()
+{
+    // the 1/sqrt(8) normalization of the Hadamard matrix is done here
+    float norm = 1.f / sqrtf(LINES);
+    for (int i = 0; i < LINES; i++) {
+        float g_lo = powf(0.001f, delay[i] / (time * sr));
+        float g_hi = powf(0.001f, delay[i] / (time * hf_decay * sr));
+        gain_hi[i] = g_hi * norm;
+        gain_diff[i] = (g_lo - g_hi) * norm;
+    }
+    lp_coeff = 1.f - expf(-2 * M_PI * std::min(cutoff, sr * 0.49f) / sr);
+}
+
+void fdn_reverb::reset()
+{
+    memset(lines, 0, sizeof(lines));
+    memset(lp_state, 0, sizeof(lp_state));
+    diffL1.reset(); diffL2.reset();
+    diffR1.reset(); diffR2.reset();
+    for (int i = 0; i < LINES; i++)
+        cur_delay[i] = delay[i];
+    mod_phase = 0;
+    pos = 0;
+}
+
+void fdn_reverb::extra_sanitize()
+{
+    for (int i = 0; i < LINES; i++)
+        sanitize(lp_state[i]);
+}
+
+#if defined(__SSE2__)
+/// Unnormalized 4 point Hadamard transform within a vector
+static inline __m128 hadamard4(__m128 v)
+{
+    const __m128 sign1 = _mm_setr_ps(1.f, -1.f, 1.f, -1.f), sign2 = _mm_setr_ps(1.f, 1.f, -1.f, -1.f);
+    v = _mm_add_ps(_mm_mul_ps(v, sign1), _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_add_ps(_mm_mul_ps(v, sign2), _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+static inline float horizontal_sum(__m128 v)
+{
+    v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm_cvtss_f32(v);
+}
+
+/// Zero the values below small_value, like sanitize
+static inline __m128 sanitize4(__m128 v)
+{
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    return _mm_and_ps(v, _mm_cmpge_ps(_mm_and_ps(v, abs_mask), _mm_set1_ps(small_value<float>())));
+}
+#endif
+
+void fdn_reverb::process(float *left, float *right, unsigned int len)
+{
+    // diffusion delays are scaled with the sample rate, up to what the buffers allow
+    float srscale = sr / 44100.f;
+    int dl1 = std::min(1023, (int)(142 * srscale)), dl2 = std::min(1023, (int)(379 * srscale));
+    int dr1 = std::min(1023, (int)(107 * srscale)), dr2 = std::min(1023, (int)(277 * srscale));
+    float diff = 0.7f * diffusion;
+    float taps[BLOCK][LINES], feedback[BLOCK][LINES], ins_l[BLOCK], ins_r[BLOCK];
+    while(len) {
+        unsigned int n = std::min<unsigned int>(len, BLOCK);
+        for (unsigned int t = 0; t < n; t++) {
+            ins_l[t] = diffL2.process_allpass_comb(diffL1.process_allpass_comb(left[t], dl1, diff), dl2, diff);
+            ins_r[t] = diffR2.process_allpass_comb(diffR1.process_allpass_comb(right[t], dr1, diff), dr2, diff);
+        }
+
+        // read the (modulated) outputs of the lines, the delay moves
+        // linearly to the new value within the block
+        mod_phase += mod_dphase * n;
+        if (mod_phase > 2 * M_PI)
+            mod_phase -= 2 * M_PI;
+        for (int i = 0; i < LINES; i++) {
+            float target = delay[i] + mod_depth * sinf(mod_phase + i * (float)(2 * M_PI / LINES));
+            float step = (target - cur_delay[i]) / n, d = cur_delay[i];
+            const float *line = lines[i];
+            for (unsigned int t = 0; t < n; t++) {
+                d += step;
+                float rpos = (float)(pos + t + MAX_DELAY) - d;
+                int ipos = (int)rpos;
+                float frac = rpos - ipos;
+                float a = line[ipos & DELAY_MASK], b = line[(ipos + 1) & DELAY_MASK];
+                taps[t][i] = a + frac * (b - a);
+            }
+            cur_delay[i] = target;
+        }
+
+        // decay filters, feedback matrix and input, across the lines
+#if defined(__SSE2__)
+        __m128 lp0 = _mm_loadu_ps(lp_state), lp1 = _mm_loadu_ps(lp_state + 4);
+        __m128 gh0 = _mm_loadu_ps(gain_hi), gh1 = _mm_loadu_ps(gain_hi + 4);
+        __m128 gd0 = _mm_loadu_ps(gain_diff), gd1 = _mm_loadu_ps(gain_diff + 4);
+        __m128 il0 = _mm_loadu_ps(in_l), il1 = _mm_loadu_ps(in_l + 4);
+        __m128 ir0 = _mm_loadu_ps(in_r), ir1 = _mm_loadu_ps(in_r + 4);
+        __m128 ol0 = _mm_loadu_ps(out_l), ol1 = _mm_loadu_ps(out_l + 4);
+        __m128 or0 = _mm_loadu_ps(out_r), or1 = _mm_loadu_ps(out_r + 4);
+        __m128 coeff = _mm_set1_ps(lp_coeff);
+        for (unsigned int t = 0; t < n; t++) {
+            __m128 y0 = _mm_loadu_ps(taps[t]), y1 = _mm_loadu_ps(taps[t] + 4);
+            left[t] = horizontal_sum(_mm_add_ps(_mm_mul_ps(y0, ol0), _mm_mul_ps(y1, ol1)));
+            right[t] = horizontal_sum(_mm_add_ps(_mm_mul_ps(y0, or0), _mm_mul_ps(y1, or1)));
+            lp0 = _mm_add_ps(lp0, _mm_mul_ps(coeff, _mm_sub_ps(y0, lp0)));
+            lp1 = _mm_add_ps(lp1, _mm_mul_ps(coeff, _mm_sub_ps(y1, lp1)));
+            y0 = hadamard4(_mm_add_ps(_mm_mul_ps(y0, gh0), _mm_mul_ps(lp0, gd0)));
+            y1 = hadamard4(_mm_add_ps(_mm_mul_ps(y1, gh1), _mm_mul_ps(lp1, gd1)));
+            __m128 l = _mm_set1_ps(ins_l[t]), r = _mm_set1_ps(ins_r[t]);
+            __m128 x0 = _mm_add_ps(_mm_add_ps(y0, y1), _mm_add_ps(_mm_mul_ps(l, il0), _mm_mul_ps(r, ir0)));
+            __m128 x1 = _mm_add_ps(_mm_sub_ps(y0, y1), _mm_add_ps(_mm_mul_ps(l, il1), _mm_mul_ps(r, ir1)));
+            _mm_storeu_ps(feedback[t], sanitize4(x0));
+            _mm_storeu_ps(feedback[t] + 4, sanitize4(x1));
+        }
+        _mm_storeu_ps(lp_state, lp0);
+        _mm_storeu_ps(lp_state + 4, lp1);
+#else
+        for (unsigned int t = 0; t < n; t++) {
+            float y[LINES], wl = 0, wr = 0;
+            for (int i = 0; i < LINES; i++) {
+                wl += taps[t][i] * out_l[i];
+                wr += taps[t][i] * out_r[i];
+                lp_state[i] += lp_coeff * (taps[t][i] - lp_state[i]);
+                y[i] = taps[t][i] * gain_hi[i] + lp_state[i] * gain_diff[i];
+            }
+            left[t] = wl;
+            right[t] = wr;
+            // fast Walsh-Hadamard transform
+            for (int h = 1; h < LINES; h <<= 1) {
+                for (int i = 0; i < LINES; i += 2 * h) {
+                    for (int j = i; j < i + h; j++) {
+                        float a = y[j], b = y[j + h];
+                        y[j] = a + b;
+                        y[j + h] = a - b;
+                    }
+                }
+            }
+            for (int i = 0; i < LINES; i++) {
+                feedback[t][i] = y[i] + ins_l[t] * in_l[i] + ins_r[t] * in_r[i];
+                sanitize(feedback[t][i]);
+            }
+        }
+#endif
+        for (int i = 0; i < LINES; i++) {
+            float *line = lines[i];
+            for (unsigned int t = 0; t < n; t++)
+                line[(pos + t) & DELAY_MASK] = feedback[t][i];
+        }
+        pos = (pos + n) & DELAY_MASK;
+        left += n;
+        right += n;
+        len -= n;
+    }
+}
+
 /// Distortion Module by Tom Szilagyi
 ///
 /// This module provides a blendable saturation stage
@@ -418,12 +620,15 @@ void tap_distortion::set_sample_rate(uint32_t sr)
 {
     srate = sr;
     over = srate * 2 > 96000 ? 1 : 2;
-    resampler.set_params(srate, over, 2);
+    // mixed with the dry signal by most users, so it uses the IIR stages,
+    // which delay it by 4 samples at 2x (about 50 with QUALITY_NORMAL)
+    resampler.set_params(over, oversampler::QUALITY_LOW_LATENCY);
 }
 
 float tap_distortion::process(float in)
 {
-    double *samples = resampler.upsample((double)in);
+    float samples[2];
+    resampler.upsample(in, samples);
     meter = 0.f;
     for (int o = 0; o < over; o++) {
         float proc = samples[o];
@@ -439,8 +644,7 @@ float tap_distortion::process(float in)
         samples[o] = proc;
         meter = std::max(meter, proc);
     }
-    float out = (float)resampler.downsample(samples);
-    return out;
+    return resampler.downsample(samples);
 }
 
 float tap_distortion::get_distortion_level()
@@ -590,6 +794,7 @@ lookahead_limiter::lookahead_limiter() {
     id = 0;
     buffer_size = 0;
     overall_buffer_size = 0;
+    allocated_size = 0;
     att = 1.f;
     att_max = 1.0;
     pos = 0;
@@ -614,12 +819,22 @@ lookahead_limiter::lookahead_limiter() {
     buffer = NULL;
     nextpos = NULL;
     nextdelta = NULL;
+    engine = ENGINE_CLASSIC;
+    true_peak = false;
+    wgain = NULL;
+    wasc = NULL;
+    wq_frame = NULL;
+    wq_gain = NULL;
 }
 lookahead_limiter::~lookahead_limiter()
 {
     free(buffer);
     free(nextpos);
     free(nextdelta);
+    free(wgain);
+    free(wasc);
+    free(wq_frame);
+    free(wq_gain);
 }
 
 void lookahead_limiter::activate()
@@ -643,21 +858,40 @@ float lookahead_limiter::get_attenuation()
     return a;
 }
 
-void lookahead_limiter::set_sample_rate(uint32_t sr)
+void lookahead_limiter::set_max_sample_rate(uint32_t sr)
 {
-    srate = sr;
-    
     free(buffer);
     free(nextpos);
     free(nextdelta);
+    free(wgain);
+    free(wasc);
+    free(wq_frame);
+    free(wq_gain);
+
+    allocated_size = (int)(sr * (100.f / 1000.f) * channels) + channels; // buffer size max attack rate multiplied by 2 channels
+    buffer = (float*) calloc(allocated_size, sizeof(float));
+    nextdelta = (float*) calloc(allocated_size, sizeof(float));
+    nextpos = (int*) malloc(allocated_size * sizeof(int));
+    // the deque briefly holds one frame more than the window
+    int frames = allocated_size / channels + 1;
+    wgain = (float*) calloc(frames, sizeof(float));
+    wasc = (float*) calloc(frames, sizeof(float));
+    wq_frame = (unsigned int*) calloc(frames, sizeof(unsigned int));
+    wq_gain = (float*) calloc(frames, sizeof(float));
+}
+
+void lookahead_limiter::set_sample_rate(uint32_t sr)
+{
+    srate = sr;
     
     // rebuild buffer
     overall_buffer_size = (int)(srate * (100.f / 1000.f) * channels) + channels; // buffer size attack rate multiplied by 2 channels
-    buffer = (float*) calloc(overall_buffer_size, sizeof(float));
+    if (overall_buffer_size > allocated_size)
+        set_max_sample_rate(sr);
     pos = 0;
 
-    nextdelta = (float*) calloc(overall_buffer_size, sizeof(float));
-    nextpos = (int*) malloc(overall_buffer_size * sizeof(int));
+    memset(buffer, 0, overall_buffer_size * sizeof(float));
+    memset(nextdelta, 0, overall_buffer_size * sizeof(float));
     memset(nextpos, -1, overall_buffer_size * sizeof(int));
     
     reset();
@@ -684,6 +918,21 @@ void lookahead_limiter::reset() {
     nextiter = 0;
     delta = 0.f;
     att = 1.f;
+    // window engine starts with an empty deque and no gain reduction
+    int frames = buffer_size / channels;
+    for (int i = 0; i < frames; i++)
+        wgain[i] = 1.f;
+    wsum = frames;
+    wq_head = 0;
+    wq_len = 0;
+    wframe = 0;
+    wrelease = 1.f;
+    wrdelta = 0.f;
+    tp_detector[0].reset();
+    tp_detector[1].reset();
+    memset(tp_line, 0, sizeof(tp_line));
+    tp_pos = 0;
+    tp_last = 0.f;
     reset_asc();
 }
 
@@ -692,6 +941,16 @@ void lookahead_limiter::reset_asc() {
     asc_c = 0;
     asc_pos = pos;
     asc_changed = true;
+    memset(wasc, 0, buffer_size / channels * sizeof(float));
+}
+
+void lookahead_limiter::set_engine(int e, bool tp)
+{
+    if (e == engine && tp == true_peak)
+        return;
+    engine = e;
+    true_peak = tp;
+    reset();
 }
 
 float lookahead_limiter::get_rdelta(float peak, float _limit, float _att, bool _asc) {
@@ -719,6 +978,12 @@ void lookahead_limiter::process(float &left, float &right, float * multi_buffer)
     // PROTIP: harming paying customers enough to make them develop a competing
     // product may be considered an example of a less than sound business practice.
 
+    if(engine == ENGINE_WINDOW) {
+        float multi_coeff = (use_multi) ? multi_buffer[pos] : 1.f;
+        process_block(&left, &right, &multi_coeff, 1);
+        return;
+    }
+
     // fill lookahead buffer
     if(_sanitize) {
         // if we're sanitizing (zeroing) the buffer on attack time change,
@@ -915,6 +1180,138 @@ void lookahead_limiter::process(float &left, float &right, float * multi_buffer)
     asc_changed = false;
 }
 
+void lookahead_limiter::process_block(float *left, float *right, const float *multi, unsigned int len)
+{
+    enum { CHUNK = 64 };
+    float tpL[CHUNK], tpR[CHUNK];
+    int frames = buffer_size / channels;
+    int cap = frames + 1;
+    double scale = 1.0 / frames;
+    int frame = pos / channels;
+    while(len) {
+        unsigned int n = std::min<unsigned int>(len, CHUNK);
+        if(true_peak) {
+            tp_detector[0].peaks(left, tpL, n);
+            tp_detector[1].peaks(right, tpR, n);
+        }
+        for(unsigned int i = 0; i < n; i++) {
+            float l = left[i], r = right[i];
+            float m = multi ? multi[i] : 1.f;
+            float peak;
+            if(true_peak) {
+                // the detector reports the inter-sample peaks between the
+                // samples TP_DELAY and TP_DELAY - 1 frames ago, so delay the
+                // input (and its coefficient) by TP_DELAY frames and take the
+                // intervals on both sides of the delayed sample into account
+                float *d = tp_line[tp_pos];
+                std::swap(l, d[0]);
+                std::swap(r, d[1]);
+                std::swap(m, d[2]);
+                if(++tp_pos == TP_DELAY) tp_pos = 0;
+                float tp = std::max(tpL[i], tpR[i]);
+                peak = std::max(std::max(fabs(l), fabs(r)), std::max(tp, tp_last));
+                tp_last = tp;
+            } else
+                peak = std::max(fabs(l), fabs(r));
+
+            // fill lookahead buffer (zeros while sanitizing)
+            buffer[pos] = _sanitize ? 0.f : l;
+            buffer[pos + 1] = _sanitize ? 0.f : r;
+
+            // gain this frame needs to stay below the limit
+            float _limit = limit * m * weight;
+            float req = peak > _limit ? _limit / peak : 1.f;
+
+            // keep track of the peaks in the buffer for asc
+            wasc[frame] = 0.f;
+            if(auto_release && peak > _limit) {
+                asc += peak;
+                asc_c ++;
+                wasc[frame] = peak;
+            }
+
+            // push the required gain into the deque after dropping all gains
+            // that are not lower, they can't be the minimum of the window
+            // anymore. So the deque rises from front to back and its front
+            // is the minimum of the window
+            int back = wq_head + wq_len;
+            if(back >= cap) back -= cap;
+            while(wq_len) {
+                int last = back ? back - 1 : cap - 1;
+                if(wq_gain[last] < req)
+                    break;
+                back = last;
+                wq_len --;
+            }
+            wq_gain[back] = req;
+            wq_frame[back] = wframe;
+            wq_len ++;
+            // one frame leaves the window per frame at most
+            if(wframe - wq_frame[wq_head] >= (unsigned int)frames) {
+                if(++wq_head == cap) wq_head = 0;
+                wq_len --;
+            }
+            wframe ++;
+            float hold = wq_gain[wq_head];
+
+            // release towards 1 (or the asc level), but never above the
+            // minimum of the window. The release delta is taken from the
+            // gain the release starts at
+            float g = wrelease + wrdelta;
+            if(g >= hold) {
+                if(wrelease != hold)
+                    wrdelta = get_rdelta(peak, _limit, hold);
+                g = hold;
+            }
+            if(g >= 1.f) {
+                g = 1.f;
+                wrdelta = 0.f;
+            }
+            wrelease = g;
+
+            // box filter the released gain over the window length. All gains
+            // averaged in are at or below the one the outgoing frame needs,
+            // so the gain ramps down linearly in front of each peak
+            wsum += g - wgain[frame];
+            wgain[frame] = g;
+            att = std::min((float)(wsum * scale), 1.f);
+            att_max = (att < att_max) ? att : att_max;
+
+            // step forward, the oldest frame leaves the buffer
+            pos += channels;
+            if(++frame == frames) {
+                pos = 0;
+                frame = 0;
+            }
+            if(wasc[frame] > 0.f) {
+                // remove the outgoing peak from asc
+                asc -= wasc[frame];
+                asc_c --;
+                wasc[frame] = 0.f;
+            }
+            left[i] = _sanitize ? 0.f : buffer[pos] * att;
+            right[i] = _sanitize ? 0.f : buffer[pos + 1] * att;
+
+            if(!frame) {
+                // resum the window once per cycle so that rounding errors of
+                // the running sum don't add up
+                double sum = 0.0;
+                for(int j = 0; j < frames; j++)
+                    sum += wgain[j];
+                wsum = sum;
+                // sanitizing is done after a full cycle through the buffer
+                _sanitize = false;
+            }
+        }
+        left += n;
+        right += n;
+        if(multi)
+            multi += n;
+        len -= n;
+    }
+    asc_changed = false;
+}
+
 bool lookahead_limiter::get_asc() {
     if(!asc_active) return false;
     asc_active = false;
@@ -942,6 +1339,7 @@ transients::transients() {
     lookpos         = 0;
     channels        = 1;
     sustain_ended   = false;
+    lookbuf         = NULL;
     srand(1);
 }
 transients::~transients()
@@ -949,8 +1347,12 @@ transients::~transients()
     free(lookbuf);
 }
 void transients::set_channels(int ch) {
+    if (!lookbuf || ch != channels) {
+        free(lookbuf);
+        lookbuf = (float*) calloc(looksize * ch, sizeof(float));
+    } else
+        memset(lookbuf, 0, looksize * ch * sizeof(float));
     channels = ch;
-    lookbuf = (float*) calloc(looksize * channels, sizeof(float));
     lookpos = 0;
 }
 void transients::set_sample_rate(uint32_t sr) {
@@ -1065,9 +1467,18 @@ void crossover::init(int c, int b, uint32_t sr) {
     channels = std::min(8, c);
     bands    = std::min(8, b);
     srate    = sr;
+    for (int f = 0; f < 4; f ++) {
+        // filters are set up by set_filter, the rest pass the signal through
+        for (int l = 0; l < 64; l ++) {
+            lp[f].set_null(l);
+            hp[f].set_null(l);
+        }
+        lp[f].reset();
+        hp[f].reset();
+    }
     for(int b = 0; b < bands; b ++) {
-        // reset frequency settings
-        freq[b]     = 1.0;
+        // reset frequency settings (0 = not set yet)
+        freq[b]     = 0.0;
         active[b]   = true;
         level[b]    = 1.0;
         for (int c = 0; c < channels; c ++) {
@@ -1077,10 +1488,11 @@ void crossover::init(int c, int b, uint32_t sr) {
     }
 }
 float crossover::set_filter(int b, float f, bool force) {
-    // keep between neighbour bands
-    if (b)
+    // keep between neighbour bands (only the ones that have been set already,
+    // so that a single call for each filter is enough after init)
+    if (b && freq[b-1] > 0)
         f = std::max((float)freq[b-1] * 1.1f, f);
-    if (b < bands - 2)
+    if (b < bands - 2 && freq[b+1] > 0)
         f = std::min((float)freq[b+1] * 0.9f, f);
     // restrict to 10-20k
     f = std::max(10.f, std::min(20000.f, f));
@@ -1102,28 +1514,30 @@ float crossover::set_filter(int b, float f, bool force) {
             break;
     }
     for (int c = 0; c < channels; c ++) {
+        // lowpass of band b and highpass of band b + 1
+        int l = c * bands + b, h = l + 1;
         if (!c) {
-            lp[c][b][0].set_lp_rbj(freq[b], q, (float)srate);
-            hp[c][b][0].set_hp_rbj(freq[b], q, (float)srate);
+            lp[0].set_lp_rbj(l, freq[b], q, (float)srate);
+            hp[0].set_hp_rbj(h, freq[b], q, (float)srate);
         } else {
-            lp[c][b][0].copy_coeffs(lp[c-1][b][0]);
-            hp[c][b][0].copy_coeffs(hp[c-1][b][0]);
+            lp[0].copy_coeffs(l, b);
+            hp[0].copy_coeffs(h, b + 1);
         }
         if (mode > 1) {
             if (!c) {
-                lp[c][b][1].set_lp_rbj(freq[b], 1.34, (float)srate);
-                hp[c][b][1].set_hp_rbj(freq[b], 1.34, (float)srate);
+                lp[1].set_lp_rbj(l, freq[b], 1.34, (float)srate);
+                hp[1].set_hp_rbj(h, freq[b], 1.34, (float)srate);
             } else {
-                lp[c][b][1].copy_coeffs(lp[c-1][b][1]);
-                hp[c][b][1].copy_coeffs(hp[c-1][b][1]);
+                lp[1].copy_coeffs(l, b);
+                hp[1].copy_coeffs(h, b + 1);
             }
-            lp[c][b][2].copy_coeffs(lp[c][b][0]);
-            hp[c][b][2].copy_coeffs(hp[c][b][0]);
-            lp[c][b][3].copy_coeffs(lp[c][b][1]);
-            hp[c][b][3].copy_coeffs(hp[c][b][1]);
+            lp[2].copy_coeffs(l, lp[0].get_coeffs(l));
+            hp[2].copy_coeffs(h, hp[0].get_coeffs(h));
+            lp[3].copy_coeffs(l, lp[1].get_coeffs(l));
+            hp[3].copy_coeffs(h, hp[1].get_coeffs(h));
         } else {
-            lp[c][b][1].copy_coeffs(lp[c][b][0]);
-            hp[c][b][1].copy_coeffs(hp[c][b][0]);
+            lp[1].copy_coeffs(l, lp[0].get_coeffs(l));
+            hp[1].copy_coeffs(h, hp[0].get_coeffs(h));
         }
     }
     redraw_graph = std::min(2, redraw_graph + 1);
@@ -1134,7 +1548,8 @@ void crossover::set_mode(int m) {
         return;
     mode = m;
     for(int i = 0; i < bands - 1; i ++) {
-        set_filter(i, freq[i], true);
+        if (freq[i] > 0)
+            set_filter(i, freq[i], true);
     }
     redraw_graph = std::min(2, redraw_graph + 1);
 }
@@ -1151,22 +1566,19 @@ void crossover::set_level(int b, float l) {
     redraw_graph = std::min(2, redraw_graph + 1);
 }
 void crossover::process(float *data) {
-    for (int c = 0; c < channels; c++) {
-        for(int b = 0; b < bands; b ++) {
-            out[c][b] = data[c];
-            for (int f = 0; f < get_filter_count(); f++){
-                if(b + 1 < bands) {
-                    out[c][b] = lp[c][b][f].process(out[c][b]);
-                    lp[c][b][f].sanitize();
-                }
-                if(b - 1 >= 0) {
-                    out[c][b] = hp[c][b - 1][f].process(out[c][b]);
-                    hp[c][b - 1][f].sanitize();
-                }
-            }
-            out[c][b] *= level[b];
-        }
+    // all bands of all channels are filtered side by side
+    int lanes = channels * bands;
+    double x[64];
+    for (int c = 0; c < channels; c++)
+        for (int b = 0; b < bands; b++)
+            x[c * bands + b] = data[c];
+    for (int f = 0; f < get_filter_count(); f++) {
+        lp[f].process(x, lanes);
+        hp[f].process(x, lanes);
     }
+    for (int c = 0; c < channels; c++)
+        for (int b = 0; b < bands; b++)
+            out[c][b] = x[c * bands + b] * level[b];
 }
 float crossover::get_value(int c, int b) {
     return out[c][b];
@@ -1184,9 +1596,9 @@ bool crossover::get_graph(int subindex, int phase, float *data, int points, cair
         freq = 20.0 * pow (20000.0 / 20.0, i * 1.0 / points);
         for(int f = 0; f < get_filter_count(); f ++) {
             if(subindex < bands -1)
-                ret *= lp[0][subindex][f].freq_gain(freq, (float)srate);
+                ret *= lp[f].freq_gain(subindex, freq, (float)srate);
             if(subindex > 0)
-                ret *= hp[0][subindex - 1][f].freq_gain(freq, (float)srate);
+                ret *= hp[f].freq_gain(subindex, freq, (float)srate);
         }
         ret *= level[subindex];
         context->set_source_rgba(0.15, 0.2, 0.0, !active[subindex] ? 0.3 : 0.8);
@@ -1351,51 +1763,379 @@ bool bitreduction::get_gridline(int subindex, int phase, float &pos, bool &verti
 
 //////////////////////////////////////////////////////////////////
 
-resampleN::resampleN()
+halfband_stage::halfband_stage()
 {
-    factor  = 2;
-    srate   = 0;
-    filters = 2;
+    taps = 0;
+    set_params(8, 80);
 }
-resampleN::~resampleN()
+
+/// Modified Bessel function of the first kind, order 0
+static double bessel_i0(double x)
 {
+    double sum = 1, term = 1;
+    for (int k = 1; k < 50 && term > sum * 1e-12; k++) {
+        term *= (x * x) / (4.0 * k * k);
+        sum += term;
+    }
+    return sum;
+}
+
+void halfband_stage::set_params(int _taps, float attenuation)
+{
+    taps = std::min((int)MAX_TAPS, std::max(8, _taps & ~7));
+    double beta = attenuation > 50 ? 0.1102 * (attenuation - 8.7)
+        : 0.5842 * pow(attenuation - 21, 0.4) + 0.07886 * (attenuation - 21);
+    int half = taps / 2;
+    double sum = 0;
+    for (int i = 0; i < half; i++) {
+        // distance from the centre tap at the high rate, always odd
+        double n = 2 * i - (taps - 1);
+        double r = n / taps;
+        double h = sin(M_PI * n / 2) / (M_PI * n) * bessel_i0(beta * sqrt(1 - r * r)) / bessel_i0(beta);
+        coeffs[i] = 2 * h;
+        sum += 4 * h;
+    }
+    // exact unity gain at DC
+    for (int i = 0; i < half; i++)
+        coeffs[i] /= sum;
+    reset();
 }
-void resampleN::set_params(uint32_t sr, int fctr = 2, int fltrs = 2)
+
+void halfband_stage::reset()
 {
-    srate   = std::max(2u, sr);
-    factor  = std::min(16, std::max(1, fctr));
-    filters = std::min(4, std::max(1, fltrs));
-    // set all filters
-    filter[0][0].set_lp_rbj(std::max(25000., (double)srate / 2), 0.8, (float)srate * factor);
-    for (int i = 1; i < filters; i++) {
-        filter[0][i].copy_coeffs(filter[0][0]);
-        filter[1][i].copy_coeffs(filter[0][0]);
+    dsp::zero(up_buf, BUF_SIZE);
+    dsp::zero(even_buf, BUF_SIZE);
+    dsp::zero(odd_buf, BUF_SIZE);
+    up_fill = down_fill = taps - 1;
+}
+
+/// Move the history back to the start of buf (and buf2) if there is no
+/// space left after fill, and return how many of len samples fit
+unsigned halfband_stage::make_room(float *buf, unsigned &fill, unsigned len, float *buf2)
+{
+    unsigned keep = taps - 1;
+    if (fill == BUF_SIZE) {
+        memmove(buf, buf + fill - keep, keep * sizeof(float));
+        if (buf2)
+            memmove(buf2, buf2 + fill - keep, keep * sizeof(float));
+        fill = keep;
+    }
+    return std::min(len, std::min((unsigned)BLOCK, BUF_SIZE - fill));
+}
+
+/// Filter with the symmetric branch, the output i being computed from the
+/// taps samples starting at buf[i]
+void halfband_stage::filter(const float *buf, float *out, unsigned len) const
+{
+    int half = taps >> 1;
+    unsigned i = 0;
+#if defined(__SSE2__)
+    // 4 consecutive outputs at a time, two accumulators to shorten the
+    // dependency chain
+    for (; i + 4 <= len; i += 4) {
+        const float *p = buf + i, *q = buf + i + taps - 1;
+        __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+        for (int j = 0; j < half; j += 2) {
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_set1_ps(coeffs[j]), _mm_add_ps(_mm_loadu_ps(p + j), _mm_loadu_ps(q - j))));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_set1_ps(coeffs[j + 1]), _mm_add_ps(_mm_loadu_ps(p + j + 1), _mm_loadu_ps(q - j - 1))));
+        }
+        _mm_storeu_ps(out + i, _mm_add_ps(acc0, acc1));
+    }
+    // the rest (all of it when called for single samples) one at a time,
+    // with the taps 4 at a time and the far end of the window reversed
+    for (; i < len; i++) {
+        const float *window = buf + i;
+        __m128 acc = _mm_setzero_ps();
+        for (int j = 0; j < half; j += 4) {
+            __m128 b = _mm_loadu_ps(window + taps - 4 - j);
+            b = _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 1, 2, 3));
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(coeffs + j), _mm_add_ps(_mm_loadu_ps(window + j), b)));
+        }
+        acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+        acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+        out[i] = _mm_cvtss_f32(acc);
+    }
+#endif
+    for (; i < len; i++) {
+        const float *window = buf + i;
+        float acc = 0.f;
+        for (int j = 0; j < half; j++)
+            acc += coeffs[j] * (window[j] + window[taps - 1 - j]);
+        out[i] = acc;
     }
 }
-double *resampleN::upsample(double sample)
+
+void halfband_stage::upsample(const float *in, float *out, unsigned len)
+{
+    float even[BLOCK];
+    int keep = taps - 1;
+    while (len) {
+        unsigned n = make_room(up_buf, up_fill, len);
+        memcpy(up_buf + up_fill, in, n * sizeof(float));
+        const float *window = up_buf + up_fill - keep;
+        filter(window, even, n);
+        // even outputs come from the sinc branch, odd ones are the centre
+        // tap, which is just a delay
+        for (unsigned i = 0; i < n; i++) {
+            out[2 * i] = even[i];
+            out[2 * i + 1] = window[i + (taps >> 1)];
+        }
+        up_fill += n;
+        in += n;
+        out += 2 * n;
+        len -= n;
+    }
+}
+
+void halfband_stage::downsample(const float *in, float *out, unsigned len)
 {
-    tmp[0] = sample;
-    if (factor > 1) {
-        for (int f = 0; f < filters; f++)
-            tmp[0] = filter[0][f].process(sample);
-        for (int i = 1; i < factor; i++) {
-            tmp[i] = 0;
-            for (int f = 0; f < filters; f++)
-                tmp[i] = filter[0][f].process(sample);
+    float even[BLOCK];
+    int keep = taps - 1, half = taps >> 1;
+    // may run in place, as the output is written after reading the input
+    // of the whole pass
+    while (len) {
+        unsigned n = make_room(even_buf, down_fill, len, odd_buf);
+        for (unsigned i = 0; i < n; i++) {
+            even_buf[down_fill + i] = in[2 * i];
+            odd_buf[down_fill + i] = in[2 * i + 1];
         }
+        filter(even_buf + down_fill - keep, even, n);
+        const float *odd = odd_buf + down_fill - half;
+        for (unsigned i = 0; i < n; i++)
+            out[i] = 0.5f * (even[i] + odd[i]);
+        down_fill += n;
+        in += 2 * n;
+        out += n;
+        len -= n;
+    }
+}
+
+halfband_iir_stage::halfband_iir_stage()
+{
+    set_params(8, 0.05);
+}
+
+/// The sum of the series used by the elliptic filter design, see
+/// Valenzuela and Constantinides, "Digital signal processing schemes for
+/// efficient interpolation and decimation" and Laurent de Soras' HIIR
+static double halfband_iir_sum(double q, int order, int c, bool numerator)
+{
+    double acc = 0, term;
+    int i = numerator ? 0 : 1, sign = numerator ? 1 : -1;
+    do {
+        if (numerator)
+            term = pow(q, i * (i + 1)) * sin((2 * i + 1) * c * M_PI / order) * sign;
+        else
+            term = pow(q, i * i) * cos(2 * i * c * M_PI / order) * sign;
+        acc += term;
+        sign = -sign;
+        i++;
+    } while (fabs(term) > 1e-100 && i < 100);
+    return acc;
+}
+
+void halfband_iir_stage::set_params(int _count, double transition)
+{
+    count = std::min((int)MAX_COEFFS, std::max(1, _count));
+    double k = tan((1 - transition * 2) * M_PI / 4);
+    k *= k;
+    double kksqrt = pow(1 - k * k, 0.25);
+    double e = 0.5 * (1 - kksqrt) / (1 + kksqrt);
+    double e2 = e * e, e4 = e2 * e2;
+    double q = e * (1 + e4 * (2 + e4 * (15 + 150 * e4)));
+    int order = count * 2 + 1;
+    delay = 1;
+    for (int i = 0; i < count; i++) {
+        double ww = halfband_iir_sum(q, order, i + 1, true) * pow(q, 0.25) / (halfband_iir_sum(q, order, i + 1, false) + 0.5);
+        double wwsq = ww * ww;
+        double x = sqrt((1 - wwsq * k) * (1 - wwsq / k)) / (1 + wwsq);
+        coeffs[i] = (1 - x) / (1 + x);
+        // twice the delay at DC of the allpass, once for each direction
+        delay += 2 * (1 - coeffs[i]) / (1 + coeffs[i]);
+    }
+    reset();
+}
+
+void halfband_iir_stage::reset()
+{
+    dsp::zero(up_x1, MAX_COEFFS);
+    dsp::zero(up_y1, MAX_COEFFS);
+    dsp::zero(down_x1, MAX_COEFFS);
+    dsp::zero(down_y1, MAX_COEFFS);
+    down_odd = 0.f;
+}
+
+void halfband_iir_stage::sanitize()
+{
+    for (int i = 0; i < count; i++) {
+        dsp::sanitize(up_x1[i]);
+        dsp::sanitize(up_y1[i]);
+        dsp::sanitize(down_x1[i]);
+        dsp::sanitize(down_y1[i]);
+    }
+    dsp::sanitize(down_odd);
+}
+
+/// Run x through the allpasses of one branch (the coefficients first,
+/// first + 2...)
+inline float halfband_iir_stage::allpass(int first, float x, float *x1, float *y1) const
+{
+    for (int i = first; i < count; i += 2) {
+        float y = coeffs[i] * (x - y1[i]) + x1[i];
+        x1[i] = x;
+        y1[i] = y;
+        x = y;
     }
-    return tmp;
+    return x;
 }
-double resampleN::downsample(double *sample)
+
+void halfband_iir_stage::upsample(const float *in, float *out, unsigned len)
 {
-    if (factor > 1) {
-        for(int i = 0; i < factor; i++) {
-            for (int f = 0; f < filters; f++) {
-                sample[i] = filter[1][f].process(sample[i]);
+    for (unsigned i = 0; i < len; i++) {
+        out[2 * i] = allpass(0, in[i], up_x1, up_y1);
+        out[2 * i + 1] = allpass(1, in[i], up_x1, up_y1);
+    }
+}
+
+void halfband_iir_stage::downsample(const float *in, float *out, unsigned len)
+{
+    for (unsigned i = 0; i < len; i++) {
+        float even = in[2 * i], odd = in[2 * i + 1];
+        out[i] = 0.5f * (allpass(0, even, down_x1, down_y1) + allpass(1, down_odd, down_x1, down_y1));
+        down_odd = odd;
+    }
+}
+
+/// Non-zero taps of the first and the later stages, and the stopband
+/// attenuation in dB, for each quality preset. The later stages get
+/// enough taps not to be the weak link: image rejection for tones up to
+/// 0.35 of the base rate is about 54, 86 and 120 dB at any factor (39, 79
+/// and 113 dB up to 20 kHz at 44.1 kHz, where the first stage is still in
+/// its transition band).
+static const struct { int first_taps, taps; float attenuation; } oversampler_presets[oversampler::QUALITY_COUNT] = {
+    { 0, 0, 0 },
+    { 24, 16, 50 },
+    { 48, 16, 80 },
+    { 96, 32, 110 },
+};
+
+oversampler::oversampler()
+{
+    factor = 0;
+    quality = -1;
+    pad_pos = 0;
+    set_params(1);
+}
+
+int oversampler::round_factor(int fctr)
+{
+    int result = 1;
+    while (result < fctr && result < MAX_FACTOR)
+        result <<= 1;
+    return result;
+}
+
+void oversampler::set_params(int fctr, int q)
+{
+    fctr = round_factor(fctr);
+    q = std::min((int)QUALITY_COUNT - 1, std::max(0, q));
+    if (fctr == factor && q == quality)
+        return;
+    factor = fctr;
+    quality = q;
+    stage_count = 0;
+    while ((1 << stage_count) < factor)
+        stage_count++;
+    if (quality == QUALITY_LOW_LATENCY) {
+        float delay = 0;
+        for (int s = 0; s < stage_count; s++) {
+            // the later stages only need to remove images far from the
+            // audio band, so their transition band can be very wide
+            iir_stages[s].set_params(s ? 4 : 8, s ? 0.25 : 0.04);
+            delay += iir_stages[s].get_latency() * (1 << (stage_count - 1 - s));
+        }
+        pad = 0;
+        latency = lrintf(delay / factor);
+    } else {
+        // round trip delay of all the stages, at the highest rate
+        int delay = 0;
+        for (int s = 0; s < stage_count; s++) {
+            stages[s].set_params(s ? oversampler_presets[q].taps : oversampler_presets[q].first_taps, oversampler_presets[q].attenuation);
+            delay += stages[s].get_latency() << (stage_count - 1 - s);
+        }
+        pad = (factor - delay % factor) % factor;
+        latency = (delay + pad) / factor;
+    }
+    reset();
+}
+
+void oversampler::reset()
+{
+    for (int s = 0; s < stage_count; s++) {
+        stages[s].reset();
+        iir_stages[s].reset();
+    }
+    dsp::zero(pad_buf, MAX_FACTOR);
+    pad_pos = 0;
+}
+
+void oversampler::upsample(const float *in, float *out, unsigned len)
+{
+    if (!stage_count) {
+        memmove(out, in, len * sizeof(float));
+        return;
+    }
+    while (len) {
+        unsigned n = std::min(len, (unsigned)CHUNK);
+        const float *src = in;
+        for (int s = 0; s < stage_count; s++) {
+            float *dst = s == stage_count - 1 ? out : work[s & 1];
+            if (quality == QUALITY_LOW_LATENCY)
+                iir_stages[s].upsample(src, dst, n << s);
+            else
+                stages[s].upsample(src, dst, n << s);
+            src = dst;
+        }
+        in += n;
+        out += n * factor;
+        len -= n;
+    }
+}
+
+void oversampler::downsample(const float *in, float *out, unsigned len)
+{
+    if (!stage_count) {
+        memmove(out, in, len * sizeof(float));
+        return;
+    }
+    while (len) {
+        unsigned n = std::min(len, (unsigned)CHUNK);
+        const float *src = in;
+        if (pad) {
+            for (unsigned i = 0; i < n * factor; i++) {
+                pad_buf[pad_pos] = in[i];
+                work[0][i] = pad_buf[(pad_pos - pad) & (MAX_FACTOR - 1)];
+                pad_pos = (pad_pos + 1) & (MAX_FACTOR - 1);
             }
+            src = work[0];
         }
+        // the stages run in place in the work buffer, except the last one
+        for (int s = stage_count - 1; s >= 0; s--) {
+            float *dst = s ? work[0] : out;
+            if (quality == QUALITY_LOW_LATENCY)
+                iir_stages[s].downsample(src, dst, n << s);
+            else
+                stages[s].downsample(src, dst, n << s);
+            src = dst;
+        }
+        in += n * factor;
+        out += n;
+        len -= n;
+    }
+    if (quality == QUALITY_LOW_LATENCY) {
+        for (int s = 0; s < stage_count; s++)
+            iir_stages[s].sanitize();
     }
-    return sample[0];
 }
 
 //////////////////////////////////////////////////////////////////
@@ -20,23 +20,32 @@
  
 #define BENCHMARK_PLUGINS
 
+#include <config.h>
 #ifdef BENCHMARK_PLUGINS
 #include <calf/giface.h>
 #include <calf/modules_tools.h>
 #include <calf/modules_delay.h>
 #include <calf/modules_comp.h>
+#include <calf/modules_limit.h>
 #include <calf/modules_dev.h>
+#include <calf/modules_dist.h>
 #include <calf/modules_filter.h>
 #include <calf/modules_mod.h>
-#else
-#include <config.h>
+#include <calf/modules_pitch.h>
+#include <calf/modules_synths.h>
+#include <calf/organ.h>
 #endif
 
 #include <calf/audio_fx.h>
+#include <calf/convolver.h>
 #include <calf/fft.h>
 #include <calf/loudness.h>
 #include <calf/benchmark.h>
+#include <calf/wavfile.h>
 #include <getopt.h>
+#include <chrono>
+#include <string>
+#include <vector>
 
 // #define TEST_OSC
 
@@ -183,6 +192,185 @@ struct fft_test_class
     double scaler() { return 1 << N; }
 };
 
+template<int N>
+struct fft_engine_test_class
+{
+    fft_engine ffter;
+    float result;
+    complex<float> data[1 << N], output[1 << N];
+    fft_engine_test_class() : ffter(N) {}
+    void prepare() {
+        for (int i = 0; i < (1 << N); i++)
+            data[i] = sin(i);
+        result = 0;
+    }
+    void cleanup()
+    {
+    }
+    void run()
+    {
+        ffter.calculate(data, output, false);
+    }
+    double scaler() { return 1 << N; }
+};
+
+template<int N>
+struct fft_engine_real_test_class
+{
+    fft_engine ffter;
+    float result;
+    float data[1 << N];
+    complex<float> output[(1 << N) / 2 + 1];
+    fft_engine_real_test_class() : ffter(N) {}
+    void prepare() {
+        for (int i = 0; i < (1 << N); i++)
+            data[i] = sin(i);
+        result = 0;
+    }
+    void cleanup()
+    {
+    }
+    void run()
+    {
+        ffter.forward_real(data, output);
+    }
+    double scaler() { return 1 << N; }
+};
+
+/// Tap i of channel c of the benchmark impulse response (decaying noise)
+static inline float benchmark_ir_tap(int c, int i, int length)
+{
+    return sin(i * (c + 1.5)) * exp(-5.0 * i / length);
+}
+
+/// Stereo impulse response of the given length, loaded the same way as in
+/// the plugin - through a (temporary) WAVE file. Exits on failure, as there
+/// is nothing to benchmark without it.
+static const convolution_ir *benchmark_ir(int length)
+{
+    char name[] = "/tmp/calfbenchmark-ir-XXXXXX";
+    std::string error = "cannot create a temporary file";
+    const convolution_ir *ir = NULL;
+    int fd = mkstemp(name);
+    if (fd != -1) {
+        close(fd);
+        std::vector<float> data[2];
+        float *ptrs[2];
+        for (int c = 0; c < 2; c++) {
+            data[c].resize(length);
+            for (int i = 0; i < length; i++)
+                data[c][i] = benchmark_ir_tap(c, i, length);
+            ptrs[c] = &data[c][0];
+        }
+        try {
+            calf_utils::wav_writer writer;
+            writer.open(name, 2, 44100);
+            writer.write(ptrs, length);
+            writer.close();
+            error.clear();
+            ir = convolution_ir::acquire(name, 44100, error);
+        }
+        catch(calf_utils::file_exception &e) {
+            error = e.what();
+        }
+        unlink(name);
+    }
+    if (!ir) {
+        fprintf(stderr, "Cannot create the benchmark impulse response: %s\n", error.c_str());
+        exit(1);
+    }
+    return ir;
+}
+
+template<int Length, int BlockSize>
+struct convolver_benchmark
+{
+    enum { BUF_SIZE = 16384 };
+    convolver conv;
+    float input[2][BUF_SIZE], output[2][BUF_SIZE];
+    float result;
+    convolver_benchmark() : conv(benchmark_ir(Length)) {}
+    void prepare()
+    {
+        for (int i = 0; i < BUF_SIZE; i++)
+            input[0][i] = input[1][i] = sin(i * 0.05);
+        conv.reset();
+        result = 0;
+    }
+    void run()
+    {
+        for (int pos = 0; pos < BUF_SIZE; pos += BlockSize)
+            conv.process(input[0] + pos, input[1] + pos, output[0] + pos, output[1] + pos, BlockSize);
+    }
+    void cleanup() { result = output[0][BUF_SIZE - 1]; }
+    double scaler() { return BUF_SIZE; }
+};
+
+/// Reference: the same as convolver_benchmark, done the direct way
+template<int Length>
+struct direct_convolution_benchmark
+{
+    enum { BUF_SIZE = 4096 };
+    float ir[2][Length];
+    float input[2][Length - 1 + BUF_SIZE], output[2][BUF_SIZE];
+    float result;
+    void prepare()
+    {
+        for (int c = 0; c < 2; c++) {
+            for (int i = 0; i < Length; i++)
+                ir[c][Length - 1 - i] = benchmark_ir_tap(c, i, Length);
+            for (int i = 0; i < Length - 1 + BUF_SIZE; i++)
+                input[c][i] = i < Length - 1 ? 0 : sin((i - Length + 1) * 0.05);
+        }
+        result = 0;
+    }
+    void run()
+    {
+        for (int c = 0; c < 2; c++) {
+            for (int i = 0; i < BUF_SIZE; i++) {
+                float sum = 0;
+                for (int t = 0; t < Length; t++)
+                    sum += ir[c][t] * input[c][i + t];
+                output[c][i] = sum;
+            }
+        }
+    }
+    void cleanup() { result = output[0][BUF_SIZE - 1]; }
+    double scaler() { return BUF_SIZE; }
+};
+
+/// Round trip through the oversampler, with the block functions or one
+/// sample at a time like the multiband limiters
+template<int Factor, int Quality, bool Block>
+struct oversampler_benchmark
+{
+    enum { BUF_SIZE = 256 };
+    dsp::oversampler resampler;
+    float input[BUF_SIZE], output[BUF_SIZE], over[BUF_SIZE * Factor];
+    float result;
+    void prepare()
+    {
+        resampler.set_params(Factor, Quality);
+        for (int i = 0; i < BUF_SIZE; i++)
+            input[i] = sin(i * 0.05);
+        result = 0;
+    }
+    void run()
+    {
+        if (Block) {
+            resampler.upsample(input, over, BUF_SIZE);
+            resampler.downsample(over, output, BUF_SIZE);
+        } else {
+            for (int i = 0; i < BUF_SIZE; i++) {
+                resampler.upsample(input[i], over);
+                output[i] = resampler.downsample(over);
+            }
+        }
+    }
+    void cleanup() { result += output[BUF_SIZE - 1]; }
+    double scaler() { return BUF_SIZE; }
+};
+
 #define ALIGN_TEST_RUN 1024
 
 struct __attribute__((aligned(8))) alignment_test: public empty_benchmark<ALIGN_TEST_RUN>
@@ -234,9 +422,65 @@ static struct option long_options[] = {
     {"help", 0, 0, 'h'},
     {"version", 0, 0, 'v'},
     {"unit", 1, 0, 'u'},
+    {"plugin", 1, 0, 'p'},
+    {"srates", 1, 0, 's'},
+    {"blocks", 1, 0, 'b'},
+    {"format", 1, 0, 'f'},
+    {"seconds", 1, 0, 't'},
+    {"runs", 1, 0, 'r'},
+    {"threads", 1, 0, 'j'},
     {0,0,0,0},
 };
 
+/// Settings of the plugin regression suite (--unit plugins)
+struct plugin_suite_options
+{
+    std::vector<std::string> plugins;
+    std::vector<uint32_t> srates;
+    std::vector<uint32_t> blocks;
+    std::string format;
+    double seconds;
+    int runs;
+    /// Voice rendering thread counts (--unit polyphony)
+    std::vector<uint32_t> threads;
+
+    plugin_suite_options()
+    : format("text")
+    , seconds(1.0)
+    , runs(5)
+    {
+        uint32_t sr[] = { 44100, 48000, 96000, 192000 };
+        uint32_t bs[] = { 16, 64, 256, 1024, 4096 };
+        uint32_t th[] = { 0, 1, 2, 3 };
+        srates.assign(sr, sr + sizeof(sr) / sizeof(sr[0]));
+        blocks.assign(bs, bs + sizeof(bs) / sizeof(bs[0]));
+        threads.assign(th, th + sizeof(th) / sizeof(th[0]));
+    }
+} suite_options;
+
+static void parse_uint_list(const char *arg, std::vector<uint32_t> &list)
+{
+    list.clear();
+    for (const char *p = arg; *p; ) {
+        list.push_back(strtoul(p, (char **)&p, 10));
+        if (*p == ',')
+            p++;
+        else if (*p)
+            break;
+    }
+}
+
+static void parse_string_list(const char *arg, std::vector<std::string> &list)
+{
+    std::string s = arg;
+    size_t start = 0, comma;
+    while((comma = s.find(',', start)) != std::string::npos) {
+        list.push_back(s.substr(start, comma - start));
+        start = comma + 1;
+    }
+    list.push_back(s.substr(start));
+}
+
 void biquad_test()
 {
         do_simple_benchmark<filter_24dB_lp_twopass_d1>();
@@ -250,7 +494,78 @@ void biquad_test()
 
 void fft_test()
 {
+        do_simple_benchmark<fft_test_class<12> >(5, 100);
+        do_simple_benchmark<fft_engine_test_class<12> >(5, 100);
+        do_simple_benchmark<fft_engine_real_test_class<12> >(5, 100);
         do_simple_benchmark<fft_test_class<17> >(5, 10);
+        do_simple_benchmark<fft_engine_test_class<17> >(5, 10);
+        do_simple_benchmark<fft_engine_real_test_class<17> >(5, 10);
+}
+
+/// Convolve noise in place, in blocks of random size, with responses of
+/// lengths around the stage boundaries, and report the largest difference
+/// from the direct form (in double precision)
+void convolution_compare()
+{
+    static const int lengths[] = { 2, 63, 64, 65, 1023, 1024, 1025, 1536, 8191, 8192, 8193, 12289 };
+    enum { Frames = 16384 };
+    std::vector<float> input[2], output[2];
+    uint32_t seed = 1;
+    for (int c = 0; c < 2; c++) {
+        input[c].resize(Frames);
+        for (int i = 0; i < Frames; i++) {
+            seed = seed * 1664525 + 1013904223;
+            input[c][i] = (seed >> 9) / 4194304.f - 1.f;
+        }
+    }
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        int length = lengths[l];
+        convolver conv(benchmark_ir(length));
+        for (int c = 0; c < 2; c++)
+            output[c] = input[c];
+        for (int pos = 0; pos < Frames; ) {
+            seed = seed * 1664525 + 1013904223;
+            int len = std::min<int>(Frames - pos, 1 + (seed >> 16) % 300);
+            conv.process(&output[0][pos], &output[1][pos], &output[0][pos], &output[1][pos], len);
+            pos += len;
+        }
+        float diff = 0.f, peak = 0.f;
+        std::vector<double> taps(length);
+        for (int c = 0; c < 2; c++) {
+            for (int t = 0; t < length; t++)
+                taps[t] = benchmark_ir_tap(c, t, length);
+            for (int i = 0; i < Frames; i++) {
+                double sum = 0;
+                for (int t = 0; t <= std::min(i, length - 1); t++)
+                    sum += taps[t] * input[c][i - t];
+                diff = std::max(diff, (float)fabs(output[c][i] - sum));
+                peak = std::max(peak, (float)fabs(sum));
+            }
+        }
+        printf("convolver vs direct form, IR length %d: max abs difference %g (output peak %g)\n", length, diff, peak);
+    }
+}
+
+void convolution_test()
+{
+        do_simple_benchmark<direct_convolution_benchmark<4096> >(5, 5);
+        do_simple_benchmark<convolver_benchmark<4096, 64> >(5, 100);
+        do_simple_benchmark<convolver_benchmark<88200, 64> >(5, 20);
+        do_simple_benchmark<convolver_benchmark<88200, 256> >(5, 20);
+        do_simple_benchmark<convolver_benchmark<264600, 64> >(5, 10);
+        convolution_compare();
+}
+
+void oversampling_test()
+{
+        do_simple_benchmark<oversampler_benchmark<2, dsp::oversampler::QUALITY_LOW_LATENCY, true> >(5, 10000);
+        do_simple_benchmark<oversampler_benchmark<2, dsp::oversampler::QUALITY_FAST, true> >(5, 10000);
+        do_simple_benchmark<oversampler_benchmark<2, dsp::oversampler::QUALITY_NORMAL, true> >(5, 10000);
+        do_simple_benchmark<oversampler_benchmark<2, dsp::oversampler::QUALITY_HIGH, true> >(5, 10000);
+        do_simple_benchmark<oversampler_benchmark<2, dsp::oversampler::QUALITY_NORMAL, false> >(5, 10000);
+        do_simple_benchmark<oversampler_benchmark<4, dsp::oversampler::QUALITY_NORMAL, true> >(5, 10000);
+        do_simple_benchmark<oversampler_benchmark<8, dsp::oversampler::QUALITY_NORMAL, true> >(5, 10000);
+        do_simple_benchmark<oversampler_benchmark<16, dsp::oversampler::QUALITY_NORMAL, true> >(5, 10000);
 }
 
 void alignment_test()
@@ -260,123 +575,567 @@ void alignment_test()
 }
 
 #ifdef BENCHMARK_PLUGINS
-template<class Effect>
-void get_default_effect_params(float params[Effect::param_count], uint32_t &sr);
+/// A/B test of the per-sample and the block-based gain computer
+template<bool Block, unsigned int bufsize = 256>
+class gain_reduction_benchmark: public empty_benchmark<bufsize>
+{
+public:
+    calf_plugins::gain_reduction_audio_module compressor;
+    float left[bufsize], right[bufsize];
+    float result;
 
-template<>
-void get_default_effect_params<calf_plugins::reverb_audio_module>(float params[3], uint32_t &sr)
+    void prepare()
+    {
+        compressor.set_sample_rate(44100);
+        compressor.set_params(0.1, 100, 0.125, 4, 2.828427, 1, 0, 1, 0, 0);
+        compressor.update_curve();
+        compressor.activate();
+        for (unsigned int i = 0; i < bufsize; i++) {
+            left[i] = sin(i * 0.05);
+            right[i] = cos(i * 0.05);
+        }
+        result = 0.f;
+    }
+    void run()
+    {
+        if (Block)
+            compressor.process_block(left, right, NULL, NULL, left, right, bufsize);
+        else {
+            for (unsigned int i = 0; i < bufsize; i++)
+                compressor.process(left[i], right[i]);
+        }
+    }
+    void cleanup()
+    {
+        for (unsigned int i = 0; i < bufsize; i++)
+            result += left[i] + right[i];
+    }
+};
+
+/// A/B test of the allpass and the feedback delay network reverb engines
+template<bool Fdn, unsigned int bufsize = 256>
+class reverb_engine_benchmark: public empty_benchmark<bufsize>
 {
-    typedef calf_plugins::reverb_audio_module mod;
-    params[mod::par_decay] = 4;
-    params[mod::par_hfdamp] = 2000;
-    params[mod::par_amount] = 2;
-    sr = 4000;
-}
+public:
+    dsp::reverb allpass;
+    dsp::fdn_reverb fdn;
+    float in_left[bufsize], in_right[bufsize];
+    float left[bufsize], right[bufsize];
+    float result;
 
-template<>
-void get_default_effect_params<calf_plugins::filter_audio_module>(float params[4], uint32_t &sr)
+    void prepare()
+    {
+        allpass.setup(44100);
+        allpass.set_type_and_diffusion(2, 0.5);
+        allpass.set_time(1.5);
+        allpass.set_cutoff(9000);
+        fdn.setup(44100);
+        fdn.set_type_and_diffusion(2, 0.5);
+        fdn.set_time(1.5);
+        fdn.set_cutoff(9000);
+        for (unsigned int i = 0; i < bufsize; i++) {
+            in_left[i] = sin(i * 0.05);
+            in_right[i] = cos(i * 0.05);
+        }
+        result = 0.f;
+    }
+    void run()
+    {
+        memcpy(left, in_left, sizeof(left));
+        memcpy(right, in_right, sizeof(right));
+        if (Fdn)
+            fdn.process(left, right, bufsize);
+        else {
+            for (unsigned int i = 0; i < bufsize; i++)
+                allpass.process(left[i], right[i]);
+        }
+    }
+    void cleanup()
+    {
+        for (unsigned int i = 0; i < bufsize; i++)
+            result += left[i] + right[i];
+    }
+};
+
+/// A/B test of the lookahead limiter engines on dense transients, the value is
+/// the highest true peak of the output relative to the limit
+template<int Engine, bool TruePeak, unsigned int bufsize = 256>
+class limiter_engine_benchmark: public empty_benchmark<bufsize>
+{
+public:
+    dsp::lookahead_limiter limiter;
+    dsp::true_peak_detector detector[2];
+    float in_left[bufsize], in_right[bufsize];
+    float left[bufsize], right[bufsize];
+    float result;
+
+    void prepare()
+    {
+        limiter.set_max_sample_rate(44100);
+        limiter.set_sample_rate(44100);
+        limiter.set_params(0.5, 5, 50);
+        limiter.set_engine(Engine, TruePeak);
+        limiter.activate();
+        // a peak on every sample, rising over the block
+        for (unsigned int i = 0; i < bufsize; i++) {
+            float level = 0.6 + 3.0 * i / bufsize;
+            in_left[i] = (i & 1) ? level : -level * 0.9;
+            in_right[i] = level * sin(i * 2.1);
+        }
+        result = 0.f;
+    }
+    void run()
+    {
+        memcpy(left, in_left, sizeof(left));
+        memcpy(right, in_right, sizeof(right));
+        if (Engine == dsp::lookahead_limiter::ENGINE_WINDOW)
+            limiter.process_block(left, right, NULL, bufsize);
+        else {
+            for (unsigned int i = 0; i < bufsize; i++)
+                limiter.process(left[i], right[i], NULL);
+        }
+    }
+    void cleanup()
+    {
+        // fill the detector history from the block itself, so that the edge
+        // of the block doesn't count as a transient
+        const int skip = dsp::true_peak_detector::Taps - 1;
+        for (int c = 0; c < 2; c++) {
+            float *data = c ? right : left;
+            detector[c].reset();
+            detector[c].process(data, skip);
+            result = std::max(result, detector[c].process(data + skip, bufsize - skip) / limiter.limit);
+        }
+    }
+};
+
+/// Compress the same signal with the per-sample and the block gain
+/// computer, for every detection and stereo link mode, and report the
+/// largest difference of the outputs
+void gain_reduction_compare()
 {
-    typedef calf_plugins::filter_audio_module mod;
-    params[mod::par_cutoff] = 500;
-    params[mod::par_resonance] = 3;
-    params[mod::par_mode] = 2;
-    params[mod::par_inertia] = 16;
-    sr = 4000;
+    enum { Blocks = 512, BlockSize = 256 };
+    for (int mode = 0; mode < 4; mode++) {
+        int detection = mode & 1, stereo_link = mode >> 1;
+        calf_plugins::gain_reduction_audio_module scalar, block;
+        calf_plugins::gain_reduction_audio_module *compressors[] = { &scalar, &block };
+        for (int c = 0; c < 2; c++) {
+            compressors[c]->set_sample_rate(44100);
+            compressors[c]->set_params(0.1, 100, 0.125, 4, 2.828427, 1, detection, stereo_link, 0, 0);
+            compressors[c]->update_curve();
+            compressors[c]->activate();
+        }
+        float left[BlockSize], right[BlockSize], block_left[BlockSize], block_right[BlockSize];
+        float diff = 0.f, peak = 0.f;
+        for (int n = 0; n < Blocks; n++) {
+            // level steps every few blocks, so that attack and release both happen
+            float level = (n / 8) % 3 == 0 ? 1.f : 0.05f;
+            for (int i = 0; i < BlockSize; i++) {
+                int t = n * BlockSize + i;
+                block_left[i] = left[i] = level * sin(t * 0.05);
+                block_right[i] = right[i] = level * 0.7f * cos(t * 0.031);
+            }
+            for (int i = 0; i < BlockSize; i++)
+                scalar.process(left[i], right[i]);
+            block.process_block(block_left, block_right, NULL, NULL, block_left, block_right, BlockSize);
+            for (int i = 0; i < BlockSize; i++) {
+                diff = std::max(diff, std::max(fabsf(block_left[i] - left[i]), fabsf(block_right[i] - right[i])));
+                peak = std::max(peak, std::max(fabsf(left[i]), fabsf(right[i])));
+            }
+        }
+        printf("gain reduction (%s, %s link): block vs per-sample, max abs difference %g (output peak %g)\n", detection ? "peak" : "RMS", stereo_link ? "max" : "average", diff, peak);
+    }
 }
 
-template<>
-void get_default_effect_params<calf_plugins::flanger_audio_module>(float params[5], uint32_t &sr)
+void effect_test()
 {
-    typedef calf_plugins::flanger_audio_module mod;
-    params[mod::par_delay] = 1;
-    params[mod::par_depth] = 2;
-    params[mod::par_rate] = 1;
-    params[mod::par_fb] = 0.9;
-    params[mod::par_amount] = 0.9;
-    sr = 44100;
+    dsp::do_simple_benchmark<gain_reduction_benchmark<false> >(5, 10000);
+    dsp::do_simple_benchmark<gain_reduction_benchmark<true> >(5, 10000);
+    gain_reduction_compare();
+    dsp::do_simple_benchmark<reverb_engine_benchmark<false> >(5, 10000);
+    dsp::do_simple_benchmark<reverb_engine_benchmark<true> >(5, 10000);
+    dsp::do_simple_benchmark<limiter_engine_benchmark<dsp::lookahead_limiter::ENGINE_CLASSIC, false> >(5, 10000);
+    dsp::do_simple_benchmark<limiter_engine_benchmark<dsp::lookahead_limiter::ENGINE_WINDOW, false> >(5, 10000);
+    dsp::do_simple_benchmark<limiter_engine_benchmark<dsp::lookahead_limiter::ENGINE_WINDOW, true> >(5, 10000);
 }
 
-template<>
-void get_default_effect_params<calf_plugins::compressor_audio_module>(float params[], uint32_t &sr)
+#if ENABLE_EXPERIMENTAL
+/// A/B test of the per-sample and the SIMD block wavetable oscillator (the
+/// plugin itself is in the plugins suite)
+template<bool Block, unsigned int bufsize = 64>
+class wavetable_osc_benchmark: public empty_benchmark<bufsize>
 {
-    typedef calf_plugins::compressor_audio_module mod;
-    params[mod::param_threshold] = 10;
-    params[mod::param_ratio] = 2;
-    params[mod::param_attack] = 0.1;
-    params[mod::param_release] = 100;
-    params[mod::param_makeup] = 1;
-    params[mod::param_stereo_link] = 1;
-    params[mod::param_detection] = 0;
-    params[mod::param_knee] = 40000;
-    params[mod::param_bypass] = 0;
-    sr = 44100;
+public:
+    // one more row, as get_block may read past the end of the last one
+    static int16_t tables[130][256];
+    calf_plugins::wavetable_oscillator osc;
+    uint16_t slices[bufsize];
+    float output[bufsize];
+    float result;
+
+    void prepare()
+    {
+        for (int i = 0; i < 129; i++)
+            for (int j = 0; j < 256; j++)
+                tables[i][j] = 32767 * sin(j * M_PI / 128) * cos(i * j * M_PI / 4096);
+        osc.tables = tables;
+        osc.reset();
+        osc.set_freq(440, 44100);
+        for (unsigned int i = 0; i < bufsize; i++)
+            slices[i] = i * 127 * 256 / bufsize;
+        result = 0.f;
+    }
+    void run()
+    {
+        if (Block)
+            osc.get_block(output, slices, bufsize);
+        else {
+            for (unsigned int i = 0; i < bufsize; i++)
+                output[i] = osc.get(slices[i]);
+        }
+    }
+    void cleanup()
+    {
+        for (unsigned int i = 0; i < bufsize; i++)
+            result += output[i];
+    }
+};
+
+template<bool Block, unsigned int bufsize>
+int16_t wavetable_osc_benchmark<Block, bufsize>::tables[130][256];
+
+/// Render the same oscillator with get and with get_block, sweeping the
+/// pitch and the table slices, and report the largest difference
+void wavetable_osc_compare()
+{
+    typedef wavetable_osc_benchmark<true> bench;
+    enum { Blocks = 4096, BlockSize = 64 };
+    bench b;
+    b.prepare();
+    calf_plugins::wavetable_oscillator scalar, block;
+    scalar.tables = block.tables = bench::tables;
+    scalar.reset();
+    block.reset();
+    uint16_t slices[BlockSize];
+    float out_scalar[BlockSize], out_block[BlockSize];
+    float diff = 0.f, peak = 0.f;
+    uint32_t seed = 1;
+    for (int n = 0; n < Blocks; n++) {
+        float freq = 20 * pow(1000.0, (double)n / Blocks);
+        scalar.set_freq(freq, 44100);
+        block.set_freq(freq, 44100);
+        for (int i = 0; i < BlockSize; i++) {
+            seed = seed * 1664525 + 1013904223;
+            slices[i] = (seed >> 16) % (128 * 256);
+        }
+        for (int i = 0; i < BlockSize; i++)
+            out_scalar[i] = scalar.get(slices[i]);
+        block.get_block(out_block, slices, BlockSize);
+        for (int i = 0; i < BlockSize; i++) {
+            diff = std::max(diff, fabsf(out_block[i] - out_scalar[i]));
+            peak = std::max(peak, fabsf(out_scalar[i]));
+        }
+    }
+    printf("wavetable oscillator: get_block vs get, max abs difference %g (output peak %g)\n", diff, peak);
 }
 
-template<>
-void get_default_effect_params<calf_plugins::multichorus_audio_module>(float params[], uint32_t &sr)
+void wavetable_test()
 {
-    typedef calf_plugins::multichorus_audio_module mod;
-    params[mod::par_delay] = 10;
-    params[mod::par_depth] = 10;
-    params[mod::par_rate] = 1;
-    params[mod::par_voices] = 6;
-    params[mod::par_stereo] = 180;
-    params[mod::par_vphase] = 20;
-    params[mod::par_amount] = 0.9;
-    sr = 44100;
+    dsp::do_simple_benchmark<wavetable_osc_benchmark<false> >(5, 100000);
+    dsp::do_simple_benchmark<wavetable_osc_benchmark<true> >(5, 100000);
+    wavetable_osc_compare();
 }
+#else
+void wavetable_test()
+{
+    printf("Wavetable benchmarks need the experimental plugins\n");
+}
+#endif
 
-template<class Effect, unsigned int bufsize = 256>
-class effect_benchmark: public empty_benchmark<bufsize>
+/// Runs a whole plugin, with all parameters at their default values, over
+/// a fixed amount of test signal in blocks of the given size - the same way
+/// a host calls run() with a fixed period size
+template<class Module>
+class plugin_benchmark
 {
 public:
-    Effect effect;
-    float inputs[Effect::in_count][bufsize];
-    float outputs[Effect::out_count][bufsize];
+    Module *module;
+    calf_plugins::audio_module_iface *iface;
+    uint32_t srate, block_size, frames;
+    bool is_synth;
+    std::vector<float> inputs, outputs, params;
     float result;
-    float params[Effect::param_count];
-    
-    void prepare()
+
+    plugin_benchmark(uint32_t _srate, uint32_t _block_size, double seconds, bool _is_synth)
+    : srate(_srate)
+    , block_size(_block_size)
+    , is_synth(_is_synth)
     {
-        for (int b = 0; b < Effect::out_count; b++)
-        {
-            effect.outs[b] = outputs[b];
-            dsp::zero(outputs[b], bufsize);
+        frames = std::max(block_size, (uint32_t)(seconds * srate) / block_size * block_size);
+        module = new Module;
+        iface = module;
+        const calf_plugins::plugin_metadata_iface *md = iface->get_metadata_iface();
+        float **ins, **outs, **prms;
+        iface->get_port_arrays(ins, outs, prms);
+
+        inputs.resize(Module::in_count * frames);
+        outputs.resize(Module::out_count * frames);
+        params.resize(Module::param_count);
+        // mix of a sine and noise with a level envelope, to get both the
+        // loud and the quiet code paths in dynamics processors
+        uint32_t seed = 1;
+        for (int c = 0; c < Module::in_count; c++) {
+            for (uint32_t i = 0; i < frames; i++) {
+                seed = seed * 1664525 + 1013904223;
+                float noise = (seed >> 9) / 4194304.f - 1.f;
+                float env = ((i / (srate / 10)) % 3 == 0) ? 0.9f : 0.1f;
+                inputs[c * frames + i] = env * (0.6f * sin(2 * M_PI * 440 * (c + 1) * i / srate) + 0.4f * noise);
+            }
+            ins[c] = &inputs[c * frames];
         }
-        for (int b = 0; b < Effect::in_count; b++)
-        {
-            effect.ins[b] = inputs[b];
-            for (unsigned int i = 0; i < bufsize; i++)
-                inputs[b][i] = (float)(10 + i*0.3f*(b+1));
+        for (int c = 0; c < Module::out_count; c++)
+            outs[c] = &outputs[c * frames];
+        for (int i = 0; i < Module::param_count; i++) {
+            params[i] = md->get_param_props(i)->def_value;
+            prms[i] = &params[i];
+        }
+        iface->post_instantiate(srate);
+        iface->set_sample_rate(srate);
+        iface->activate();
+        iface->params_changed();
+        if (is_synth) {
+            iface->note_on(0, 48, 100);
+            iface->note_on(0, 55, 100);
+            iface->note_on(0, 60, 100);
+            iface->note_on(0, 64, 100);
         }
-        for (int i = 0; i < Effect::param_count; i++)
-            effect.params[i] = &params[i];
-        ::get_default_effect_params<Effect>(params, effect.srate);
+    }
+    ~plugin_benchmark()
+    {
+        iface->deactivate();
+        delete module;
+    }
+    void prepare()
+    {
         result = 0.f;
-        effect.activate();
     }
     void run()
     {
-        effect.params_changed();
-        effect.process(0, bufsize, 3, 3);
+        for (uint32_t pos = 0; pos < frames; pos += block_size) {
+            iface->params_changed();
+            iface->process_slice(pos, pos + block_size);
+        }
     }
     void cleanup()
     {
-        for (int b = 0; b < Effect::out_count; b++)
-        {
-            for (unsigned int i = 0; i < bufsize; i++)
-                result += outputs[b][i];
+        for (uint32_t i = 0; i < outputs.size(); i++)
+            result += fabs(outputs[i]);
+    }
+    double scaler() { return frames; }
+};
+
+static int plugin_suite_rows = 0;
+
+template<class Module>
+void plugin_test(const char *id, bool is_synth)
+{
+    if (!suite_options.plugins.empty() && std::find(suite_options.plugins.begin(), suite_options.plugins.end(), id) == suite_options.plugins.end())
+        return;
+    const std::string &format = suite_options.format;
+    for (size_t s = 0; s < suite_options.srates.size(); s++) {
+        for (size_t b = 0; b < suite_options.blocks.size(); b++) {
+            uint32_t srate = suite_options.srates[s], block_size = suite_options.blocks[b];
+            dsp::median_stat stat;
+            dsp::simple_benchmark<plugin_benchmark<Module>, dsp::median_stat> benchmark(stat, srate, block_size, suite_options.seconds, is_synth);
+            benchmark.measure(suite_options.runs, 1);
+            // the stat values are seconds per sample
+            double ns = stat.get() * 1e9, ns_min = stat.get_min() * 1e9, ns_max = stat.get_max() * 1e9;
+            double rt_factor = 1.0 / (stat.get() * srate);
+            double spread = ns > 0 ? 100.0 * (ns_max - ns_min) / ns : 0;
+            if (format == "csv")
+                printf("%s,%u,%u,%f,%f,%f,%f,%f\n", id, srate, block_size, ns, ns_min, ns_max, spread, rt_factor);
+            else if (format == "json")
+                printf("%s\n  {\"plugin\": \"%s\", \"srate\": %u, \"block\": %u, \"ns_per_sample\": %f, \"ns_min\": %f, \"ns_max\": %f, \"spread_pct\": %f, \"realtime_factor\": %f}", plugin_suite_rows ? "," : "", id, srate, block_size, ns, ns_min, ns_max, spread, rt_factor);
+            else
+                printf("%-20s %7u %6u %12.2f %12.2f %12.2f %8.2f%% %12.1fx\n", id, srate, block_size, ns, ns_min, ns_max, spread, rt_factor);
+            fflush(stdout);
+            plugin_suite_rows++;
+        }
+    }
+}
+
+void plugin_suite()
+{
+    const std::string &format = suite_options.format;
+    if (format == "csv")
+        printf("plugin,srate,block,ns_per_sample,ns_min,ns_max,spread_pct,realtime_factor\n");
+    else if (format == "json")
+        printf("[");
+    else
+        printf("%-20s %7s %6s %12s %12s %12s %9s %13s\n", "plugin", "srate", "block", "ns/sample", "min", "max", "spread", "realtime");
+    plugin_suite_rows = 0;
+    #define PER_MODULE_ITEM(name, isSynth, jackname) plugin_test<calf_plugins::name##_audio_module>(jackname, isSynth);
+    #include <calf/modulelist.h>
+    if (format == "json")
+        printf("\n]\n");
+}
+
+/// MIDI torture test for the dsp::basic_synth based instruments: all voices
+/// in use, percussion on every note, one note released and one pressed in
+/// every period, and the hold pedal going up and down
+template<class Module>
+class polyphony_benchmark: public plugin_benchmark<Module>
+{
+public:
+    using plugin_benchmark<Module>::iface;
+    using plugin_benchmark<Module>::frames;
+    using plugin_benchmark<Module>::block_size;
+    enum { Notes = 32 };
+    int notes[Notes];
+    uint32_t seed;
+
+    polyphony_benchmark(uint32_t srate, uint32_t block_size, double seconds, int threads)
+    : plugin_benchmark<Module>(srate, block_size, seconds, false)
+    {
+        const calf_plugins::plugin_metadata_iface *md = iface->get_metadata_iface();
+        for (int i = 0; i < Module::param_count; i++) {
+            const calf_plugins::parameter_properties *pp = md->get_param_props(i);
+            if (!strcmp(pp->short_name, "polyphony") || !strcmp(pp->short_name, "perc_trigger"))
+                this->params[i] = pp->max;
+        }
+        iface->params_changed();
+        this->module->set_render_threads(threads, calf_plugins::MAX_SAMPLE_RUN);
+    }
+    void prepare()
+    {
+        plugin_benchmark<Module>::prepare();
+        seed = 1;
+        iface->control_change(0, 120, 0);
+        iface->control_change(0, 64, 0);
+        for (int i = 0; i < Notes; i++) {
+            notes[i] = 36 + i * 2;
+            iface->note_on(0, notes[i], 100);
+        }
+    }
+    void run()
+    {
+        int period = 0;
+        for (uint32_t pos = 0; pos < frames; pos += block_size, period++) {
+            int k = period % Notes;
+            seed = seed * 1664525 + 1013904223;
+            iface->note_off(0, notes[k], 0);
+            notes[k] = 36 + (seed >> 16) % 60;
+            iface->note_on(0, notes[k], 40 + (seed >> 8) % 88);
+            if (period % 16 == 0)
+                iface->control_change(0, 64, (period & 16) ? 127 : 0);
+            iface->params_changed();
+            iface->process_slice(pos, pos + block_size);
         }
     }
 };
 
-void effect_test()
+template<class Module>
+void polyphony_test(const char *id)
 {
-    dsp::do_simple_benchmark<effect_benchmark<calf_plugins::flanger_audio_module> >(5, 10000);
-    dsp::do_simple_benchmark<effect_benchmark<calf_plugins::reverb_audio_module> >(5, 1000);
-    dsp::do_simple_benchmark<effect_benchmark<calf_plugins::filter_audio_module> >(5, 10000);
-    dsp::do_simple_benchmark<effect_benchmark<calf_plugins::compressor_audio_module> >(5, 10000);
-    dsp::do_simple_benchmark<effect_benchmark<calf_plugins::multichorus_audio_module> >(5, 10000);
+    if (!suite_options.plugins.empty() && std::find(suite_options.plugins.begin(), suite_options.plugins.end(), id) == suite_options.plugins.end())
+        return;
+    const std::string &format = suite_options.format;
+    for (size_t s = 0; s < suite_options.srates.size(); s++) {
+        for (size_t b = 0; b < suite_options.blocks.size(); b++) {
+            for (size_t t = 0; t < suite_options.threads.size(); t++) {
+                uint32_t srate = suite_options.srates[s], block_size = suite_options.blocks[b], threads = suite_options.threads[t];
+                polyphony_benchmark<Module> bench(srate, block_size, suite_options.seconds, threads);
+                // wall clock time, as the CPU time of all the threads together does not say whether the host can keep up
+                dsp::median_stat stat;
+                stat.start(suite_options.runs);
+                for (int r = 0; r < suite_options.runs; r++) {
+                    bench.prepare();
+                    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                    bench.run();
+                    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                    stat.add(elapsed.count() / bench.scaler());
+                    bench.cleanup();
+                }
+                stat.end();
+                double ns = stat.get() * 1e9, rt_factor = 1.0 / (stat.get() * srate);
+                // sum of the output of the last run - the threads only change
+                // the order in which the voices are added up, so this should
+                // be (almost) the same for any number of threads
+                double checksum = bench.result;
+                if (format == "csv")
+                    printf("%s,%u,%u,%u,%f,%f,%f\n", id, srate, block_size, threads, ns, rt_factor, checksum);
+                else if (format == "json")
+                    printf("%s\n  {\"plugin\": \"%s\", \"srate\": %u, \"block\": %u, \"threads\": %u, \"ns_per_sample\": %f, \"realtime_factor\": %f, \"checksum\": %f}", plugin_suite_rows ? "," : "", id, srate, block_size, threads, ns, rt_factor, checksum);
+                else
+                    printf("%-20s %7u %6u %7u %12.2f %12.1fx %16.4f\n", id, srate, block_size, threads, ns, rt_factor, checksum);
+                fflush(stdout);
+                plugin_suite_rows++;
+            }
+        }
+    }
+}
+
+inline void set_voice_bank(calf_plugins::organ_audio_module *module, bool on)
+{
+    module->use_voice_bank = on;
+}
+#if ENABLE_EXPERIMENTAL
+inline void set_batch_modmatrix(calf_plugins::wavetable_audio_module *module, bool on)
+{
+    module->batch_modmatrix = on;
+}
+inline void set_simd_oscillators(calf_plugins::wavetable_audio_module *module, bool on)
+{
+    module->simd_oscillators = on;
+}
+#endif
+
+/// Play the polyphony test with an optimisation switched on and off (no
+/// voice threads, so that both add up the voices in the same order) and
+/// report the largest difference of the outputs
+template<class Module>
+void polyphony_compare(const char *id, const char *what, void (*set)(Module *, bool))
+{
+    if (!suite_options.plugins.empty() && std::find(suite_options.plugins.begin(), suite_options.plugins.end(), id) == suite_options.plugins.end())
+        return;
+    polyphony_benchmark<Module> on(44100, 256, 1, 0), off(44100, 256, 1, 0);
+    set(on.module, true);
+    set(off.module, false);
+    on.prepare();
+    on.run();
+    off.prepare();
+    off.run();
+    float diff = 0.f, peak = 0.f;
+    for (size_t i = 0; i < off.outputs.size(); i++) {
+        diff = std::max(diff, fabsf(on.outputs[i] - off.outputs[i]));
+        peak = std::max(peak, fabsf(off.outputs[i]));
+    }
+    printf("%s: %s on vs off, max abs difference %g (output peak %g)\n", id, what, diff, peak);
+}
+
+void polyphony_suite()
+{
+    const std::string &format = suite_options.format;
+    if (format == "csv")
+        printf("plugin,srate,block,threads,ns_per_sample,realtime_factor,checksum\n");
+    else if (format == "json")
+        printf("[");
+    else
+        printf("%-20s %7s %6s %7s %12s %13s %16s\n", "plugin", "srate", "block", "threads", "ns/sample", "realtime", "checksum");
+    plugin_suite_rows = 0;
+    polyphony_test<calf_plugins::organ_audio_module>("organ");
+#if ENABLE_EXPERIMENTAL
+    polyphony_test<calf_plugins::wavetable_audio_module>("wavetable");
+#endif
+    if (format == "json")
+        printf("\n]\n");
+    if (format != "csv" && format != "json") {
+        polyphony_compare<calf_plugins::organ_audio_module>("organ", "voice bank", set_voice_bank);
+#if ENABLE_EXPERIMENTAL
+        polyphony_compare<calf_plugins::wavetable_audio_module>("wavetable", "batched mod matrix", set_batch_modmatrix);
+        polyphony_compare<calf_plugins::wavetable_audio_module>("wavetable", "SIMD oscillators", set_simd_oscillators);
+#endif
+    }
 }
 
 #else
@@ -384,6 +1143,18 @@ void effect_test()
 {
     printf("Test temporarily removed due to refactoring\n");
 }
+void wavetable_test()
+{
+    printf("Wavetable benchmarks not compiled in\n");
+}
+void plugin_suite()
+{
+    printf("Plugin benchmarks not compiled in\n");
+}
+void polyphony_suite()
+{
+    printf("Plugin benchmarks not compiled in\n");
+}
 #endif
 void reverbir_calc()
 {
@@ -509,13 +1280,16 @@ int main(int argc, char *argv[])
 {
     while(1) {
         int option_index;
-        int c = getopt_long(argc, argv, "u:hv", long_options, &option_index);
+        int c = getopt_long(argc, argv, "u:p:s:b:f:t:r:j:hv", long_options, &option_index);
         if (c == -1)
             break;
         switch(c) {
             case 'h':
             case '?':
-                printf("Benchmark suite Calf plugin pack\nSyntax: %s [--help] [--version] [--unit biquad|alignment|effects]\n", argv[0]);
+                printf("Benchmark suite Calf plugin pack\nSyntax: %s [--help] [--version] [--unit biquad|alignment|effects|wavetable|fft|convolution|oversampling|plugins|polyphony]\n"
+                       "Options for the plugins and polyphony units:\n"
+                       "  [--plugin id[,id...]] [--srates 44100,...] [--blocks 16,...] [--seconds 1] [--runs 5] [--format text|csv|json]\n"
+                       "  [--threads 0,1,...] (voice rendering threads, polyphony unit only)\n", argv[0]);
                 return 0;
             case 'v':
                 printf("%s\n", PACKAGE_STRING);
@@ -523,6 +1297,27 @@ int main(int argc, char *argv[])
             case 'u':
                 unit = optarg;
                 break;
+            case 'p':
+                parse_string_list(optarg, suite_options.plugins);
+                break;
+            case 's':
+                parse_uint_list(optarg, suite_options.srates);
+                break;
+            case 'b':
+                parse_uint_list(optarg, suite_options.blocks);
+                break;
+            case 'f':
+                suite_options.format = optarg;
+                break;
+            case 't':
+                suite_options.seconds = atof(optarg);
+                break;
+            case 'r':
+                suite_options.runs = std::max(1, atoi(optarg));
+                break;
+            case 'j':
+                parse_uint_list(optarg, suite_options.threads);
+                break;
         }
     }
     
@@ -540,6 +1335,21 @@ int main(int argc, char *argv[])
     if (!unit || !strcmp(unit, "effects"))
         effect_test();
 
+    if (!unit || !strcmp(unit, "wavetable"))
+        wavetable_test();
+
+    if (unit && !strcmp(unit, "plugins"))
+        plugin_suite();
+
+    if (unit && !strcmp(unit, "polyphony"))
+        polyphony_suite();
+
+    if (unit && !strcmp(unit, "convolution"))
+        convolution_test();
+
+    if (unit && !strcmp(unit, "oversampling"))
+        oversampling_test();
+
     if (unit && !strcmp(unit, "reverbir"))
         reverbir_calc();
 
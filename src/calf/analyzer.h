@@ -32,6 +32,7 @@
 #include <math.h>
 #include "plugin_tools.h"
 #include "fft.h"
+#include <atomic>
 
 #define MATH_E 2.718281828
 
@@ -65,7 +66,18 @@ public:
 
     uint32_t srate;
     analyzer();
-    void process(float L, float R);
+    /// Audio thread: append one sample to the history (call publish() at the end of the block)
+    inline void process(float L, float R) {
+        fft_bufferL[fpos] = L;
+        fft_bufferR[fpos] = R;
+        fpos = (fpos + 1) & (max_fft_cache_size - 1);
+        unpublished++;
+    }
+    /// Audio thread: append a block of samples to the history and publish it
+    void process(const float *L, const float *R, uint32_t count);
+    /// Audio thread: hand the latest FFT window over to the GUI, at most
+    /// every publish_interval samples (wait-free, never blocks on the GUI)
+    void publish();
     void set_sample_rate(uint32_t sr);
     bool set_mode(int mode);
     void invalidate();
@@ -78,16 +90,29 @@ public:
     bool get_gridline(int subindex, int phase, float &pos, bool &vertical, std::string &legend, cairo_iface *context) const;
     bool get_layers(int generation, unsigned int &layers) const;
 protected:
-    int fft_buffer_size;
-    float *fft_buffer;
+    static const int max_fft_cache_size = 32768;
+    /// History ring, written by the audio thread only
+    float *fft_bufferL, *fft_bufferR;
     int *spline_buffer;
     int fpos;
+    /// Samples added since the last snapshot, and the minimum between two
+    /// snapshots (10 ms), so that big windows aren't copied on every block
+    uint32_t unpublished, publish_interval;
+    /// Triple buffered snapshots of the last FFT window (oldest sample first),
+    /// the back one is owned by the audio thread, the front one by the GUI
+    float *snapshotL[3], *snapshotR[3];
+    int snapshot_frames[3];
+    int snapshot_back;
+    mutable int snapshot_front;
+    /// Index of the snapshot between the two threads, plus snapshot_fresh if
+    /// the GUI hasn't taken it yet
+    mutable std::atomic<int> snapshot_middle;
+    static const int snapshot_fresh = 4;
+    /// GUI thread: switch to the most recently published snapshot
+    void fetch_snapshot() const;
     mutable bool sanitize, recreate_plan;
     static const int MAX_FFT_ORDER = 15;
-    dsp::fft<float, MAX_FFT_ORDER> fft;
-    mutable dsp::fft<float, MAX_FFT_ORDER>::complex fft_temp[1 << MAX_FFT_ORDER];
-    static const int max_fft_cache_size = 32768;
-    static const int max_fft_buffer_size = max_fft_cache_size * 2;
+    mutable dsp::fft_engine fft;
     float *fft_inL, *fft_outL;
     float *fft_inR, *fft_outR;
     float *fft_smoothL, *fft_smoothR;
@@ -27,6 +27,7 @@
 #include "inertia.h"
 #include "giface.h"
 #include "onepole.h"
+#include "vumeter.h"
 #include <complex>
 
 namespace calf_plugins {
@@ -436,6 +437,65 @@ public:
     }
 };
 
+/**
+ * Feedback delay network reverb: eight modulated delay lines fed back
+ * through a Hadamard matrix, with a two band decay filter in each line.
+ * An alternative to reverb with a denser tail. The lines are processed a
+ * block at a time (all delays are longer than a block), with SIMD across
+ * the lines for the decay filters and the matrix.
+ */
+class fdn_reverb
+{
+public:
+    enum { LINES = 8, BLOCK = 32, MAX_DELAY = 32768, DELAY_MASK = MAX_DELAY - 1 };
+private:
+    float lines[LINES][MAX_DELAY];
+    simple_delay<1024, float> diffL1, diffL2, diffR1, diffR2;
+    int pos;
+    /// Nominal delay of each line, and the modulated delay at the end of the last block
+    float delay[LINES], cur_delay[LINES];
+    float mod_depth, mod_phase, mod_dphase;
+    /// Decay filters: gain above the crossover, difference between the gain below and above it, lowpass state
+    float gain_hi[LINES], gain_diff[LINES], lp_state[LINES];
+    float lp_coeff;
+    /// Input weights and output signs
+    float in_l[LINES], in_r[LINES], out_l[LINES], out_r[LINES];
+    int type;
+    float time, hf_decay, cutoff, diffusion;
+    int sr;
+    void update_times();
+    void update_decay();
+public:
+    fdn_reverb();
+    void setup(int sample_rate);
+    void set_time(float time) {
+        this->time = time;
+        update_decay();
+    }
+    /// Decay time above the cutoff frequency, relative to the decay time
+    void set_hf_decay(float ratio) {
+        hf_decay = ratio;
+        update_decay();
+    }
+    /// Crossover frequency of the two band decay
+    void set_cutoff(float cutoff) {
+        this->cutoff = cutoff;
+        update_decay();
+    }
+    /// Room type (same range as in reverb, sets the line lengths) and input diffusion
+    void set_type_and_diffusion(int type, float diffusion) {
+        this->diffusion = diffusion;
+        if (type != this->type) {
+            this->type = type;
+            update_times();
+        }
+    }
+    void reset();
+    /// Replace len samples of input with the reverberated signal
+    void process(float *left, float *right, unsigned int len);
+    void extra_sanitize();
+};
+
 class filter_module_iface
 {
 public:
@@ -552,10 +612,15 @@ public:
 };
 
 
-/// Lookahead Limiter by Markus Schmidt and Christian Holschuh
+/// Lookahead Limiter by Markus Schmidt and Christian Holschuh. The classic
+/// engine follows the stored gain deltas of upcoming peaks, the window engine
+/// plans the gain from the minimum of the required gains in the lookahead
 class lookahead_limiter {
 private:
 public:
+    enum { ENGINE_CLASSIC, ENGINE_WINDOW };
+    /// Frames the true peak detector lags behind its input
+    enum { TP_DELAY = 6 };
     float limit, attack, release, weight;
     uint32_t srate;
     float att; // a coefficient the output is multiplied with
@@ -563,6 +628,7 @@ public:
     int pos; // where we are actually in our sample buffer
     int buffer_size;
     int overall_buffer_size;
+    int allocated_size; // number of frames * channels the buffers can hold
     bool is_active;
     bool debug;
     bool auto_release;
@@ -587,6 +653,24 @@ public:
     bool asc_changed;
     float asc_coeff;
     bool _asc_used;
+    int engine;
+    bool true_peak;
+    // window engine: released gains of the last buffer_size / channels
+    // frames (box filtered into att), peaks each frame added to asc and a
+    // monotonic deque (frame counter, gain) of the required gains
+    float *wgain;
+    float *wasc;
+    unsigned int *wq_frame;
+    float *wq_gain;
+    int wq_head, wq_len;
+    unsigned int wframe;
+    double wsum;
+    float wrelease, wrdelta;
+    // true peak detection, input delayed to line up with the detector
+    true_peak_detector tp_detector[2];
+    float tp_line[TP_DELAY][3];
+    int tp_pos;
+    float tp_last;
     static inline void denormal(volatile float *f) {
         *f += 1e-18;
         *f -= 1e-18;
@@ -599,6 +683,14 @@ public:
     ~lookahead_limiter();
     void set_multi(bool set);
     void process(float &left, float &right, float *multi_buffer);
+    /// Limit a block in place with the window engine, multi holds one
+    /// multiband coefficient per frame (or is NULL)
+    void process_block(float *left, float *right, const float *multi, unsigned int len);
+    /// Select ENGINE_CLASSIC or ENGINE_WINDOW, resets the limiter on change
+    void set_engine(int e, bool tp = false);
+    /// Allocate the lookahead buffers for sample rates up to sr (not realtime safe)
+    void set_max_sample_rate(uint32_t sr);
+    /// Does not allocate if sr is not higher than the rate passed to set_max_sample_rate
     void set_sample_rate(uint32_t sr);
     void set_params(float l, float a, float r, float weight = 1.f, bool ar = false, float arc = 1.f, bool d = false);
     float get_attenuation();
@@ -636,7 +728,9 @@ private:
 public:
     int channels, bands, mode;
     float freq[8], active[8], level[8], out[8][8];
-    dsp::biquad_d2 lp[8][8][4], hp[8][8][4];
+    // one lane per channel and band (lane = channel * bands + band), hp
+    // lanes hold the highpass below their band, missing filters are null
+    dsp::biquad_d2_bank<64> lp[4], hp[4];
     mutable int redraw_graph;
     uint32_t srate;
     crossover();
@@ -673,20 +767,125 @@ public:
     bool get_gridline(int subindex, int phase, float &pos, bool &vertical, std::string &legend, calf_plugins::cairo_iface *context) const;
 };
 
-class resampleN
+/// One 2x stage of the oversampler: a linear phase half-band FIR in
+/// polyphase form. Half of the taps of a half-band filter are zero and one
+/// is the centre tap, so each direction only needs taps / 2 multiplies per
+/// low rate sample, exploiting the symmetry.
+class halfband_stage
+{
+public:
+    /// Maximum number of non-zero taps on the sinc side of the filter
+    enum { MAX_TAPS = 96 };
+private:
+    /// Low rate samples filtered per pass
+    enum { BLOCK = 64, BUF_SIZE = MAX_TAPS + BLOCK };
+    /// First half of the symmetric coefficients of the non-trivial branch
+    float coeffs[MAX_TAPS / 2];
+    int taps;
+    /// Low rate input, at least taps - 1 samples of history followed by
+    /// the samples of the current pass, which start at the fill position.
+    /// The history is only moved back to the start when the buffer is
+    /// full, so that calls for a single sample stay cheap.
+    float up_buf[BUF_SIZE], even_buf[BUF_SIZE], odd_buf[BUF_SIZE];
+    unsigned up_fill, down_fill;
+    void filter(const float *buf, float *out, unsigned len) const;
+    unsigned make_room(float *buf, unsigned &fill, unsigned len, float *buf2 = NULL);
+public:
+    halfband_stage();
+    /// Design a Kaiser windowed half-band filter with taps non-zero
+    /// coefficients on the sinc side (a multiple of 8, up to MAX_TAPS) for
+    /// the given stopband attenuation in dB
+    void set_params(int taps, float attenuation);
+    /// Delay of an upsample + downsample round trip, in high rate samples
+    int get_latency() const { return 2 * (taps - 1); }
+    void reset();
+    /// Produce 2 * len samples in out from len samples in in
+    void upsample(const float *in, float *out, unsigned len);
+    /// Produce len samples in out from 2 * len samples in in
+    void downsample(const float *in, float *out, unsigned len);
+};
+
+/// One 2x stage of the low latency oversampler: a half-band IIR made of two
+/// chains of first order allpasses running at the low rate, one per
+/// polyphase branch. Not linear phase, the delay at low frequencies is a
+/// few samples.
+class halfband_iir_stage
 {
+public:
+    enum { MAX_COEFFS = 12 };
+private:
+    float coeffs[MAX_COEFFS];
+    int count;
+    /// Previous input and output of each allpass, for both directions
+    float up_x1[MAX_COEFFS], up_y1[MAX_COEFFS];
+    float down_x1[MAX_COEFFS], down_y1[MAX_COEFFS];
+    /// Odd input sample of the previous pair when downsampling
+    float down_odd;
+    float delay;
+    inline float allpass(int first, float x, float *x1, float *y1) const;
+public:
+    halfband_iir_stage();
+    /// Design count allpass coefficients (up to MAX_COEFFS) for the given
+    /// transition band, as a fraction of the high sample rate
+    void set_params(int count, double transition);
+    /// Delay of an upsample + downsample round trip at DC, in high rate
+    /// samples
+    float get_latency() const { return delay; }
+    void reset();
+    void sanitize();
+    void upsample(const float *in, float *out, unsigned len);
+    void downsample(const float *in, float *out, unsigned len);
+};
+
+/// Oversampling by 2, 4, 8 or 16 with a cascade of half-band stages. The
+/// first stage has the sharpest filter, the later ones only need to remove
+/// images far from the audio band and are much shorter. Upsampling and
+/// downsampling each have their own state, so the same instance can be
+/// used for both directions of a signal.
+///
+/// Nothing reports the round trip latency to the host, and the bypass
+/// crossfade mixes with the undelayed input, so users that need phase
+/// alignment with the dry signal must delay it by get_latency() samples.
+class oversampler
+{
+public:
+    enum { MAX_STAGES = 4, MAX_FACTOR = 1 << MAX_STAGES };
+    /// QUALITY_LOW_LATENCY uses IIR stages, for signals mixed with their
+    /// dry version, the others linear phase FIR stages of growing length
+    enum { QUALITY_LOW_LATENCY, QUALITY_FAST, QUALITY_NORMAL, QUALITY_HIGH, QUALITY_COUNT };
 private:
+    /// Samples per chunk of the block functions, at the base rate
+    enum { CHUNK = 16 };
+    halfband_stage stages[MAX_STAGES];
+    halfband_iir_stage iir_stages[MAX_STAGES];
+    int factor, stage_count, quality;
+    int latency, pad;
+    /// Delay that makes the round trip an integer number of base rate samples
+    float pad_buf[MAX_FACTOR];
+    int pad_pos;
+    float work[2][CHUNK * MAX_FACTOR];
 public:
-    uint32_t srate; // sample rate; source for upsampling, target for downsampling
-    int factor; // number of added/removed samples, max 16
-    int filters; // how many lowpasses should be used, max 4
-    double tmp[16];
-    dsp::biquad_d2 filter[2][4];
-    resampleN();
-    ~resampleN();
-    void set_params(uint32_t sr, int factor, int filters);
-    double *upsample(double sample);
-    double downsample(double *sample);
+    oversampler();
+    /// Factor actually used for a requested one: the next power of 2, up
+    /// to MAX_FACTOR
+    static int round_factor(int factor);
+    /// Set the factor (rounded with round_factor) and one of the QUALITY_
+    /// presets, resetting the state if either changes. Real-time safe.
+    void set_params(int factor, int quality = QUALITY_NORMAL);
+    int get_factor() const { return factor; }
+    /// Delay of an upsample + downsample round trip, in base rate samples
+    /// (rounded, at DC, with QUALITY_LOW_LATENCY)
+    int get_latency() const { return latency; }
+    void reset();
+    /// Produce len * get_factor() samples in out from len samples in in
+    void upsample(const float *in, float *out, unsigned len);
+    /// Produce len samples in out from len * get_factor() samples in in,
+    /// which may be the same buffer as out
+    void downsample(const float *in, float *out, unsigned len);
+    /// Produce get_factor() samples in out from one input sample
+    inline void upsample(float in, float *out) { upsample(&in, out, 1); }
+    /// Produce one output sample from get_factor() samples in in
+    inline float downsample(const float *in) { float out; downsample(in, &out, 1); return out; }
 };
 
 class samplereduction
@@ -712,7 +911,7 @@ private:
     float rdrive, rbdr, kpa, kpb, kna, knb, ap, an, imr, kc, srct, sq, pwrq;
     int over;
     float prev_med, prev_out;
-    resampleN resampler;
+    oversampler resampler;
 public:
     uint32_t srate;
     bool is_active;
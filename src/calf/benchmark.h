@@ -71,6 +71,16 @@ public:
         assert(sorted);
         return data[count >> 1];
     }
+    float get_min()
+    {
+        assert(sorted);
+        return data[0];
+    }
+    float get_max()
+    {
+        assert(sorted);
+        return data[count - 1];
+    }
 };
 
 // USE_RDTSC is for testing on my own machine, a crappy 1.6GHz Pentium 4 - it gives less headaches than clock() based measurements
@@ -2,17 +2,26 @@
 #define CALF_BYPASS_H
 
 #include "inertia.h"
+#include <assert.h>
 
 namespace dsp {
 
 class bypass
 {
+public:
+    /// Largest block save_dry can keep (same as MAX_SAMPLE_RUN)
+    enum { max_dry_channels = 2, max_dry_samples = 256 };
+private:
     inertia<linear_ramp> ramp;
     float first_value, next_value;
+    /// Unprocessed input kept by save_dry, used by the next crossfade instead of the inputs
+    float dry[max_dry_channels][max_dry_samples];
+    bool has_dry;
     
 public:
     bypass(int _ramp_len = 1024)
     : ramp(linear_ramp(_ramp_len))
+    , has_dry(false)
     {
     }
     
@@ -27,6 +36,19 @@ public:
         return first_value >= 1 && next_value >= 1;
     }
     
+    /// Keep a copy of the unprocessed input for crossfade, for modules that
+    /// support in-place processing (the inputs are overwritten by the time
+    /// crossfade is called). Only copies while the ramp is in progress.
+    void save_dry(float *inputs[], uint32_t nbuffers, uint32_t offset, uint32_t nsamples)
+    {
+        has_dry = (first_value + next_value) != 0;
+        if (!has_dry)
+            return;
+        assert(nbuffers <= max_dry_channels && nsamples <= max_dry_samples);
+        for (uint32_t b = 0; b < nbuffers; ++b)
+            memcpy(dry[b], inputs[b] + offset, nsamples * sizeof(float));
+    }
+    
     /// Apply ramp to prevent clicking
     void crossfade(float *inputs[], float *outputs[], uint32_t nbuffers, uint32_t offset, uint32_t nsamples)
     {
@@ -35,7 +57,7 @@ public:
         float step = (next_value - first_value) / nsamples;
         for (uint32_t b = 0; b < nbuffers; ++b)
         {
-            float *out = outputs[b] + offset, *in = inputs[b] + offset;
+            float *out = outputs[b] + offset, *in = has_dry ? dry[b] : inputs[b] + offset;
             if (first_value >= 1 && next_value >= 1)
                 memcpy(out, in, nsamples * sizeof(float));
             else
@@ -47,6 +69,7 @@ public:
                 }
             }
         }
+        has_dry = false;
     }
 };
 
@@ -0,0 +1,141 @@
+/* Calf DSP Library
+ * Zero latency partitioned convolution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef CALF_CONVOLVER_H
+#define CALF_CONVOLVER_H
+
+#include <stdint.h>
+#include <string>
+#include "pffft.h"
+
+namespace dsp {
+
+/**
+ * Impulse response prepared for the convolver: the first HEAD taps as a
+ * direct form FIR, the rest split into partitions of growing size, stored
+ * as spectra. Read-only once built, so the instances that use the same file
+ * at the same sample rate share one copy (see acquire and release).
+ *
+ * Stage s handles the taps from stage_start[s] in partitions of
+ * stage_size[s] samples. A stage may only start at or after the end of its
+ * first block, which makes the whole convolution free of latency.
+ */
+class convolution_ir
+{
+public:
+    enum { HEAD = 64, STAGES = 3, MAX_CHANNELS = 2 };
+    /// Longest impulse response accepted, in samples at the target rate
+    enum { MAX_LENGTH = 1 << 21 };
+    static const unsigned stage_size[STAGES];
+    static const unsigned stage_start[STAGES];
+
+    struct stage
+    {
+        /// Partition size (half the FFT size)
+        unsigned size;
+        /// Index of the first partition, in units of size
+        unsigned first;
+        /// Number of partitions, 0 if the IR is too short to reach this stage
+        unsigned count;
+        PFFFT_Setup *setup;
+        /// count spectra of 2 * size floats per channel, scaled by 1 / (2 * size)
+        float *spectra;
+        inline const float *spectrum(unsigned channel, unsigned partition) const
+        {
+            return spectra + 2 * size * (channel * count + partition);
+        }
+    };
+
+    /// 1 (the same response for both channels) or 2
+    unsigned channels;
+    /// Length in samples
+    unsigned length;
+    /// Sample rate of the file, before resampling
+    uint32_t file_rate;
+    /// Sample rate the response has been resampled to
+    uint32_t srate;
+    /// Head taps, time reversed
+    float head[MAX_CHANNELS][HEAD];
+    stage stages[STAGES];
+
+    /// Load an impulse response from a WAVE file, resampled to srate if
+    /// needed, or reuse the one already loaded by another instance. Not
+    /// real-time safe. Returns NULL and sets error on failure.
+    static const convolution_ir *acquire(const std::string &file_name, uint32_t srate, std::string &error);
+    /// Drop a reference obtained with acquire. Not real-time safe.
+    static void release(const convolution_ir *ir);
+private:
+    std::string key;
+    int refs;
+
+    convolution_ir(const std::string &_key);
+    ~convolution_ir();
+    void build(float *const *data, unsigned channels, unsigned length);
+};
+
+/**
+ * Stereo convolution engine for one convolution_ir. All the buffers are
+ * allocated by the constructor, process does not allocate or lock.
+ *
+ * A stage whose partitions start two or more blocks in (first >= 2) doesn't
+ * need the result for a block of input until one block after it's complete,
+ * so its FFT work is spread evenly over the HEAD sized chunks of the
+ * following block. Only the smallest stage does all its work in the call
+ * that completes its block.
+ */
+class convolver
+{
+    struct stage_state
+    {
+        /// Last two blocks of input, per channel
+        float *input[convolution_ir::MAX_CHANNELS];
+        /// Output for the current block, per channel
+        float *output[convolution_ir::MAX_CHANNELS];
+        /// Output for the next block, being computed (spread stages only)
+        float *next[convolution_ir::MAX_CHANNELS];
+        /// Ring of the input spectra, fdl_size entries per channel
+        float *fdl[convolution_ir::MAX_CHANNELS];
+        float *accum, *work;
+        unsigned fdl_size, fdl_pos, pos;
+        /// FDL slot of the block being worked on, and the progress of that
+        /// work in steps (steps = nothing left to do)
+        unsigned job_slot, step, steps;
+    };
+    const convolution_ir *ir;
+    /// Previous HEAD - 1 input samples followed by the current chunk
+    float history[convolution_ir::MAX_CHANNELS][convolution_ir::HEAD * 2];
+    stage_state states[convolution_ir::STAGES];
+    unsigned phase;
+
+    void run_stage(unsigned s);
+    void run_step(unsigned s);
+    static inline bool is_spread(const convolution_ir::stage &is) { return is.first >= 2; }
+public:
+    /// Takes a reference to ir, which is released by the destructor
+    convolver(const convolution_ir *_ir);
+    ~convolver();
+    const convolution_ir *get_ir() const { return ir; }
+    void reset();
+    /// Convolve len samples. The outputs may be the same buffers as the inputs.
+    void process(const float *in_l, const float *in_r, float *out_l, float *out_r, unsigned len);
+};
+
+};
+
+#endif
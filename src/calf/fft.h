@@ -22,7 +22,13 @@
 #ifndef __CALF_FFT_H
 #define __CALF_FFT_H
 
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
 #include <complex>
+#include <vector>
+#include "pffft.h"
 
 namespace dsp {
 
@@ -173,6 +179,274 @@ public:
     }
 };
 
+/// FFT of a size chosen at runtime, following the same conventions as
+/// dsp::fft above (forward transform uses exp(+i), inverse transform is
+/// scaled by 1/N), so it can be used as a drop-in replacement.
+/// Backed by pffft (SIMD where available) for the sizes it supports,
+/// with a plain radix-2 implementation for the tiny ones it doesn't.
+/// Owns its scratch buffers, so an instance must not be shared between
+/// threads; set_order allocates, the transforms don't.
+class fft_engine
+{
+public:
+    typedef std::complex<float> complex;
+private:
+    int order, N;
+    PFFFT_Setup *real_setup, *complex_setup;
+    /// Aligned scratch space, 2*N floats each
+    float *buf, *work;
+    /// Tables for the radix-2 fallback
+    std::vector<int> scramble;
+    std::vector<complex> sines;
+
+    void release()
+    {
+        if (real_setup)
+            pffft_destroy_setup(real_setup);
+        if (complex_setup)
+            pffft_destroy_setup(complex_setup);
+        if (buf)
+            pffft_aligned_free(buf);
+        if (work)
+            pffft_aligned_free(work);
+        real_setup = complex_setup = NULL;
+        buf = work = NULL;
+        scramble.clear();
+        sines.clear();
+    }
+    static bool aligned(const void *ptr)
+    {
+        return !((uintptr_t)ptr & 15);
+    }
+    /// Same algorithm as dsp::fft::calculate, just with a runtime order
+    void calculate_radix2(const complex *input, complex *output, bool inverse) const
+    {
+        int N1 = N - 1;
+        int i;
+        if (inverse)
+        {
+            float mf = 1.0 / N;
+            for (i = 0; i < N; i++)
+            {
+                const complex &c = input[scramble[i]];
+                output[i] = mf * complex(c.imag(), c.real());
+            }
+        }
+        else
+            for (i = 0; i < N; i++)
+                output[i] = input[scramble[i]];
+        for (i = 0; i < order; i++)
+        {
+            int PO = 1 << i, PNO = 1 << (order - i - 1);
+            for (int j = 0; j < PNO; j++)
+            {
+                int base = j << (i + 1);
+                for (int k = 0; k < PO; k++)
+                {
+                    int B1 = base + k;
+                    int B2 = base + k + (1 << i);
+                    complex r1 = output[B1];
+                    complex r2 = output[B2];
+                    output[B1] = r1 + r2 * sines[(B1 << (order - i - 1)) & N1];
+                    output[B2] = r1 + r2 * sines[(B2 << (order - i - 1)) & N1];
+                }
+            }
+        }
+        if (inverse)
+        {
+            for (i = 0; i < N; i++)
+            {
+                const complex &c = output[i];
+                output[i] = complex(c.imag(), c.real());
+            }
+        }
+    }
+public:
+    fft_engine(int _order = 0)
+    : order(-1), N(0), real_setup(NULL), complex_setup(NULL), buf(NULL), work(NULL)
+    {
+        if (_order)
+            set_order(_order);
+    }
+    fft_engine(const fft_engine &src)
+    : order(-1), N(0), real_setup(NULL), complex_setup(NULL), buf(NULL), work(NULL)
+    {
+        if (src.order > 0)
+            set_order(src.order);
+    }
+    fft_engine &operator=(const fft_engine &src)
+    {
+        if (src.order != order)
+            set_order(src.order);
+        return *this;
+    }
+    ~fft_engine()
+    {
+        release();
+    }
+    /// Change transform size to 2^_order (not realtime safe)
+    void set_order(int _order)
+    {
+        assert(_order >= 2 && _order < 30);
+        release();
+        order = _order;
+        N = 1 << order;
+        buf = (float *)pffft_aligned_malloc(2 * N * sizeof(float));
+        work = (float *)pffft_aligned_malloc(2 * N * sizeof(float));
+        if (order >= 5)
+        {
+            real_setup = pffft_new_setup(N, PFFFT_REAL);
+            complex_setup = pffft_new_setup(N, PFFFT_COMPLEX);
+        }
+        if (real_setup && complex_setup)
+            return;
+        if (real_setup)
+            pffft_destroy_setup(real_setup);
+        if (complex_setup)
+            pffft_destroy_setup(complex_setup);
+        real_setup = complex_setup = NULL;
+        scramble.resize(N);
+        sines.resize(N);
+        for (int i = 0; i < N; i++)
+        {
+            int v = 0;
+            for (int j = 0; j < order; j++)
+                if (i & (1 << j))
+                    v += N >> (j + 1);
+            scramble[i] = v;
+        }
+        int N90 = N >> 2;
+        float divN = 2 * M_PI / N;
+        for (int i = 0; i < N90; i++)
+        {
+            float angle = divN * i;
+            float c = cos(angle), s = sin(angle);
+            sines[i + 3 * N90] = -(sines[i + N90] = complex(-s, c));
+            sines[i + 2 * N90] = -(sines[i] = complex(c, s));
+        }
+    }
+    int get_order() const { return order; }
+    int size() const { return N; }
+    /// Complex transform of N points, input and output may alias
+    void calculate(const complex *input, complex *output, bool inverse)
+    {
+        if (!complex_setup)
+        {
+            memcpy(work, input, N * sizeof(complex));
+            calculate_radix2((const complex *)work, output, inverse);
+            return;
+        }
+        // pffft's backward transform is exp(+i) and unscaled, which
+        // is exactly what dsp::fft calls the forward one
+        const float *src = (const float *)input;
+        float *dest = aligned(output) ? (float *)output : buf;
+        if (!aligned(input))
+        {
+            memcpy(dest, input, N * sizeof(complex));
+            src = dest;
+        }
+        pffft_transform_ordered(complex_setup, src, dest, work, inverse ? PFFFT_FORWARD : PFFFT_BACKWARD);
+        if (inverse)
+        {
+            float mf = 1.0 / N;
+            for (int i = 0; i < 2 * N; i++)
+                dest[i] *= mf;
+        }
+        if (dest != (float *)output)
+            memcpy(reinterpret_cast<float *>(output), dest, N * sizeof(complex));
+    }
+    /// Forward transform of N real samples into N/2 + 1 complex bins
+    /// (the remaining ones are complex conjugates of those)
+    void forward_real(const float *input, complex *output)
+    {
+        if (!real_setup)
+        {
+            complex *tmp = (complex *)work;
+            for (int i = 0; i < N; i++)
+                tmp[i] = input[i];
+            calculate_radix2(tmp, (complex *)buf, false);
+            memcpy(reinterpret_cast<float *>(output), buf, (N / 2 + 1) * sizeof(complex));
+            return;
+        }
+        const float *src = input;
+        if (!aligned(input))
+        {
+            memcpy(buf, input, N * sizeof(float));
+            src = buf;
+        }
+        pffft_transform_ordered(real_setup, src, buf, work, PFFFT_FORWARD);
+        // pffft packs DC and Nyquist into the first bin, and uses the
+        // opposite sign convention
+        output[0] = complex(buf[0], 0.f);
+        output[N / 2] = complex(buf[1], 0.f);
+        for (int i = 1; i < N / 2; i++)
+            output[i] = complex(buf[2 * i], -buf[2 * i + 1]);
+    }
+    /// Inverse of forward_real: N/2 + 1 bins of a conjugate-symmetric
+    /// spectrum into N real samples (scaled by 1/N)
+    void inverse_real(const complex *input, float *output)
+    {
+        if (!real_setup)
+        {
+            complex *tmp = (complex *)work;
+            for (int i = 0; i <= N / 2; i++)
+                tmp[i] = input[i];
+            for (int i = 1; i < N / 2; i++)
+                tmp[N - i] = conj(input[i]);
+            calculate_radix2(tmp, (complex *)buf, true);
+            for (int i = 0; i < N; i++)
+                output[i] = ((complex *)buf)[i].real();
+            return;
+        }
+        float mf = 1.0 / N;
+        buf[0] = input[0].real();
+        buf[1] = input[N / 2].real();
+        for (int i = 1; i < N / 2; i++)
+        {
+            buf[2 * i] = input[i].real();
+            buf[2 * i + 1] = -input[i].imag();
+        }
+        pffft_transform_ordered(real_setup, buf, buf, work, PFFFT_BACKWARD);
+        for (int i = 0; i < N; i++)
+            output[i] = buf[i] * mf;
+    }
+    /// Forward real transform with the output layout of dsp::fft::execute_r2r
+    /// (real parts from the start, imaginary parts mirrored from the end)
+    void execute_r2r(const float *input, float *output)
+    {
+        complex *tmp = (complex *)buf;
+        if (real_setup)
+        {
+            const float *src = input;
+            if (!aligned(input))
+            {
+                memcpy(buf, input, N * sizeof(float));
+                src = buf;
+            }
+            pffft_transform_ordered(real_setup, src, buf, work, PFFFT_FORWARD);
+            output[0] = buf[0];
+            output[N / 2] = 0.f;
+            for (int i = 1; i < N / 2; i++)
+            {
+                output[i] = buf[2 * i];
+                output[N - 1 - i] = -buf[2 * i + 1];
+            }
+            return;
+        }
+        complex *data = (complex *)work;
+        for (int i = 0; i < N; i++)
+            data[i] = input[i];
+        calculate_radix2(data, tmp, false);
+        output[0] = tmp[0].real();
+        output[N / 2] = tmp[0].imag();
+        for (int i = 1; i < N / 2; i++)
+        {
+            output[i] = tmp[i].real();
+            output[N - 1 - i] = tmp[i].imag();
+        }
+    }
+};
+
 };
 
 #endif
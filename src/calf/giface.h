@@ -38,6 +38,12 @@ enum {
     MAX_SAMPLE_RUN = 256
 };
 
+/// Default for how often process_slice checks the plugin's inputs and
+/// outputs for NaN/infinity/huge values: every Nth call (1 = always, 0 = never)
+#ifndef CALF_SANITY_CHECK_INTERVAL
+#define CALF_SANITY_CHECK_INTERVAL 1
+#endif
+
 struct automation_range;
 
 /// Values ORed together for flags field in parameter_properties
@@ -330,7 +336,7 @@ struct ladspa_plugin_info
 /// An interface returning metadata about a plugin
 struct plugin_metadata_iface
 {
-    enum { simulate_stereo_input = true, has_live_updates = true };
+    enum { simulate_stereo_input = true, has_live_updates = true, inplace_safe = false };
     /// @return plugin long name
     virtual const char *get_name() const = 0;
     /// @return plugin LV2 label
@@ -379,6 +385,8 @@ struct plugin_metadata_iface
     virtual bool get_simulate_stereo_input() const = 0;
     /// @return whether live UI events are generated
     virtual bool sends_live_updates() const = 0;
+    /// @return whether the plugin works correctly with an input and an output port sharing the same buffer
+    virtual bool is_inplace_safe() const = 0;
 
     /// Do-nothing destructor to silence compiler warning
     virtual ~plugin_metadata_iface() {}
@@ -457,6 +465,17 @@ public:
 /// Load and strdup a text file with GUI definition
 extern char *load_gui_xml(const std::string &plugin_id);
 
+/// Value of a configure variable parsed outside of the audio thread, see
+/// audio_module_iface::prepare_configure
+struct configure_state
+{
+    /// Store the value in the module. Called in the audio thread, so it
+    /// must not parse, allocate or free anything.
+    virtual void apply() = 0;
+    /// The object is deleted outside of the audio thread, after apply
+    virtual ~configure_state() {}
+};
+
 /// Interface to audio processing plugins (the real things, not only metadata)
 struct audio_module_iface
 {
@@ -476,6 +495,8 @@ struct audio_module_iface
     virtual void channel_pressure(int channel, int value) = 0;
     /// Called when params are changed (before processing)
     virtual void params_changed() = 0;
+    /// Call params_changed if any input parameter has changed since the last check (or always if force is true); returns true if it was called
+    virtual bool check_params_changed(bool force) = 0;
     /// LADSPA-esque activate function, except it is called after ports are connected, not before
     virtual void activate() = 0;
     /// LADSPA-esque deactivate function
@@ -486,6 +507,10 @@ struct audio_module_iface
     virtual void execute(int cmd_no) = 0;
     /// DSSI configure call, value = NULL = reset to default
     virtual char *configure(const char *key, const char *value) = 0;
+    /// Parse a configure call outside of the audio thread, into an object
+    /// that can be applied in the audio thread later; NULL if the module
+    /// does not support that for the key (then configure has to be used)
+    virtual configure_state *prepare_configure(const char *key, const char *value) = 0;
     /// Send all understood configure vars (none by default)
     virtual void send_configures(send_configure_iface *sci) = 0;
     /// Send all supported status vars (none by default)
@@ -500,6 +525,8 @@ struct audio_module_iface
     virtual const plugin_metadata_iface *get_metadata_iface() const = 0;
     /// Set the progress report interface to communicate progress to
     virtual void set_progress_report_iface(progress_report_iface *iface) = 0;
+    /// Check the inputs and outputs in process_slice only on every Nth call (1 = always, 0 = never)
+    virtual void set_sanity_check_interval(uint32_t interval) = 0;
     /// Clear a part of output buffers that have 0s at mask; subdivide the buffer so that no runs > MAX_SAMPLE_RUN are fed to process function
     virtual uint32_t process_slice(uint32_t offset, uint32_t end) = 0;
     /// The audio processing loop; assumes numsamples <= MAX_SAMPLE_RUN, for larger buffers, call process_slice
@@ -527,6 +554,19 @@ public:
     float *params[Metadata::param_count];
     bool questionable_data_reported_in;
     bool questionable_data_reported_out;
+    /// Number of process_slice calls skipped because of questionable input, and of questionable outputs zeroed
+    volatile uint32_t questionable_inputs, questionable_outputs;
+    /// Status serial for the counters above
+    volatile int questionable_data_serial;
+    uint32_t sanity_check_interval, sanity_check_countdown;
+    /// Input parameter values seen by the last check_params_changed call
+    float params_snapshot[(Metadata::param_count != 0) ? Metadata::param_count : 1];
+    /// One bit per parameter that changed between the last two check_params_changed calls
+    uint32_t params_dirty[(Metadata::param_count + 31) / 32 + 1];
+    /// params_snapshot holds valid values
+    bool params_snapshot_valid;
+    /// params_dirty is only meaningful during params_changed called from check_params_changed
+    bool params_dirty_valid;
 
     progress_report_iface *progress_report;
 
@@ -537,6 +577,12 @@ public:
         memset(params, 0, sizeof(params));
         questionable_data_reported_in = false;
         questionable_data_reported_out = false;
+        questionable_inputs = questionable_outputs = 0;
+        questionable_data_serial = 0;
+        sanity_check_interval = CALF_SANITY_CHECK_INTERVAL;
+        sanity_check_countdown = 0;
+        params_snapshot_valid = false;
+        params_dirty_valid = false;
     }
 
     /// Handle MIDI Note On
@@ -555,6 +601,42 @@ public:
     void channel_pressure(int channel, int value) {}
     /// Called when params are changed (before processing)
     void params_changed() {}
+    /// Compare the input parameters with the values seen last time, and call
+    /// params_changed if any of them differ. Inside that call, is_param_dirty
+    /// tells which ones did; in calls made from anywhere else (activate etc.)
+    /// all the parameters count as changed.
+    virtual bool check_params_changed(bool force) {
+        bool any = !params_snapshot_valid;
+        memset(params_dirty, any ? 0xFF : 0, sizeof(params_dirty));
+        for (int i = 0; i < Metadata::param_count; i++) {
+            if (!params[i] || (Metadata::param_props[i].flags & PF_PROP_OUTPUT))
+                continue;
+            float value = *params[i];
+            if (value != params_snapshot[i] || !params_snapshot_valid) {
+                params_snapshot[i] = value;
+                params_dirty[i >> 5] |= 1u << (i & 31);
+                any = true;
+            }
+        }
+        params_snapshot_valid = true;
+        if (!any && !force)
+            return false;
+        params_dirty_valid = !force;
+        params_changed();
+        params_dirty_valid = false;
+        return true;
+    }
+    /// Whether parameter param_no has changed (see check_params_changed)
+    inline bool is_param_dirty(int param_no) const {
+        return !params_dirty_valid || (params_dirty[param_no >> 5] & (1u << (param_no & 31)));
+    }
+    /// Whether any of the parameters first..last (inclusive) has changed
+    inline bool is_param_range_dirty(int first, int last) const {
+        for (int i = first; i <= last; i++)
+            if (is_param_dirty(i))
+                return true;
+        return false;
+    }
     /// LADSPA-esque activate function, except it is called after ports are connected, not before
     void activate() {}
     /// LADSPA-esque deactivate function
@@ -565,10 +647,22 @@ public:
     void execute(int cmd_no) {}
     /// DSSI configure call
     virtual char *configure(const char *key, const char *value) { return NULL; }
+    /// Off-thread configure (not supported by default)
+    virtual configure_state *prepare_configure(const char *key, const char *value) { return NULL; }
     /// Send all understood configure vars (none by default)
     void send_configures(send_configure_iface *sci) {}
-    /// Send all supported status vars (none by default)
-    int send_status_updates(send_updates_iface *sui, int last_serial) { return last_serial; }
+    /// Send all supported status vars (only the counters of questionable input/output data by default)
+    int send_status_updates(send_updates_iface *sui, int last_serial) {
+        int serial = questionable_data_serial;
+        if (serial != last_serial) {
+            char buf[16];
+            sprintf(buf, "%u", questionable_inputs);
+            sui->send_status("questionable_inputs", buf);
+            sprintf(buf, "%u", questionable_outputs);
+            sui->send_status("questionable_outputs", buf);
+        }
+        return serial;
+    }
     /// Reset parameter values for epp:trigger type parameters (ones activated by oneshot push button instead of check box)
     void params_reset() {}
     /// Called after instantiating (after all the feature pointers are set - including interfaces like progress_report_iface)
@@ -590,6 +684,7 @@ public:
     virtual const plugin_metadata_iface *get_metadata_iface() const { return this; }
     /// Set the progress report interface to communicate progress to
     virtual void set_progress_report_iface(progress_report_iface *iface) { progress_report = iface; }
+    virtual void set_sanity_check_interval(uint32_t interval) { sanity_check_interval = interval; sanity_check_countdown = 0; }
 
     /// utility function: zero port values if mask is 0
     inline void zero_by_mask(uint32_t mask, uint32_t offset, uint32_t nsamples)
@@ -600,55 +695,57 @@ public:
             }
         }
     }
-    /// utility function: call process, and if it returned zeros in output masks, zero out the relevant output port buffers
+    /// utility function: call process, and if it returned zeros in output masks, zero out the relevant output port buffers;
+    /// also refuses to process NaN/infinite/huge input and zeroes such output (checked every sanity_check_interval calls)
     uint32_t process_slice(uint32_t offset, uint32_t end)
     {
+        bool check = false;
+        if (sanity_check_interval && !sanity_check_countdown--) {
+            sanity_check_countdown = sanity_check_interval - 1;
+            check = true;
+        }
         bool had_errors = false;
-        for (int i=0; i<Metadata::in_count; ++i) {
-            float *indata = ins[i];
-            if (indata) {
-                float errval = 0;
-                for (uint32_t j = offset; j < end; j++)
-                {
-                    if (!std::isfinite(indata[j]) || fabs(indata[j]) > 4294967296.0) {
-                        errval = indata[j];
-                        had_errors = true;
-                    }
-                }
-                if (had_errors && !questionable_data_reported_in) {
-                    fprintf(stderr, "Warning: Plugin %s got questionable value %f on its input %d\n", Metadata::get_name(), errval, i);
+        if (check) {
+            for (int i=0; i<Metadata::in_count; ++i) {
+                if (!ins[i])
+                    continue;
+                int pos = dsp::find_questionable(ins[i] + offset, end - offset);
+                if (pos == -1)
+                    continue;
+                if (!questionable_data_reported_in) {
+                    fprintf(stderr, "Warning: Plugin %s got questionable value %f on its input %d\n", Metadata::get_name(), ins[i][offset + pos], i);
                     questionable_data_reported_in = true;
                 }
+                had_errors = true;
+            }
+            if (had_errors) {
+                questionable_inputs++;
+                questionable_data_serial++;
             }
         }
         uint32_t total_out_mask = 0;
-        while(offset < end)
+        for (uint32_t pos = offset; pos < end; )
         {
-            uint32_t newend = std::min(offset + MAX_SAMPLE_RUN, end);
-            uint32_t out_mask = !had_errors ? process(offset, newend - offset, -1, -1) : 0;
+            uint32_t newend = std::min(pos + MAX_SAMPLE_RUN, end);
+            uint32_t out_mask = !had_errors ? process(pos, newend - pos, -1, -1) : 0;
             total_out_mask |= out_mask;
-            zero_by_mask(out_mask, offset, newend - offset);
-            offset = newend;
+            zero_by_mask(out_mask, pos, newend - pos);
+            pos = newend;
         }
-        for (int i=0; i<Metadata::out_count; ++i) {
-            if (total_out_mask & (1 << i))
-            {
-                had_errors = false;
-                float *outdata = outs[i];
-                float errval = 0;
-                for (uint32_t j = offset; j < end; j++)
-                {
-                    if (!std::isfinite(outdata[j]) || fabs(outdata[j]) > 4294967296.0) {
-                        errval = outdata[j];
-                        had_errors = true;
-                    }
-                }
-                if (had_errors && !questionable_data_reported_out) {
-                    fprintf(stderr, "Warning: Plugin %s generated questionable value %f on its output %d - this is most likely a bug in the plugin!\n", Metadata::get_name(), errval, i);
+        if (check) {
+            for (int i=0; i<Metadata::out_count; ++i) {
+                if (!outs[i] || !(total_out_mask & (1 << i)))
+                    continue;
+                int pos = dsp::find_questionable(outs[i] + offset, end - offset);
+                if (pos == -1)
+                    continue;
+                if (!questionable_data_reported_out) {
+                    fprintf(stderr, "Warning: Plugin %s generated questionable value %f on its output %d - this is most likely a bug in the plugin!\n", Metadata::get_name(), outs[i][offset + pos], i);
                     questionable_data_reported_out = true;
                 }
-                if (had_errors)
-                    dsp::zero(outs[i] + offset, end - offset);
+                dsp::zero(outs[i] + offset, end - offset);
+                questionable_outputs++;
+                questionable_data_serial++;
             }
         }
         return total_out_mask;
@@ -734,6 +831,7 @@ public:
     const ladspa_plugin_info &get_plugin_info() const { return plugin_info; }
     bool get_simulate_stereo_input() const { return Metadata::simulate_stereo_input; }
     bool sends_live_updates() const { return Metadata::has_live_updates; }
+    bool is_inplace_safe() const { return Metadata::inplace_safe; }
 };
 
 #define CALF_PORT_NAMES(name) template<> const char *calf_plugins::plugin_metadata<name##_metadata>::port_names[]
@@ -28,6 +28,8 @@
 #include "utils.h"
 #include "vumeter.h"
 #include <pthread.h>
+#include <atomic>
+#include <functional>
 #include <jack/jack.h>
 #include <jack/session.h>
 
@@ -47,22 +49,130 @@ struct automation_iface
     virtual ~automation_iface() {}
 };
 
+/// Ordering constraints between the plugins of a jack_client, indexed
+/// by position in the (already topologically sorted) plugin list
+struct plugin_graph
+{
+    /// For each plugin, the plugins that may only start after it has finished
+    std::vector<std::vector<int> > dependents;
+    /// For each plugin, the number of plugins it has to wait for
+    std::vector<int> dependency_count;
+    
+    void resize(int count) { dependents.clear(); dependents.resize(count); dependency_count.clear(); dependency_count.resize(count); }
+    int size() const { return dependency_count.size(); }
+};
+
+/// Snapshot of the plugin list of a jack_client, as seen by the process
+/// callback. Never modified once published (except for the scheduler's
+/// scratch space) - any change to the rack publishes a new snapshot, and
+/// the old one is freed once no process cycle can be using it anymore.
+struct plugin_list
+{
+    std::vector<jack_host *> plugins;
+    /// Dependency graph for the parallel scheduler, empty if not known for this list
+    plugin_graph graph;
+    /// Per plugin: dependencies not processed yet in the current cycle
+    std::atomic<int> *pending;
+    /// Plugins ready to run, in the order they became ready (-1 = slot reserved but not filled yet)
+    std::atomic<int> *ready;
+    
+    plugin_list(const std::vector<jack_host *> &_plugins) : plugins(_plugins), pending(NULL), ready(NULL) {}
+    ~plugin_list() { delete []pending; delete []ready; }
+    /// Attach a dependency graph (before publishing), allocates the scheduler's scratch space
+    void set_graph(plugin_graph &new_graph);
+};
+
+/// Runs independent branches of a plugin graph in parallel, on the JACK
+/// process thread plus a pool of realtime worker threads. The per-cycle
+/// handoff uses atomic dependency counters and a futex wakeup only, the
+/// process thread never blocks on a lock held by a worker.
+class parallel_scheduler
+{
+    struct worker
+    {
+        parallel_scheduler *owner;
+        pthread_t thread;
+    };
+    std::atomic<int> ready_read, ready_write, remaining;
+    /// Cycle counter, odd while a cycle is being processed; also the futex word the workers sleep on
+    std::atomic<int> cycle;
+    std::atomic<int> active, sleepers;
+    std::atomic<bool> quit;
+    /// Current cycle's parameters, written before the cycle is opened
+    plugin_list *cycle_list;
+    jack_nframes_t cycle_nframes;
+    /// Buffer of the automation MIDI port, fetched by the JACK thread
+    void *cycle_automation_buffer;
+    std::vector<worker> workers;
+    
+    void push_ready(int plugin);
+    int pop_ready();
+    void run_plugins();
+    void worker_loop();
+    static void *worker_thread(void *arg);
+public:
+    parallel_scheduler();
+    ~parallel_scheduler();
+    /// Create the worker threads (not realtime safe)
+    void start(jack_client_t *client, int threads);
+    /// Stop and join the worker threads (not realtime safe)
+    void stop();
+    /// True if the workers are running and the list has a graph to schedule by
+    bool is_usable(const plugin_list &list) const { return !workers.empty() && list.plugins.size() > 1 && list.graph.size() == (int)list.plugins.size(); }
+    /// Process one JACK cycle, returns when all plugins have been processed.
+    /// automation_buffer is the automation port's buffer for this cycle
+    /// (jack_port_get_buffer is only called from the JACK thread).
+    void process(plugin_list &list, jack_nframes_t nframes, void *automation_buffer);
+};
+
 class jack_client {
 protected:
+    /// Master copy of the plugin list, only used outside of the process callback
     std::vector<jack_host *> plugins;
+    /// Serializes changes to the rack (the process callback doesn't use it)
     calf_utils::ptmutex mutex;
+    /// The snapshot currently used by the process callback
+    std::atomic<plugin_list *> current_list;
+    /// Process cycles started and completed, used to tell when retired objects are safe to free
+    std::atomic<unsigned int> cycles_started, cycles_finished;
+    /// Objects removed from the rack, to be freed once the process callback can't see them anymore
+    struct garbage_item
+    {
+        unsigned int cycle;
+        std::function<void()> release;
+    };
+    std::vector<garbage_item> garbage;
+    /// Protects garbage - retire is also called from outside the rack mutex
+    /// (e.g. jack_host::replace_automation_map from the GUI or OSC threads)
+    calf_utils::ptmutex garbage_mutex;
+    bool jack_active;
 
     /// Common port for MIDI parameter automation
     jack_port_t *automation_port;
+    
+    /// Worker threads for running the rack in parallel (0 = process serially)
+    int worker_threads;
+    parallel_scheduler scheduler;
+    /// Retrieve producer/consumer pairs of plugins connected to each other, as (consumer, producer)
+    void get_plugin_connections(std::multimap<int, int> &run_before);
+    /// Make a new snapshot current, and retire the old one
+    void publish(plugin_list *list);
+    void retire_func(const std::function<void()> &release);
+    static int do_jack_graph_order(void *p);
 
 public:
     jack_client_t *client;
     int input_nr, output_nr, midi_nr;
     std::string name, input_name, output_name, midi_name;
     int sample_rate;
+    /// Set by JACK when connections change, the plugin graph needs updating
+    volatile bool graph_changed;
 
     jack_client();
+    ~jack_client();
     void add(jack_host *plugin);
+    /// Remove the plugin from the rack and take its ownership - it will be
+    /// deleted by collect_garbage once the process callback is done with it
     void del(jack_host *plugin);
     void open(const char *client_name, const char *jack_session_id);
     std::string get_name();
@@ -75,16 +185,24 @@ public:
     void close();
     void apply_plugin_order(const std::vector<int> &indices);
     void calculate_plugin_order(std::vector<int> &indices);
+    /// Set the number of worker threads for parallel processing, takes effect on activate()
+    void set_worker_threads(int threads) { worker_threads = threads; }
+    /// Rebuild the dependency graph used by the parallel scheduler from the current connections
+    void update_plugin_graph();
+    /// Delete an object that the process callback may still be using, once it's safe to do so
+    template<class T>
+    void retire(T *ptr)
+    {
+        if (ptr)
+            retire_func([ptr]() { delete ptr; });
+    }
+    /// Free the retired objects the process callback is done with (call from the idle loop).
+    /// If wait is true, wait for the process callback to finish with all of them first.
+    void collect_garbage(bool wait = false);
     const char **get_ports(const char *name_re, const char *type_re, unsigned long flags);
     
     static int do_jack_process(jack_nframes_t nframes, void *p);
     static int do_jack_bufsize(jack_nframes_t numsamples, void *p);
-    template<class T>
-    void atomic_swap(T &v1, T &v2)
-    {
-        calf_utils::ptlock lock(mutex);
-        std::swap(v1, v2);
-    }
 };
 
 class jack_host: public plugin_ctl_iface {
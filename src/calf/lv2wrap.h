@@ -32,8 +32,10 @@
 #include <calf/lv2_midi.h>
 #include <calf/lv2_state.h>
 #include <calf/lv2_options.h>
+#include <calf/lv2_patch.h>
 #include <calf/lv2_progress.h>
 #include <calf/lv2_urid.h>
+#include <calf/lv2_worker.h>
 #include <string.h>
 
 namespace calf_plugins {
@@ -48,8 +50,11 @@ struct lv2_instance: public plugin_ctl_iface, public progress_report_iface
     uint32_t event_out_capacity;
     LV2_URID_Map *urid_map;
     uint32_t midi_event_type, property_type, string_type, sequence_type;
+    uint32_t object_type, blank_type, urid_type, float_type, double_type, int_type, bool_type;
+    uint32_t patch_set_type, patch_property, patch_value;
     LV2_Progress *progress_report_feature;
     LV2_Options_Interface *options_feature;
+    LV2_Worker_Schedule *worker_schedule;
     float **ins, **outs, **params;
     int in_count;
     int out_count;
@@ -61,6 +66,36 @@ struct lv2_instance: public plugin_ctl_iface, public progress_report_iface
     };
     std::vector<lv2_var> vars;
     std::map<uint32_t, int> uri_to_var;
+    /// Control port buffers as connected by the host (params may point to automated_values instead)
+    std::vector<float *> port_params;
+    /// Parameter values set by patch:Set events, used until the control port value changes
+    std::vector<float> automated_values;
+    /// Control port values at the time the automation took over
+    std::vector<float> automated_port_values;
+    std::vector<bool> automated;
+    int automated_count;
+    /// Set when a patch:Set event changed a value since the last check_params_changed
+    bool automation_pending;
+    /// Maps parameter URIs (plugin URI + "#param_" + short name) to parameter indices
+    std::map<uint32_t, int> uri_to_param;
+    /// Parameter events closer than this to the start of the current slice don't split it
+    uint32_t min_slice;
+    /// Message passed between run() and the worker
+    struct work_message
+    {
+        enum kind {
+            /// Parse configure variable var (the value follows the message, NUL terminated)
+            configure_var,
+            /// Apply the state prepared by the worker (response)
+            apply_state,
+            /// Delete a state that has been applied
+            free_state,
+        } type;
+        int var;
+        configure_state *state;
+    };
+    /// Buffer for the messages to the worker, so that run() doesn't need to allocate
+    std::vector<char> work_buffer;
 
     lv2_instance(audio_module_iface *_module);
     void lv2_instantiate(const LV2_Descriptor * Descriptor, double sample_rate, const char *bundle_path, const LV2_Feature *const *features);
@@ -107,8 +142,16 @@ struct lv2_instance: public plugin_ctl_iface, public progress_report_iface
     void output_event_property(const char *key, const char *value);
     void process_event_string(const char *str);
     void process_event_property(const LV2_Atom_Property *prop);
+    bool is_patch_set(const LV2_Atom *atom) const;
+    void process_event_patch_set(const LV2_Atom_Object *obj);
+    void set_automated_value(int param_no, float value);
+    void connect_param(int param_no, float *data);
+    /// Check for parameter changes caused by patch:Set events, then process a slice
+    void run_slice(uint32_t from, uint32_t to);
     void process_events(uint32_t &offset);
     void run(uint32_t SampleCount, bool has_simulate_stereo_input_flag);
+    LV2_Worker_Status work(LV2_Worker_Respond_Function respond, LV2_Worker_Respond_Handle handle, uint32_t size, const void *data);
+    LV2_Worker_Status work_response(uint32_t size, const void *data);
     virtual float get_param_value(int param_no)
     {
         // XXXKF hack
@@ -151,6 +194,7 @@ struct lv2_wrapper
     static LV2_Descriptor descriptor;
     static LV2_Calf_Descriptor calf_descriptor;
     static LV2_State_Interface state_iface;
+    static LV2_Worker_Interface worker_iface;
     std::string uri;
     
     lv2_wrapper()
@@ -167,6 +211,9 @@ struct lv2_wrapper
         descriptor.extension_data = cb_ext_data;
         state_iface.save = cb_state_save;
         state_iface.restore = cb_state_restore;
+        worker_iface.work = cb_work;
+        worker_iface.work_response = cb_work_response;
+        worker_iface.end_run = NULL;
         calf_descriptor.get_pci = cb_get_pci;
     }
 
@@ -185,8 +232,7 @@ struct lv2_wrapper
         else if (port < ins + outs)
             mod->outs[port - ins] = (float *)DataLocation;
         else if (port < ins + outs + params) {
-            int i = port - ins - outs;
-            mod->params[i] = (float *)DataLocation;
+            mod->connect_param(port - ins - outs, (float *)DataLocation);
         }
         else if (has_event_in && port == ins + outs + params) {
             mod->event_in_data = (LV2_Atom_Sequence *)DataLocation;
@@ -237,8 +283,20 @@ struct lv2_wrapper
             return &calf_descriptor;
         if (!strcmp(URI, LV2_STATE__interface))
             return &state_iface;
+        if (!strcmp(URI, LV2_WORKER__interface))
+            return &worker_iface;
         return NULL;
     }
+    static LV2_Worker_Status cb_work(LV2_Handle Instance, LV2_Worker_Respond_Function respond, LV2_Worker_Respond_Handle handle, uint32_t size, const void *data)
+    {
+        instance *const inst = (instance *)Instance;
+        return inst->work(respond, handle, size, data);
+    }
+    static LV2_Worker_Status cb_work_response(LV2_Handle Instance, uint32_t size, const void *data)
+    {
+        instance *const inst = (instance *)Instance;
+        return inst->work_response(size, data);
+    }
     static LV2_State_Status cb_state_save(
         LV2_Handle Instance, LV2_State_Store_Function store, LV2_State_Handle handle,
         uint32_t flags, const LV2_Feature *const * features)
@@ -59,6 +59,7 @@ struct filter_metadata: public plugin_metadata<filter_metadata>
         STEREO_VU_METER_PARAMS,
         param_count };
     enum { in_count = 2, out_count = 2, ins_optional = 0, outs_optional = 0, rt_capable = true, require_midi = false, support_midi = false, require_instance_access = false };
+    enum { inplace_safe = true };
     PLUGIN_NAME_ID_LABEL("filter", "filter", "Filter")
     /// do not export mode and inertia as CVs, as those are settings and not parameters
     bool is_cv(int param_no) const { return param_no != par_mode && param_no != par_inertia; }
@@ -97,11 +98,25 @@ struct reverb_metadata: public plugin_metadata<reverb_metadata>
            par_decay, par_hfdamp, par_roomsize, par_diffusion, par_amount, par_dry, par_predelay, par_basscut, par_treblecut, par_on,
            param_level_in, param_level_out,
            param_meter_outL, param_meter_outR, param_clip_inL, param_clip_inR, param_clip_outR,
+           par_engine, par_hf_decay,
            param_count };
+    enum { engine_allpass, engine_fdn };
     enum { in_count = 2, out_count = 2, ins_optional = 0, outs_optional = 0, support_midi = false, require_midi = false, rt_capable = true, require_instance_access = false };
     PLUGIN_NAME_ID_LABEL("reverb", "reverb", "Reverb")
 };
 
+struct convolution_metadata: public plugin_metadata<convolution_metadata>
+{
+    enum { param_bypass, param_level_in, param_level_out,
+           STEREO_VU_METER_PARAMS,
+           param_dry, param_wet, param_ir_length,
+           param_count };
+    enum { in_count = 2, out_count = 2, ins_optional = 0, outs_optional = 0, support_midi = false, require_midi = false, rt_capable = true, require_instance_access = false };
+    enum { inplace_safe = true };
+    PLUGIN_NAME_ID_LABEL("convolution", "convolution", "Convolution Reverb")
+    void get_configure_vars(std::vector<std::string> &names) const;
+};
+
 struct vintage_delay_metadata: public plugin_metadata<vintage_delay_metadata>
 {
     enum {  param_on, param_level_in, param_level_out,
@@ -241,6 +256,7 @@ struct monosynth_metadata: public plugin_metadata<monosynth_metadata>
 struct compressor_metadata: public plugin_metadata<compressor_metadata>
 {
     enum { in_count = 2, out_count = 2, ins_optional = 0, outs_optional = 0, support_midi = false, require_midi = false, rt_capable = true, require_instance_access = false };
+    enum { inplace_safe = true };
     enum { param_bypass, param_level_in, MONO_VU_METER_PARAMS,
            param_threshold, param_ratio, param_attack, param_release, param_makeup, param_knee, param_detection, param_stereo_link, param_compression, param_mix,
            param_count };
@@ -349,6 +365,7 @@ struct multibandgate_metadata: public plugin_metadata<multibandgate_metadata>
 struct limiter_metadata: public plugin_metadata<limiter_metadata>
 {
     enum { in_count = 2, out_count = 2, ins_optional = 0, outs_optional = 0, support_midi = false, require_midi = false, rt_capable = true, require_instance_access = false };
+    enum { inplace_safe = true };
     enum { param_bypass, param_level_in, param_level_out,
            STEREO_VU_METER_PARAMS,
            param_limit, param_attack, param_release,
@@ -356,6 +373,7 @@ struct limiter_metadata: public plugin_metadata<limiter_metadata>
            param_asc, param_asc_led, param_asc_coeff,
            param_oversampling,
            param_auto_level,
+           param_engine, param_true_peak,
            param_count };
     PLUGIN_NAME_ID_LABEL("limiter", "limiter", "Limiter")
 };
@@ -377,6 +395,7 @@ struct multibandlimiter_metadata: public plugin_metadata<multibandlimiter_metada
            param_asc, param_asc_led, param_asc_coeff,
            param_oversampling,
            param_auto_level,
+           param_engine, param_true_peak,
            param_count };
     PLUGIN_NAME_ID_LABEL("multibandlimiter", "multibandlimiter", "Multiband Limiter")
 };
@@ -399,6 +418,7 @@ struct sidechainlimiter_metadata: public plugin_metadata<sidechainlimiter_metada
            param_asc, param_asc_led, param_asc_coeff,
            param_oversampling, param_level_sc,
            param_auto_level,
+           param_engine, param_true_peak,
            param_count };
     PLUGIN_NAME_ID_LABEL("sidechainlimiter", "sidechainlimiter", "Sidechain Limiter")
 };
@@ -416,6 +436,7 @@ struct emphasis_metadata: public plugin_metadata<emphasis_metadata>
 struct equalizer5band_metadata: public plugin_metadata<equalizer5band_metadata>
 {
     enum { in_count = 2, out_count = 2, ins_optional = 0, outs_optional = 0, support_midi = false, require_midi = false, rt_capable = true, require_instance_access = false };
+    enum { inplace_safe = true };
     enum { param_bypass, param_level_in, param_level_out,
            STEREO_VU_METER_PARAMS,
            param_ls_active, param_ls_level, param_ls_freq, param_ls_q,
@@ -436,6 +457,7 @@ struct equalizer5band_metadata: public plugin_metadata<equalizer5band_metadata>
 struct equalizer8band_metadata: public plugin_metadata<equalizer8band_metadata>
 {
     enum { in_count = 2, out_count = 2, ins_optional = 0, outs_optional = 0, support_midi = false, require_midi = false, rt_capable = true, require_instance_access = false };
+    enum { inplace_safe = true };
     enum { param_bypass, param_level_in, param_level_out,
            STEREO_VU_METER_PARAMS,
            param_hp_active, param_hp_freq, param_hp_mode, param_hp_q,
@@ -455,6 +477,7 @@ struct equalizer8band_metadata: public plugin_metadata<equalizer8band_metadata>
 struct equalizer12band_metadata: public plugin_metadata<equalizer12band_metadata>
 {
     enum { in_count = 2, out_count = 2, ins_optional = 0, outs_optional = 0, support_midi = false, require_midi = false, rt_capable = true, require_instance_access = false };
+    enum { inplace_safe = true };
     enum { param_bypass, param_level_in, param_level_out,
            STEREO_VU_METER_PARAMS,
            param_hp_active, param_hp_freq, param_hp_mode, param_hp_q,
@@ -681,6 +704,7 @@ struct ringmodulator_metadata: public plugin_metadata<ringmodulator_metadata>
 struct saturator_metadata: public plugin_metadata<saturator_metadata>
 {
     enum { in_count = 2, out_count = 2, ins_optional = 1, outs_optional = 1, support_midi = false, require_midi = false, rt_capable = true, require_instance_access = false };
+    enum { inplace_safe = true };
     enum { param_bypass, param_level_in, param_level_out,
            STEREO_VU_METER_PARAMS,
            param_mix, param_drive, param_blend,
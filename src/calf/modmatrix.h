@@ -22,7 +22,9 @@
 #define __CALF_MODMATRIX_H
  
 #include "giface.h"
+#include <atomic>
 #include <stdio.h>
+#include <vector>
 
 namespace dsp {
 
@@ -74,34 +76,121 @@ protected:
     /// Polynomials for different scaling modes (1, x, x^2)
     static const float scaling_coeffs[calf_plugins::mod_matrix_metadata::map_type_count][3];
 
+    /// Matrix row reduced to dest += (c0 + c1 * x + c2 * x^2) * y, x = modsrc[src1], y = modsrc[src2]
+    /// (the amount is folded into the coefficients)
+    struct plan_row
+    {
+        int src1, src2;
+        float c0, c1, c2;
+    };
+    /// Rows of the matrix that can change the outputs, grouped by destination
+    std::vector<plan_row> plan_rows;
+    /// Destinations that have rows in the plan, and the end of the destination's rows in plan_rows
+    std::vector<std::pair<int, int> > plan_dests;
+    /// Destinations that were modulated by an earlier plan but not by the current one
+    std::vector<int> plan_stale;
+    /// Number of used entries in the three vectors above (which are allocated in advance)
+    int plan_row_count, plan_dest_count, plan_stale_count;
+    /// Destinations that are either modulated now or in plan_stale
+    std::vector<bool> plan_touched;
+    /// Set when the matrix has been changed and the plan needs to be rebuilt
+    std::atomic<bool> plan_dirty;
+
+    /// Rebuild the plan from the matrix rows
+    void compile_plan();
+    /// Rebuild the plan if the matrix has changed. Must be called by the
+    /// audio thread while no voice is calculating the matrix (at the start
+    /// of process, before the voice threads are started), as the
+    /// calculate_modmatrix functions read the plan without any locking.
+    inline void check_plan()
+    {
+        if (plan_dirty.load(std::memory_order_relaxed) && plan_dirty.exchange(false, std::memory_order_acquire))
+            compile_plan();
+    }
+
 public:
     mod_matrix_impl(dsp::modulation_entry *_matrix, calf_plugins::mod_matrix_metadata *_metadata);
 
-    /// Process modulation matrix, calculate outputs from inputs
-    inline void calculate_modmatrix(float *moddest, int moddest_count, float *modsrc)
+    /// Process modulation matrix, calculate outputs from inputs, using the
+    /// plan as of the last check_plan call (read only, so it can be called
+    /// from several voice threads at once).
+    /// Only the destinations that are (or were) modulated are written, the
+    /// other ones keep their old values, so moddest needs to be cleared once
+    /// before it is first used.
+    inline void calculate_modmatrix(float *moddest, int moddest_count, const float *modsrc) const
+    {
+        for (int i = 0; i < plan_stale_count; i++)
+            moddest[plan_stale[i]] = 0;
+        int r = 0;
+        for (int d = 0; d < plan_dest_count; d++)
+        {
+            float sum = 0;
+            for (int end = plan_dests[d].second; r < end; r++)
+            {
+                const plan_row &row = plan_rows[r];
+                float value = modsrc[row.src1];
+                sum += (row.c0 + value * (row.c1 + value * row.c2)) * modsrc[row.src2];
+            }
+            assert(plan_dests[d].first < moddest_count);
+            moddest[plan_dests[d].first] = sum;
+        }
+    }
+    /// Same as calculate_modmatrix, but for count sets of inputs and outputs
+    /// (like all the voices of a synth) in a single pass over the plan
+    void calculate_modmatrix_batch(float *const *moddest, int moddest_count, const float *const *modsrc, int count) const
     {
-        for (int i = 0; i < moddest_count; i++)
-            moddest[i] = 0;
-        for (unsigned int i = 0; i < matrix_rows; ++i)
+        for (int i = 0; i < plan_stale_count; i++)
         {
-            dsp::modulation_entry &slot = matrix[i];
-            if (slot.dest) {
-                float value = modsrc[slot.src1];
-                const float *c = scaling_coeffs[slot.mapping];
-                value = c[0] + c[1] * value + c[2] * value * value;
-                moddest[slot.dest] += value * modsrc[slot.src2] * slot.amount;
+            int dest = plan_stale[i];
+            for (int v = 0; v < count; v++)
+                moddest[v][dest] = 0;
+        }
+        int r = 0;
+        for (int d = 0; d < plan_dest_count; d++)
+        {
+            int dest = plan_dests[d].first, end = plan_dests[d].second;
+            assert(dest < moddest_count);
+            for (int v = 0; v < count; v++)
+                moddest[v][dest] = 0;
+            for (; r < end; r++)
+            {
+                const plan_row &row = plan_rows[r];
+                for (int v = 0; v < count; v++)
+                {
+                    float value = modsrc[v][row.src1];
+                    moddest[v][dest] += (row.c0 + value * (row.c1 + value * row.c2)) * modsrc[v][row.src2];
+                }
             }
         }
     }
     void send_configures(send_configure_iface *);
     char *configure(const char *key, const char *value);
+    /// Parse a mod_matrix configure key outside of the audio thread (NULL for other keys)
+    configure_state *prepare_configure(const char *key, const char *value);
     
     virtual const dsp::modulation_entry *get_default_mod_matrix_value(int row) const
     { return NULL; }
     
 private:
+    /// A parsed matrix cell, stored into the matrix by apply
+    struct cell_state: public configure_state
+    {
+        mod_matrix_impl *impl;
+        /// -1 if the key or value was invalid and nothing needs to be changed
+        int row, column;
+        dsp::modulation_entry slot;
+        cell_state(mod_matrix_impl *_impl, int _row, int _column, const dsp::modulation_entry &_slot)
+        : impl(_impl), row(_row), column(_column), slot(_slot) {}
+        virtual void apply() { if (row != -1) impl->apply_cell(row, column, slot); }
+    };
+
     std::string get_cell(int row, int column) const;
-    void set_cell(int row, int column, const std::string &src, std::string &error);
+    /// Parse the text of a cell into the field of slot that belongs to column
+    bool parse_cell(int column, const std::string &src, dsp::modulation_entry &slot, std::string &error) const;
+    /// Copy the field of src that belongs to column into the matrix
+    void apply_cell(int row, int column, const dsp::modulation_entry &src);
+    /// Parse a configure key and value; returns false if it is not a mod_matrix key
+    bool parse_configure(const char *key, const char *value, int &row, int &column, dsp::modulation_entry &slot, std::string &error) const;
 };
 
 };
@@ -19,6 +19,7 @@
     
     // Reverb
     PER_MODULE_ITEM(reverb,              false, "reverb")
+    PER_MODULE_ITEM(convolution,         false, "convolution")
     
     // Delay
     PER_MODULE_ITEM(vintage_delay,       false, "vintagedelay")
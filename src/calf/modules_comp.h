@@ -49,11 +49,18 @@ private:
     bool is_active;
     inline float output_level(float slope) const;
     inline float output_gain(float linSlope, bool rms) const;
+    template<bool rms, bool average>
+    void process_block_mode(const float *inL, const float *inR, const float *detL, const float *detR, float *outL, float *outR, uint32_t n, float *gains);
 public:
     gain_reduction_audio_module();
     void set_params(float att, float rel, float thr, float rat, float kn, float mak, float det, float stl, float byp, float mu);
     void update_curve();
+    /// Per-sample reference implementation, kept for A/B comparisons with process_block
     void process(float &left, float &right, const float *det_left = NULL, const float *det_right = NULL);
+    /// Process n samples with the detector mode (RMS/peak, average/max link) fixed for the whole block.
+    /// Output buffers may alias the input buffers. NULL detector buffers mean the inputs are used for detection.
+    /// @param gains optional buffer receiving the per-sample gain (the value get_comp_level() would return)
+    void process_block(const float *inL, const float *inR, const float *detL, const float *detR, float *outL, float *outR, uint32_t n, float *gains = NULL);
     void activate();
     void deactivate();
     int id;
@@ -86,7 +93,11 @@ public:
     gain_reduction2_audio_module();
     void set_params(float att, float rel, float thr, float rat, float kn, float mak, float byp, float mu);
     void update_curve();
+    /// Per-sample reference implementation, kept for A/B comparisons with process_block
     void process(float &left);
+    /// Process n samples, the output buffer may alias the input buffer
+    /// @param gains optional buffer receiving the per-sample gain (the value get_comp_level() would return)
+    void process_block(const float *in, float *out, uint32_t n, float *gains = NULL);
     void activate();
     void deactivate();
     int id;
@@ -112,13 +123,20 @@ private:
     mutable bool redraw_graph;
     inline float output_level(float slope) const;
     inline float output_gain(float linSlope, bool rms) const;
+    template<bool rms, bool average>
+    void process_block_mode(const float *inL, const float *inR, const float *detL, const float *detR, float *outL, float *outR, uint32_t n, float *gains);
 public:
     uint32_t srate;
     bool is_active;
     expander_audio_module();
     void set_params(float att, float rel, float thr, float rat, float kn, float mak, float det, float stl, float byp, float mu, float ran);
     void update_curve();
+    /// Per-sample reference implementation, kept for A/B comparisons with process_block
     void process(float &left, float &right, const float *det_left = NULL, const float *det_right = NULL);
+    /// Process n samples with the detector mode (RMS/peak, average/max link) fixed for the whole block.
+    /// Output buffers may alias the input buffers. NULL detector buffers mean the inputs are used for detection.
+    /// @param gains optional buffer receiving the per-sample gain (the value get_expander_level() would return)
+    void process_block(const float *inL, const float *inR, const float *detL, const float *detR, float *outL, float *outR, uint32_t n, float *gains = NULL);
     void activate();
     void deactivate();
     int id;
@@ -412,6 +430,8 @@ class transientdesigner_audio_module:
 {
     typedef transientdesigner_audio_module AM;
     static const int channels = 2;
+    /// Widest graph that can be drawn, the pixel buffer is allocated for it
+    static const int max_graph_points = 2048;
     uint32_t srate;
     bool active;
     mutable bool redraw;
@@ -24,8 +24,10 @@
 
 #include <assert.h>
 #include <limits.h>
+#include <atomic>
 #include "biquad.h"
 #include "bypass.h"
+#include "convolver.h"
 #include "inertia.h"
 #include "audio_fx.h"
 #include "giface.h"
@@ -47,12 +49,17 @@ class reverb_audio_module: public audio_module<reverb_metadata>
     vumeters meters;
 public:    
     dsp::reverb reverb;
+    dsp::fdn_reverb fdn;
     dsp::simple_delay<131072, dsp::stereo_sample<float> > pre_delay;
     dsp::onepole<float> left_lo, right_lo, left_hi, right_hi;
     uint32_t srate;
     dsp::gain_smoothing amount, dryamount;
     int predelay_amt;
+    /// Selected engine (engine_allpass or engine_fdn)
+    int engine;
+    float dry_buf[2][MAX_SAMPLE_RUN], wet_buf[2][MAX_SAMPLE_RUN];
     
+    reverb_audio_module();
     void params_changed();
     uint32_t process(uint32_t offset, uint32_t numsamples, uint32_t inputs_mask, uint32_t outputs_mask);
     void activate();
@@ -60,6 +67,43 @@ public:
     void deactivate();
 };
 
+/**********************************************************************
+ * CONVOLUTION REVERB
+**********************************************************************/
+
+struct convolution_ir_state;
+
+class convolution_audio_module: public audio_module<convolution_metadata>
+{
+    vumeters meters;
+    dsp::bypass bypass;
+    dsp::gain_smoothing wet, dry;
+    uint32_t srate;
+    /// Engine for the current impulse response, NULL if none is loaded.
+    /// Swapped by configure outside of the audio thread.
+    std::atomic<dsp::convolver *> engine;
+    /// Process calls started and finished, so that configure can tell when
+    /// the audio thread has got past the engine it replaced
+    std::atomic<unsigned int> cycles_started, cycles_finished;
+    float in_buf[2][MAX_SAMPLE_RUN], wet_buf[2][MAX_SAMPLE_RUN];
+    friend struct convolution_ir_state;
+public:
+    /// Value of the ir_file configure variable
+    std::string ir_file;
+
+    convolution_audio_module();
+    ~convolution_audio_module();
+    void post_instantiate(uint32_t sr);
+    void params_changed();
+    uint32_t process(uint32_t offset, uint32_t numsamples, uint32_t inputs_mask, uint32_t outputs_mask);
+    void activate();
+    void set_sample_rate(uint32_t sr);
+    void deactivate();
+    char *configure(const char *key, const char *value);
+    configure_state *prepare_configure(const char *key, const char *value);
+    void send_configures(send_configure_iface *sci);
+};
+
 /**********************************************************************
  * VINTAGE DELAY by Krzysztof Foltman
 **********************************************************************/
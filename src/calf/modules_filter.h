@@ -64,13 +64,15 @@ private:
     mutable float old_params_for_graph[graph_param_count];
     vumeters meters;
     CalfEqMode hp_mode, lp_mode;
-    dsp::biquad_d2 hp[3][2], lp[3][2];
-    dsp::biquad_d2 lsL, lsR, hsL, hsR;
-    dsp::biquad_d2 pL[PeakBands], pR[PeakBands];
+    // stereo filters, lane 0 is left (or mid) and lane 1 is right (or side)
+    dsp::biquad_d2_bank<2> hp[3], lp[3];
+    dsp::biquad_d2_bank<2> ls, hs;
+    dsp::biquad_d2_bank<2> peaks[PeakBands];
     dsp::bypass bypass;
     int keep_gliding;
     mutable int last_peak;
-    inline void process_hplp(float &left, float &right);
+    inline void process_hplp(float *left, float *right, uint32_t count);
+    inline void process_filters(dsp::biquad_d2_bank<2> *filters, int nfilters, int active, float *left, float *right, uint32_t count);
 public:
     typedef std::complex<double> cfloat;
     uint32_t srate;
@@ -234,13 +236,22 @@ public:
         if (bypassed) {
             float values[] = {0,0,0,0};
             for (uint32_t i = offset; i < offset + numsamples; i++) {
-                outs[0][i] = ins[0][i];
+                float inL = ins[0][i], inR = ins[ins[1]?1:0][i];
+                outs[0][i] = inL;
                 if(outs[1])
-                    outs[1][i] = ins[ins[1]?1:0][i];
+                    outs[1][i] = inR;
                 meters.process(values);
                 ostate = -1;
             }
         } else {
+            // the channels are processed one after another, so work on a copy
+            // of the input in case the host runs the plugin in place
+            float in_copy[2][MAX_SAMPLE_RUN];
+            memcpy(in_copy[0], ins[0] + offset, numsamples * sizeof(float));
+            if (ins[1])
+                memcpy(in_copy[1], ins[1] + offset, numsamples * sizeof(float));
+            const float *in[2] = { in_copy[0], in_copy[ins[1] ? 1 : 0] };
+            bypass.save_dry(ins, 1 + (int)(ins[1] && outs[1]), offset, numsamples);
             numsamples += offset;
             while(offset < numsamples) {
                 uint32_t numnow = numsamples - offset;
@@ -248,18 +259,18 @@ public:
                 if (inertia_cutoff.active() || inertia_resonance.active() || inertia_gain.active())
                     numnow = timer.get(numnow);
                 if (outputs_mask & 1) {
-                    ostate |= FilterClass::process_channel(0, ins[0] + offset, outs[0] + offset, numnow, inputs_mask & 1, *params[Metadata::param_level_in], *params[Metadata::param_level_out]);
+                    ostate |= FilterClass::process_channel(0, in[0] + offset - orig_offset, outs[0] + offset, numnow, inputs_mask & 1, *params[Metadata::param_level_in], *params[Metadata::param_level_out]);
                 }
                 if (outputs_mask & 2 && outs[1]) {
-                    ostate |= FilterClass::process_channel(1, ins[(ins[1] ? 1 : 0)] + offset, outs[1] + offset, numnow, inputs_mask & 2, *params[Metadata::param_level_in], *params[Metadata::param_level_out]);
+                    ostate |= FilterClass::process_channel(1, in[1] + offset - orig_offset, outs[1] + offset, numnow, inputs_mask & 2, *params[Metadata::param_level_in], *params[Metadata::param_level_out]);
                 }
                 if (timer.elapsed()) {
                     on_timer();
                 }
                 for (uint32_t i = offset; i < offset + numnow; i++) {
                     float values[] = {
-                        ins[0][i] * *params[Metadata::param_level_in],
-                        (ins[ins[1]?1:0][i]) * *params[Metadata::param_level_in],
+                        in[0][i - orig_offset] * *params[Metadata::param_level_in],
+                        in[1][i - orig_offset] * *params[Metadata::param_level_in],
                         outs[0][i],
                         (outs[outs[1]?1:0][i])
                     };
@@ -422,7 +433,7 @@ public:
     uint32_t srate;
     bool is_active;
     static const int maxorder = 8;
-    dsp::biquad_d2 detector[2][maxorder][32], modulator[2][maxorder][32];
+    dsp::biquad_d2_bank<32> detector[2][maxorder], modulator[2][maxorder];
     dsp::bypass bypass;
     double env_mods[2][32];
     vumeters meters;
@@ -43,7 +43,7 @@ private:
     uint32_t asc_led;
     int oversampling_old;
     dsp::lookahead_limiter limiter;
-    dsp::resampleN resampler[2];
+    dsp::oversampler resampler[2];
     dsp::bypass bypass;
     vumeters meters;
 public:
@@ -75,10 +75,10 @@ private:
     bool no_solo;
     dsp::lookahead_limiter strip[strips];
     dsp::lookahead_limiter broadband;
-    dsp::resampleN resampler[strips][2];
+    dsp::oversampler resampler[strips][2];
     dsp::crossover crossover;
     dsp::bypass bypass;
-    float over;
+    int over;
     unsigned int pos;
     unsigned int buffer_size;
     unsigned int overall_buffer_size;
@@ -117,10 +117,10 @@ private:
     bool no_solo;
     dsp::lookahead_limiter strip[strips];
     dsp::lookahead_limiter broadband;
-    dsp::resampleN resampler[strips][2];
+    dsp::oversampler resampler[strips][2];
     dsp::crossover crossover;
     dsp::bypass bypass;
-    float over;
+    int over;
     unsigned int pos;
     unsigned int buffer_size;
     unsigned int overall_buffer_size;
@@ -20,12 +20,13 @@ namespace calf_plugins {
 class pitch_audio_module: public audio_module<pitch_metadata>, public line_graph_iface
 {
 protected:
-    typedef dsp::fft<float, 12> pfft;
-    enum { BufferSize = 4096 };
+    typedef dsp::fft_engine pfft;
+    enum { BufferSizeBits = 12, BufferSize = 1 << BufferSizeBits };
     uint32_t srate;
     pfft transform;
     float inputbuf[BufferSize];
-    pfft::complex waveform[2 * BufferSize], spectrum[2 * BufferSize], autocorr[2 * BufferSize];
+    float waveform[BufferSize], autocorr[BufferSize];
+    pfft::complex spectrum[BufferSize / 2 + 1], power[BufferSize / 2 + 1];
     float magarr[BufferSize / 2];
     float sumsquares[BufferSize + 1], sumsquares_last;
     uint32_t write_ptr;
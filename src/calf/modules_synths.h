@@ -175,6 +175,7 @@ public:
     /// Send all configure variables set within a plugin to given destination (which may be limited to only those that plugin understands)
     virtual void send_configures(send_configure_iface *sci) { return mod_matrix_impl::send_configures(sci); }
     virtual char *configure(const char *key, const char *value) { return mod_matrix_impl::configure(key, value); }
+    virtual configure_state *prepare_configure(const char *key, const char *value) { return mod_matrix_impl::prepare_configure(key, value); }
 private:
     void reset();
     float get_lfo(dsp::triangle_lfo &lfo, int param);
@@ -0,0 +1,81 @@
+/* Calf DSP Library Utility Application - calfjackhost
+ * Offline (file to file) rendering of a rack, without a JACK server.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+#ifndef CALF_OFFLINE_RENDER_H
+#define CALF_OFFLINE_RENDER_H
+
+#include <config.h>
+
+#include <atomic>
+#include "giface.h"
+#include "jackhost.h"
+#include "preset.h"
+
+namespace calf_plugins {
+
+/// Renders WAV files through a rack of plugins as fast as possible. The
+/// plugins are the same jack_host wrappers calfjackhost uses, attached to
+/// a jack_client that is never opened, and their process_part is fed from
+/// the file instead of JACK port buffers. The rack is processed as a single
+/// chain in rack order (output N of a plugin goes to input N of the next
+/// one), since session files do not store the port connections.
+class offline_renderer
+{
+public:
+    /// Frames processed by each plugin at a time
+    enum { block_size = 1024 };
+private:
+    struct rack_entry
+    {
+        /// Plugin type (as used on the command line)
+        std::string type;
+        /// Preset stored in the session file
+        plugin_preset preset;
+        bool has_preset;
+        /// Name of a user or built-in preset to look up (from the command line)
+        std::string preset_name;
+        /// Automation assignments stored in the session file
+        std::vector<std::pair<std::string, std::string> > automation_entries;
+        rack_entry() : has_preset(false) {}
+    };
+    std::vector<rack_entry> rack;
+    std::vector<std::pair<std::string, std::string> > files;
+    /// Plugin creation and preset lookup are serialized between the rendering threads
+    calf_utils::ptmutex create_mutex;
+    std::atomic<int> next_file, failures;
+
+    void create_chain(jack_client &client, std::vector<jack_host *> &chain);
+    static void destroy_chain(std::vector<jack_host *> &chain);
+    void render_file(const std::string &in_name, const std::string &out_name);
+    void render_files();
+    static void *render_thread(void *arg);
+public:
+    offline_renderer();
+    /// Add the plugins of a session file written by host_session::save_file
+    void load_session(const char *name);
+    /// Add a plugin by type, with an optional user or built-in preset
+    void add_plugin(const std::string &type, const std::string &preset_name);
+    /// Queue a file to render
+    void add_file(const std::string &in_name, const std::string &out_name);
+    /// Render all queued files, on the calling thread plus up to extra_threads other threads; returns the number of files that failed
+    int run(int extra_threads);
+};
+
+};
+
+#endif
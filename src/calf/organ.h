@@ -213,6 +213,69 @@ public:
     void process(organ_parameters *parameters, float (*data)[2], unsigned int len, float sample_rate);
 };
 
+/// Drawbar oscillators of a group of organ voices that all need a new block,
+/// stored as arrays indexed by voice (structure of arrays). The same drawbar
+/// of 8 (AVX2) or 4 (SSE2) voices is rendered at once, each voice having its
+/// own waveform level, phase and phase delta; the result is the same as that
+/// of organ_voice::render_drawbars, apart from rounding errors.
+class organ_voice_bank: public calf_plugins::organ_enums
+{
+public:
+    enum { Channels = 2, BlockSize = 64, Drawbars = 9, MaxVoices = 40, MaxSampleRun = calf_plugins::MAX_SAMPLE_RUN };
+    /// Settings of one drawbar, common to all voices
+    struct drawbar
+    {
+        bool enabled;
+        /// All the levels of the waveform family
+        const float *tables;
+        /// Waveform size - 1
+        uint32_t mask;
+        int routing;
+        float ampl, ampr;
+    };
+    drawbar drawbars[Drawbars];
+    /// Bit mask of the aux buffers used by the enabled drawbars
+    int routings_used;
+    /// Integer part of the table position of each oscillator
+    uint32_t pos_int[Drawbars][MaxVoices];
+    /// 20-bit fractional part of the table position
+    uint32_t pos_frac[Drawbars][MaxVoices];
+    uint32_t delta_int[Drawbars][MaxVoices], delta_frac[Drawbars][MaxVoices];
+    /// Offset of the level used within drawbars[].tables
+    int32_t level[Drawbars][MaxVoices];
+    /// Left and right amplitude (0 if the voice has no level for the frequency)
+    float ampl[Drawbars][MaxVoices], ampr[Drawbars][MaxVoices];
+    /// Drawbar output of the voices (the three organ_voice::aux_buffers of each), voice index last
+    float output[3][BlockSize][Channels][MaxVoices];
+    /// Output of the voices for the current basic_synth::render_to call
+    float voice_output[MaxVoices][MaxSampleRun][Channels];
+
+    /// Read the per drawbar settings from the parameters
+    void setup(organ_parameters *parameters);
+    /// Set the oscillator of one voice's drawbar (pos and delta in 1/2^20ths of a table point)
+    inline void set_oscillator(int h, int voice, const float *data, uint64_t pos, uint32_t delta)
+    {
+        const drawbar &db = drawbars[h];
+        if (!data)
+        {
+            level[h][voice] = pos_int[h][voice] = pos_frac[h][voice] = delta_int[h][voice] = delta_frac[h][voice] = 0;
+            ampl[h][voice] = ampr[h][voice] = 0.f;
+            return;
+        }
+        level[h][voice] = data - db.tables;
+        pos_int[h][voice] = (uint32_t)(pos >> 20) & db.mask;
+        pos_frac[h][voice] = (uint32_t)pos & 0xFFFFF;
+        delta_int[h][voice] = delta >> 20;
+        delta_frac[h][voice] = delta & 0xFFFFF;
+        ampl[h][voice] = db.ampl;
+        ampr[h][voice] = db.ampr;
+    }
+    /// Render one block of drawbar output for the first voices voices
+    void render(int voices);
+    /// Copy the drawbar output into the aux_buffers of the voices (the ones not used by any drawbar are left alone)
+    void get_output(float (*const *aux)[BlockSize][Channels], int voices);
+};
+
 class organ_voice: public dsp::voice, public organ_voice_base {
 protected:    
     enum { Channels = 2, BlockSize = 64, EnvCount = organ_parameters::EnvCount, FilterCount = organ_parameters::FilterCount, MaxSampleRun = calf_plugins::MAX_SAMPLE_RUN };
@@ -246,6 +309,16 @@ public:
     virtual float get_priority() { return stolen ? 20000 : (perc_released ? 1 : (sostenuto ? 200 : 100)); }
     virtual void steal();
     void render_block(int current_snapshot);
+    /// First part of render_block, returns false if the drawbars don't need to be rendered
+    bool start_block();
+    /// Mix the drawbar oscillators into aux_buffers
+    void render_drawbars();
+    /// Set up this voice's drawbar oscillators in the bank, for render_drawbars done by the bank
+    void setup_drawbars(organ_voice_bank &bank, int index);
+    /// Buffers for the drawbar output, filled by the bank when setup_drawbars is used
+    float (*get_aux_buffers())[BlockSize][Channels] { return aux_buffers; }
+    /// Last part of render_block (filters, envelopes, vibrato and percussion)
+    void finish_block();
     
     virtual int get_current_note() {
         return note;
@@ -289,12 +362,18 @@ struct drawbar_organ: public dsp::basic_synth, public calf_plugins::organ_enums
     percussion_voice percussion;
     scanner_vibrato global_vibrato;
     two_band_eq eq_l, eq_r;
+    organ_voice_bank bank;
+    /// Render the drawbars of all voices through the bank (only when there are no voice threads; can be switched off for comparison)
+    bool use_voice_bank;
     
      drawbar_organ(organ_parameters *_parameters)
     : parameters(_parameters)
-    , percussion(_parameters) {
+    , percussion(_parameters)
+    , use_voice_bank(true) {
         init_voices(36);
+        set_render_threads(default_render_threads(), calf_plugins::MAX_SAMPLE_RUN);
     }
+    virtual void render_to(float (*output)[2], int nsamples);
     void render_separate(float *output[], int nsamples);
     dsp::voice *alloc_voice();
     virtual void percussion_note_on(int note, int vel);
@@ -349,6 +428,7 @@ public:
     bool get_graph(int index, int subindex, int phase, float *data, int points, cairo_iface *context, int *mode) const;
     bool get_layers(int index, int generation, unsigned int &layers) const;
     char *configure(const char *key, const char *value);
+    configure_state *prepare_configure(const char *key, const char *value);
     void send_configures(send_configure_iface *);
     uint32_t message_run(const void *valid_inputs, void *output_ports);
 public:
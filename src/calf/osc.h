@@ -23,7 +23,7 @@
 #define CALF_OSC_H
 
 #include "fft.h"
-#include <map>
+#include <vector>
 
 namespace dsp
 {
@@ -76,34 +76,27 @@ template<int SIZE_BITS>
 struct bandlimiter
 {
     enum { SIZE = 1 << SIZE_BITS };
-    static dsp::fft<float, SIZE_BITS> &get_fft()
-    {
-        static dsp::fft<float, SIZE_BITS> fft;
-        return fft;
-    }
     
+    dsp::fft_engine fft;
     std::complex<float> spectrum[SIZE];
     
+    bandlimiter()
+    : fft(SIZE_BITS)
+    {
+    }
+    
     /// Import time domain waveform and calculate spectrum from it
     void compute_spectrum(float input[SIZE])
     {
-        dsp::fft<float, SIZE_BITS> &fft = get_fft();
-        std::complex<float> *data = new std::complex<float>[SIZE];
-        for (int i = 0; i < SIZE; i++)
-            data[i] = input[i];
-        fft.calculate(data, spectrum, false);
-        delete []data;
+        fft.forward_real(input, spectrum);
+        for (int i = 1; i < SIZE / 2; i++)
+            spectrum[SIZE - i] = conj(spectrum[i]);
     }
     
     /// Generate the waveform from the contained spectrum.
     void compute_waveform(float output[SIZE])
     {
-        dsp::fft<float, SIZE_BITS> &fft = get_fft();
-        std::complex<float> *data = new std::complex<float>[SIZE];
-        fft.calculate(spectrum, data, true);
-        for (int i = 0; i < SIZE; i++)
-            output[i] = data[i].real();
-        delete []data;
+        inverse_real(spectrum, output);
     }
     
     /// remove DC offset of the spectrum (it usually does more harm than good!)
@@ -116,10 +109,8 @@ struct bandlimiter
     /// might need to be improved much in future!
     void make_waveform(float output[SIZE], int cutoff, bool foldover = false)
     {
-        dsp::fft<float, SIZE_BITS> &fft = get_fft();
-        std::vector<std::complex<float> > new_spec, iffted;
+        std::vector<std::complex<float> > new_spec;
         new_spec.resize(SIZE);
-        iffted.resize(SIZE);
         // Copy original harmonics up to cutoff point
         new_spec[0] = spectrum[0];
         for (int i = 1; i < cutoff; i++)
@@ -152,21 +143,47 @@ struct bandlimiter
                 new_spec[SIZE - i] = 0.f;
         }
         // convert back to time domain (IFFT) and extract only real part
-        fft.calculate(&new_spec.front(), &iffted.front(), true);
-        for (int i = 0; i < SIZE; i++)
-            output[i] = iffted[i].real();
+        inverse_real(&new_spec.front(), output);
+    }
+private:
+    /// Real part of the inverse transform of a full spectrum. Only the
+    /// conjugate-symmetric part of the spectrum contributes to the real
+    /// part, so that is all that goes into the (cheaper) real IFFT.
+    void inverse_real(const std::complex<float> *spec, float output[SIZE])
+    {
+        std::vector<std::complex<float> > half;
+        half.resize(SIZE / 2 + 1);
+        half[0] = spec[0].real();
+        half[SIZE / 2] = spec[SIZE / 2].real();
+        for (int i = 1; i < SIZE / 2; i++)
+            half[i] = 0.5f * (spec[i] + conj(spec[SIZE - i]));
+        fft.inverse_real(&half.front(), output);
     }
 };
 
-/// Set of bandlimited wavetables
+/// Set of bandlimited wavetables. The levels are kept in one cache-aligned
+/// block, in the order of increasing phase delta (decreasing number of
+/// harmonics), each level being SIZE + 1 points padded to a 16 byte boundary.
 template<int SIZE_BITS>
-struct waveform_family: public std::map<uint32_t, float *>
+struct waveform_family
 {
-    enum { SIZE = 1 << SIZE_BITS };
-    using std::map<uint32_t, float *>::iterator;
-    using std::map<uint32_t, float *>::end;
-    using std::map<uint32_t, float *>::lower_bound;
+    enum { SIZE = 1 << SIZE_BITS, STRIDE = SIZE + 4, MAX_LEVELS = 64 };
     float original[SIZE];
+    /// Number of levels
+    unsigned int count;
+    /// Level i is used for phase deltas below keys[i] (and not below keys[i - 1])
+    uint32_t keys[MAX_LEVELS];
+    /// First level (count * STRIDE values)
+    float *tables;
+    /// Index of the first level with key over 2^(n-1), for n significant bits of the phase delta
+    uint8_t first_level[33];
+    /// Memory block holding the tables, or NULL if the tables belong to someone else (see waveform_cache)
+    float *allocated;
+    
+    waveform_family() : count(0), tables(NULL), allocated(NULL)
+    {
+        update_index();
+    }
     
     /// Fill the family using specified bandlimiter and original waveform. Optionally apply foldover. 
     /// Does not produce harmonics over specified limit (limit = (SIZE / 2) / min_number_of_harmonics)
@@ -182,6 +199,7 @@ struct waveform_family: public std::map<uint32_t, float *>
     void make_from_spectrum(bandlimiter<SIZE_BITS> &bl, bool foldover = false, uint32_t limit = SIZE / 2)
     {
         bl.remove_dc();
+        release();
         
         uint32_t base = 1 << (32 - SIZE_BITS);
         uint32_t cutoff = SIZE / 2, top = SIZE / 2;
@@ -190,6 +208,8 @@ struct waveform_family: public std::map<uint32_t, float *>
             vmax = std::max(vmax, abs(bl.spectrum[i]));
         float vthres = vmax / 1024.0;  // -60dB
         float cumul = 0.f;
+        // find all the levels first, so that they can be allocated as a single block
+        uint32_t cutoffs[MAX_LEVELS];
         while(cutoff > (SIZE / limit)) {
             if (!foldover)
             {
@@ -203,31 +223,78 @@ struct waveform_family: public std::map<uint32_t, float *>
                     cutoff--;
                 }
             }
-            float *wf = new float[SIZE+1];
-            bl.make_waveform(wf, cutoff, foldover);
-            wf[SIZE] = wf[0];
-            float **storage = &(*this)[base * (top / cutoff)];
-            delete[] *storage;
-            *storage = wf;
+            // a level with the same key as the previous one replaces it
+            uint32_t key = base * (top / cutoff);
+            if (!count || keys[count - 1] != key)
+            {
+                assert(count < MAX_LEVELS);
+                count++;
+            }
+            keys[count - 1] = key;
+            cutoffs[count - 1] = cutoff;
             cutoff = (int)(0.75 * cutoff);
         }
+        // 64 extra bytes for cache line alignment
+        allocated = new float[count * STRIDE + 16];
+        tables = (float *)(((uintptr_t)allocated + 63) & ~(uintptr_t)63);
+        for (unsigned int i = 0; i < count; i++)
+        {
+            float *wf = tables + i * STRIDE;
+            bl.make_waveform(wf, cutoffs[i], foldover);
+            wf[SIZE] = wf[0];
+            for (int j = SIZE + 1; j < STRIDE; j++)
+                wf[j] = 0.f;
+        }
+        update_index();
     }
     
     /// Retrieve waveform pointer suitable for specified phase_delta
-    inline float *get_level(uint32_t phase_delta)
+    inline float *get_level(uint32_t phase_delta) const
     {
-        iterator i = upper_bound(phase_delta);
-        if (i == end())
+        if (!count || phase_delta >= keys[count - 1])
             return NULL;
-        // printf("Level = %08x\n", i->first);
-        return i->second;
+        // there are at most a few levels per octave, so this loop is short
+        unsigned int i = first_level[32 - clz(phase_delta | 1)];
+        while (keys[i] <= phase_delta)
+            i++;
+        return tables + i * STRIDE;
+    }
+    /// Use levels owned by someone else (count * STRIDE values, ordered by key)
+    bool attach(unsigned int _count, const uint32_t *_keys, float *_tables)
+    {
+        if (_count > MAX_LEVELS)
+            return false;
+        release();
+        count = _count;
+        memcpy(keys, _keys, count * sizeof(uint32_t));
+        tables = _tables;
+        update_index();
+        return true;
+    }
+    /// Remove all the levels, freeing them if owned
+    void release()
+    {
+        delete []allocated;
+        allocated = NULL;
+        tables = NULL;
+        count = 0;
+        update_index();
     }
-    /// Destructor, deletes the waveforms and removes them from the map.
     ~waveform_family()
     {
-        for (iterator i = begin(); i != end(); i++)
-            delete []i->second;
-        clear();
+        release();
+    }
+private:
+    void update_index()
+    {
+        unsigned int i = 0;
+        first_level[0] = 0;
+        for (int bits = 1; bits <= 32; bits++)
+        {
+            while (i < count && keys[i] <= (1U << (bits - 1)))
+                i++;
+            first_level[bits] = i;
+        }
     }
 };
 
@@ -40,6 +40,9 @@ public:
     
     std::vector<meter_data> meters;    
     float *const *params;
+    /// Values passed to the per-sample process, MAX_SAMPLE_RUN per meter
+    std::vector<float> staging;
+    unsigned int staged;
 
     void init(float *const *prms, int *lvls, int *clps, int length, uint32_t srate) {
         meters.resize(length);
@@ -51,26 +54,62 @@ public:
             md.meter.set_falloff(1.f, srate);
         }
         params = prms;
+        staging.resize(length * MAX_SAMPLE_RUN);
+        staged = 0;
     }
+    /// Select what a meter measures (sample peak by default)
+    void set_mode(int meter, dsp::vumeter_mode mode, uint32_t srate) {
+        meters[meter].meter.set_mode(mode, srate);
+    }
+    /// Add one value per meter. The values are only collected here and
+    /// measured a block at a time by flush(), which fall() calls.
     void process(float *values) {
+        for (size_t i = 0; i < meters.size(); ++i)
+            staging[i * MAX_SAMPLE_RUN + staged] = values[i];
+        if (++staged == MAX_SAMPLE_RUN)
+            flush();
+    }
+    /// Measure a block of samples, one buffer per meter
+    void process(const float *const *values, unsigned int numsamples) {
+        flush();
+        for (size_t i = 0; i < meters.size(); ++i) {
+            meter_data &md = meters[i];
+            if (is_connected(md)) {
+                md.meter.update_block(values[i], numsamples);
+                output(md);
+            }
+        }
+    }
+    /// Measure the values collected by the per-sample process
+    void flush() {
+        if (!staged)
+            return;
         for (size_t i = 0; i < meters.size(); ++i) {
             meter_data &md = meters[i];
-            if ((md.level_idx != -1 && params[(int)abs(md.level_idx)] != NULL) || 
-                (md.clip_idx != -1 && params[(int)abs(md.clip_idx)] != NULL))
-            {
-                md.meter.process(values[i]);
-                if (md.level_idx != -1 && params[(int)abs(md.level_idx)])
-                    *params[(int)abs(md.level_idx)] = md.meter.level;
-                if (md.clip_idx != -1 && params[(int)abs(md.clip_idx)])
-                    *params[(int)abs(md.clip_idx)] = md.meter.clip > 0 ? 1.f : 0.f;
+            if (is_connected(md)) {
+                md.meter.update_block(&staging[i * MAX_SAMPLE_RUN], staged);
+                output(md);
             }
         }
+        staged = 0;
     }
     void fall(unsigned int numsamples) {
+        flush();
         for (size_t i = 0; i < meters.size(); ++i)
             if (meters[i].level_idx != -1)
                 meters[i].meter.fall(numsamples);
     }
+private:
+    inline bool is_connected(const meter_data &md) const {
+        return (md.level_idx != -1 && params[(int)abs(md.level_idx)] != NULL) || 
+            (md.clip_idx != -1 && params[(int)abs(md.clip_idx)] != NULL);
+    }
+    inline void output(const meter_data &md) {
+        if (md.level_idx != -1 && params[(int)abs(md.level_idx)])
+            *params[(int)abs(md.level_idx)] = md.meter.level;
+        if (md.clip_idx != -1 && params[(int)abs(md.clip_idx)])
+            *params[(int)abs(md.clip_idx)] = md.meter.clip > 0 ? 1.f : 0.f;
+    }
 };
 
 struct debug_send_configure_iface: public send_configure_iface
@@ -29,6 +29,12 @@
 #include <cstdlib>
 #include <map>
 #include <algorithm>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 namespace dsp {
 
@@ -75,6 +81,83 @@ void fill(T *data, T value, unsigned int size) {
         *data++ = value;
 }
 
+/// Find a value no plugin should ever receive or produce: NaN, infinity or
+/// magnitude above 2^32. The absolute values are compared as integers, which
+/// keeps the check working with -ffast-math (where std::isfinite is assumed
+/// to be always true) and makes the common case a single branchless pass.
+/// @return index of the first such value, or -1 if there are none
+inline int find_questionable(const float *data, unsigned int size)
+{
+    const uint32_t abs_mask = 0x7FFFFFFF, limit = 0x4F800000; // 2^32
+    unsigned int i = 0;
+    uint32_t any = 0;
+#if defined(__SSE2__)
+    const __m128i abs_mask4 = _mm_set1_epi32(abs_mask), limit4 = _mm_set1_epi32(limit);
+    __m128i bad = _mm_setzero_si128();
+    for (; i + 4 <= size; i += 4)
+    {
+        __m128i bits = _mm_and_si128(_mm_loadu_si128((const __m128i *)(data + i)), abs_mask4);
+        bad = _mm_or_si128(bad, _mm_cmpgt_epi32(bits, limit4));
+    }
+    any = _mm_movemask_epi8(bad);
+#endif
+    for (; i < size; i++)
+    {
+        uint32_t bits;
+        memcpy(&bits, data + i, sizeof(bits));
+        any |= (bits & abs_mask) > limit;
+    }
+    if (!any)
+        return -1;
+    // rare case, find where it is
+    for (i = 0; i < size; i++)
+    {
+        uint32_t bits;
+        memcpy(&bits, data + i, sizeof(bits));
+        if ((bits & abs_mask) > limit)
+            return i;
+    }
+    return -1;
+}
+
+/// Largest absolute value in a buffer (0 for an empty buffer)
+inline float abs_max(const float *data, unsigned int size)
+{
+    unsigned int i = 0;
+    float result = 0.f;
+#if defined(__SSE2__)
+    const __m128 abs_mask4 = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    __m128 max4 = _mm_setzero_ps();
+    for (; i + 4 <= size; i += 4)
+        max4 = _mm_max_ps(max4, _mm_and_ps(_mm_loadu_ps(data + i), abs_mask4));
+    max4 = _mm_max_ps(max4, _mm_shuffle_ps(max4, max4, _MM_SHUFFLE(1, 0, 3, 2)));
+    max4 = _mm_max_ps(max4, _mm_shuffle_ps(max4, max4, _MM_SHUFFLE(2, 3, 0, 1)));
+    result = _mm_cvtss_f32(max4);
+#endif
+    for (; i < size; i++)
+        result = std::max(result, std::abs(data[i]));
+    return result;
+}
+
+/// Smallest absolute value in a buffer (FLT_MAX for an empty buffer)
+inline float abs_min(const float *data, unsigned int size)
+{
+    unsigned int i = 0;
+    float result = 3.402823466e+38f;
+#if defined(__SSE2__)
+    const __m128 abs_mask4 = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    __m128 min4 = _mm_set1_ps(result);
+    for (; i + 4 <= size; i += 4)
+        min4 = _mm_min_ps(min4, _mm_and_ps(_mm_loadu_ps(data + i), abs_mask4));
+    min4 = _mm_min_ps(min4, _mm_shuffle_ps(min4, min4, _MM_SHUFFLE(1, 0, 3, 2)));
+    min4 = _mm_min_ps(min4, _mm_shuffle_ps(min4, min4, _MM_SHUFFLE(2, 3, 0, 1)));
+    result = _mm_cvtss_f32(min4);
+#endif
+    for (; i < size; i++)
+        result = std::min(result, std::abs(data[i]));
+    return result;
+}
+
 template<class T = float>struct stereo_sample {
     T left;
     T right;
@@ -448,6 +531,40 @@ inline int fastf2i_drm(float f)
 #endif
 }
 
+/// Number of leading zero bits (undefined for 0 with GCC, 32 with MSVC)
+#ifdef _MSC_VER
+inline int clz(unsigned int value)
+{
+    unsigned long leading_zero = 0;
+
+    if (_BitScanReverse(&leading_zero, value))
+    {
+        //_BitScanReverse return the position while GCC returns number of leading zeros
+        //so reverse it.
+        return 31 - leading_zero;
+    }
+    else
+    {
+        //GCC implementation says it's undefined in this case
+        return 32;
+    }
+}
+#else
+inline int clz(unsigned int value) { return __builtin_clz(value); }
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+/// AVX2 versions of inner loops can be built with the target attribute even
+/// if the rest of the code is compiled for plain SSE2, and picked at runtime
+#define CALF_AVX2_DISPATCH 1
+/// Whether the CPU the code is running on supports AVX2
+inline bool cpu_has_avx2()
+{
+    static bool has_avx2 = __builtin_cpu_supports("avx2");
+    return has_avx2;
+}
+#endif
+
 /// Convert MIDI note to frequency in Hz.
 inline float note_to_hz(double note, double detune_cents = 0.0)
 {
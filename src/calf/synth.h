@@ -137,6 +137,8 @@ public:
     enum { BlockSize = Base::BlockSize, MaxSnapshots = (Base::MaxSampleRun + Base::BlockSize - 1) / Base::BlockSize + 1 };
     unsigned int sample_ctr;
 
+    block_allvoices_base() : sample_ctr(0) {}
+
     void fill_snapshots(int nsamples)
     {
         int s = 0;
@@ -269,6 +271,8 @@ struct basic_pool {
         delete []items;
     }
 };
+class voice_render_pool;
+
 /// Base class for all kinds of polyphonic instruments, provides
 /// somewhat reasonable voice management, pedal support - and 
 /// little else. It's implemented as a base class with virtual
@@ -294,11 +298,16 @@ protected:
     std::bitset<128> gate;
     /// Maximum allocated number of channels
     unsigned int polyphony_limit;
+    /// Worker threads rendering a part of the active voices (NULL if all voices are rendered by the calling thread)
+    voice_render_pool *render_pool;
 
     void init_voices(int count);
     void kill_note(int note, int vel, bool just_one);
     virtual dsp::voice *alloc_voice() = 0;
 public:
+    /// Upper limit for set_render_threads
+    enum { MaxRenderThreads = 7 };
+    basic_synth() : render_pool(NULL) {}
     virtual void setup(int sr) {
         sample_rate = sr;
         hold = false;
@@ -317,6 +326,16 @@ public:
     virtual void pitch_bend(int amt) {}
     virtual void on_pedal_release();
     virtual bool check_percussion() { return active_voices.empty(); }
+    /// Render the active voices on the given number of worker threads in
+    /// addition to the thread calling render_to (0 = no worker threads).
+    /// max_samples is the largest nsamples value render_to is called with.
+    /// Voice allocation, stealing and pedal handling stay on the calling
+    /// thread. Must not be called while render_to may be running.
+    void set_render_threads(int threads, int max_samples);
+    /// Number of worker threads currently used by render_to
+    int get_render_threads() const;
+    /// Number of worker threads requested in the CALF_VOICE_THREADS environment variable (0 if not set)
+    static int default_render_threads();
     virtual ~basic_synth();
 };
 
@@ -22,9 +22,135 @@
 #define __CALF_VUMETER_H
 
 #include <math.h>
+#include "primitives.h"
+#include "biquad.h"
 
 namespace dsp {
 
+/// What a vumeter measures
+enum vumeter_mode {
+    VUMETER_PEAK,           ///< sample peak with falloff (default)
+    VUMETER_RMS,            ///< RMS level, 300 ms integration time
+    VUMETER_TRUE_PEAK,      ///< peak of the 4x oversampled signal with falloff (ITU-R BS.1770)
+    VUMETER_LUFS_MOMENTARY, ///< K-weighted mean square over 400 ms (ITU-R BS.1770), as linear amplitude
+};
+
+/// Inter-sample peak detector: 4x oversampling polyphase FIR from ITU-R BS.1770-4, annex 2
+struct true_peak_detector
+{
+    enum { Taps = 12, Chunk = 64 };
+    /// Last Taps - 1 input samples
+    float history[Taps - 1];
+
+    true_peak_detector() { reset(); }
+    void reset() { dsp::zero(history, Taps - 1); }
+
+    /// Interpolation filter, transposed so that one row holds one tap of all 4 phases
+    static const float (*get_coeffs())[4]
+    {
+        static const float coeffs[Taps][4] = {
+            {  0.0017089843750f, -0.0291748046875f, -0.0189208984375f, -0.0083007812500f },
+            {  0.0109863281250f,  0.0292968750000f,  0.0330810546875f,  0.0148925781250f },
+            { -0.0196533203125f, -0.0517578125000f, -0.0582275390625f, -0.0266113281250f },
+            {  0.0332031250000f,  0.0891113281250f,  0.1015625000000f,  0.0476074218750f },
+            { -0.0594482421875f, -0.1665039062500f, -0.2003173828125f, -0.1022949218750f },
+            {  0.1373291015625f,  0.4650878906250f,  0.7797851562500f,  0.9721679687500f },
+            {  0.9721679687500f,  0.7797851562500f,  0.4650878906250f,  0.1373291015625f },
+            { -0.1022949218750f, -0.2003173828125f, -0.1665039062500f, -0.0594482421875f },
+            {  0.0476074218750f,  0.1015625000000f,  0.0891113281250f,  0.0332031250000f },
+            { -0.0266113281250f, -0.0582275390625f, -0.0517578125000f, -0.0196533203125f },
+            {  0.0148925781250f,  0.0330810546875f,  0.0292968750000f,  0.0109863281250f },
+            { -0.0083007812500f, -0.0189208984375f, -0.0291748046875f,  0.0017089843750f },
+        };
+        return coeffs;
+    }
+
+    /// Largest absolute value of the oversampled block
+    float process(const float *src, unsigned int len)
+    {
+        const float (*coeffs)[4] = get_coeffs();
+        float buf[Taps - 1 + Chunk];
+        float peak = 0.f;
+        while(len) {
+            unsigned int n = std::min<unsigned int>(len, Chunk);
+            memcpy(buf, history, sizeof(history));
+            memcpy(buf + Taps - 1, src, n * sizeof(float));
+#if defined(__SSE2__)
+            const __m128 abs_mask4 = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+            __m128 peak4 = _mm_setzero_ps();
+            for (unsigned int i = 0; i < n; i++) {
+                // buf[i + Taps - 1] is the newest sample, buf[i] the oldest
+                __m128 sum = _mm_setzero_ps();
+                for (int k = 0; k < Taps; k++)
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(coeffs[k]), _mm_set1_ps(buf[i + Taps - 1 - k])));
+                peak4 = _mm_max_ps(peak4, _mm_and_ps(sum, abs_mask4));
+            }
+            float p[4];
+            _mm_storeu_ps(p, peak4);
+            peak = std::max(peak, std::max(std::max(p[0], p[1]), std::max(p[2], p[3])));
+#else
+            for (unsigned int i = 0; i < n; i++) {
+                for (int ph = 0; ph < 4; ph++) {
+                    float sum = 0.f;
+                    for (int k = 0; k < Taps; k++)
+                        sum += coeffs[k][ph] * buf[i + Taps - 1 - k];
+                    peak = std::max(peak, std::abs(sum));
+                }
+            }
+#endif
+            memcpy(history, buf + n, sizeof(history));
+            src += n;
+            len -= n;
+        }
+        return peak;
+    }
+
+    /// Largest absolute value of the 4 oversampled points between src[i - 6]
+    /// and src[i - 5] for every input sample, so dst lags src by 6 samples
+    void peaks(const float *src, float *dst, unsigned int len)
+    {
+        const float (*coeffs)[4] = get_coeffs();
+        float buf[Taps - 1 + Chunk];
+        while(len) {
+            unsigned int n = std::min<unsigned int>(len, Chunk);
+            memcpy(buf, history, sizeof(history));
+            memcpy(buf + Taps - 1, src, n * sizeof(float));
+            unsigned int i = 0;
+#if defined(__SSE2__)
+            // 4 output samples at a time, one vector per phase
+            const __m128 abs_mask4 = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+            for (; i + 4 <= n; i += 4) {
+                __m128 s0 = _mm_setzero_ps(), s1 = s0, s2 = s0, s3 = s0;
+                for (int k = 0; k < Taps; k++) {
+                    __m128 x = _mm_loadu_ps(buf + i + Taps - 1 - k);
+                    s0 = _mm_add_ps(s0, _mm_mul_ps(x, _mm_set1_ps(coeffs[k][0])));
+                    s1 = _mm_add_ps(s1, _mm_mul_ps(x, _mm_set1_ps(coeffs[k][1])));
+                    s2 = _mm_add_ps(s2, _mm_mul_ps(x, _mm_set1_ps(coeffs[k][2])));
+                    s3 = _mm_add_ps(s3, _mm_mul_ps(x, _mm_set1_ps(coeffs[k][3])));
+                }
+                s0 = _mm_max_ps(_mm_and_ps(s0, abs_mask4), _mm_and_ps(s1, abs_mask4));
+                s2 = _mm_max_ps(_mm_and_ps(s2, abs_mask4), _mm_and_ps(s3, abs_mask4));
+                _mm_storeu_ps(dst + i, _mm_max_ps(s0, s2));
+            }
+#endif
+            for (; i < n; i++) {
+                float peak = 0.f;
+                for (int ph = 0; ph < 4; ph++) {
+                    float sum = 0.f;
+                    for (int k = 0; k < Taps; k++)
+                        sum += coeffs[k][ph] * buf[i + Taps - 1 - k];
+                    peak = std::max(peak, std::abs(sum));
+                }
+                dst[i] = peak;
+            }
+            memcpy(history, buf + n, sizeof(history));
+            src += n;
+            dst += n;
+            len -= n;
+        }
+    }
+};
+
 /// Peak meter class
 struct vumeter
 {
@@ -40,12 +166,28 @@ struct vumeter
     int count_over;
     /// reverse VU meter
     bool reverse;
+    /// What the meter measures
+    vumeter_mode mode;
+    /// Mean square for the RMS and LUFS modes
+    double mean_square;
+    /// RMS mode: 1-pole integration coefficient per sample
+    double rms_coeff;
+    /// LUFS mode: K-weighting filter (shelf and high pass)
+    biquad_d2 kweight[2];
+    /// LUFS mode: sums of squares of the last 4 100 ms periods and of the current one
+    double loudness_sums[4], loudness_sum;
+    int loudness_pos, loudness_count, loudness_period;
+    /// TRUE_PEAK mode: oversampling detector
+    true_peak_detector true_peak;
     
     vumeter()
     {
         falloff = 0.999f;
         clip_falloff = 0.999f;
         reverse = false;
+        mode = VUMETER_PEAK;
+        rms_coeff = 0.9999;
+        loudness_period = 4800;
         reset();
     }
     
@@ -53,6 +195,40 @@ struct vumeter
     {
         level = reverse ? 1 : 0;
         clip = 0;
+        count_over = 0;
+        mean_square = 0;
+        kweight[0].reset();
+        kweight[1].reset();
+        dsp::zero(loudness_sums, 4);
+        loudness_sum = 0;
+        loudness_pos = loudness_count = 0;
+        true_peak.reset();
+    }
+    
+    /// Select what the meter measures (sample_rate is needed for all modes except peak)
+    void set_mode(vumeter_mode m, double sample_rate)
+    {
+        mode = m;
+        rms_coeff = exp(-1.0 / (0.3 * sample_rate));
+        loudness_period = std::max(1, (int)(sample_rate / 10));
+        // K-weighting as in ITU-R BS.1770, recalculated for the actual sample rate
+        double K = tan(M_PI * 1681.974450955533 / sample_rate), Q = 0.7071752369554196;
+        double Vh = pow(10.0, 3.999843853973347 / 20), Vb = pow(Vh, 0.4996667741545416);
+        double n0 = 1 + K / Q + K * K;
+        kweight[0].a0 = (Vh + Vb * K / Q + K * K) / n0;
+        kweight[0].a1 = 2 * (K * K - Vh) / n0;
+        kweight[0].a2 = (Vh - Vb * K / Q + K * K) / n0;
+        kweight[0].b1 = 2 * (K * K - 1) / n0;
+        kweight[0].b2 = (1 - K / Q + K * K) / n0;
+        K = tan(M_PI * 38.13547087602444 / sample_rate);
+        Q = 0.5003270373238773;
+        n0 = 1 + K / Q + K * K;
+        kweight[1].a0 = 1;
+        kweight[1].a1 = -2;
+        kweight[1].a2 = 1;
+        kweight[1].b1 = 2 * (K * K - 1) / n0;
+        kweight[1].b2 = (1 - K / Q + K * K) / n0;
+        reset();
     }
     
     /// Set falloff so that the meter falls 20dB in time_20dB seconds, assuming sample rate of sample_rate
@@ -109,9 +285,96 @@ struct vumeter
         if (count_over >= 3)
             clip = 1.f;
     }
+    /// Update the meter from a block of samples; gives the same result as
+    /// calling process() for each sample, but in closed form per block
+    void update_block(const float *src, unsigned int len)
+    {
+        if (!len)
+            return;
+        switch(mode) {
+        case VUMETER_PEAK:
+        default:
+            update_peak(src, len);
+            break;
+        case VUMETER_TRUE_PEAK: {
+            float peak = true_peak.process(src, len);
+            level = std::max(level, peak);
+            // inter-sample overs are exactly what this mode is for, so flag the first one
+            if (peak > 1.f)
+                clip = 1.f;
+            break;
+        }
+        case VUMETER_RMS: {
+            double sum = 0;
+            for (unsigned int i = 0; i < len; i++)
+                sum += src[i] * src[i];
+            // exact for a block with constant power, close enough otherwise
+            double c = pow(rms_coeff, (double)len);
+            mean_square = c * mean_square + (1 - c) * sum / len;
+            level = sqrt(mean_square);
+            if (abs_max(src, len) > 1.f)
+                clip = 1.f;
+            break;
+        }
+        case VUMETER_LUFS_MOMENTARY:
+            for (unsigned int i = 0; i < len; i++) {
+                double v = kweight[1].process(kweight[0].process(src[i]));
+                loudness_sum += v * v;
+                if (++loudness_count == loudness_period) {
+                    loudness_sums[loudness_pos] = loudness_sum;
+                    loudness_pos = (loudness_pos + 1) & 3;
+                    loudness_sum = 0;
+                    loudness_count = 0;
+                }
+            }
+            mean_square = (loudness_sums[0] + loudness_sums[1] + loudness_sums[2] + loudness_sums[3]) / (4.0 * loudness_period);
+            // -0.691 dB calibration offset from BS.1770, applied to the amplitude
+            level = sqrt(mean_square * 0.8529037);
+            if (abs_max(src, len) > 1.f)
+                clip = 1.f;
+            break;
+        }
+    }
+    /// Closed form of process() over a block
+    void update_peak(const float *src, unsigned int len)
+    {
+        if (reverse) {
+            // the level only goes down, so it is above 0 dB for a prefix of the block
+            unsigned int above = 0;
+            if (level > 1.f) {
+                if (abs_min(src, len) > 1.f)
+                    above = len;
+                else
+                    while(std::abs(src[above]) > 1.f)
+                        above++;
+            }
+            if (above && count_over + (int)above >= 3)
+                clip = 1.f;
+            count_over = above == len ? count_over + len : 0;
+            level = std::min(level, abs_min(src, len));
+        } else {
+            // the level only goes up, so it is above 0 dB for a suffix of the block
+            float peak = abs_max(src, len);
+            if (level > 1.f)
+                count_over += len;
+            else if (peak > 1.f) {
+                unsigned int first = 0;
+                while(std::abs(src[first]) <= 1.f)
+                    first++;
+                count_over = first ? len - first : count_over + len;
+            }
+            else
+                count_over = 0;
+            level = std::max(level, peak);
+            if (count_over >= 3)
+                clip = 1.f;
+        }
+    }
     void fall(unsigned int len) {
-        // "Age" the old level by falloff^length
-        if (reverse)
+        // "Age" the old level by falloff^length (RMS and loudness have their own ballistics)
+        if (mode == VUMETER_RMS || mode == VUMETER_LUFS_MOMENTARY)
+            ;
+        else if (reverse)
             level /= pow(falloff, len);
         else
             level *= pow(falloff, len);
@@ -0,0 +1,152 @@
+/* Calf DSP Library
+ * Persistent cache of precalculated waveform families
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef CALF_WAVECACHE_H
+#define CALF_WAVECACHE_H
+
+#include "primitives.h"
+#include "osc.h"
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+namespace dsp
+{
+
+/**
+ * Binary cache of waveform families in the user's cache directory
+ * ($XDG_CACHE_HOME/calf or ~/.cache/calf). The file is mapped read-only and
+ * the families are pointed straight at the mapped level blocks, so that loading a
+ * synth only pages in data that other processes may already have in memory,
+ * instead of recomputing all the bandlimited levels.
+ *
+ * The file is rejected (and the caller should generate the waveforms and
+ * save them again) if the format, the generator version or the checksum
+ * does not match. Bump the generator version whenever the waveform code
+ * changes in a way that alters the tables.
+ */
+class waveform_cache
+{
+public:
+    /// Each block in the file (and so each table) starts on a 16 byte boundary
+    enum { ALIGN = 16 };
+private:
+    struct header
+    {
+        char magic[8];
+        uint32_t format;
+        uint32_t version;
+        uint64_t data_size;
+        uint64_t checksum;
+        uint32_t reserved[4];
+    };
+    /// Family descriptor, padded to ALIGN bytes
+    struct block
+    {
+        uint32_t size_bits;
+        uint32_t count;
+        uint32_t reserved[2];
+    };
+    std::string name;
+    uint32_t version;
+    /// Mapped file (NULL if not mapped)
+    const char *map_data;
+    size_t map_size;
+    /// Read position within the mapped file
+    size_t read_pos;
+    /// Some families point into the mapping, so it must never be unmapped
+    bool attached;
+    /// File being written (NULL if not writing) and its temporary name
+    FILE *out;
+    std::string out_name;
+    uint64_t out_size, out_checksum[4];
+    bool out_failed;
+
+    static std::string get_dir(bool create);
+    /// Bytes taken by a key table, including the padding
+    static size_t keys_size(uint32_t count) { return (count * sizeof(uint32_t) + ALIGN - 1) & ~(size_t)(ALIGN - 1); }
+    const void *read_block(size_t bytes);
+    void write_block(const void *data, size_t bytes);
+    void unmap();
+public:
+    waveform_cache(const char *_name, uint32_t _version);
+    ~waveform_cache();
+    /// Map the cache file and check its header and checksum
+    bool open();
+    /// Attach the next count families stored in the file to the mapped tables, in the order they were written
+    template<int SIZE_BITS>
+    bool read(waveform_family<SIZE_BITS> *families, int count);
+    /// Start writing a new cache file, replacing the old one on commit
+    bool create();
+    /// Append count families to the file being written
+    template<int SIZE_BITS>
+    void write(waveform_family<SIZE_BITS> *families, int count);
+    /// Finish the file being written and atomically move it into place
+    bool commit();
+};
+
+template<int SIZE_BITS>
+bool waveform_cache::read(waveform_family<SIZE_BITS> *families, int count)
+{
+    typedef waveform_family<SIZE_BITS> family;
+    if (!map_data)
+        return false;
+    // Validate the whole range before touching any of the families
+    size_t start = read_pos;
+    for (int i = 0; i < count; i++)
+    {
+        const block *fb = (const block *)read_block(sizeof(block));
+        if (!fb || fb->size_bits != SIZE_BITS || fb->count > family::MAX_LEVELS
+            || !read_block(keys_size(fb->count)) || !read_block(sizeof(families[i].original))
+            || !read_block(fb->count * family::STRIDE * sizeof(float)))
+            return false;
+    }
+    read_pos = start;
+    for (int i = 0; i < count; i++)
+    {
+        const block *fb = (const block *)read_block(sizeof(block));
+        const uint32_t *keys = (const uint32_t *)read_block(keys_size(fb->count));
+        memcpy(families[i].original, read_block(sizeof(families[i].original)), sizeof(families[i].original));
+        // the mapping is read-only, the oscillators never write to the tables
+        families[i].attach(fb->count, keys, (float *)read_block(fb->count * family::STRIDE * sizeof(float)));
+    }
+    attached = true;
+    return true;
+}
+
+template<int SIZE_BITS>
+void waveform_cache::write(waveform_family<SIZE_BITS> *families, int count)
+{
+    typedef waveform_family<SIZE_BITS> family;
+    static const uint32_t padding[ALIGN / sizeof(uint32_t)] = { 0 };
+    for (int i = 0; i < count; i++)
+    {
+        block fb = { SIZE_BITS, families[i].count, 0, 0 };
+        write_block(&fb, sizeof(fb));
+        write_block(families[i].keys, families[i].count * sizeof(uint32_t));
+        write_block(padding, keys_size(families[i].count) - families[i].count * sizeof(uint32_t));
+        write_block(families[i].original, sizeof(families[i].original));
+        write_block(families[i].tables, families[i].count * family::STRIDE * sizeof(float));
+    }
+}
+
+};
+
+#endif
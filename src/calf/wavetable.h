@@ -41,6 +41,12 @@ struct wavetable_oscillator: public dsp::simple_oscillator
         phase += phasedelta;
         return dsp::lerp(value1, value2, fracslice) * (1.0 / 8.0) * (1.0 / 32768.0);;
     }
+    /// Render nsamples values, using table slice slices[i] for the i-th one.
+    /// Matches calling get() for each sample within float rounding, but
+    /// processes several samples at once (AVX2 gathers if the CPU has them, otherwise
+    /// SSE2). The AVX2 version reads 32 bits for every 16-bit value, so
+    /// there must be one more readable value after the last table.
+    void get_block(float *output, const uint16_t *slices, unsigned int nsamples);
 };
 
 class wavetable_voice: public dsp::voice
@@ -57,8 +63,12 @@ protected:
     dsp::adsr envs[EnvCount];
     /// Current MIDI velocity
     float velocity;
+    /// Mod matrix inputs for the current block
+    float modsrc[wavetable_metadata::modsrc_count];
     /// Current calculated mod matrix outputs
     float moddest[wavetable_metadata::moddest_count];
+    /// Velocity-scaled value of the amplitude envelope in the current block
+    float amp_env;
     /// Last oscillator shift (wavetable index) of each oscillator
     float last_oscshift[OscCount];
     /// Last oscillator amplitude of each oscillator
@@ -75,6 +85,12 @@ public:
     void channel_pressure(int value);
     void steal();
     void render_block(int current_snapshot);
+    /// First part of render_block: advance the envelopes and LFOs and set the mod matrix inputs
+    void start_block();
+    /// Rest of render_block, after the mod matrix outputs have been calculated
+    void finish_block(int current_snapshot);
+    float *get_modsrc() { return modsrc; }
+    float *get_moddest() { return moddest; }
     const int16_t *get_last_table(int osc) const;
     virtual int get_current_note() {
         return note;
@@ -105,6 +121,12 @@ protected:
 
 public:
     int16_t tables[wt_count][129][256]; // one dummy level for interpolation
+    /// Room for the wavetable_oscillator::get_block reads past the last value of the last table
+    int16_t tables_padding[2];
+    /// Render the oscillators with wavetable_oscillator::get_block instead of get() (can be switched off for comparison)
+    bool simd_oscillators;
+    /// Calculate the mod matrix for all the voices starting a block at once (can be switched off for comparison)
+    bool batch_modmatrix;
     /// Rows of the modulation matrix
     dsp::modulation_entry mod_matrix_data[mod_matrix_slots];
     /// Smoothed pitch bend value
@@ -122,6 +144,7 @@ public:
     ControlSnapshot control_snapshots[MaxSnapshots];
 
 public:
+    enum { MaxVoices = 36 };
     wavetable_audio_module();
 
     dsp::voice *alloc_voice() {
@@ -131,6 +154,8 @@ public:
     }
     
     uint32_t get_crate() const { return crate; }
+    /// Same as basic_synth::render_to, but with the mod matrix of all the voices calculated together
+    virtual void render_to(float (*output)[2], int nsamples);
     
     /// process function copied from Organ (will probably need some adjustments as well as implementing the panic flag elsewhere
     uint32_t process(uint32_t offset, uint32_t nsamples, uint32_t inputs_mask, uint32_t outputs_mask) {
@@ -143,9 +168,11 @@ public:
         }
         
         fill_snapshots(nsamples);
+        // before the voices (and possibly the voice threads) use the matrix
+        check_plan();
         float buf[MAX_SAMPLE_RUN][2];
         dsp::zero(&buf[0][0], 2 * nsamples);
-        basic_synth::render_to(buf, nsamples);
+        render_to(buf, nsamples);
         if (!active_voices.empty())
             last_voice = (wavetable_voice *)*active_voices.begin();
         float gain = 1.0f;
@@ -184,6 +211,7 @@ public:
     bool get_layers(int index, int generation, unsigned int &layers) const { layers = LG_REALTIME_GRAPH; return true; }
     virtual void send_configures(send_configure_iface *sci) { return mod_matrix_impl::send_configures(sci); }
     virtual char *configure(const char *key, const char *value);
+    virtual configure_state *prepare_configure(const char *key, const char *value) { return mod_matrix_impl::prepare_configure(key, value); }
     virtual const dsp::modulation_entry *get_default_mod_matrix_value(int row) const;
 
 };
@@ -0,0 +1,225 @@
+/* Calf DSP Library
+ * Minimal RIFF WAVE file reader and writer.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef CALF_WAVFILE_H
+#define CALF_WAVFILE_H
+
+#include "utils.h"
+#include <algorithm>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace calf_utils {
+
+inline uint32_t get_le16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+inline uint32_t get_le32(const uint8_t *p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+inline void put_le16(uint8_t *p, uint32_t v) { p[0] = v; p[1] = v >> 8; }
+inline void put_le32(uint8_t *p, uint32_t v) { p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24; }
+
+enum { WAVE_FORMAT_PCM = 1, WAVE_FORMAT_IEEE_FLOAT = 3, WAVE_FORMAT_EXTENSIBLE = 0xFFFE };
+
+/// Streaming reader for RIFF WAVE files - 8/16/24/32 bit integer PCM or 32/64 bit float
+class wav_reader
+{
+    FILE *f;
+    int format, bits, bytes_per_frame;
+    std::vector<uint8_t> raw;
+
+    inline float decode(const uint8_t *p) const
+    {
+        switch(format == WAVE_FORMAT_PCM ? bits : -bits)
+        {
+        case 8: return (p[0] - 128) * (1.f / 128.f);
+        case 16: return (int16_t)get_le16(p) * (1.f / 32768.f);
+        case 24: return ((int32_t)((p[0] << 8) | (p[1] << 16) | ((uint32_t)p[2] << 24)) >> 8) * (1.f / 8388608.f);
+        case 32: return (int32_t)get_le32(p) * (1.0 / 2147483648.0);
+        case -32: {
+            uint32_t v = get_le32(p);
+            float value;
+            memcpy(&value, &v, sizeof(value));
+            return value;
+        }
+        case -64: {
+            uint64_t v = get_le32(p) | ((uint64_t)get_le32(p + 4) << 32);
+            double value;
+            memcpy(&value, &v, sizeof(value));
+            return value;
+        }
+        }
+        return 0.f;
+    }
+public:
+    int channels, sample_rate;
+    uint32_t frames_left;
+
+    wav_reader() : f(NULL) {}
+    ~wav_reader() { if (f) fclose(f); }
+    void open(const std::string &name)
+    {
+        f = fopen(name.c_str(), "rb");
+        if (!f)
+            throw file_exception(name);
+        uint8_t header[12];
+        if (fread(header, 1, 12, f) != 12 || memcmp(header, "RIFF", 4) || memcmp(header + 8, "WAVE", 4))
+            throw file_exception(name, "not a RIFF WAVE file");
+        bool have_format = false;
+        while(true)
+        {
+            uint8_t chunk[8];
+            if (fread(chunk, 1, 8, f) != 8)
+                throw file_exception(name, "no audio data found");
+            uint32_t size = get_le32(chunk + 4);
+            if (!memcmp(chunk, "fmt ", 4))
+            {
+                if (size < 16 || size > 1024)
+                    throw file_exception(name, "invalid format chunk");
+                std::vector<uint8_t> fmt(size + (size & 1));
+                if (fread(&fmt[0], 1, fmt.size(), f) != fmt.size())
+                    throw file_exception(name, "truncated format chunk");
+                format = get_le16(&fmt[0]);
+                channels = get_le16(&fmt[2]);
+                sample_rate = get_le32(&fmt[4]);
+                bits = get_le16(&fmt[14]);
+                if (format == WAVE_FORMAT_EXTENSIBLE && size >= 26)
+                    format = get_le16(&fmt[24]);
+                have_format = true;
+            }
+            else if (!memcmp(chunk, "data", 4))
+            {
+                if (!have_format)
+                    throw file_exception(name, "audio data before the format chunk");
+                bool supported = (format == WAVE_FORMAT_PCM && (bits == 8 || bits == 16 || bits == 24 || bits == 32))
+                    || (format == WAVE_FORMAT_IEEE_FLOAT && (bits == 32 || bits == 64));
+                if (!supported || channels < 1 || sample_rate < 1)
+                    throw file_exception(name, "unsupported sample format");
+                bytes_per_frame = channels * bits / 8;
+                frames_left = size / bytes_per_frame;
+                return;
+            }
+            else if (fseek(f, size + (size & 1), SEEK_CUR))
+                throw file_exception(name);
+        }
+    }
+    /// Read up to len frames into per-channel buffers, returns the number of frames read
+    uint32_t read(float **data, uint32_t len)
+    {
+        len = std::min(len, frames_left);
+        if (!len)
+            return 0;
+        raw.resize(len * bytes_per_frame);
+        uint32_t got = fread(&raw[0], bytes_per_frame, len, f);
+        int bytes = bits / 8;
+        const uint8_t *p = &raw[0];
+        for (uint32_t i = 0; i < got; i++)
+        {
+            for (int c = 0; c < channels; c++, p += bytes)
+                data[c][i] = decode(p);
+        }
+        frames_left = (got < len) ? 0 : frames_left - got;
+        return got;
+    }
+};
+
+/// Streaming writer for 32 bit float RIFF WAVE files
+class wav_writer
+{
+    FILE *f;
+    std::string name;
+    int channels;
+    uint32_t frames;
+    std::vector<uint8_t> raw;
+
+    enum { header_size = 56 };
+    void write_header(int sample_rate)
+    {
+        uint32_t data_size = frames * channels * 4;
+        uint8_t header[header_size];
+        memcpy(header, "RIFF", 4);
+        put_le32(header + 4, header_size - 8 + data_size);
+        memcpy(header + 8, "WAVE", 4);
+        memcpy(header + 12, "fmt ", 4);
+        put_le32(header + 16, 16);
+        put_le16(header + 20, WAVE_FORMAT_IEEE_FLOAT);
+        put_le16(header + 22, channels);
+        put_le32(header + 24, sample_rate);
+        put_le32(header + 28, sample_rate * channels * 4);
+        put_le16(header + 32, channels * 4);
+        put_le16(header + 34, 32);
+        memcpy(header + 36, "fact", 4);
+        put_le32(header + 40, 4);
+        put_le32(header + 44, frames);
+        memcpy(header + 48, "data", 4);
+        put_le32(header + 52, data_size);
+        if (fwrite(header, 1, header_size, f) != header_size)
+            throw file_exception(name);
+    }
+public:
+    int sample_rate;
+
+    wav_writer() : f(NULL) {}
+    ~wav_writer() { if (f) fclose(f); }
+    void open(const std::string &_name, int _channels, int _sample_rate)
+    {
+        name = _name;
+        channels = _channels;
+        sample_rate = _sample_rate;
+        frames = 0;
+        f = fopen(name.c_str(), "wb");
+        if (!f)
+            throw file_exception(name);
+        // sizes are filled in by close()
+        write_header(sample_rate);
+    }
+    void write(float **data, uint32_t len)
+    {
+        if ((uint64_t)(frames + len) * channels * 4 > 0xFFFFFFFFU - header_size)
+            throw file_exception(name, "output file too large for the WAVE format");
+        raw.resize(len * channels * 4);
+        uint8_t *p = &raw[0];
+        for (uint32_t i = 0; i < len; i++)
+        {
+            for (int c = 0; c < channels; c++, p += 4)
+            {
+                uint32_t v;
+                memcpy(&v, &data[c][i], sizeof(v));
+                put_le32(p, v);
+            }
+        }
+        if (fwrite(&raw[0], 1, raw.size(), f) != raw.size())
+            throw file_exception(name);
+        frames += len;
+    }
+    void close()
+    {
+        if (fseek(f, 0, SEEK_SET))
+            throw file_exception(name);
+        write_header(sample_rate);
+        int result = fclose(f);
+        f = NULL;
+        if (result)
+            throw file_exception(name);
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,425 @@
+/* Calf DSP Library
+ * Zero latency partitioned convolution.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02111-1307, USA.
+ */
+#include <calf/convolver.h>
+#include <calf/wavfile.h>
+#include <calf/utils.h>
+#include <math.h>
+#include <map>
+#include <vector>
+
+using namespace dsp;
+using namespace std;
+
+const unsigned convolution_ir::stage_size[convolution_ir::STAGES] = { 64, 512, 4096 };
+const unsigned convolution_ir::stage_start[convolution_ir::STAGES] = { 64, 1024, 8192 };
+
+namespace {
+
+typedef map<string, convolution_ir *> ir_map;
+
+calf_utils::ptmutex &ir_cache_mutex()
+{
+    static calf_utils::ptmutex mutex;
+    return mutex;
+}
+
+ir_map &ir_cache()
+{
+    static ir_map cache;
+    return cache;
+}
+
+/// Windowed sinc sample rate conversion of an impulse response. The result
+/// is scaled by from / to, so that the gain of the convolution stays the same.
+void resample(vector<float> &data, uint32_t from, uint32_t to)
+{
+    double ratio = (double)to / from;
+    double cutoff = std::min(1.0, ratio);
+    int width = (int)ceil(16 / cutoff);
+    int len = data.size();
+    vector<float> result((size_t)ceil(len * ratio));
+    for (size_t n = 0; n < result.size(); n++)
+    {
+        double t = n / ratio;
+        int center = (int)t;
+        double sum = 0;
+        for (int i = std::max(0, center - width + 1); i <= center + width && i < len; i++)
+        {
+            double d = t - i;
+            double x = M_PI * cutoff * d;
+            double sinc = fabs(x) < 1e-9 ? 1.0 : sin(x) / x;
+            double window = 0.42 + 0.5 * cos(M_PI * d / width) + 0.08 * cos(2 * M_PI * d / width);
+            sum += data[i] * cutoff * sinc * window;
+        }
+        result[n] = sum / ratio;
+    }
+    data.swap(result);
+}
+
+}
+
+convolution_ir::convolution_ir(const string &_key)
+: key(_key)
+, refs(1)
+{
+    for (int s = 0; s < STAGES; s++)
+    {
+        stages[s].setup = NULL;
+        stages[s].spectra = NULL;
+        stages[s].count = 0;
+    }
+}
+
+convolution_ir::~convolution_ir()
+{
+    for (int s = 0; s < STAGES; s++)
+    {
+        if (stages[s].setup)
+            pffft_destroy_setup(stages[s].setup);
+        if (stages[s].spectra)
+            pffft_aligned_free(stages[s].spectra);
+    }
+}
+
+void convolution_ir::build(float *const *data, unsigned _channels, unsigned _length)
+{
+    channels = _channels;
+    length = _length;
+    for (unsigned c = 0; c < MAX_CHANNELS; c++)
+    {
+        const float *src = data[c < channels ? c : 0];
+        for (unsigned t = 0; t < HEAD; t++)
+            head[c][HEAD - 1 - t] = t < length ? src[t] : 0.f;
+    }
+    for (int s = 0; s < STAGES; s++)
+    {
+        stage &st = stages[s];
+        unsigned size = stage_size[s];
+        unsigned end = s < STAGES - 1 ? std::min(length, stage_start[s + 1]) : length;
+        st.size = size;
+        st.first = stage_start[s] / size;
+        st.count = end > stage_start[s] ? (end - stage_start[s] + size - 1) / size : 0;
+        if (!st.count)
+            continue;
+        st.setup = pffft_new_setup(2 * size, PFFFT_REAL);
+        st.spectra = (float *)pffft_aligned_malloc(2 * size * channels * st.count * sizeof(float));
+        float *buf = (float *)pffft_aligned_malloc(2 * size * sizeof(float));
+        float *work = (float *)pffft_aligned_malloc(2 * size * sizeof(float));
+        float scale = 1.f / (2 * size);
+        for (unsigned c = 0; c < channels; c++)
+        {
+            for (unsigned p = 0; p < st.count; p++)
+            {
+                unsigned from = (st.first + p) * size;
+                unsigned taps = std::min(size, end - from);
+                // overlap-save: the partition goes into the first half, the
+                // second half of the inverse transform is the valid output
+                memset(buf, 0, 2 * size * sizeof(float));
+                for (unsigned t = 0; t < taps; t++)
+                    buf[t] = data[c][from + t] * scale;
+                pffft_transform(st.setup, buf, (float *)st.spectrum(c, p), work, PFFFT_FORWARD);
+            }
+        }
+        pffft_aligned_free(buf);
+        pffft_aligned_free(work);
+    }
+}
+
+const convolution_ir *convolution_ir::acquire(const string &file_name, uint32_t srate, string &error)
+{
+    string key = file_name + "\n" + calf_utils::i2s(srate);
+    calf_utils::ptlock lock(ir_cache_mutex());
+    ir_map &cache = ir_cache();
+    ir_map::iterator i = cache.find(key);
+    if (i != cache.end())
+    {
+        i->second->refs++;
+        return i->second;
+    }
+
+    vector<vector<float> > data;
+    uint32_t file_rate;
+    try {
+        calf_utils::wav_reader reader;
+        reader.open(file_name);
+        file_rate = reader.sample_rate;
+        uint32_t frames = std::min<uint64_t>(reader.frames_left, (uint64_t)MAX_LENGTH * file_rate / srate);
+        data.resize(reader.channels);
+        vector<float *> ptrs(reader.channels);
+        for (int c = 0; c < reader.channels; c++)
+        {
+            data[c].resize(std::max<uint32_t>(frames, 1));
+            ptrs[c] = &data[c][0];
+        }
+        frames = reader.read(&ptrs[0], frames);
+        // channels past the second one are ignored
+        data.resize(std::min<size_t>(data.size(), MAX_CHANNELS));
+        for (size_t c = 0; c < data.size(); c++)
+            data[c].resize(frames);
+    }
+    catch(calf_utils::file_exception &e)
+    {
+        error = e.what();
+        return NULL;
+    }
+    if (file_rate != srate)
+    {
+        for (size_t c = 0; c < data.size(); c++)
+            resample(data[c], file_rate, srate);
+    }
+    // trailing silence would only cost CPU time
+    size_t length = data[0].size();
+    while(length > 0)
+    {
+        bool silent = true;
+        for (size_t c = 0; c < data.size(); c++)
+            silent = silent && fabs(data[c][length - 1]) < 1e-6f;
+        if (!silent)
+            break;
+        length--;
+    }
+    if (!length)
+    {
+        error = "The impulse response is empty or silent";
+        return NULL;
+    }
+    length = std::min<size_t>(length, MAX_LENGTH);
+
+    float *ptrs[MAX_CHANNELS];
+    for (size_t c = 0; c < data.size(); c++)
+        ptrs[c] = &data[c][0];
+    convolution_ir *ir = new convolution_ir(key);
+    ir->file_rate = file_rate;
+    ir->srate = srate;
+    ir->build(ptrs, data.size(), length);
+    cache[key] = ir;
+    return ir;
+}
+
+void convolution_ir::release(const convolution_ir *ir)
+{
+    calf_utils::ptlock lock(ir_cache_mutex());
+    convolution_ir *mutable_ir = const_cast<convolution_ir *>(ir);
+    if (--mutable_ir->refs)
+        return;
+    ir_cache().erase(ir->key);
+    delete mutable_ir;
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+convolver::convolver(const convolution_ir *_ir)
+: ir(_ir)
+{
+    for (int s = 0; s < convolution_ir::STAGES; s++)
+    {
+        const convolution_ir::stage &is = ir->stages[s];
+        stage_state &st = states[s];
+        st.fdl_size = is.count ? is.first + is.count - 1 : 0;
+        unsigned size = is.size;
+        for (int c = 0; c < convolution_ir::MAX_CHANNELS; c++)
+        {
+            st.input[c] = is.count ? (float *)pffft_aligned_malloc(2 * size * sizeof(float)) : NULL;
+            st.output[c] = is.count ? (float *)pffft_aligned_malloc(size * sizeof(float)) : NULL;
+            st.next[c] = is.count ? (float *)pffft_aligned_malloc(size * sizeof(float)) : NULL;
+            st.fdl[c] = is.count ? (float *)pffft_aligned_malloc(2 * size * st.fdl_size * sizeof(float)) : NULL;
+        }
+        st.accum = is.count ? (float *)pffft_aligned_malloc(2 * size * sizeof(float)) : NULL;
+        st.work = is.count ? (float *)pffft_aligned_malloc(2 * size * sizeof(float)) : NULL;
+        // per channel: forward transform, one step per partition, inverse transform
+        st.steps = is_spread(is) ? convolution_ir::MAX_CHANNELS * (is.count + 2) : 0;
+    }
+    reset();
+}
+
+convolver::~convolver()
+{
+    for (int s = 0; s < convolution_ir::STAGES; s++)
+    {
+        stage_state &st = states[s];
+        if (!ir->stages[s].count)
+            continue;
+        for (int c = 0; c < convolution_ir::MAX_CHANNELS; c++)
+        {
+            pffft_aligned_free(st.input[c]);
+            pffft_aligned_free(st.output[c]);
+            pffft_aligned_free(st.next[c]);
+            pffft_aligned_free(st.fdl[c]);
+        }
+        pffft_aligned_free(st.accum);
+        pffft_aligned_free(st.work);
+    }
+    convolution_ir::release(ir);
+}
+
+void convolver::reset()
+{
+    memset(history, 0, sizeof(history));
+    phase = 0;
+    for (int s = 0; s < convolution_ir::STAGES; s++)
+    {
+        stage_state &st = states[s];
+        st.pos = st.fdl_pos = st.job_slot = 0;
+        st.step = st.steps;
+        unsigned size = ir->stages[s].size;
+        if (!ir->stages[s].count)
+            continue;
+        for (int c = 0; c < convolution_ir::MAX_CHANNELS; c++)
+        {
+            memset(st.input[c], 0, 2 * size * sizeof(float));
+            memset(st.output[c], 0, size * sizeof(float));
+            memset(st.next[c], 0, size * sizeof(float));
+            memset(st.fdl[c], 0, 2 * size * st.fdl_size * sizeof(float));
+        }
+    }
+}
+
+void convolver::run_step(unsigned s)
+{
+    const convolution_ir::stage &is = ir->stages[s];
+    stage_state &st = states[s];
+    unsigned size = is.size;
+    unsigned c = st.step / (is.count + 2), k = st.step % (is.count + 2);
+    float *fdl = st.fdl[c];
+    if (k == 0)
+    {
+        float *slot = fdl + 2 * size * st.job_slot;
+        pffft_transform(is.setup, slot, slot, st.work, PFFFT_FORWARD);
+        memset(st.accum, 0, 2 * size * sizeof(float));
+    }
+    else if (k <= is.count)
+    {
+        // the result is for the block after the next one, so partition k
+        // is applied to the spectrum of the input from k - 2 blocks before
+        unsigned p = k - 1;
+        unsigned slot = (st.job_slot + st.fdl_size + 2 - is.first - p) % st.fdl_size;
+        pffft_zconvolve_accumulate(is.setup, fdl + 2 * size * slot, is.spectrum(ir->channels > 1 ? c : 0, p), st.accum, 1.f);
+    }
+    else
+    {
+        pffft_transform(is.setup, st.accum, st.accum, st.work, PFFFT_BACKWARD);
+        memcpy(st.next[c], st.accum + size, size * sizeof(float));
+    }
+    st.step++;
+}
+
+void convolver::run_stage(unsigned s)
+{
+    const convolution_ir::stage &is = ir->stages[s];
+    stage_state &st = states[s];
+    unsigned size = is.size;
+    if (is_spread(is))
+    {
+        // normally there's nothing left by now
+        while(st.step < st.steps)
+            run_step(s);
+        for (int c = 0; c < convolution_ir::MAX_CHANNELS; c++)
+        {
+            std::swap(st.output[c], st.next[c]);
+            // transformed in place by the first step of the new job
+            memcpy(st.fdl[c] + 2 * size * st.fdl_pos, st.input[c], 2 * size * sizeof(float));
+            memcpy(st.input[c], st.input[c] + size, size * sizeof(float));
+        }
+        st.job_slot = st.fdl_pos;
+        st.step = 0;
+        st.fdl_pos = (st.fdl_pos + 1) % st.fdl_size;
+        st.pos = 0;
+        return;
+    }
+    for (int c = 0; c < convolution_ir::MAX_CHANNELS; c++)
+    {
+        unsigned ic = ir->channels > 1 ? c : 0;
+        float *fdl = st.fdl[c];
+        pffft_transform(is.setup, st.input[c], fdl + 2 * size * st.fdl_pos, st.work, PFFFT_FORWARD);
+        // partition k is applied to the spectrum of the input from k - 1 blocks ago
+        memset(st.accum, 0, 2 * size * sizeof(float));
+        unsigned slot = (st.fdl_pos + st.fdl_size + 1 - is.first) % st.fdl_size;
+        for (unsigned p = 0; p < is.count; p++)
+        {
+            pffft_zconvolve_accumulate(is.setup, fdl + 2 * size * slot, is.spectrum(ic, p), st.accum, 1.f);
+            slot = slot ? slot - 1 : st.fdl_size - 1;
+        }
+        pffft_transform(is.setup, st.accum, st.accum, st.work, PFFFT_BACKWARD);
+        memcpy(st.output[c], st.accum + size, size * sizeof(float));
+        memcpy(st.input[c], st.input[c] + size, size * sizeof(float));
+    }
+    st.fdl_pos = (st.fdl_pos + 1) % st.fdl_size;
+    st.pos = 0;
+}
+
+void convolver::process(const float *in_l, const float *in_r, float *out_l, float *out_r, unsigned len)
+{
+    enum { HEAD = convolution_ir::HEAD };
+    const float *ins[2] = { in_l, in_r };
+    float *outs[2] = { out_l, out_r };
+    while(len)
+    {
+        // the smallest partition is HEAD samples long, so no stage completes
+        // its block in the middle of a chunk
+        unsigned n = std::min(len, HEAD - phase);
+        for (int c = 0; c < convolution_ir::MAX_CHANNELS; c++)
+        {
+            memcpy(history[c] + HEAD - 1, ins[c], n * sizeof(float));
+            for (int s = 0; s < convolution_ir::STAGES; s++)
+            {
+                if (ir->stages[s].count)
+                    memcpy(states[s].input[c] + ir->stages[s].size + states[s].pos, ins[c], n * sizeof(float));
+            }
+        }
+        for (int c = 0; c < convolution_ir::MAX_CHANNELS; c++)
+        {
+            const float *h = ir->head[c];
+            const float *x = history[c];
+            float *out = outs[c];
+            for (unsigned i = 0; i < n; i++)
+            {
+                float sum = 0.f;
+                for (int t = 0; t < HEAD; t++)
+                    sum += h[t] * x[i + t];
+                out[i] = sum;
+            }
+            for (int s = 0; s < convolution_ir::STAGES; s++)
+            {
+                if (!ir->stages[s].count)
+                    continue;
+                const float *y = states[s].output[c] + states[s].pos;
+                for (unsigned i = 0; i < n; i++)
+                    out[i] += y[i];
+            }
+            memmove(history[c], history[c] + n, (HEAD - 1) * sizeof(float));
+            ins[c] += n;
+            outs[c] += n;
+        }
+        for (int s = 0; s < convolution_ir::STAGES; s++)
+        {
+            if (!ir->stages[s].count)
+                continue;
+            stage_state &st = states[s];
+            st.pos += n;
+            // keep the spread work in step with the input
+            unsigned target = (unsigned)((uint64_t)st.steps * st.pos / ir->stages[s].size);
+            while(st.step < target)
+                run_step(s);
+            if (st.pos == ir->stages[s].size)
+                run_stage(s);
+        }
+        phase = (phase + n) % HEAD;
+        len -= n;
+    }
+}
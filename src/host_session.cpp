@@ -217,7 +217,9 @@ void host_session::remove_plugin(plugin_ctl_iface *plugin)
             plugins.erase(plugins.begin() + i);
             if (has_gui)
                 main_win->del_plugin(plugin);
-            delete plugin;
+            // the client deletes it once the process callback is done with
+            // it - which must happen before its port names can be reused
+            client.collect_garbage(true);
             return;
         }
     }
@@ -246,8 +248,8 @@ void host_session::remove_all_plugins()
         plugins.erase(plugins.begin());
         if (has_gui)
             main_win->del_plugin(plugin);
-        delete plugin;
     }
+    client.collect_garbage(true);
     instances.clear();
 }
 
@@ -591,6 +593,10 @@ void host_session::signal_handler(int signum)
 
 void host_session::on_idle()
 {
+    if (client.graph_changed)
+        client.update_plugin_graph();
+    client.collect_garbage();
+
     if (save_file_on_next_idle_call)
     {
         save_file_on_next_idle_call = false;
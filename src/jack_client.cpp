@@ -25,6 +25,13 @@
 #include <calf/giface.h>
 #include <calf/jackhost.h>
 #include <set>
+#include <limits.h>
+#include <sched.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
 
 using namespace std;
 using namespace calf_utils;
@@ -39,12 +46,26 @@ jack_client::jack_client()
     sample_rate = 0;
     client = NULL;
     automation_port = NULL;
+    worker_threads = 0;
+    graph_changed = false;
+    current_list = new plugin_list(plugins);
+    cycles_started = cycles_finished = 0;
+    jack_active = false;
+}
+
+jack_client::~jack_client()
+{
+    jack_active = false;
+    collect_garbage();
+    delete current_list.load();
 }
 
 void jack_client::add(jack_host *plugin)
 {
     calf_utils::ptlock lock(mutex);
     plugins.push_back(plugin);
+    publish(new plugin_list(plugins));
+    graph_changed = true;
 }
 
 void jack_client::del(jack_host *plugin)
@@ -55,12 +76,65 @@ void jack_client::del(jack_host *plugin)
         if (plugins[i] == plugin)
         {
             plugins.erase(plugins.begin()+i);
+            publish(new plugin_list(plugins));
+            retire(plugin);
+            graph_changed = true;
             return;
         }
     }
     assert(0);
 }
 
+void jack_client::publish(plugin_list *list)
+{
+    plugin_list *old = current_list.exchange(list);
+    retire(old);
+}
+
+void jack_client::retire_func(const std::function<void()> &release)
+{
+    // Any cycle that may have seen the object has started by now, so it's
+    // safe to free once that many cycles have finished
+    garbage_item item;
+    item.cycle = cycles_started.load();
+    item.release = release;
+    ptlock lock(garbage_mutex);
+    garbage.push_back(item);
+}
+
+void jack_client::collect_garbage(bool wait)
+{
+    if (wait && jack_active)
+    {
+        unsigned int last;
+        {
+            ptlock lock(garbage_mutex);
+            if (garbage.empty())
+                return;
+            last = garbage.back().cycle;
+        }
+        // give the process callback up to a second to get past the objects
+        for (int i = 0; i < 1000 && (int)(cycles_finished.load() - last) < 0; i++)
+            usleep(1000);
+    }
+    unsigned int finished = cycles_finished.load();
+    std::vector<garbage_item> keep, expired;
+    {
+        ptlock lock(garbage_mutex);
+        for (unsigned int i = 0; i < garbage.size(); i++)
+        {
+            if (!jack_active || (int)(finished - garbage[i].cycle) >= 0)
+                expired.push_back(garbage[i]);
+            else
+                keep.push_back(garbage[i]);
+        }
+        garbage.swap(keep);
+    }
+    // outside of the lock, as deleting a plugin may retire more objects
+    for (unsigned int i = 0; i < expired.size(); i++)
+        expired[i].release();
+}
+
 void jack_client::open(const char *client_name, const char *jack_session_id)
 {
     jack_status_t status;
@@ -73,6 +147,7 @@ void jack_client::open(const char *client_name, const char *jack_session_id)
     sample_rate = jack_get_sample_rate(client);
     jack_set_process_callback(client, do_jack_process, this);
     jack_set_buffer_size_callback(client, do_jack_bufsize, this);
+    jack_set_graph_order_callback(client, do_jack_graph_order, this);
     name = get_name();
 }
 
@@ -83,12 +158,18 @@ std::string jack_client::get_name()
 
 void jack_client::activate()
 {
+    if (worker_threads > 0)
+        scheduler.start(client, worker_threads);
+    jack_active = true;
     jack_activate(client);        
 }
 
 void jack_client::deactivate()
 {
     jack_deactivate(client);        
+    jack_active = false;
+    scheduler.stop();
+    collect_garbage();
 }
 
 void jack_client::connect(const std::string &p1, const std::string &p2)
@@ -126,11 +207,13 @@ class jack_automation: public automation_iface
         }
     }
 public:
-    jack_automation(jack_port_t *automation_port, int nframes, jack_host *_plugin)
+    /// automation_buffer is the automation port's buffer for the cycle, which
+    /// is only read here, so several plugins may use it at the same time
+    jack_automation(void *automation_buffer, int nframes, jack_host *_plugin)
     {
         event_pos = 0;
         plugin = _plugin;
-        midi_data = jack_port_get_buffer(automation_port, nframes);
+        midi_data = automation_buffer;
         event_count = jack_midi_get_event_count(midi_data NFRAMES_MAYBE(nframes));
     }
     
@@ -152,24 +235,38 @@ public:
 int jack_client::do_jack_process(jack_nframes_t nframes, void *p)
 {
     jack_client *self = (jack_client *)p;
-    pttrylock lock(self->mutex);
-    if (lock.is_locked())
+    unsigned int cycle = self->cycles_started.fetch_add(1) + 1;
+    plugin_list *list = self->current_list.load();
+    void *automation_buffer = jack_port_get_buffer(self->automation_port, nframes);
+    if (self->scheduler.is_usable(*list))
+        self->scheduler.process(*list, nframes, automation_buffer);
+    else
     {
-        for(unsigned int i = 0; i < self->plugins.size(); i++)
+        for(unsigned int i = 0; i < list->plugins.size(); i++)
         {
-            jack_automation au(self->automation_port, nframes, self->plugins[i]);
-            self->plugins[i]->process(nframes, au);
+            jack_automation au(automation_buffer, nframes, list->plugins[i]);
+            list->plugins[i]->process(nframes, au);
         }
     }
+    self->cycles_finished.store(cycle);
+    return 0;
+}
+
+int jack_client::do_jack_graph_order(void *p)
+{
+    jack_client *self = (jack_client *)p;
+    self->graph_changed = true;
     return 0;
 }
 
 int jack_client::do_jack_bufsize(jack_nframes_t numsamples, void *p)
 {
     jack_client *self = (jack_client *)p;
-    ptlock lock(self->mutex);
-    for(unsigned int i = 0; i < self->plugins.size(); i++)
-        self->plugins[i]->cache_ports();
+    unsigned int cycle = self->cycles_started.fetch_add(1) + 1;
+    plugin_list *list = self->current_list.load();
+    for(unsigned int i = 0; i < list->plugins.size(); i++)
+        list->plugins[i]->cache_ports();
+    self->cycles_finished.store(cycle);
     return 0;
 }
 
@@ -177,9 +274,11 @@ void jack_client::delete_plugins()
 {
     ptlock lock(mutex);
     for (unsigned int i = 0; i < plugins.size(); i++) {
-        delete plugins[i];
+        retire(plugins[i]);
     }
     plugins.clear();
+    publish(new plugin_list(plugins));
+    collect_garbage();
 }
 
 void jack_client::create_automation_input()
@@ -195,10 +294,9 @@ void jack_client::destroy_automation_input()
         jack_port_unregister(client, automation_port);
 }
 
-void jack_client::calculate_plugin_order(std::vector<int> &indices)
+void jack_client::get_plugin_connections(std::multimap<int, int> &run_before)
 {
     map<string, int> port_to_plugin;
-    multimap<int, int> run_before;
     for (unsigned int i = 0; i < plugins.size(); i++)
     {
         vector<jack_host::port *> ports;
@@ -232,6 +330,12 @@ void jack_client::calculate_plugin_order(std::vector<int> &indices)
             jack_free(conns);
         }
     }
+}
+
+void jack_client::calculate_plugin_order(std::vector<int> &indices)
+{
+    multimap<int, int> run_before;
+    get_plugin_connections(run_before);
     
     struct deptracker
     {
@@ -271,8 +375,12 @@ void jack_client::apply_plugin_order(const std::vector<int> &indices)
     assert(indices.size() == plugins.size());
     for (unsigned int i = 0; i < indices.size(); i++)
         plugins_new.push_back(plugins[indices[i]]);
-    ptlock lock(mutex);
-    plugins.swap(plugins_new);
+    {
+        ptlock lock(mutex);
+        plugins.swap(plugins_new);
+        publish(new plugin_list(plugins));
+    }
+    update_plugin_graph();
     
     string s;
     for (unsigned int i = 0; i < plugins.size(); i++)    
@@ -283,3 +391,242 @@ void jack_client::apply_plugin_order(const std::vector<int> &indices)
     }
     printf("Order: %s\n", s.c_str());
 }
+
+void jack_client::update_plugin_graph()
+{
+    graph_changed = false;
+    multimap<int, int> run_before;
+    get_plugin_connections(run_before);
+    
+    // Any connection between two plugins means they must not run at the
+    // same time. Keep the order they'd run in serially, so that a feedback
+    // connection still reads the previous cycle's data.
+    set<pair<int, int> > edges;
+    for (multimap<int, int>::const_iterator i = run_before.begin(); i != run_before.end(); ++i)
+    {
+        if (i->first != i->second)
+            edges.insert(make_pair(min(i->first, i->second), max(i->first, i->second)));
+    }
+    plugin_graph graph;
+    graph.resize(plugins.size());
+    for (set<pair<int, int> >::const_iterator i = edges.begin(); i != edges.end(); ++i)
+    {
+        graph.dependents[i->first].push_back(i->second);
+        graph.dependency_count[i->second]++;
+    }
+    
+    ptlock lock(mutex);
+    plugin_list *list = new plugin_list(plugins);
+    list->set_graph(graph);
+    publish(list);
+}
+
+void plugin_list::set_graph(plugin_graph &new_graph)
+{
+    std::swap(graph, new_graph);
+    delete []pending;
+    delete []ready;
+    pending = new std::atomic<int>[graph.size()];
+    ready = new std::atomic<int>[graph.size()];
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static inline void cpu_relax()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#endif
+}
+
+/// Busy wait step that gives up the CPU now and then, in case the thread
+/// being waited for shares the core (all the threads are SCHED_FIFO with
+/// the same priority, so it would never get to run otherwise)
+static inline void spin_wait(int &spins)
+{
+    if (++spins & 63)
+        cpu_relax();
+    else
+        sched_yield();
+}
+
+static void futex_wait(std::atomic<int> *addr, int value)
+{
+#if defined(__linux__)
+    syscall(SYS_futex, (int *)addr, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+#else
+    if (addr->load() == value)
+        usleep(100);
+#endif
+}
+
+static void futex_wake(std::atomic<int> *addr)
+{
+#if defined(__linux__)
+    syscall(SYS_futex, (int *)addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#endif
+}
+
+parallel_scheduler::parallel_scheduler()
+{
+    ready_read = ready_write = remaining = 0;
+    cycle = 0;
+    active = sleepers = 0;
+    quit = false;
+    cycle_list = NULL;
+    cycle_nframes = 0;
+    cycle_automation_buffer = NULL;
+}
+
+parallel_scheduler::~parallel_scheduler()
+{
+    stop();
+}
+
+void parallel_scheduler::start(jack_client_t *client, int threads)
+{
+    stop();
+    quit = false;
+    workers.resize(threads);
+    int priority = jack_client_real_time_priority(client);
+    for (int i = 0; i < threads; i++)
+    {
+        workers[i].owner = this;
+        if (jack_client_create_thread(client, &workers[i].thread, priority, jack_is_realtime(client) && priority >= 0, worker_thread, &workers[i]))
+        {
+            fprintf(stderr, "Could not create worker thread %d, processing plugins serially\n", i + 1);
+            workers.resize(i);
+            stop();
+            return;
+        }
+    }
+}
+
+void parallel_scheduler::stop()
+{
+    if (workers.empty())
+        return;
+    quit = true;
+    // keep the cycle closed (even) while waking everybody up
+    cycle.fetch_add(2);
+    futex_wake(&cycle);
+    for (unsigned int i = 0; i < workers.size(); i++)
+        pthread_join(workers[i].thread, NULL);
+    workers.clear();
+}
+
+void parallel_scheduler::push_ready(int plugin)
+{
+    int pos = ready_write.fetch_add(1);
+    cycle_list->ready[pos].store(plugin, std::memory_order_release);
+}
+
+int parallel_scheduler::pop_ready()
+{
+    int pos = ready_read.load();
+    while (pos < ready_write.load())
+    {
+        if (ready_read.compare_exchange_weak(pos, pos + 1))
+        {
+            // the slot is reserved by now, it may just not be filled in yet
+            int plugin, spins = 0;
+            while((plugin = cycle_list->ready[pos].load(std::memory_order_acquire)) < 0)
+                spin_wait(spins);
+            return plugin;
+        }
+    }
+    return -1;
+}
+
+void parallel_scheduler::run_plugins()
+{
+    int spins = 0;
+    while(remaining.load(std::memory_order_acquire) > 0)
+    {
+        int plugin = pop_ready();
+        if (plugin < 0)
+        {
+            spin_wait(spins);
+            continue;
+        }
+        jack_host *host = cycle_list->plugins[plugin];
+        jack_automation au(cycle_automation_buffer, cycle_nframes, host);
+        host->process(cycle_nframes, au);
+        const std::vector<int> &deps = cycle_list->graph.dependents[plugin];
+        for (unsigned int i = 0; i < deps.size(); i++)
+        {
+            if (cycle_list->pending[deps[i]].fetch_sub(1, std::memory_order_acq_rel) == 1)
+                push_ready(deps[i]);
+        }
+        remaining.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+void parallel_scheduler::process(plugin_list &list, jack_nframes_t nframes, void *automation_buffer)
+{
+    const plugin_graph &graph = list.graph;
+    int count = graph.size();
+    cycle_list = &list;
+    cycle_nframes = nframes;
+    cycle_automation_buffer = automation_buffer;
+    for (int i = 0; i < count; i++)
+    {
+        list.pending[i].store(graph.dependency_count[i], std::memory_order_relaxed);
+        list.ready[i].store(-1, std::memory_order_relaxed);
+    }
+    ready_read = 0;
+    ready_write = 0;
+    remaining = count;
+    for (int i = 0; i < count; i++)
+    {
+        if (!graph.dependency_count[i])
+            push_ready(i);
+    }
+    // open the cycle and wake up the workers that went to sleep
+    cycle.fetch_add(1);
+    if (sleepers.load())
+        futex_wake(&cycle);
+    run_plugins();
+    // close the cycle, and wait for stragglers to leave it before anything
+    // gets reset for the next one
+    cycle.fetch_add(1);
+    int spins = 0;
+    while(active.load())
+        spin_wait(spins);
+}
+
+void parallel_scheduler::worker_loop()
+{
+    int last_cycle = cycle.load();
+    while(!quit)
+    {
+        int current = cycle.load();
+        if (!(current & 1) || current == last_cycle)
+        {
+            // spin for a little while, the next cycle or the rest of this
+            // one is likely close, then sleep until the cycle counter changes
+            for (int i = 0; i < 1000 && cycle.load() == current; i++)
+                cpu_relax();
+            if (cycle.load() != current)
+                continue;
+            sleepers.fetch_add(1);
+            if (!quit)
+                futex_wait(&cycle, current);
+            sleepers.fetch_sub(1);
+            continue;
+        }
+        active.fetch_add(1);
+        // the cycle might have been closed in the meantime
+        if (cycle.load() == current)
+            run_plugins();
+        active.fetch_sub(1);
+        last_cycle = current;
+    }
+}
+
+void *parallel_scheduler::worker_thread(void *arg)
+{
+    worker *w = (worker *)arg;
+    w->owner->worker_loop();
+    return NULL;
+}
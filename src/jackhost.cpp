@@ -20,6 +20,7 @@
  */
 #include <jack/midiport.h>
 #include <calf/host_session.h>
+#include <calf/offline_render.h>
 #include <calf/preset.h>
 #include <calf/gtk_session_env.h>
 #include <calf/plugin_tools.h>
@@ -177,10 +178,12 @@ void jack_host::rename(std::string name) {
 void jack_host::handle_automation_cc(uint32_t designator, int value)
 {
     last_designator = designator;
-    if (!cc_mappings)
+    // called from the process callback, the map may get replaced meanwhile
+    const automation_map *amap = __atomic_load_n(&cc_mappings, __ATOMIC_ACQUIRE);
+    if (!amap)
         return;
-    automation_map::const_iterator i = cc_mappings->find(designator);
-    while (i != cc_mappings->end() && i->first == designator)
+    automation_map::const_iterator i = amap->find(designator);
+    while (i != amap->end() && i->first == designator)
     {
         const automation_range &r = i->second;
         const parameter_properties *props = metadata->get_param_props(r.param_no);
@@ -286,10 +289,8 @@ int jack_host::process(jack_nframes_t nframes, automation_iface &automation)
     }
     if (metadata->get_midi())
         midi_port.data = (float *)jack_port_get_buffer(midi_port.handle, nframes);
-    if (changed) {
-        module->params_changed();
-        changed = false;
-    }
+    module->check_params_changed(changed);
+    changed = false;
 
     unsigned int time = 0;
     if (metadata->get_midi())
@@ -380,8 +381,9 @@ void jack_host::delete_automation(uint32_t source, int param_no)
 
 void jack_host::replace_automation_map(automation_map *amap)
 {
-    client->atomic_swap(cc_mappings, amap);
-    delete amap;
+    // the process callback may still be using the old map
+    automation_map *old = __atomic_exchange_n(&cc_mappings, amap, __ATOMIC_ACQ_REL);
+    client->retire(old);
 }
 
 void jack_host::get_automation(int param_no, multimap<uint32_t, automation_range> &dests)
@@ -421,7 +423,7 @@ char *jack_host::configure(const char *key, const char *value)
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-static const char *short_options = "c:i:l:o:m:M:s:S:ehvLnt";
+static const char *short_options = "c:i:l:o:m:M:s:S:T:R:ehvLnt";
 
 static struct option long_options[] = {
     {"help", 0, 0, 'h'},
@@ -438,6 +440,8 @@ static struct option long_options[] = {
     {"list", 0, 0, 'L'},
     {"no-gui", 0, 0, 'n'},
     {"no-tray", 0, 0, 't'},
+    {"threads", 1, 0, 'T'},
+    {"render", 1, 0, 'R'},
     {0,0,0,0},
 };
 
@@ -446,6 +450,7 @@ void print_help(char *argv[])
     printf("JACK host for Calf effects\n"
         "Syntax: %s [--client, -c <name>] [--input, -i <name>] [--output, -o <name>] [--midi, -m <name>] [--load|state, -l|s <session>]\n"
         "       [--connect-midi, -M <name|capture-index>] [--help, -h] [--version, -v] [--list, -L] [--no-tray, -t]\n"
+        "       [--threads, -T <count>] [--render, -R <input.wav> <output.wav>]\n"
         "       [!] pluginname[:<preset>] [!] ...\n", 
         argv[0]);
 }
@@ -469,6 +474,7 @@ int main(int argc, char *argv[])
     
     // Scan the options for the first time to find switches like --help, -h or -?
     // This avoids starting communication with LASH when displaying help text.
+    bool render = false;
     while(1)
     {
         int option_index;
@@ -480,15 +486,29 @@ int main(int argc, char *argv[])
             print_help(argv);
             return 0;
         }
+        if (c == 'R')
+        {
+            // skip the output file name, so that getopt doesn't move it to the plugin list
+            if (optind >= argc)
+            {
+                fprintf(stderr, "Missing output file name for --render %s\n", optarg);
+                return 1;
+            }
+            optind++;
+            render = true;
+        }
     }
     // Rewind options to start
     optind = 1;
     
 #if USE_LASH
-    sess.session_manager = create_lash_session_mgr(&sess, argc, argv);
+    // offline rendering doesn't talk to JACK or a session manager at all
+    sess.session_manager = render ? NULL : create_lash_session_mgr(&sess, argc, argv);
 #else
     sess.session_manager = NULL;
 #endif
+    offline_renderer renderer;
+    int worker_threads = 0;
     while(1)
     {
         int option_index;
@@ -524,6 +544,14 @@ int main(int argc, char *argv[])
             case 't':
                 sess.has_trayicon = false;
                 break;
+            case 'T':
+                // extra threads running independent plugin chains in parallel
+                worker_threads = atoi(optarg);
+                sess.client.set_worker_threads(worker_threads);
+                break;
+            case 'R':
+                renderer.add_file(optarg, argv[optind++]);
+                break;
             case 'l':
             case 's':
             {
@@ -583,6 +611,22 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
+    if (render)
+    {
+        // the extra threads render separate files in parallel
+        try {
+            if (!sess.load_name.empty())
+                renderer.load_session(sess.load_name.c_str());
+            for (unsigned int i = 0; i < sess.plugin_names.size(); i++)
+                renderer.add_plugin(sess.plugin_names[i], sess.presets.count(i) ? sess.presets[i] : string());
+        }
+        catch(calf_plugins::preset_exception &e)
+        {
+            fprintf(stderr, "Cannot load '%s': %s\n", sess.load_name.c_str(), e.what());
+            exit(1);
+        }
+        return renderer.run(worker_threads) ? 1 : 0;
+    }
         
     try {
         if(sess.has_gui){
@@ -597,6 +641,9 @@ int main(int argc, char *argv[])
         } else {
             while (sess.quit_on_next_idle_call == 0){
                 sleep(1);
+                if (sess.client.graph_changed)
+                    sess.client.update_plugin_graph();
+                sess.client.collect_garbage();
             }   
         }
         sess.close();
@@ -1,5 +1,7 @@
 #include <config.h>
 #include "calf/lv2wrap.h"
+#include <algorithm>
+#include <stdlib.h>
 
 #if USE_LV2
 
@@ -19,10 +21,20 @@ lv2_instance::lv2_instance(audio_module_iface *_module)
     event_out_data = NULL;
     progress_report_feature = NULL;
     options_feature = NULL;
+    worker_schedule = NULL;
     midi_event_type = 0xFFFFFFFF;
 
     srate_to_set = 44100;
     set_srate = true;
+
+    port_params.resize(real_param_count, NULL);
+    automated_values.resize(real_param_count, 0.f);
+    automated_port_values.resize(real_param_count, 0.f);
+    automated.resize(real_param_count, false);
+    automated_count = 0;
+    automation_pending = false;
+    const char *slice = getenv("CALF_LV2_MIN_SLICE");
+    min_slice = slice ? std::max(1, atoi(slice)) : 16;
 }
 
 void lv2_instance::lv2_instantiate(const LV2_Descriptor * Descriptor, double sample_rate, const char *bundle_path, const LV2_Feature *const *features)
@@ -46,8 +58,25 @@ void lv2_instance::lv2_instantiate(const LV2_Descriptor * Descriptor, double sam
         {
             options_feature = (LV2_Options_Interface *)((*features)->data);
         }
+        else if (!strcmp((*features)->URI, LV2_WORKER__schedule))
+        {
+            worker_schedule = (LV2_Worker_Schedule *)((*features)->data);
+        }
         features++;
     }
+    if (urid_map)
+    {
+        for (int i = 0; i < real_param_count; i++)
+        {
+            const parameter_properties *pp = metadata->get_param_props(i);
+            if (pp->flags & PF_PROP_OUTPUT)
+                continue;
+            std::string pred = std::string(Descriptor->URI) + "#param_" + pp->short_name;
+            uint32_t mapped_uri = urid_map->map(urid_map->handle, pred.c_str());
+            if (mapped_uri)
+                uri_to_param[mapped_uri] = i;
+        }
+    }
     post_instantiate();
 }
 
@@ -80,6 +109,18 @@ void lv2_instance::post_instantiate()
         assert(sequence_type);
         property_type = urid_map->map(urid_map->handle, LV2_ATOM__Property);
         assert(property_type);
+        object_type = urid_map->map(urid_map->handle, LV2_ATOM__Object);
+        blank_type = urid_map->map(urid_map->handle, LV2_ATOM__Blank);
+        urid_type = urid_map->map(urid_map->handle, LV2_ATOM__URID);
+        float_type = urid_map->map(urid_map->handle, LV2_ATOM__Float);
+        double_type = urid_map->map(urid_map->handle, LV2_ATOM__Double);
+        int_type = urid_map->map(urid_map->handle, LV2_ATOM__Int);
+        bool_type = urid_map->map(urid_map->handle, LV2_ATOM__Bool);
+        patch_set_type = urid_map->map(urid_map->handle, LV2_PATCH__Set);
+        patch_property = urid_map->map(urid_map->handle, LV2_PATCH__property);
+        patch_value = urid_map->map(urid_map->handle, LV2_PATCH__value);
+        if (worker_schedule && !vars.empty())
+            work_buffer.resize(16384);
     }
     module->post_instantiate(srate_to_set);
 }
@@ -139,12 +180,25 @@ void lv2_instance::output_event_property(const char *key, const char *value)
 
 void lv2_instance::run(uint32_t SampleCount, bool has_simulate_stereo_input_flag)
 {
+    // after a sample rate change, everything has to be recalculated
+    bool force = set_srate;
     if (set_srate) {
         module->set_sample_rate(srate_to_set);
         module->activate();
         set_srate = false;
     }
-    module->params_changed();
+    // the host moving a control port takes over from the patch:Set automation
+    for (int i = 0; automated_count && i < real_param_count; i++)
+    {
+        if (automated[i] && *port_params[i] != automated_port_values[i])
+        {
+            automated[i] = false;
+            params[i] = port_params[i];
+            automated_count--;
+        }
+    }
+    module->check_params_changed(force);
+    automation_pending = false;
     uint32_t offset = 0;
     if (event_out_data)
     {
@@ -161,7 +215,7 @@ void lv2_instance::run(uint32_t SampleCount, bool has_simulate_stereo_input_flag
     bool simulate_stereo_input = (in_count > 1) && has_simulate_stereo_input_flag && !ins[1];
     if (simulate_stereo_input)
         ins[1] = ins[0];
-    module->process_slice(offset, SampleCount);
+    run_slice(offset, SampleCount);
     if (simulate_stereo_input)
         ins[1] = NULL;
 }
@@ -185,19 +239,147 @@ void lv2_instance::process_event_string(const char *str)
 
 void lv2_instance::process_event_property(const LV2_Atom_Property *prop)
 {
-    if (prop->body.value.type == string_type)
+    if (prop->body.value.type != string_type)
+        return;
+    std::map<uint32_t, int>::iterator i = uri_to_var.find(prop->body.key);
+    if (i == uri_to_var.end())
+        return;
+    const char *value = (const char *)((&prop->body)+1);
+    // Parsing the value may allocate memory, so leave it to the worker
+    // thread if the host has one. The worker's response is applied in
+    // work_response, which is called in the audio thread.
+    uint32_t len = strlen(value) + 1;
+    if (sizeof(work_message) + len <= work_buffer.size())
+    {
+        work_message *msg = (work_message *)&work_buffer[0];
+        msg->type = work_message::configure_var;
+        msg->var = i->second;
+        msg->state = NULL;
+        memcpy(msg + 1, value, len);
+        if (worker_schedule->schedule_work(worker_schedule->handle, sizeof(work_message) + len, msg) == LV2_WORKER_SUCCESS)
+            return;
+    }
+    configure(vars[i->second].name.c_str(), value);
+}
+
+LV2_Worker_Status lv2_instance::work(LV2_Worker_Respond_Function respond, LV2_Worker_Respond_Handle handle, uint32_t size, const void *data)
+{
+    if (size < sizeof(work_message))
+        return LV2_WORKER_ERR_UNKNOWN;
+    const work_message *msg = (const work_message *)data;
+    switch(msg->type)
     {
-        std::map<uint32_t, int>::iterator i = uri_to_var.find(prop->body.key);
-        if (i == uri_to_var.end())
-            printf("Set property %d -> %s\n", prop->body.key, (const char *)((&prop->body)+1));
-        else
-            printf("Set property %s -> %s\n", vars[i->second].name.c_str(), (const char *)((&prop->body)+1));
+    case work_message::configure_var:
+    {
+        if (msg->var < 0 || msg->var >= (int)vars.size())
+            return LV2_WORKER_ERR_UNKNOWN;
+        configure_state *state = module->prepare_configure(vars[msg->var].name.c_str(), (const char *)(msg + 1));
+        if (!state)
+        {
+            // not supported by the module, so configure it in the audio thread as before
+            return respond(handle, size, data);
+        }
+        work_message response = { work_message::apply_state, msg->var, state };
+        LV2_Worker_Status status = respond(handle, sizeof(response), &response);
+        if (status != LV2_WORKER_SUCCESS)
+            delete state;
+        return status;
+    }
+    case work_message::free_state:
+        delete msg->state;
+        return LV2_WORKER_SUCCESS;
+    default:
+        return LV2_WORKER_ERR_UNKNOWN;
+    }
+}
+
+LV2_Worker_Status lv2_instance::work_response(uint32_t size, const void *data)
+{
+    if (size < sizeof(work_message))
+        return LV2_WORKER_ERR_UNKNOWN;
+    const work_message *msg = (const work_message *)data;
+    switch(msg->type)
+    {
+    case work_message::configure_var:
+        configure(vars[msg->var].name.c_str(), (const char *)(msg + 1));
+        return LV2_WORKER_SUCCESS;
+    case work_message::apply_state:
+    {
+        msg->state->apply();
+        // the state may own memory that the audio thread should not free
+        work_message request = { work_message::free_state, msg->var, msg->state };
+        if (worker_schedule->schedule_work(worker_schedule->handle, sizeof(request), &request) != LV2_WORKER_SUCCESS)
+            delete msg->state;
+        return LV2_WORKER_SUCCESS;
+    }
+    default:
+        return LV2_WORKER_ERR_UNKNOWN;
+    }
+}
+
+bool lv2_instance::is_patch_set(const LV2_Atom *atom) const
+{
+    if (atom->type != object_type && atom->type != blank_type)
+        return false;
+    return ((const LV2_Atom_Object *)atom)->body.otype == patch_set_type;
+}
+
+void lv2_instance::process_event_patch_set(const LV2_Atom_Object *obj)
+{
+    const LV2_Atom *property = NULL, *value = NULL;
+    lv2_atom_object_get(obj, patch_property, &property, patch_value, &value, 0);
+    if (!property || !value || property->type != urid_type)
+        return;
+    std::map<uint32_t, int>::const_iterator i = uri_to_param.find(((const LV2_Atom_URID *)property)->body);
+    if (i == uri_to_param.end())
+        return;
+    if (value->type == float_type)
+        set_automated_value(i->second, ((const LV2_Atom_Float *)value)->body);
+    else if (value->type == double_type)
+        set_automated_value(i->second, ((const LV2_Atom_Double *)value)->body);
+    else if (value->type == int_type)
+        set_automated_value(i->second, ((const LV2_Atom_Int *)value)->body);
+    else if (value->type == bool_type)
+        set_automated_value(i->second, ((const LV2_Atom_Bool *)value)->body ? 1.f : 0.f);
+}
+
+void lv2_instance::set_automated_value(int param_no, float value)
+{
+    if (!port_params[param_no])
+        return;
+    const parameter_properties *pp = metadata->get_param_props(param_no);
+    if (!(pp->flags & PF_PROP_NOBOUNDS))
+        value = std::max(pp->min, std::min(pp->max, value));
+    automated_values[param_no] = value;
+    if (!automated[param_no])
+    {
+        automated[param_no] = true;
+        automated_port_values[param_no] = *port_params[param_no];
+        params[param_no] = &automated_values[param_no];
+        automated_count++;
+    }
+    automation_pending = true;
+}
+
+void lv2_instance::connect_param(int param_no, float *data)
+{
+    port_params[param_no] = data;
+    params[param_no] = data;
+    if (automated[param_no])
+    {
+        automated[param_no] = false;
+        automated_count--;
+    }
+}
 
-        if (i != uri_to_var.end())
-            configure(vars[i->second].name.c_str(), (const char *)((&prop->body)+1));
+void lv2_instance::run_slice(uint32_t from, uint32_t to)
+{
+    if (automation_pending)
+    {
+        module->check_params_changed(false);
+        automation_pending = false;
     }
-    else
-        printf("Set property %d -> unknown type %d\n", prop->body.key, prop->body.value.type);
+    module->process_slice(from, to);
 }
 
 void lv2_instance::process_events(uint32_t &offset)
@@ -206,11 +388,19 @@ void lv2_instance::process_events(uint32_t &offset)
         const uint8_t* const data = (const uint8_t*)(ev + 1);
         uint32_t ts = ev->time.frames;
         // printf("Event: timestamp %d type %x vs %x vs %x\n", ts, ev->body.type, midi_event_type, property_type);
-        if (ts > offset)
+        bool patch_set = is_patch_set(&ev->body);
+        // parameter changes are allowed to come a little early instead of
+        // splitting the block into slices too short to be processed efficiently
+        if (ts > offset && (!patch_set || ts >= offset + min_slice))
         {
-            module->process_slice(offset, ts);
+            run_slice(offset, ts);
             offset = ts;
         }
+        if (patch_set)
+        {
+            process_event_patch_set((const LV2_Atom_Object *)&ev->body);
+            continue;
+        }
         if (ev->body.type == string_type)
         {
             process_event_string((const char *)LV2_ATOM_CONTENTS(LV2_Atom_String, &ev->body));
@@ -27,6 +27,7 @@
 #include <calf/lv2_options.h>
 #include <calf/lv2_state.h>
 #include <calf/lv2_urid.h>
+#include <calf/lv2_worker.h>
 #endif
 #ifdef _MSC_VER
     #include "getopt_windows.h"
@@ -63,7 +64,7 @@ static FILE *open_and_check(const std::string &filename)
 }
 
 #if USE_LV2
-static void add_port(string &ports, const char *symbol, const char *name, const char *direction, int pidx, const char *type = "lv2:AudioPort", bool optional = false)
+static void add_port(string &ports, const char *symbol, const char *name, const char *direction, int pidx, const char *type = "lv2:AudioPort", bool optional = false, bool patch_messages = false)
 {
     stringstream ss;
     const char *ind = "        ";
@@ -81,7 +82,10 @@ static void add_port(string &ports, const char *symbol, const char *name, const
     if (!strcmp(type, "atom:AtomPort")) {
         ss << ind << "atom:bufferType atom:Sequence ;\n"
            << ind << "atom:supports lv2midi:MidiEvent ;\n"
-           << ind << "atom:supports atom:Property ;\n"<< endl;
+           << ind << "atom:supports atom:Property ;\n";
+        if (patch_messages)
+            ss << ind << "atom:supports patch:Message ;\n";
+        ss << endl;
     }
     if (!strcmp(std::string(symbol, 0, 4).c_str(), "in_l")) 
         ss << ind << "lv2:designation pg:left ;\n"
@@ -196,6 +200,31 @@ static bool add_ctl_port(string &ports, const parameter_properties &pp, int pidx
     return true;
 }
 
+/// Declare a control port as a parameter that can also be set with
+/// sample accurate patch:Set events (see lv2_instance::process_event_patch_set)
+static void add_ctl_parameter(string &ttl, const parameter_properties &pp)
+{
+    stringstream ss;
+    ss << showpoint;
+    ss << ":param_" << pp.short_name << " a lv2:Parameter ;\n";
+    ss << "    rdfs:label \"" << pp.name << "\" ;\n";
+    // the range is also the atom type hosts send in patch:Set
+    parameter_flags type = (parameter_flags)(pp.flags & PF_TYPEMASK);
+    if (type == PF_BOOL || type == PF_INT || type == PF_ENUM)
+    {
+        ss << "    rdfs:range " << (type == PF_BOOL ? "atom:Bool" : "atom:Int") << " ;\n";
+        ss << "    lv2:minimum " << (int)pp.min << " ;\n";
+        ss << "    lv2:maximum " << (int)pp.max << " .\n\n";
+    }
+    else
+    {
+        ss << "    rdfs:range atom:Float ;\n";
+        ss << "    lv2:minimum " << pp.min << " ;\n";
+        ss << "    lv2:maximum " << pp.max << " .\n\n";
+    }
+    ttl += ss.str();
+}
+
 void make_ttl(string path_prefix, const string *data_dir)
 {
     if (path_prefix.empty())
@@ -224,6 +253,7 @@ void make_ttl(string path_prefix, const string *data_dir)
         "@prefix epp: <http://lv2plug.in/ns/ext/port-props#> .\n"
         "@prefix foaf: <http://xmlns.com/foaf/0.1/> .\n"
         "@prefix param: <http://lv2plug.in/ns/ext/parameters#> .\n"
+        "@prefix patch: <http://lv2plug.in/ns/ext/patch#> .\n"
         "\n"
         "<http://calf.sourceforge.net/team>\n"
         "    a foaf:Person ;\n"
@@ -333,6 +363,20 @@ void make_ttl(string path_prefix, const string *data_dir)
                 "    rdfs:label \"Output\" .\n\n";
         }
         
+        // parameter automation events can only be received through an event input
+        string writable;
+        if (pi->get_midi() || pi->sends_live_updates())
+        {
+            for (int j = 0; j < pi->get_param_count(); j++)
+            {
+                const parameter_properties &props = *pi->get_param_props(j);
+                if (props.flags & PF_PROP_OUTPUT)
+                    continue;
+                add_ctl_parameter(ttl, props);
+                writable += (writable.empty() ? "" : " ,\n        ") + string(":param_") + props.short_name;
+            }
+        }
+
         ttl += uri;
         
         if (classes.count(lpi.plugin_type))
@@ -354,6 +398,8 @@ void make_ttl(string path_prefix, const string *data_dir)
         ttl += "    lv2:optionalFeature epp:supportsStrictBounds ;\n";
         if (pi->is_rt_capable())
             ttl += "    lv2:optionalFeature lv2:hardRTCapable ;\n";
+        if (!pi->is_inplace_safe())
+            ttl += "    lv2:requiredFeature lv2:inPlaceBroken ;\n";
         if (pi->get_midi())
         {
             if (pi->requires_midi()) {
@@ -369,7 +415,11 @@ void make_ttl(string path_prefix, const string *data_dir)
         if (!configure_keys.empty())
         {
             ttl += "    lv2:extensionData <" LV2_STATE__interface "> ;\n";
+            ttl += "    lv2:extensionData <" LV2_WORKER__interface "> ;\n";
+            ttl += "    lv2:optionalFeature <" LV2_WORKER__schedule "> ;\n";
         }
+        if (!writable.empty())
+            ttl += "    patch:writable " + writable + " ;\n";
 
         if(pi->get_input_count() >= 1) {
             ttl += "    pg:mainInput :in ;\n";
@@ -399,10 +449,11 @@ void make_ttl(string path_prefix, const string *data_dir)
                 pn++;
         bool needs_event_io = pi->sends_live_updates();
         if (pi->get_midi() || needs_event_io) {
+            // patch:Set messages for the patch:writable parameters arrive here
             if (pi->get_midi())
-                add_port(ports, "midi_in", "MIDI In", "Input", pn++, "atom:AtomPort", true);
+                add_port(ports, "midi_in", "MIDI In", "Input", pn++, "atom:AtomPort", true, !writable.empty());
             else
-                add_port(ports, "events_in", "Events", "Input", pn++, "atom:AtomPort", true);
+                add_port(ports, "events_in", "Events", "Input", pn++, "atom:AtomPort", true, !writable.empty());
         }
         if (needs_event_io) {
             add_port(ports, "events_out", "Events", "Output", pn++, "atom:AtomPort", true);
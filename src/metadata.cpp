@@ -152,6 +152,8 @@ CALF_PORT_NAMES(reverb) = {"In L", "In R", "Out L", "Out R"};
 
 const char *reverb_room_sizes[] = { "Small", "Medium", "Large", "Tunnel-like", "Large/smooth", "Experimental" };
 
+const char *reverb_engine_names[] = { "Allpass", "FDN" };
+
 CALF_PORT_PROPS(reverb) = {
     { 0,           0,           1,     0,  PF_FLOAT | PF_SCALE_GAIN | PF_CTL_METER | PF_CTLO_LABEL | PF_UNIT_DB | PF_PROP_OUTPUT | PF_PROP_OPTIONAL, NULL, "meter_inL", "Meter-InL" }, \
     { 0,           0,           1,     0,  PF_FLOAT | PF_SCALE_GAIN | PF_CTL_METER | PF_CTLO_LABEL | PF_UNIT_DB | PF_PROP_OUTPUT | PF_PROP_OPTIONAL, NULL, "meter_inR", "Meter-InR" }, \
@@ -175,6 +177,8 @@ CALF_PORT_PROPS(reverb) = {
     { 0,           0,           1,     0,  PF_FLOAT | PF_CTL_LED | PF_PROP_OUTPUT | PF_PROP_OPTIONAL, NULL, "clip_inL", "0dB-InL" }, \
     { 0,           0,           1,     0,  PF_FLOAT | PF_CTL_LED | PF_PROP_OUTPUT | PF_PROP_OPTIONAL, NULL, "clip_inR", "0dB-InR" }, \
     { 0,           0,           1,     0,  PF_FLOAT | PF_CTL_LED | PF_PROP_OUTPUT | PF_PROP_OPTIONAL, NULL, "clip_outR", "0dB-OutR" },
+    { 0,          0,     1, 0,  PF_ENUM | PF_CTL_COMBO, reverb_engine_names, "engine", "Engine" },
+    { 0.5,      0.1,     1, 0,  PF_FLOAT | PF_SCALE_LOG | PF_CTL_KNOB | PF_UNIT_COEF, NULL, "hf_decay", "HF Decay (FDN)" },
     {}
 };
 
@@ -182,6 +186,26 @@ CALF_PLUGIN_INFO(reverb) = { 0x847e, "Reverb", "Calf Reverb", "Calf Studio Gear"
 
 ////////////////////////////////////////////////////////////////////////////
 
+CALF_PORT_NAMES(convolution) = {"In L", "In R", "Out L", "Out R"};
+
+CALF_PORT_PROPS(convolution) = {
+    BYPASS_AND_LEVEL_PARAMS
+    METERING_PARAMS
+    { 1,          0,    2,    0, PF_FLOAT | PF_SCALE_GAIN | PF_CTL_KNOB | PF_UNIT_COEF | PF_PROP_NOBOUNDS, NULL, "dry", "Dry Amount" },
+    { 0.25,       0,    2,    0, PF_FLOAT | PF_SCALE_GAIN | PF_CTL_KNOB | PF_UNIT_COEF | PF_PROP_NOBOUNDS, NULL, "wet", "Wet Amount" },
+    { 0,          0,   60,    0, PF_FLOAT | PF_UNIT_SEC | PF_PROP_OUTPUT, NULL, "ir_length", "IR Length" },
+    {}
+};
+
+CALF_PLUGIN_INFO(convolution) = { 0x8702, "Convolution", "Calf Convolution Reverb", "Calf Studio Gear", calf_plugins::calf_copyright_info, "ReverbPlugin" };
+
+void convolution_metadata::get_configure_vars(vector<string> &names) const
+{
+    names.push_back("ir_file");
+}
+
+////////////////////////////////////////////////////////////////////////////
+
 CALF_PORT_NAMES(filter) = {"In L", "In R", "Out L", "Out R"};
 
 const char *filter_choices[] = {
@@ -695,6 +719,8 @@ CALF_PLUGIN_INFO(multibandgate) = { 0x8505, "MultibandGate", "Calf Multiband Gat
 
 ////////////////////////////////////////////////////////////////////////////
 
+const char *limiter_engine_names[] = { "Classic", "Window" };
+
 CALF_PORT_NAMES(limiter) = {"In L", "In R", "Out L", "Out R"};
 
 CALF_PORT_PROPS(limiter) = {
@@ -713,6 +739,8 @@ CALF_PORT_PROPS(limiter) = {
     { 0.5f,      0.f,         1.f,   0,  PF_FLOAT | PF_SCALE_LINEAR | PF_CTL_KNOB | PF_UNIT_COEF | PF_PROP_GRAPH, NULL, "asc_coeff", "ASC Level" },
     { 1,           1,           4,   0,  PF_INT | PF_SCALE_LINEAR | PF_UNIT_COEF | PF_CTL_KNOB, NULL, "oversampling", "Oversampling" },
     { 1,           0,           1,   0,  PF_BOOL | PF_CTL_TOGGLE, NULL, "auto_level", "Auto-level" },
+    { 0,           0,           1,   0,  PF_ENUM | PF_CTL_COMBO, limiter_engine_names, "engine", "Engine" },
+    { 0,           0,           1,   0,  PF_BOOL | PF_CTL_TOGGLE, NULL, "true_peak", "True Peak" },
     {}
 };
 
@@ -770,6 +798,8 @@ CALF_PORT_PROPS(multibandlimiter) = {
     { 1,           1,           4,   0,  PF_INT | PF_SCALE_LINEAR | PF_UNIT_COEF | PF_CTL_KNOB, NULL, "oversampling", "Oversampling" },
     { 1,           0,           1,   0,  PF_BOOL | PF_CTL_TOGGLE, NULL, "auto_level", "Auto-level" },
 
+    { 0,           0,           1,   0,  PF_ENUM | PF_CTL_COMBO, limiter_engine_names, "engine", "Engine" },
+    { 0,           0,           1,   0,  PF_BOOL | PF_CTL_TOGGLE, NULL, "true_peak", "True Peak" },
     {}
 };
 
@@ -834,6 +864,8 @@ CALF_PORT_PROPS(sidechainlimiter) = {
     { 1,           1,           4,   0,  PF_INT | PF_SCALE_LINEAR | PF_UNIT_COEF | PF_CTL_KNOB, NULL, "oversampling", "Oversampling" },
     { 1,           0.015625,    64,    0,  PF_FLOAT | PF_SCALE_GAIN | PF_CTL_KNOB | PF_UNIT_DB, NULL, "level_sc", "Level S/C"},
     { 1,           0,           1,     0,  PF_BOOL | PF_CTL_TOGGLE, NULL, "auto_level", "Auto-level" },
+    { 0,           0,           1,   0,  PF_ENUM | PF_CTL_COMBO, limiter_engine_names, "engine", "Engine" },
+    { 0,           0,           1,   0,  PF_BOOL | PF_CTL_TOGGLE, NULL, "true_peak", "True Peak" },
     {}
 };
 
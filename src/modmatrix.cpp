@@ -35,6 +35,56 @@ mod_matrix_impl::mod_matrix_impl(dsp::modulation_entry *_matrix, mod_matrix_meta
     matrix_rows = metadata->get_table_rows();
     for (unsigned int i = 0; i < matrix_rows; i++)
         matrix[i].reset();
+    int dest_count = 0;
+    for (const char **names = metadata->get_table_columns()[4].values; names[dest_count]; dest_count++)
+        ;
+    // allocated here, so that the plan can be rebuilt in the audio thread
+    plan_rows.resize(matrix_rows);
+    plan_dests.resize(matrix_rows);
+    plan_stale.resize(dest_count);
+    plan_touched.resize(dest_count);
+    plan_row_count = plan_dest_count = plan_stale_count = 0;
+    plan_dirty = true;
+}
+
+void mod_matrix_impl::compile_plan()
+{
+    int dest_count = plan_touched.size();
+    plan_row_count = plan_dest_count = plan_stale_count = 0;
+    // destination 0 is "None", and rows with zero amount don't add anything
+    for (int dest = 1; dest < dest_count; dest++)
+    {
+        int first = plan_row_count;
+        for (unsigned int i = 0; i < matrix_rows; i++)
+        {
+            const modulation_entry &slot = matrix[i];
+            if (slot.dest != dest || slot.amount == 0)
+                continue;
+            const float *c = scaling_coeffs[slot.mapping];
+            plan_row &row = plan_rows[plan_row_count++];
+            row.src1 = slot.src1;
+            row.src2 = slot.src2;
+            // source 0 is "None", which is always 1, so the mapped value is a constant
+            if (!slot.src1)
+            {
+                row.c0 = (c[0] + c[1] + c[2]) * slot.amount;
+                row.c1 = row.c2 = 0;
+            }
+            else
+            {
+                row.c0 = c[0] * slot.amount;
+                row.c1 = c[1] * slot.amount;
+                row.c2 = c[2] * slot.amount;
+            }
+        }
+        if (plan_row_count > first)
+        {
+            plan_dests[plan_dest_count++] = std::make_pair(dest, plan_row_count);
+            plan_touched[dest] = true;
+        }
+        else if (plan_touched[dest])
+            plan_stale[plan_stale_count++] = dest;
+    }
 }
 
 const float mod_matrix_impl::scaling_coeffs[mod_matrix_metadata::map_type_count][3] = {
@@ -70,10 +120,8 @@ std::string mod_matrix_impl::get_cell(int row, int column) const
     }
 }
     
-void mod_matrix_impl::set_cell(int row, int column, const std::string &src, std::string &error)
+bool mod_matrix_impl::parse_cell(int column, const std::string &src, modulation_entry &slot, std::string &error) const
 {
-    assert(row >= 0 && row < (int)matrix_rows);
-    modulation_entry &slot = matrix[row];
     const char **arr = metadata->get_table_columns()[column].values;
     switch(column) {
         case 0:
@@ -94,20 +142,36 @@ void mod_matrix_impl::set_cell(int row, int column, const std::string &src, std:
                     else if (column == 4)
                         slot.dest = i;
                     error.clear();
-                    return;
+                    return true;
                 }
             }
             error = "Invalid name: " + src;
-            return;
+            return false;
         }
         case 3:
         {
             stringstream ss(src);
             ss >> slot.amount;
             error.clear();
-            return;
+            return true;
         }
     }
+    return false;
+}
+
+void mod_matrix_impl::apply_cell(int row, int column, const modulation_entry &src)
+{
+    assert(row >= 0 && row < (int)matrix_rows);
+    modulation_entry &slot = matrix[row];
+    switch(column)
+    {
+    case 0: slot.src1 = src.src1; break;
+    case 1: slot.mapping = src.mapping; break;
+    case 2: slot.src2 = src.src2; break;
+    case 3: slot.amount = src.amount; break;
+    case 4: slot.dest = src.dest; break;
+    }
+    plan_dirty.store(true, std::memory_order_release);
 }
 
 void mod_matrix_impl::send_configures(send_configure_iface *sci)
@@ -122,46 +186,65 @@ void mod_matrix_impl::send_configures(send_configure_iface *sci)
     }
 }
 
-char *mod_matrix_impl::configure(const char *key, const char *value)
+bool mod_matrix_impl::parse_configure(const char *key, const char *value, int &row, int &column, modulation_entry &slot, std::string &error) const
 {
     bool is_rows;
-    int row, column;
     if (!parse_table_key(key, "mod_matrix:", is_rows, row, column))
-        return NULL;
+        return false;
     if (is_rows)
-        return strdup("Unexpected key");
-    
-    if (row != -1 && column != -1)
     {
-        string error;
-        string value_text;
-        if (value == NULL)
+        error = "Unexpected key";
+        return true;
+    }
+    if (row == -1 || column == -1)
+        return true;
+    string value_text;
+    if (value == NULL)
+    {
+        const modulation_entry *src = get_default_mod_matrix_value(row);
+        if (src)
         {
-            const modulation_entry *src = get_default_mod_matrix_value(row);
-            if (src)
-            {
-                modulation_entry &slot = matrix[row];
-                switch(column)
-                {
-                case 0: slot.src1 = src->src1; break;
-                case 1: slot.mapping = src->mapping; break;
-                case 2: slot.src2 = src->src2; break;
-                case 3: slot.amount = src->amount; break;
-                case 4: slot.dest = src->dest; break;                    
-                }
-                return NULL;
-            }
-            const table_column_info &ci = metadata->get_table_columns()[column];
-            if (ci.type == TCT_ENUM)
-                value_text = ci.values[(int)ci.def_value];
-            else
-            if (ci.type == TCT_FLOAT)
-                value_text = f2s(ci.def_value);
-            value = value_text.c_str();
+            slot = *src;
+            return true;
         }
-        set_cell(row, column, value, error);
-        if (!error.empty())
-            return strdup(error.c_str());
+        const table_column_info &ci = metadata->get_table_columns()[column];
+        if (ci.type == TCT_ENUM)
+            value_text = ci.values[(int)ci.def_value];
+        else
+        if (ci.type == TCT_FLOAT)
+            value_text = f2s(ci.def_value);
+        value = value_text.c_str();
     }
+    parse_cell(column, value, slot, error);
+    return true;
+}
+
+char *mod_matrix_impl::configure(const char *key, const char *value)
+{
+    int row, column;
+    modulation_entry slot;
+    string error;
+    if (!parse_configure(key, value, row, column, slot, error))
+        return NULL;
+    if (!error.empty())
+        return strdup(error.c_str());
+    if (row != -1 && column != -1)
+        apply_cell(row, column, slot);
     return NULL;
 }
+
+configure_state *mod_matrix_impl::prepare_configure(const char *key, const char *value)
+{
+    int row, column;
+    modulation_entry slot;
+    string error;
+    if (!parse_configure(key, value, row, column, slot, error))
+        return NULL;
+    if (!error.empty() || row == -1 || column == -1)
+    {
+        if (!error.empty())
+            fprintf(stderr, "Error in %s: %s\n", key, error.c_str());
+        return new cell_state(this, -1, -1, slot);
+    }
+    return new cell_state(this, row, column, slot);
+}
@@ -132,6 +132,65 @@ void gain_reduction_audio_module::process(float &left, float &right, const float
     }
 }
 
+template<bool rms, bool average>
+void gain_reduction_audio_module::process_block_mode(const float *inL, const float *inR, const float *detL, const float *detR, float *outL, float *outR, uint32_t n, float *gains)
+{
+    float attack_coeff = std::min(1.f, 1.f / (attack * srate / 4000.f));
+    float release_coeff = std::min(1.f, 1.f / (release * srate / 4000.f));
+    float slope = linSlope;
+    float gain = 1.f;
+    for (uint32_t i = 0; i < n; i++) {
+        float absample = average ? (fabs(detL[i]) + fabs(detR[i])) * 0.5f : std::max(fabs(detL[i]), fabs(detR[i]));
+        if(rms) absample *= absample;
+
+        dsp::sanitize(slope);
+
+        slope += (absample - slope) * (absample > slope ? attack_coeff : release_coeff);
+
+        gain = slope > 0.f ? output_gain(slope, rms) : 1.f;
+        outL[i] = inL[i] * (gain * makeup);
+        outR[i] = inR[i] * (gain * makeup);
+        if (gains)
+            gains[i] = gain;
+    }
+    linSlope = slope;
+    meter_out = std::max(fabs(outL[n - 1]), fabs(outR[n - 1]));
+    meter_comp = gain;
+    detected = rms ? sqrt(linSlope) : linSlope;
+}
+
+void gain_reduction_audio_module::process_block(const float *inL, const float *inR, const float *detL, const float *detR, float *outL, float *outR, uint32_t n, float *gains)
+{
+    if (!n)
+        return;
+    if (bypass >= 0.5f) {
+        if (outL != inL)
+            memcpy(outL, inL, n * sizeof(float));
+        if (outR != inR)
+            memcpy(outR, inR, n * sizeof(float));
+        if (gains)
+            dsp::fill(gains, meter_comp, n);
+        return;
+    }
+    if (!detL)
+        detL = inL;
+    if (!detR)
+        detR = inR;
+    bool rms = (detection == 0);
+    bool average = (stereo_link == 0);
+    if (rms) {
+        if (average)
+            process_block_mode<true, true>(inL, inR, detL, detR, outL, outR, n, gains);
+        else
+            process_block_mode<true, false>(inL, inR, detL, detR, outL, outR, n, gains);
+    } else {
+        if (average)
+            process_block_mode<false, true>(inL, inR, detL, detR, outL, outR, n, gains);
+        else
+            process_block_mode<false, false>(inL, inR, detL, detR, outL, outR, n, gains);
+    }
+}
+
 float gain_reduction_audio_module::output_level(float slope) const {
     return slope * output_gain(slope, false) * makeup;
 }
@@ -375,6 +434,62 @@ void gain_reduction2_audio_module::process(float &left)
     }
 }
 
+void gain_reduction2_audio_module::process_block(const float *in, float *out, uint32_t n, float *gains)
+{
+    if (!n)
+        return;
+    if (bypass >= 0.5f) {
+        if (out != in)
+            memcpy(out, in, n * sizeof(float));
+        if (gains)
+            dsp::fill(gains, meter_comp, n);
+        return;
+    }
+    // everything that only depends on the parameters is computed once per block
+    float width=(knee-0.99f)*8.f;
+    float attack_coeff = exp(-1000.f/(attack * srate));
+    float release_coeff = exp(-1000.f/(release * srate));
+    float thresdb=20.f*log10(threshold);
+    float y1 = old_y1, yl = old_yl, mre = old_mre, mae = old_mae;
+    float gain = 1.f;
+
+    for (uint32_t i = 0; i < n; i++) {
+        float xg, xl, yg;
+        yg=0.f;
+        xg = (in[i]==0.f) ? -160.f : 20.f*log10(fabs(in[i]));
+
+        if (2.f*(xg-thresdb)<-width) {
+            yg = xg;
+        }
+        if (2.f*fabs(xg-thresdb)<=width) {
+            yg = xg + (1.f/ratio-1.f)*(xg-thresdb+width/2.f)*(xg-thresdb+width/2.f)/(2.f*width);
+        }
+        if (2.f*(xg-thresdb)>width) {
+            yg = thresdb + (xg-thresdb)/ratio;
+        }
+
+        xl = xg - yg;
+
+        y1 = _sanitize(std::max(xl, release_coeff*y1+(1.f-release_coeff)*xl));
+        yl = _sanitize(attack_coeff*yl+(1.f-attack_coeff)*y1);
+
+        gain = exp(-yl/20.f*log(10.f));
+        out[i] = in[i] * (gain * makeup);
+        if (gains)
+            gains[i] = gain;
+
+        mre = _sanitize(std::max(xg, release_coeff*mre+(1.f-release_coeff)*xg));
+        mae = _sanitize(attack_coeff*mae+(1.f-attack_coeff)*mre);
+    }
+    meter_out = fabs(out[n - 1]);
+    meter_comp = gain;
+    detected = exp(mae/20.f*log(10.f));
+    old_y1 = y1;
+    old_yl = yl;
+    old_mre = mre;
+    old_mae = mae;
+}
+
 float gain_reduction2_audio_module::output_level(float inputt) const {
     return (output_gain(inputt) * makeup);
 }
@@ -603,6 +718,63 @@ void expander_audio_module::process(float &left, float &right, const float *det_
     }
 }
 
+template<bool rms, bool average>
+void expander_audio_module::process_block_mode(const float *inL, const float *inR, const float *detL, const float *detR, float *outL, float *outR, uint32_t n, float *gains)
+{
+    float slope = linSlope;
+    float gain = 1.f;
+    for (uint32_t i = 0; i < n; i++) {
+        float absample = average ? (fabs(detL[i]) + fabs(detR[i])) * 0.5f : std::max(fabs(detL[i]), fabs(detR[i]));
+        if(rms) absample *= absample;
+
+        dsp::sanitize(slope);
+
+        slope += (absample - slope) * (absample > slope ? attack_coeff : release_coeff);
+
+        gain = slope > 0.f ? output_gain(slope, rms) : 1.f;
+        outL[i] = inL[i] * (gain * makeup);
+        outR[i] = inR[i] * (gain * makeup);
+        if (gains)
+            gains[i] = gain;
+    }
+    linSlope = slope;
+    meter_out = std::max(fabs(outL[n - 1]), fabs(outR[n - 1]));
+    meter_gate = gain;
+    detected = linSlope;
+}
+
+void expander_audio_module::process_block(const float *inL, const float *inR, const float *detL, const float *detR, float *outL, float *outR, uint32_t n, float *gains)
+{
+    if (!n)
+        return;
+    if (bypass >= 0.5f) {
+        if (outL != inL)
+            memcpy(outL, inL, n * sizeof(float));
+        if (outR != inR)
+            memcpy(outR, inR, n * sizeof(float));
+        if (gains)
+            dsp::fill(gains, meter_gate, n);
+        return;
+    }
+    if (!detL)
+        detL = inL;
+    if (!detR)
+        detR = inR;
+    bool rms = (detection == 0);
+    bool average = (stereo_link == 0);
+    if (rms) {
+        if (average)
+            process_block_mode<true, true>(inL, inR, detL, detR, outL, outR, n, gains);
+        else
+            process_block_mode<true, false>(inL, inR, detL, detR, outL, outR, n, gains);
+    } else {
+        if (average)
+            process_block_mode<false, true>(inL, inR, detL, detR, outL, outR, n, gains);
+        else
+            process_block_mode<false, false>(inL, inR, detL, detR, outL, outR, n, gains);
+    }
+}
+
 float expander_audio_module::output_level(float slope) const {
     bool rms = (detection == 0);
     return slope * output_gain(rms ? slope*slope : slope, rms) * makeup;
@@ -784,9 +956,10 @@ uint32_t compressor_audio_module::process(uint32_t offset, uint32_t numsamples,
     if(bypassed) {
         // everything bypassed
         while(offset < numsamples) {
-            outs[0][offset] = ins[0][offset];
+            float inL = ins[0][offset], inR = ins[ins[1]?1:0][offset];
+            outs[0][offset] = inL;
             if(outs[1])
-                outs[1][offset] = ins[ins[1]?1:0][offset];
+                outs[1][offset] = inR;
             float values[] = {0, 0, 1};
             meters.process(values);
             ++offset;
@@ -796,43 +969,35 @@ uint32_t compressor_audio_module::process(uint32_t offset, uint32_t numsamples,
         // process
         uint32_t orig_numsamples = numsamples-offset;
         uint32_t orig_offset = offset;
+        bypass.save_dry(ins, 1 + (int)(ins[1] && outs[1]), orig_offset, orig_numsamples);
         compressor.update_curve();
 
-        while(offset < numsamples) {
-            // cycle through samples
-            float outL = 0.f;
-            float outR = 0.f;
-            float inL = ins[0][offset];
-            float inR = ins[ins[1]?1:0][offset];
-            float Lin = ins[0][offset];
-            float Rin = ins[ins[1]?1:0][offset];
-            
-            // in level
-            inR *= *params[param_level_in];
-            inL *= *params[param_level_in];
-
-            float leftAC = inL;
-            float rightAC = inR;
+        float bufL[MAX_SAMPLE_RUN], bufR[MAX_SAMPLE_RUN], compL[MAX_SAMPLE_RUN], compR[MAX_SAMPLE_RUN], gains[MAX_SAMPLE_RUN];
+        const float *srcL = ins[0];
+        const float *srcR = ins[ins[1]?1:0];
+        float level_in = *params[param_level_in];
+        float mix = *params[param_mix];
 
-            compressor.process(leftAC, rightAC);
+        // in level
+        for (uint32_t i = 0; i < orig_numsamples; i++) {
+            bufL[i] = srcL[offset + i] * level_in;
+            bufR[i] = srcR[offset + i] * level_in;
+        }
 
-            outL = leftAC;
-            outR = rightAC;
+        compressor.process_block(bufL, bufR, NULL, NULL, compL, compR, orig_numsamples, gains);
 
+        for (uint32_t i = 0; i < orig_numsamples; i++, offset++) {
             // mix
-            outL = outL * *params[param_mix] + Lin * (*params[param_mix] * -1 + 1);
-            outR = outR * *params[param_mix] + Rin * (*params[param_mix] * -1 + 1);
-                
+            float outL = compL[i] * mix + srcL[offset] * (mix * -1 + 1);
+            float outR = compR[i] * mix + srcR[offset] * (mix * -1 + 1);
+
             // send to output
             outs[0][offset] = outL;
             if(outs[1])
                 outs[1][offset] = outR;
 
-            float values[] = {std::max(inL, inR), std::max(outL, outR), compressor.get_comp_level()};
+            float values[] = {std::max(bufL[i], bufR[i]), std::max(outL, outR), gains[i]};
             meters.process(values);
-            
-            // next sample
-            ++offset;
         } // cycle trough samples
         bypass.crossfade(ins, outs, 1 + (int)(ins[1] && outs[1]), orig_offset, orig_numsamples);
     }
@@ -1075,108 +1240,106 @@ uint32_t sidechaincompressor_audio_module::process(uint32_t offset, uint32_t num
         uint32_t orig_offset = offset;
         compressor.update_curve();
 
-        while(offset < numsamples) {
-            // cycle through samples
-            float outL = 0.f;
-            float outR = 0.f;
-            float inL  = ins[0][offset];
-            float inR  = ins[1][offset];
-            float Lin  = ins[0][offset];
-            float Rin  = ins[1][offset];
-            
-            float in2L = ins[2] ? ins[2][offset] : 0;
-            float in2R = ins[3] ? ins[3][offset] : 0;
-            
+        // inL/inR: input after level, AC: signal to compress (or the untouched
+        // band in split modes), TC: band to compress in split modes, SC: detector
+        float inL[MAX_SAMPLE_RUN], inR[MAX_SAMPLE_RUN];
+        float leftAC[MAX_SAMPLE_RUN], rightAC[MAX_SAMPLE_RUN];
+        float leftTC[MAX_SAMPLE_RUN], rightTC[MAX_SAMPLE_RUN];
+        float leftSC[MAX_SAMPLE_RUN], rightSC[MAX_SAMPLE_RUN];
+        float gains[MAX_SAMPLE_RUN];
+        float level_in = *params[param_level_in];
+        float sc_level = *params[param_sc_level];
+        bool sc_route = *params[param_sc_route] > 0.5;
+        int mode = (CalfScModes)int(*params[param_sc_mode]);
+        bool split = (mode == DEESSER_SPLIT || mode == DERUMBLER_SPLIT);
+
+        for (uint32_t i = 0; i < orig_numsamples; i++) {
+            uint32_t pos = offset + i;
             // in level
-            inR *= *params[param_level_in];
-            inL *= *params[param_level_in];
-
-            float leftAC  = inL;
-            float rightAC = inR;
-            float leftSC  = inL * *params[param_sc_level];
-            float rightSC = inR * *params[param_sc_level];
-            float leftMC  = inL;
-            float rightMC = inR;
-            float leftTC  = inL;
-            float rightTC = inR;
-            
-            if (*params[param_sc_route] > 0.5) {
-                leftSC  = in2L * *params[param_sc_level];
-                rightSC = in2R * *params[param_sc_level];
+            inL[i] = ins[0][pos] * level_in;
+            inR[i] = ins[1][pos] * level_in;
+            leftAC[i]  = inL[i];
+            rightAC[i] = inR[i];
+            if (sc_route) {
+                leftSC[i]  = (ins[2] ? ins[2][pos] : 0) * sc_level;
+                rightSC[i] = (ins[3] ? ins[3][pos] : 0) * sc_level;
+            } else {
+                leftSC[i]  = inL[i] * sc_level;
+                rightSC[i] = inR[i] * sc_level;
             }
-            
-            int mode = (CalfScModes)int(*params[param_sc_mode]);
-            switch (mode) {
-                default:
-                case WIDEBAND:
-                    compressor.process(leftAC, rightAC, &leftSC, &rightSC);
-                    leftMC  = leftSC;
-                    rightMC = rightSC;
-                    break;
-                case DEESSER_WIDE:
-                case DERUMBLER_WIDE:
-                case WEIGHTED_1:
-                case WEIGHTED_2:
-                case WEIGHTED_3:
-                case BANDPASS_2:
-                    leftSC  = f2L.process(f1L.process(leftSC));
-                    rightSC = f2R.process(f1R.process(rightSC));
-                    leftMC  = leftSC;
-                    rightMC = rightSC;
-                    compressor.process(leftAC, rightAC, &leftSC, &rightSC);
-                    break;
-                case BANDPASS_1:
-                    leftSC  = f1L.process(leftSC);
-                    rightSC = f1R.process(rightSC);
-                    leftMC  = leftSC;
-                    rightMC = rightSC;
-                    compressor.process(leftAC, rightAC, &leftSC, &rightSC);
-                    break;
-                case DEESSER_SPLIT:
-                case DERUMBLER_SPLIT:
+        }
+
+        switch (mode) {
+            default:
+            case WIDEBAND:
+                break;
+            case DEESSER_WIDE:
+            case DERUMBLER_WIDE:
+            case WEIGHTED_1:
+            case WEIGHTED_2:
+            case WEIGHTED_3:
+            case BANDPASS_2:
+                for (uint32_t i = 0; i < orig_numsamples; i++) {
+                    leftSC[i]  = f2L.process(f1L.process(leftSC[i]));
+                    rightSC[i] = f2R.process(f1R.process(rightSC[i]));
+                }
+                break;
+            case BANDPASS_1:
+                for (uint32_t i = 0; i < orig_numsamples; i++) {
+                    leftSC[i]  = f1L.process(leftSC[i]);
+                    rightSC[i] = f1R.process(rightSC[i]);
+                }
+                break;
+            case DEESSER_SPLIT:
+            case DERUMBLER_SPLIT:
+                for (uint32_t i = 0; i < orig_numsamples; i++) {
                     if (mode == DEESSER_SPLIT) {
-                        leftTC  = f2L.process(leftTC);
-                        rightTC = f2R.process(rightTC);
-                        leftAC   = f1L.process(leftAC);
-                        rightAC  = f1R.process(rightAC);
+                        leftTC[i]  = f2L.process(inL[i]);
+                        rightTC[i] = f2R.process(inR[i]);
+                        leftAC[i]  = f1L.process(leftAC[i]);
+                        rightAC[i] = f1R.process(rightAC[i]);
                     } else {
-                        leftTC  = f1L.process(leftTC);
-                        rightTC = f1R.process(rightTC);
-                        leftAC   = f2L.process(leftAC);
-                        rightAC  = f2R.process(rightAC);
+                        leftTC[i]  = f1L.process(inL[i]);
+                        rightTC[i] = f1R.process(inR[i]);
+                        leftAC[i]  = f2L.process(leftAC[i]);
+                        rightAC[i] = f2R.process(rightAC[i]);
                     }
-                    if (*params[param_sc_route] <= 0.5) {
-                        leftSC  = leftTC;
-                        rightSC = rightTC;
-                    }
-                    compressor.process(leftTC, rightTC, &leftSC, &rightSC);
-                    leftMC  = leftSC;
-                    rightMC = rightSC;
-                    leftAC  += leftTC;
-                    rightAC += rightTC;
-                    break;
-            }
+                }
+                if (!sc_route) {
+                    memcpy(leftSC, leftTC, orig_numsamples * sizeof(float));
+                    memcpy(rightSC, rightTC, orig_numsamples * sizeof(float));
+                }
+                break;
+        }
 
-            if(*params[param_sc_listen] > 0.f) {
-                outL = leftMC;
-                outR = rightMC;
+        if (split) {
+            compressor.process_block(leftTC, rightTC, leftSC, rightSC, leftTC, rightTC, orig_numsamples, gains);
+            for (uint32_t i = 0; i < orig_numsamples; i++) {
+                leftAC[i]  += leftTC[i];
+                rightAC[i] += rightTC[i];
+            }
+        } else
+            compressor.process_block(leftAC, rightAC, leftSC, rightSC, leftAC, rightAC, orig_numsamples, gains);
+
+        bool sc_listen = *params[param_sc_listen] > 0.f;
+        float mix = *params[param_mix];
+        for (uint32_t i = 0; i < orig_numsamples; i++, offset++) {
+            float outL, outR;
+            if(sc_listen) {
+                outL = leftSC[i];
+                outR = rightSC[i];
             } else {
-                outL = leftAC;
-                outR = rightAC;
                 // mix
-                outL = outL * *params[param_mix] + Lin * (*params[param_mix] * -1 + 1);
-                outR = outR * *params[param_mix] + Rin * (*params[param_mix] * -1 + 1);
+                outL = leftAC[i] * mix + ins[0][offset] * (mix * -1 + 1);
+                outR = rightAC[i] * mix + ins[1][offset] * (mix * -1 + 1);
             }
 
             // send to output
             outs[0][offset] = outL;
             outs[1][offset] = outR;
-            
-            float values[] = {std::max(inL, inR), std::max(outL, outR), compressor.get_comp_level()};
+
+            float values[] = {std::max(inL[i], inR[i]), std::max(outL, outR), gains[i]};
             meters.process(values);
-            
-            // next sample
-            ++offset;
         } // cycle trough samples
         bypass.crossfade(ins, outs, 2, orig_offset, orig_numsamples);
         f1L.sanitize();
@@ -1347,51 +1510,65 @@ uint32_t multibandcompressor_audio_module::process(uint32_t offset, uint32_t num
         // process all strips
         uint32_t orig_numsamples = numsamples-offset;
         uint32_t orig_offset = offset;
-        while(offset < numsamples) {
-            // cycle through samples
-            float inL = ins[0][offset];
-            float inR = ins[1][offset];
+        uint32_t n = orig_numsamples;
+        float inL[MAX_SAMPLE_RUN], inR[MAX_SAMPLE_RUN];
+        float bandL[strips][MAX_SAMPLE_RUN], bandR[strips][MAX_SAMPLE_RUN], gains[strips][MAX_SAMPLE_RUN];
+        float level_in = *params[param_level_in];
+        float level_out = *params[param_level_out];
+        for (uint32_t i = 0; i < n; i++) {
             // in level
-            inR *= *params[param_level_in];
-            inL *= *params[param_level_in];
+            inL[i] = ins[0][offset + i] * level_in;
+            inR[i] = ins[1][offset + i] * level_in;
             // process crossover
-            xin[0] = inL;
-            xin[1] = inR;
+            xin[0] = inL[i];
+            xin[1] = inR[i];
             crossover.process(xin);
+            for (int j = 0; j < strips; j++) {
+                bandL[j][i] = crossover.get_value(0, j);
+                bandR[j][i] = crossover.get_value(1, j);
+            }
+        }
+        bool active[strips], strip_bypass[strips];
+        for (int j = 0; j < strips; j ++) {
+            // cycle trough strips
+            active[j] = solo[j] || no_solo;
+            strip_bypass[j] = *params[param_bypass0 + j * (param_bypass1 - param_bypass0)] > 0.5f;
+            if (active[j])
+                strip[j].process_block(bandL[j], bandR[j], NULL, NULL, bandL[j], bandR[j], n, gains[j]);
+        }
+        for (uint32_t i = 0; i < n; i++, offset++) {
             // out vars
             float outL = 0.f;
             float outR = 0.f;
-            for (int i = 0; i < strips; i ++) {
-                // cycle trough strips
-                if (solo[i] || no_solo) {
-                    // strip unmuted
-                    float left  = crossover.get_value(0, i);
-                    float right = crossover.get_value(1, i);
-                    // process gain reduction
-                    strip[i].process(left, right);
+            float values[] = {inL[i], inR[i], 0, 0, 0, 1, 0, 1, 0, 1, 0, 1};
+            for (int j = 0; j < strips; j ++) {
+                if (active[j]) {
                     // sum up output
-                    outL += left;
-                    outR += right;
+                    outL += bandL[j][i];
+                    outR += bandR[j][i];
+                }
+                if (strip_bypass[j])
+                    continue;
+                if (active[j]) {
+                    values[4 + 2 * j] = std::max(fabs(bandL[j][i]), fabs(bandR[j][i]));
+                    values[5 + 2 * j] = gains[j][i];
+                } else {
+                    values[4 + 2 * j] = strip[j].get_output_level();
+                    values[5 + 2 * j] = strip[j].get_comp_level();
                 }
-            } // process single strip
+            }
 
             // out level
-            outL *= *params[param_level_out];
-            outR *= *params[param_level_out];
+            outL *= level_out;
+            outR *= level_out;
 
             // send to output
             outs[0][offset] = outL;
             outs[1][offset] = outR;
-            
-            float values[] = {inL, inR, outL, outR,
-                *params[param_bypass0] > 0.5f ? 0 : strip[0].get_output_level(), *params[param_bypass0] > 0.5f ? 1 : strip[0].get_comp_level(),
-                *params[param_bypass1] > 0.5f ? 0 : strip[1].get_output_level(), *params[param_bypass1] > 0.5f ? 1 : strip[1].get_comp_level(),
-                *params[param_bypass2] > 0.5f ? 0 : strip[2].get_output_level(), *params[param_bypass2] > 0.5f ? 1 : strip[2].get_comp_level(),
-                *params[param_bypass3] > 0.5f ? 0 : strip[3].get_output_level(), *params[param_bypass3] > 0.5f ? 1 : strip[3].get_comp_level() };
+
+            values[2] = outL;
+            values[3] = outR;
             meters.process(values);
-                
-            // next sample
-            ++offset;
         } // cycle trough samples
         bypass.crossfade(ins, outs, 2, orig_offset, orig_numsamples);
     } // process all strips (no bypass)
@@ -1533,40 +1710,25 @@ uint32_t monocompressor_audio_module::process(uint32_t offset, uint32_t numsampl
         uint32_t orig_offset = offset;
         monocompressor.update_curve();
 
-        while(offset < numsamples) {
-            // cycle through samples
-            float outL = 0.f;
-            //float outR = 0.f;
-            float inL = ins[0][offset];
-            //float inR = ins[1][offset];
-            float Lin = ins[0][offset];
-            //float Rin = ins[1][offset];
-            
-            // in level
-            //inR *= *params[param_level_in];
-            inL *= *params[param_level_in];
+        float bufL[MAX_SAMPLE_RUN], compL[MAX_SAMPLE_RUN], gains[MAX_SAMPLE_RUN];
+        float level_in = *params[param_level_in];
+        float mix = *params[param_mix];
 
-            float leftAC = inL;
-            //float rightAC = inR;
+        // in level
+        for (uint32_t i = 0; i < orig_numsamples; i++)
+            bufL[i] = ins[0][offset + i] * level_in;
 
-            monocompressor.process(leftAC);
+        monocompressor.process_block(bufL, compL, orig_numsamples, gains);
 
-            outL = leftAC;
-            //outR = rightAC;
-            
+        for (uint32_t i = 0; i < orig_numsamples; i++, offset++) {
             // mix
-            outL = outL * *params[param_mix] + Lin * (*params[param_mix] * -1 + 1);
-            //outR = outR * *params[param_mix] + Rin * (*params[param_mix] * -1 + 1);
-                
+            float outL = compL[i] * mix + ins[0][offset] * (mix * -1 + 1);
+
             // send to output
             outs[0][offset] = outL;
-            //outs[1][offset] = 0.f;
-            
-            float values[] = {inL, outL, monocompressor.get_comp_level()};
+
+            float values[] = {bufL[i], outL, gains[i]};
             meters.process(values);
-            
-            // next sample
-            ++offset;
         } // cycle trough samples
         bypass.crossfade(ins, outs, 1, orig_offset, orig_numsamples);
     }
@@ -1697,66 +1859,52 @@ uint32_t deesser_audio_module::process(uint32_t offset, uint32_t numsamples, uin
         uint32_t orig_offset = offset;
         compressor.update_curve();
 
-        while(offset < numsamples) {
-            // cycle through samples
-            float outL = 0.f;
-            float outR = 0.f;
-            float inL = ins[0][offset];
-            float inR = ins[1][offset];
-
-
-            float leftAC = inL;
-            float rightAC = inR;
-            float leftSC = inL;
-            float rightSC = inR;
-            float leftRC = inL;
-            float rightRC = inR;
-            float leftMC = inL;
-            float rightMC = inR;
-
-            leftSC = pL.process(hpL.process(leftSC));
-            rightSC = pR.process(hpR.process(rightSC));
-            leftMC = leftSC;
-            rightMC = rightSC;
-
-            switch ((int)*params[param_mode]) {
-                default:
-                case WIDE:
-                    compressor.process(leftAC, rightAC, &leftSC, &rightSC);
-                    break;
-                case SPLIT:
-                    hpL.sanitize();
-                    hpR.sanitize();
-                    leftRC = hpL.process(leftRC);
-                    rightRC = hpR.process(rightRC);
-                    compressor.process(leftRC, rightRC, &leftSC, &rightSC);
-                    leftAC = lpL.process(leftAC);
-                    rightAC = lpR.process(rightAC);
-                    leftAC += leftRC;
-                    rightAC += rightRC;
-                    break;
+        // AC: signal to compress (or the low band in split mode),
+        // RC: high band in split mode, SC: detector
+        float leftAC[MAX_SAMPLE_RUN], rightAC[MAX_SAMPLE_RUN];
+        float leftRC[MAX_SAMPLE_RUN], rightRC[MAX_SAMPLE_RUN];
+        float leftSC[MAX_SAMPLE_RUN], rightSC[MAX_SAMPLE_RUN];
+        float gains[MAX_SAMPLE_RUN];
+        bool split = (int)*params[param_mode] == SPLIT;
+
+        for (uint32_t i = 0; i < orig_numsamples; i++) {
+            float inL = ins[0][offset + i];
+            float inR = ins[1][offset + i];
+            leftSC[i] = pL.process(hpL.process(inL));
+            rightSC[i] = pR.process(hpR.process(inR));
+            if (split) {
+                hpL.sanitize();
+                hpR.sanitize();
+                leftRC[i] = hpL.process(inL);
+                rightRC[i] = hpR.process(inR);
+                leftAC[i] = lpL.process(inL);
+                rightAC[i] = lpR.process(inR);
+            } else {
+                leftAC[i] = inL;
+                rightAC[i] = inR;
             }
+        }
 
-            if(*params[param_sc_listen] > 0.f) {
-                outL = leftMC;
-                outR = rightMC;
-            } else {
-                outL = leftAC;
-                outR = rightAC;
+        if (split) {
+            compressor.process_block(leftRC, rightRC, leftSC, rightSC, leftRC, rightRC, orig_numsamples, gains);
+            for (uint32_t i = 0; i < orig_numsamples; i++) {
+                leftAC[i] += leftRC[i];
+                rightAC[i] += rightRC[i];
             }
+        } else
+            compressor.process_block(leftAC, rightAC, leftSC, rightSC, leftAC, rightAC, orig_numsamples, gains);
 
+        bool sc_listen = *params[param_sc_listen] > 0.f;
+        for (uint32_t i = 0; i < orig_numsamples; i++, offset++) {
             // send to output
-            outs[0][offset] = outL;
-            outs[1][offset] = outR;
+            outs[0][offset] = sc_listen ? leftSC[i] : leftAC[i];
+            outs[1][offset] = sc_listen ? rightSC[i] : rightAC[i];
 
-            detected = std::max(fabs(leftMC), fabs(rightMC));
-            
-            float comp = compressor.get_comp_level();
-            float values[] = {detected, comp};
+            detected = std::max(fabs(leftSC[i]), fabs(rightSC[i]));
+
+            float values[] = {detected, gains[i]};
             meters.process(values);
-            gain = std::min(comp, gain);
-            // next sample
-            ++offset;
+            gain = std::min(gains[i], gain);
         } // cycle trough samples
         bypass.crossfade(ins, outs, 2, orig_offset, orig_numsamples);
         hpL.sanitize();
@@ -1829,33 +1977,20 @@ uint32_t gate_audio_module::process(uint32_t offset, uint32_t numsamples, uint32
         gate.update_curve();
         uint32_t orig_numsamples = numsamples-offset;
         uint32_t orig_offset = offset;
-        while(offset < numsamples) {
-            // cycle through samples
-            float outL = 0.f;
-            float outR = 0.f;
-            float inL = ins[0][offset];
-            float inR = ins[1][offset];
-            // in level
-            inR *= *params[param_level_in];
-            inL *= *params[param_level_in];
+        float bufL[MAX_SAMPLE_RUN], bufR[MAX_SAMPLE_RUN], gains[MAX_SAMPLE_RUN];
+        float level_in = *params[param_level_in];
 
-            float leftAC = inL;
-            float rightAC = inR;
-
-            gate.process(leftAC, rightAC);
+        // in level
+        for (uint32_t i = 0; i < orig_numsamples; i++) {
+            bufL[i] = ins[0][offset + i] * level_in;
+            bufR[i] = ins[1][offset + i] * level_in;
+        }
 
-            outL = leftAC;
-            outR = rightAC;
+        gate.process_block(bufL, bufR, NULL, NULL, outs[0] + offset, outs[1] + offset, orig_numsamples, gains);
 
-            // send to output
-            outs[0][offset] = outL;
-            outs[1][offset] = outR;
-            
-            float values[] = {std::max(inL, inR), std::max(outL, outR), gate.get_expander_level()};
+        for (uint32_t i = 0; i < orig_numsamples; i++, offset++) {
+            float values[] = {std::max(bufL[i], bufR[i]), std::max(outs[0][offset], outs[1][offset]), gains[i]};
             meters.process(values);
-            
-            // next sample
-            ++offset;
         } // cycle trough samples
         bypass.crossfade(ins, outs, 2, orig_offset, orig_numsamples);
     }
@@ -2092,104 +2227,98 @@ uint32_t sidechaingate_audio_module::process(uint32_t offset, uint32_t numsample
         uint32_t orig_offset = offset;
         gate.update_curve();
 
-        while(offset < numsamples) {
-            // cycle through samples
-            float outL = 0.f;
-            float outR = 0.f;
-            float inL  = ins[0][offset];
-            float inR  = ins[1][offset];
-            
-            float in2L = ins[2] ? ins[2][offset] : 0;
-            float in2R = ins[3] ? ins[3][offset] : 0;
-            
+        // inL/inR: input after level, AC: signal to gate (or the untouched
+        // band in split modes), TC: band to gate in split modes, SC: detector
+        float inL[MAX_SAMPLE_RUN], inR[MAX_SAMPLE_RUN];
+        float leftAC[MAX_SAMPLE_RUN], rightAC[MAX_SAMPLE_RUN];
+        float leftTC[MAX_SAMPLE_RUN], rightTC[MAX_SAMPLE_RUN];
+        float leftSC[MAX_SAMPLE_RUN], rightSC[MAX_SAMPLE_RUN];
+        float gains[MAX_SAMPLE_RUN];
+        float level_in = *params[param_level_in];
+        float sc_level = *params[param_sc_level];
+        bool sc_route = *params[param_sc_route] > 0.5;
+        int mode = (CalfScModes)int(*params[param_sc_mode]);
+        bool split = (mode == HIGHGATE_SPLIT || mode == LOWGATE_SPLIT);
+
+        for (uint32_t i = 0; i < orig_numsamples; i++) {
+            uint32_t pos = offset + i;
             // in level
-            inR *= *params[param_level_in];
-            inL *= *params[param_level_in];
-            
-            float leftAC  = inL;
-            float rightAC = inR;
-            float leftSC  = inL * *params[param_sc_level];
-            float rightSC = inR * *params[param_sc_level];
-            float leftMC  = inL;
-            float rightMC = inR;
-            float leftTC  = inL;
-            float rightTC = inR;
-            
-            if (*params[param_sc_route] > 0.5) {
-                leftSC  = in2L * *params[param_sc_level];
-                rightSC = in2R * *params[param_sc_level];
+            inL[i] = ins[0][pos] * level_in;
+            inR[i] = ins[1][pos] * level_in;
+            leftAC[i]  = inL[i];
+            rightAC[i] = inR[i];
+            if (sc_route) {
+                leftSC[i]  = (ins[2] ? ins[2][pos] : 0) * sc_level;
+                rightSC[i] = (ins[3] ? ins[3][pos] : 0) * sc_level;
+            } else {
+                leftSC[i]  = inL[i] * sc_level;
+                rightSC[i] = inR[i] * sc_level;
             }
-            
-            int mode = (CalfScModes)int(*params[param_sc_mode]);
-            
-            switch (mode) {
-                default:
-                case WIDEBAND:
-                    gate.process(leftAC, rightAC, &leftSC, &rightSC);
-                    leftMC  = leftSC;
-                    rightMC = rightSC;
-                    break;
-                case HIGHGATE_WIDE:
-                case LOWGATE_WIDE:
-                case WEIGHTED_1:
-                case WEIGHTED_2:
-                case WEIGHTED_3:
-                case BANDPASS_2:
-                    leftSC  = f2L.process(f1L.process(leftSC));
-                    rightSC = f2R.process(f1R.process(rightSC));
-                    leftMC  = leftSC;
-                    rightMC = rightSC;
-                    gate.process(leftAC, rightAC, &leftSC, &rightSC);
-                    break;
-                case BANDPASS_1:
-                    leftSC  = f1L.process(leftSC);
-                    rightSC = f1R.process(rightSC);
-                    leftMC  = leftSC;
-                    rightMC = rightSC;
-                    gate.process(leftAC, rightAC, &leftSC, &rightSC);
-                    break;
-                case HIGHGATE_SPLIT:
-                case LOWGATE_SPLIT:
+        }
+
+        switch (mode) {
+            default:
+            case WIDEBAND:
+                break;
+            case HIGHGATE_WIDE:
+            case LOWGATE_WIDE:
+            case WEIGHTED_1:
+            case WEIGHTED_2:
+            case WEIGHTED_3:
+            case BANDPASS_2:
+                for (uint32_t i = 0; i < orig_numsamples; i++) {
+                    leftSC[i]  = f2L.process(f1L.process(leftSC[i]));
+                    rightSC[i] = f2R.process(f1R.process(rightSC[i]));
+                }
+                break;
+            case BANDPASS_1:
+                for (uint32_t i = 0; i < orig_numsamples; i++) {
+                    leftSC[i]  = f1L.process(leftSC[i]);
+                    rightSC[i] = f1R.process(rightSC[i]);
+                }
+                break;
+            case HIGHGATE_SPLIT:
+            case LOWGATE_SPLIT:
+                for (uint32_t i = 0; i < orig_numsamples; i++) {
                     if (mode == HIGHGATE_SPLIT) {
-                        leftTC  = f2L.process(leftTC);
-                        rightTC = f2R.process(rightTC);
-                        leftAC   = f1L.process(leftAC);
-                        rightAC  = f1R.process(rightAC);
+                        leftTC[i]  = f2L.process(inL[i]);
+                        rightTC[i] = f2R.process(inR[i]);
+                        leftAC[i]  = f1L.process(leftAC[i]);
+                        rightAC[i] = f1R.process(rightAC[i]);
                     } else {
-                        leftTC  = f1L.process(leftTC);
-                        rightTC = f1R.process(rightTC);
-                        leftAC   = f2L.process(leftAC);
-                        rightAC  = f2R.process(rightAC);
-                    }
-                    if (*params[param_sc_route] <= 0.5) {
-                        leftSC  = leftTC;
-                        rightSC = rightTC;
+                        leftTC[i]  = f1L.process(inL[i]);
+                        rightTC[i] = f1R.process(inR[i]);
+                        leftAC[i]  = f2L.process(leftAC[i]);
+                        rightAC[i] = f2R.process(rightAC[i]);
                     }
-                    gate.process(leftTC, rightTC, &leftSC, &rightSC);
-                    leftMC  = leftSC;
-                    rightMC = rightSC;
-                    leftAC  += leftTC;
-                    rightAC += rightTC;
-                    break;
-            }
+                }
+                if (!sc_route) {
+                    memcpy(leftSC, leftTC, orig_numsamples * sizeof(float));
+                    memcpy(rightSC, rightTC, orig_numsamples * sizeof(float));
+                }
+                break;
+        }
 
-            if(*params[param_sc_listen] > 0.f) {
-                outL = leftMC;
-                outR = rightMC;
-            } else {
-                outL = leftAC;
-                outR = rightAC;
+        if (split) {
+            gate.process_block(leftTC, rightTC, leftSC, rightSC, leftTC, rightTC, orig_numsamples, gains);
+            for (uint32_t i = 0; i < orig_numsamples; i++) {
+                leftAC[i]  += leftTC[i];
+                rightAC[i] += rightTC[i];
             }
+        } else
+            gate.process_block(leftAC, rightAC, leftSC, rightSC, leftAC, rightAC, orig_numsamples, gains);
+
+        bool sc_listen = *params[param_sc_listen] > 0.f;
+        for (uint32_t i = 0; i < orig_numsamples; i++, offset++) {
+            float outL = sc_listen ? leftSC[i] : leftAC[i];
+            float outR = sc_listen ? rightSC[i] : rightAC[i];
 
             // send to output
             outs[0][offset] = outL;
             outs[1][offset] = outR;
-            
-            float values[] = {std::max(inL, inR), std::max(outL, outR), gate.get_expander_level()};
+
+            float values[] = {std::max(inL[i], inR[i]), std::max(outL, outR), gains[i]};
             meters.process(values);
-            
-            // next sample
-            ++offset;
         } // cycle trough samples
         bypass.crossfade(ins, outs, 2, orig_offset, orig_numsamples);
         f1L.sanitize();
@@ -2359,50 +2488,65 @@ uint32_t multibandgate_audio_module::process(uint32_t offset, uint32_t numsample
         // process all strips
         uint32_t orig_numsamples = numsamples-offset;
         uint32_t orig_offset = offset;
-        while(offset < numsamples) {
-            // cycle through samples
-            float inL = ins[0][offset];
-            float inR = ins[1][offset];
+        uint32_t n = orig_numsamples;
+        float inL[MAX_SAMPLE_RUN], inR[MAX_SAMPLE_RUN];
+        float bandL[strips][MAX_SAMPLE_RUN], bandR[strips][MAX_SAMPLE_RUN], gains[strips][MAX_SAMPLE_RUN];
+        float level_in = *params[param_level_in];
+        float level_out = *params[param_level_out];
+        for (uint32_t i = 0; i < n; i++) {
             // in level
-            inR *= *params[param_level_in];
-            inL *= *params[param_level_in];
+            inL[i] = ins[0][offset + i] * level_in;
+            inR[i] = ins[1][offset + i] * level_in;
             // process crossover
-            xin[0] = inL;
-            xin[1] = inR;
+            xin[0] = inL[i];
+            xin[1] = inR[i];
             crossover.process(xin);
+            for (int j = 0; j < strips; j++) {
+                bandL[j][i] = crossover.get_value(0, j);
+                bandR[j][i] = crossover.get_value(1, j);
+            }
+        }
+        bool active[strips], strip_bypass[strips];
+        for (int j = 0; j < strips; j ++) {
+            // cycle trough strips
+            active[j] = solo[j] || no_solo;
+            strip_bypass[j] = *params[param_bypass0 + j * (param_bypass1 - param_bypass0)] > 0.5f;
+            if (active[j])
+                gate[j].process_block(bandL[j], bandR[j], NULL, NULL, bandL[j], bandR[j], n, gains[j]);
+        }
+        for (uint32_t i = 0; i < n; i++, offset++) {
             // out vars
             float outL = 0.f;
             float outR = 0.f;
-            for (int i = 0; i < strips; i ++) {
-                // cycle trough strips
-                if (solo[i] || no_solo) {
-                    // strip unmuted
-                    float left  = crossover.get_value(0, i);
-                    float right = crossover.get_value(1, i);
-                    gate[i].process(left, right);
+            float values[] = {inL[i], inR[i], 0, 0, 0, 1, 0, 1, 0, 1, 0, 1};
+            for (int j = 0; j < strips; j ++) {
+                if (active[j]) {
                     // sum up output
-                    outL += left;
-                    outR += right;
+                    outL += bandL[j][i];
+                    outR += bandR[j][i];
+                }
+                if (strip_bypass[j])
+                    continue;
+                if (active[j]) {
+                    values[4 + 2 * j] = std::max(fabs(bandL[j][i]), fabs(bandR[j][i]));
+                    values[5 + 2 * j] = gains[j][i];
+                } else {
+                    values[4 + 2 * j] = gate[j].get_output_level();
+                    values[5 + 2 * j] = gate[j].get_expander_level();
                 }
-            } // process single strip
+            }
 
             // out level
-            outL *= *params[param_level_out];
-            outR *= *params[param_level_out];
+            outL *= level_out;
+            outR *= level_out;
 
             // send to output
             outs[0][offset] = outL;
             outs[1][offset] = outR;
 
-            float values[] = {inL, inR, outL, outR,
-                *params[param_bypass0] > 0.5f ? 0 : gate[0].get_output_level(), *params[param_bypass0] > 0.5f ? 1 : gate[0].get_expander_level(),
-                *params[param_bypass1] > 0.5f ? 0 : gate[1].get_output_level(), *params[param_bypass1] > 0.5f ? 1 : gate[1].get_expander_level(),
-                *params[param_bypass2] > 0.5f ? 0 : gate[2].get_output_level(), *params[param_bypass2] > 0.5f ? 1 : gate[2].get_expander_level(),
-                *params[param_bypass3] > 0.5f ? 0 : gate[3].get_output_level(), *params[param_bypass3] > 0.5f ? 1 : gate[3].get_expander_level() };
+            values[2] = outL;
+            values[3] = outR;
             meters.process(values);
-            
-            // next sample
-            ++offset;
         } // cycle trough samples
         bypass.crossfade(ins, outs, 2, orig_offset, orig_numsamples);
 
@@ -2509,7 +2653,9 @@ transientdesigner_audio_module::transientdesigner_audio_module() {
     transients.set_channels(channels);
     hp_f_old = hp_m_old = lp_f_old = lp_m_old = 0;
     redraw = false;
-    pbuffer = NULL;
+    // allocated once for the widest graph, as process() writes it while
+    // get_graph runs in the GUI thread
+    pbuffer = (float*) calloc(max_graph_points * 5 * 100, sizeof(float));
 }
 transientdesigner_audio_module::~transientdesigner_audio_module()
 {
@@ -2717,7 +2863,7 @@ bool transientdesigner_audio_module::get_graph(int index, int subindex, int phas
     
     if (subindex >= 2 || (*params[param_bypass] > 0.5f && subindex >= 1))
         return false;
-    if (points <= 0)
+    if (points <= 0 || points > max_graph_points)
         return false;
     if (points != pixels) {
         // the zoom level changed or it's the first time we want to draw
@@ -2728,8 +2874,8 @@ bool transientdesigner_audio_module::get_graph(int index, int subindex, int phas
         // keeping the input and the output fabs signals and all graphs
         // of the envelopes
         pbuffer_size = (int)(points * 5 * 100);
-        // create array
-        pbuffer = (float*) calloc(pbuffer_size, sizeof(float));
+        // clear the part of the array that is used now
+        dsp::zero(pbuffer, pbuffer_size);
         
         // sanitize some indexes and addresses
         pbuffer_pos    = 0;
@@ -27,6 +27,7 @@
 #include <calf/modules_dev.h>
 #ifndef _MSC_VER
 #include <sys/time.h>
+#include <unistd.h>
 #endif
 using namespace dsp;
 using namespace calf_plugins;
@@ -43,9 +44,15 @@ FORWARD_DECLARE_METADATA(reverse_delay)
  * REVERB by Krzysztof Foltman
 **********************************************************************/
 
+reverb_audio_module::reverb_audio_module()
+{
+    engine = engine_allpass;
+}
+
 void reverb_audio_module::activate()
 {
     reverb.reset();
+    fdn.reset();
 }
 
 void reverb_audio_module::deactivate()
@@ -56,6 +63,7 @@ void reverb_audio_module::set_sample_rate(uint32_t sr)
 {
     srate = sr;
     reverb.setup(sr);
+    fdn.setup(sr);
     amount.set_sample_rate(sr);
     int meter[] = {param_meter_inL, param_meter_inR, param_meter_outL, param_meter_outR};
     int clip[] = {param_clip_inL, param_clip_inR, param_clip_outL, param_clip_outR};
@@ -67,6 +75,17 @@ void reverb_audio_module::params_changed()
     reverb.set_type_and_diffusion(fastf2i_drm(*params[par_roomsize]), *params[par_diffusion]);
     reverb.set_time(*params[par_decay]);
     reverb.set_cutoff(*params[par_hfdamp]);
+    fdn.set_type_and_diffusion(fastf2i_drm(*params[par_roomsize]), *params[par_diffusion]);
+    fdn.set_time(*params[par_decay]);
+    fdn.set_cutoff(*params[par_hfdamp]);
+    fdn.set_hf_decay(*params[par_hf_decay]);
+    int new_engine = fastf2i_drm(*params[par_engine]);
+    if (new_engine != engine) {
+        // do not resume whatever tail was left in the other engine
+        engine = new_engine;
+        reverb.reset();
+        fdn.reset();
+    }
     amount.set_inertia(*params[par_amount]);
     dryamount.set_inertia(*params[par_dry]);
     left_lo.set_lp(dsp::clip(*params[par_treblecut], 20.f, (float)(srate * 0.49f)), srate);
@@ -78,33 +97,42 @@ void reverb_audio_module::params_changed()
 
 uint32_t reverb_audio_module::process(uint32_t offset, uint32_t numsamples, uint32_t inputs_mask, uint32_t outputs_mask)
 {
-    numsamples += offset;
-    for (uint32_t i = offset; i < numsamples; i++) {
-        float dry = dryamount.get();
-        float wet = amount.get();
+    uint32_t end = offset + numsamples;
+    bool on = *params[par_on] > 0.5;
+    for (uint32_t i = offset, j = 0; i < end; i++, j++) {
         stereo_sample<float> s(ins[0][i] * *params[param_level_in],
                                ins[1][i] * *params[param_level_in]);
         stereo_sample<float> s2 = pre_delay.process(s, predelay_amt);
-        
-        float rl = s2.left, rr = s2.right;
-        rl = left_lo.process(left_hi.process(rl));
-        rr = right_lo.process(right_hi.process(rr));
-        if (*params[par_on] > 0.5)
-            reverb.process(rl, rr);
-        outs[0][i] = dry*s.left;
-        outs[1][i] = dry*s.right;
-        if (*params[par_on] > 0.5) {
-            outs[0][i] += wet*rl;
-            outs[1][i] += wet*rr;
+        dry_buf[0][j] = s.left;
+        dry_buf[1][j] = s.right;
+        wet_buf[0][j] = left_lo.process(left_hi.process(s2.left));
+        wet_buf[1][j] = right_lo.process(right_hi.process(s2.right));
+    }
+    if (on) {
+        if (engine == engine_fdn)
+            fdn.process(wet_buf[0], wet_buf[1], numsamples);
+        else {
+            for (uint32_t j = 0; j < numsamples; j++)
+                reverb.process(wet_buf[0][j], wet_buf[1][j]);
+        }
+    }
+    for (uint32_t i = offset, j = 0; i < end; i++, j++) {
+        float dry = dryamount.get();
+        float wet = amount.get();
+        outs[0][i] = dry*dry_buf[0][j];
+        outs[1][i] = dry*dry_buf[1][j];
+        if (on) {
+            outs[0][i] += wet*wet_buf[0][j];
+            outs[1][i] += wet*wet_buf[1][j];
         }
         outs[0][i] *= *params[param_level_out];
         outs[1][i] *= *params[param_level_out];
-        
-        float values[] = {s.left, s.right, outs[0][i], outs[1][i]};
-        meters.process(values);
     }
+    const float *values[] = {dry_buf[0], dry_buf[1], outs[0] + offset, outs[1] + offset};
+    meters.process(values, numsamples);
     meters.fall(numsamples);
     reverb.extra_sanitize();
+    fdn.extra_sanitize();
     left_lo.sanitize();
     left_hi.sanitize();
     right_lo.sanitize();
@@ -112,6 +140,168 @@ uint32_t reverb_audio_module::process(uint32_t offset, uint32_t numsamples, uint
     return outputs_mask;
 }
 
+/**********************************************************************
+ * CONVOLUTION REVERB
+**********************************************************************/
+
+namespace calf_plugins {
+
+/// Engine built for a new value of ir_file. apply only swaps the pointers
+/// and the strings, the previous engine is freed together with this object.
+struct convolution_ir_state: public configure_state
+{
+    convolution_audio_module *module;
+    std::string file, error;
+    dsp::convolver *engine;
+    virtual void apply()
+    {
+        // a file that failed to load leaves the current one in place
+        if (!error.empty())
+            return;
+        module->ir_file.swap(file);
+        engine = module->engine.exchange(engine);
+    }
+    virtual ~convolution_ir_state()
+    {
+        delete engine;
+    }
+};
+
+}
+
+convolution_audio_module::convolution_audio_module()
+{
+    srate = 0;
+    engine = NULL;
+    cycles_started = cycles_finished = 0;
+}
+
+convolution_audio_module::~convolution_audio_module()
+{
+    delete engine.load();
+}
+
+void convolution_audio_module::post_instantiate(uint32_t sr)
+{
+    // the impulse response may be configured before set_sample_rate
+    srate = sr;
+}
+
+void convolution_audio_module::activate()
+{
+    dsp::convolver *conv = engine;
+    if (conv)
+        conv->reset();
+}
+
+void convolution_audio_module::deactivate()
+{
+}
+
+void convolution_audio_module::set_sample_rate(uint32_t sr)
+{
+    srate = sr;
+    wet.set_sample_rate(sr);
+    dry.set_sample_rate(sr);
+    int meter[] = {param_meter_inL, param_meter_inR, param_meter_outL, param_meter_outR};
+    int clip[] = {param_clip_inL, param_clip_inR, param_clip_outL, param_clip_outR};
+    meters.init(params, meter, clip, 4, srate);
+    // LV2 calls this from run(), so the impulse response can't be reloaded
+    // here. The hosts don't change the rate of an instance after
+    // post_instantiate anyway; if that ever happens, the next ir_file
+    // prepare_configure loads the response for the new rate.
+}
+
+void convolution_audio_module::params_changed()
+{
+    wet.set_inertia(*params[param_wet]);
+    dry.set_inertia(*params[param_dry]);
+}
+
+configure_state *convolution_audio_module::prepare_configure(const char *key, const char *value)
+{
+    if (strcmp(key, "ir_file"))
+        return NULL;
+    convolution_ir_state *state = new convolution_ir_state;
+    state->module = this;
+    state->file = value ? value : "";
+    state->engine = NULL;
+    if (!state->file.empty()) {
+        const dsp::convolution_ir *ir = dsp::convolution_ir::acquire(state->file, srate, state->error);
+        if (ir)
+            state->engine = new dsp::convolver(ir);
+        else
+            fprintf(stderr, "Cannot load impulse response %s: %s\n", state->file.c_str(), state->error.c_str());
+    }
+    return state;
+}
+
+char *convolution_audio_module::configure(const char *key, const char *value)
+{
+    convolution_ir_state *state = (convolution_ir_state *)prepare_configure(key, value);
+    if (!state)
+        return NULL;
+    std::string error;
+    error.swap(state->error);
+    state->apply();
+    // unlike with prepare_configure, the audio thread may be using the old
+    // engine right now. Any process call that may have seen it has started
+    // by now, so it can be freed once that many have finished (the same as
+    // jack_client::collect_garbage does for the rack). If no call is in
+    // progress, there's nothing to wait for.
+    unsigned int cycle = cycles_started;
+    while((int)(cycles_finished - cycle) < 0)
+        usleep(1000);
+    delete state;
+    return error.empty() ? NULL : strdup(error.c_str());
+}
+
+void convolution_audio_module::send_configures(send_configure_iface *sci)
+{
+    sci->send_configure("ir_file", ir_file.c_str());
+}
+
+uint32_t convolution_audio_module::process(uint32_t offset, uint32_t numsamples, uint32_t inputs_mask, uint32_t outputs_mask)
+{
+    bool bypassed = bypass.update(*params[param_bypass] > 0.5f, numsamples);
+    uint32_t end = offset + numsamples;
+    cycles_started++;
+    dsp::convolver *conv = engine;
+    *params[param_ir_length] = conv ? (float)conv->get_ir()->length / conv->get_ir()->srate : 0.f;
+    if (bypassed) {
+        for (uint32_t i = offset; i < end; i++) {
+            float l = ins[0][i], r = ins[1][i];
+            outs[0][i] = l;
+            outs[1][i] = r;
+        }
+        memset(in_buf, 0, sizeof(in_buf));
+        const float *values[] = {in_buf[0], in_buf[1], in_buf[0], in_buf[1]};
+        meters.process(values, numsamples);
+    } else {
+        bypass.save_dry(ins, 2, offset, numsamples);
+        float level_in = *params[param_level_in], level_out = *params[param_level_out];
+        for (uint32_t i = 0; i < numsamples; i++) {
+            in_buf[0][i] = ins[0][offset + i] * level_in;
+            in_buf[1][i] = ins[1][offset + i] * level_in;
+        }
+        if (conv)
+            conv->process(in_buf[0], in_buf[1], wet_buf[0], wet_buf[1], numsamples);
+        else
+            memset(wet_buf, 0, sizeof(wet_buf));
+        for (uint32_t i = 0; i < numsamples; i++) {
+            float d = dry.get(), w = wet.get();
+            outs[0][offset + i] = (d * in_buf[0][i] + w * wet_buf[0][i]) * level_out;
+            outs[1][offset + i] = (d * in_buf[1][i] + w * wet_buf[1][i]) * level_out;
+        }
+        const float *values[] = {in_buf[0], in_buf[1], outs[0] + offset, outs[1] + offset};
+        meters.process(values, numsamples);
+        bypass.crossfade(ins, outs, 2, offset, numsamples);
+    }
+    meters.fall(numsamples);
+    cycles_finished++;
+    return outputs_mask;
+}
+
 /**********************************************************************
  * VINTAGE DELAY by Krzysztof Foltman
 **********************************************************************/
@@ -33,27 +33,6 @@ FORWARD_DECLARE_METADATA(tapesimulator)
 FORWARD_DECLARE_METADATA(crusher)
 FORWARD_DECLARE_METADATA(psyclipper)
 
-#ifdef _MSC_VER
-#include <intrin.h>
-inline int clz(unsigned int value)
-{
-	unsigned long leading_zero = 0;
-
-	if (_BitScanReverse(&leading_zero, value))
-	{
-		//_BitScanReverse return the position while GCC returns number of leading zeros
-		//so reverse it.
-		return 31 - leading_zero;
-	}
-	else
-	{
-		//GCC implementation says it's undefined in this case
-		return 32;
-	}
-}
-#else 
-inline int clz(unsigned int value) { return __builtin_clz(value); }
-#endif
 using namespace dsp;
 using namespace calf_plugins;
 
@@ -158,16 +137,18 @@ uint32_t saturator_audio_module::process(uint32_t offset, uint32_t numsamples, u
     if(bypassed) {
         // everything bypassed
         while(offset < numsamples) {
+            float inL = ins[0][offset];
             if(ins[1] && outs[1]) {
-                outs[0][offset] = ins[0][offset];
-                outs[1][offset] = ins[1][offset];
+                float inR = ins[1][offset];
+                outs[0][offset] = inL;
+                outs[1][offset] = inR;
             } else if(ins[1]) {
-                outs[0][offset] = (ins[0][offset] + ins[1][offset]) / 2;
+                outs[0][offset] = (inL + ins[1][offset]) / 2;
             } else if(outs[1]) {
-                outs[0][offset] = ins[0][offset];
-                outs[1][offset] = ins[0][offset];
+                outs[0][offset] = inL;
+                outs[1][offset] = inL;
             } else {
-                outs[0][offset] = ins[0][offset];
+                outs[0][offset] = inL;
             }
             float values[] = {0, 0, 0, 0};
             meters.process(values);
@@ -176,6 +157,7 @@ uint32_t saturator_audio_module::process(uint32_t offset, uint32_t numsamples, u
     } else {
         uint32_t orig_numsamples = numsamples-offset;
         uint32_t orig_offset = offset;
+        bypass.save_dry(ins, 1 + (int)(ins[1] && outs[1]), orig_offset, orig_numsamples);
         // process
         while(offset < numsamples) {
             // cycle through samples
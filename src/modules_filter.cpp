@@ -96,12 +96,12 @@ void equalizerNband_audio_module<BaseClass, has_lphp>::deactivate()
     is_active = false;
 }
 
-static inline void copy_lphp(biquad_d2 filters[3][2])
+static inline void copy_lphp(biquad_d2_bank<2> filters[3])
 {
     for (int i = 0; i < 3; i++)
         for (int j = 0; j < 2; j++)
             if (i || j)
-                filters[i][j].copy_coeffs(filters[0][0]);
+                filters[i].copy_coeffs(j, filters[0].get_coeffs(0));
 }
 
 static inline double glide(double value, double target, int &keep_gliding)
@@ -132,13 +132,13 @@ void equalizerNband_audio_module<BaseClass, has_lphp>::params_changed()
         
         if(hpfreq != hp_freq_old || hpq != hp_q_old) {
             hpfreq = glide(hp_freq_old, hpfreq, keep_gliding);
-            hp[0][0].set_hp_rbj(hpfreq, hpq, (float)srate, 1.0);
+            hp[0].set_hp_rbj(0, hpfreq, hpq, (float)srate, 1.0);
             copy_lphp(hp);
             hp_freq_old = hpfreq;
         }
         if(lpfreq != lp_freq_old || lpq != lp_q_old) {
             lpfreq = glide(lp_freq_old, lpfreq, keep_gliding);
-            lp[0][0].set_lp_rbj(lpfreq, lpq, (float)srate, 1.0);
+            lp[0].set_lp_rbj(0, lpfreq, lpq, (float)srate, 1.0);
             copy_lphp(lp);
             lp_freq_old = lpfreq;
         }
@@ -150,16 +150,16 @@ void equalizerNband_audio_module<BaseClass, has_lphp>::params_changed()
     
     if(lsfreq != ls_freq_old || lslevel != ls_level_old || lsq != ls_q_old) {
         lsfreq = glide(ls_freq_old, lsfreq, keep_gliding);
-        lsL.set_lowshelf_rbj(lsfreq, lsq, lslevel, (float)srate);
-        lsR.copy_coeffs(lsL);
+        ls.set_lowshelf_rbj(0, lsfreq, lsq, lslevel, (float)srate);
+        ls.copy_coeffs(1, 0);
         ls_level_old = lslevel;
         ls_freq_old = lsfreq;
         ls_q_old = lsq;
     }
     if(hsfreq != hs_freq_old || hslevel != hs_level_old || hsq != hs_q_old) {
         hsfreq = glide(hs_freq_old, hsfreq, keep_gliding);
-        hsL.set_highshelf_rbj(hsfreq, hsq, hslevel, (float)srate);
-        hsR.copy_coeffs(hsL);
+        hs.set_highshelf_rbj(0, hsfreq, hsq, hslevel, (float)srate);
+        hs.copy_coeffs(1, 0);
         hs_level_old = hslevel;
         hs_freq_old = hsfreq;
         hs_q_old = hsq;
@@ -172,8 +172,8 @@ void equalizerNband_audio_module<BaseClass, has_lphp>::params_changed()
         float q = *params[AM::param_p1_q + offset];
         if(freq != p_freq_old[i] || level != p_level_old[i] || q != p_q_old[i]) {
             freq = glide(p_freq_old[i], freq, keep_gliding);
-            pL[i].set_peakeq_rbj(freq, q, level, (float)srate);
-            pR[i].copy_coeffs(pL[i]);
+            peaks[i].set_peakeq_rbj(0, freq, q, level, (float)srate);
+            peaks[i].copy_coeffs(1, 0);
             p_freq_old[i] = freq;
             p_level_old[i] = level;
             p_q_old[i] = q;
@@ -204,64 +204,31 @@ void equalizerNband_audio_module<BaseClass, has_lphp>::params_changed()
 }
 
 template<class BaseClass, bool has_lphp>
-inline void equalizerNband_audio_module<BaseClass, has_lphp>::process_hplp(float &left, float &right)
+inline void equalizerNband_audio_module<BaseClass, has_lphp>::process_filters(dsp::biquad_d2_bank<2> *filters, int nfilters, int active, float *left, float *right, uint32_t count)
+{
+    // active: 0 = off, 1 = stereo, 2 = left, 3 = right, 4 = mid, 5 = side
+    if (active <= 0)
+        return;
+    if (active > 3)
+        for (uint32_t i = 0; i < count; i++)
+            diff_ms(left[i], right[i]);
+    for (int f = 0; f < nfilters; f++)
+        filters[f].process_stereo(left, right, count,
+            active == 1 || active == 2 || active == 4,
+            active == 1 || active == 3 || active == 5);
+    if (active > 3)
+        for (uint32_t i = 0; i < count; i++)
+            undiff_ms(left[i], right[i]);
+}
+
+template<class BaseClass, bool has_lphp>
+inline void equalizerNband_audio_module<BaseClass, has_lphp>::process_hplp(float *left, float *right, uint32_t count)
 {
     if (!has_lphp)
         return;
-    int active = *params[AM::param_lp_active];
-    if (active > 0.f)
-    {
-        if (active > 3) diff_ms(left, right);
-        switch(lp_mode)
-        {
-            case MODE12DB:
-                if (active == 1 || active == 2 || active == 4)
-                    left = lp[0][0].process(left);
-                if (active == 1 || active == 3 || active == 5)
-                    right = lp[0][1].process(right);
-                break;
-            case MODE24DB:
-                if (active == 1 || active == 2 || active == 4)
-                    left = lp[1][0].process(lp[0][0].process(left));
-                if (active == 1 || active == 3 || active == 5)
-                    right = lp[1][1].process(lp[0][1].process(right));
-                break;
-            case MODE36DB:
-                if (active == 1 || active == 2 || active == 4)
-                    left = lp[2][0].process(lp[1][0].process(lp[0][0].process(left)));
-                if (active == 1 || active == 3 || active == 5)
-                    right = lp[2][1].process(lp[1][1].process(lp[0][1].process(right)));
-                break;
-        }
-        if (active > 3) undiff_ms(left, right);
-    }
-    active = *params[AM::param_hp_active];
-    if (active > 0.f)
-    {
-        if (active > 3) diff_ms(left, right);
-        switch(hp_mode)
-        {
-            case MODE12DB:
-                if (active == 1 || active == 2 || active == 4)
-                    left = hp[0][0].process(left);
-                if (active == 1 || active == 3 || active == 5)
-                    right = hp[0][1].process(right);
-                break;
-            case MODE24DB:
-                if (active == 1 || active == 2 || active == 4)
-                    left = hp[1][0].process(hp[0][0].process(left));
-                if (active == 1 || active == 3 || active == 5)
-                    right = hp[1][1].process(hp[0][1].process(right));
-                break;
-            case MODE36DB:
-                if (active == 1 || active == 2 || active == 4)
-                    left = hp[2][0].process(hp[1][0].process(hp[0][0].process(left)));
-                if (active == 1 || active == 3 || active == 5)
-                    right = hp[2][1].process(hp[1][1].process(hp[0][1].process(right)));
-                break;
-        }
-        if (active > 3) undiff_ms(left, right);
-    }
+    // MODE12DB, MODE24DB and MODE36DB run one, two or three filters
+    process_filters(lp, (int)lp_mode + 1, *params[AM::param_lp_active], left, right, count);
+    process_filters(hp, (int)hp_mode + 1, *params[AM::param_hp_active], left, right, count);
 }
 
 template<class BaseClass, bool has_lphp>
@@ -286,100 +253,70 @@ uint32_t equalizerNband_audio_module<BaseClass, has_lphp>::process(uint32_t offs
     if(bypassed) {
         // everything bypassed
         while(offset < numsamples) {
-            outs[0][offset] = ins[0][offset];
-            outs[1][offset] = ins[1][offset];
+            float inL = ins[0][offset], inR = ins[1][offset];
+            outs[0][offset] = inL;
+            outs[1][offset] = inR;
             float values[] = {0, 0, 0, 0};
             meters.process(values);
             _analyzer.process(0, 0);
             ++offset;
         }
+        _analyzer.publish();
     } else {
         // process
         uint32_t orig_numsamples = numsamples-offset;
         uint32_t orig_offset = offset;
-        while(offset < numsamples) {
-            // cycle through samples
-            float outL = 0.f;
-            float outR = 0.f;
-            float inL = ins[0][offset];
-            float inR = ins[1][offset];
-            // in level
-            inR *= *params[AM::param_level_in];
-            inL *= *params[AM::param_level_in];
-            
-            float procL = inL;
-            float procR = inR;
-            
-            // all filters in chain
-            process_hplp(procL, procR);
-            
-            int active = *params[AM::param_ls_active];
-            if (active > 3) diff_ms(procL, procR);
-            if (active == 1 || active == 2 || active == 4)
-                procL = lsL.process(procL);
-            if (active == 1 || active == 3 || active == 5)
-                procR = lsR.process(procR);
-            if (active > 3) undiff_ms(procL, procR);
-            
-            active = *params[AM::param_hs_active];
-            if (active > 3) diff_ms(procL, procR);
-            if (active == 1 || active == 2 || active == 4)
-                procL = hsL.process(procL);
-            if (active == 1 || active == 3 || active == 5)
-                procR = hsR.process(procR);
-            if (active > 3) undiff_ms(procL, procR);
-            
-            for (int i = 0; i < AM::PeakBands; i++)
-            {
-                int offset = i * params_per_band;
-                int active = *params[AM::param_p1_active + offset];
-                if (active > 3) diff_ms(procL, procR);
-                if (active == 1 || active == 2 || active == 4)
-                    procL = pL[i].process(procL);
-                if (active == 1 || active == 3 || active == 5)
-                    procR = pR[i].process(procR);
-                if (active > 3) undiff_ms(procL, procR);
-            }
-            
-            outL = procL * *params[AM::param_level_out];
-            outR = procR * *params[AM::param_level_out];
+        bypass.save_dry(ins, 2, orig_offset, orig_numsamples);
+        // in level
+        float inL[MAX_SAMPLE_RUN], inR[MAX_SAMPLE_RUN];
+        float procL[MAX_SAMPLE_RUN], procR[MAX_SAMPLE_RUN];
+        float anaL[MAX_SAMPLE_RUN], anaR[MAX_SAMPLE_RUN];
+        for (uint32_t i = 0; i < orig_numsamples; i++) {
+            inL[i] = procL[i] = ins[0][offset + i] * *params[AM::param_level_in];
+            inR[i] = procR[i] = ins[1][offset + i] * *params[AM::param_level_in];
+        }
+        
+        // all filters in chain, each one over the whole block
+        process_hplp(procL, procR, orig_numsamples);
+        process_filters(&ls, 1, *params[AM::param_ls_active], procL, procR, orig_numsamples);
+        process_filters(&hs, 1, *params[AM::param_hs_active], procL, procR, orig_numsamples);
+        for (int i = 0; i < AM::PeakBands; i++)
+            process_filters(&peaks[i], 1, *params[AM::param_p1_active + i * params_per_band], procL, procR, orig_numsamples);
+        
+        for (uint32_t i = 0; i < orig_numsamples; i++) {
+            float outL = procL[i] * *params[AM::param_level_out];
+            float outR = procR[i] * *params[AM::param_level_out];
             
             // analyzer
-            _analyzer.process((inL + inR) / 2.f, (outL + outR) / 2.f);
+            anaL[i] = (inL[i] + inR[i]) / 2.f;
+            anaR[i] = (outL + outR) / 2.f;
         
             // send to output
-            outs[0][offset] = outL;
-            outs[1][offset] = outR;
-            
-            float values[] = {inL, inR, outL, outR};
-            meters.process(values);
-
-            // next sample
-            ++offset;
-        } // cycle trough samples
+            outs[0][offset + i] = outL;
+            outs[1][offset + i] = outR;
+        }
+        const float *values[] = {inL, inR, outs[0] + offset, outs[1] + offset};
+        meters.process(values, orig_numsamples);
+        _analyzer.process(anaL, anaR, orig_numsamples);
         bypass.crossfade(ins, outs, 2, orig_offset, orig_numsamples);
         // clean up
         for(int i = 0; i < 3; ++i) {
-            hp[i][0].sanitize();
-            hp[i][1].sanitize();
-            lp[i][0].sanitize();
-            lp[i][1].sanitize();
-        }
-        lsL.sanitize();
-        hsR.sanitize();
-        for(int i = 0; i < AM::PeakBands; ++i) {
-            pL[i].sanitize();
-            pR[i].sanitize();
+            hp[i].sanitize();
+            lp[i].sanitize();
         }
+        ls.sanitize();
+        hs.sanitize();
+        for(int i = 0; i < AM::PeakBands; ++i)
+            peaks[i].sanitize();
     }
     meters.fall(numsamples);
     return outputs_mask;
 }
 
-static inline float adjusted_lphp_gain(const float *const *params, int param_active, int param_mode, const biquad_d2 &filter, float freq, float srate)
+static inline float adjusted_lphp_gain(const float *const *params, int param_active, int param_mode, const biquad_d2_bank<2> &filter, float freq, float srate)
 {
     if(*params[param_active] > 0.f) {
-        float gain = filter.freq_gain(freq, srate);
+        float gain = filter.freq_gain(0, freq, srate);
         switch((int)*params[param_mode]) {
             case MODE12DB:
                 return gain;
@@ -459,15 +396,15 @@ bool equalizerNband_audio_module<BaseClass, has_lphp>::get_graph(int index, int
         for (int i = 0; i < points; i++) {
             double freq = 20.0 * pow (20000.0 / 20.0, i * 1.0 / points);
             if (last_peak < PeakBands) {
-                data[i] = pL[last_peak].freq_gain(freq, (float)srate);
+                data[i] = peaks[last_peak].freq_gain(0, freq, (float)srate);
             } else if (last_peak == PeakBands) {
-                data[i] = lsL.freq_gain(freq, (float)srate);
+                data[i] = ls.freq_gain(0, freq, (float)srate);
             } else if (last_peak == PeakBands + 1) {
-                data[i] = hsL.freq_gain(freq, (float)srate);
+                data[i] = hs.freq_gain(0, freq, (float)srate);
             } else if (last_peak == PeakBands + 2 && has_lphp) {
-                data[i] = adjusted_lphp_gain(params, AM::param_hp_active, AM::param_hp_mode, hp[0][0], freq, (float)srate);
+                data[i] = adjusted_lphp_gain(params, AM::param_hp_active, AM::param_hp_mode, hp[0], freq, (float)srate);
             } else if (last_peak == PeakBands + 3 && has_lphp) {
-                data[i] = adjusted_lphp_gain(params, AM::param_lp_active, AM::param_lp_mode, lp[0][0], freq, (float)srate);
+                data[i] = adjusted_lphp_gain(params, AM::param_lp_active, AM::param_lp_mode, lp[0], freq, (float)srate);
             }
             data[i] = dB_grid(data[i], 128 * *params[AM::param_zoom], 0);
         }
@@ -502,13 +439,13 @@ float equalizerNband_audio_module<BaseClass, has_lphp>::freq_gain(int index, dou
     float ret = 1.f;
     if (has_lphp)
     {
-        ret *= adjusted_lphp_gain(params, AM::param_hp_active, AM::param_hp_mode, hp[0][0], freq, (float)srate);
-        ret *= adjusted_lphp_gain(params, AM::param_lp_active, AM::param_lp_mode, lp[0][0], freq, (float)srate);
+        ret *= adjusted_lphp_gain(params, AM::param_hp_active, AM::param_hp_mode, hp[0], freq, (float)srate);
+        ret *= adjusted_lphp_gain(params, AM::param_lp_active, AM::param_lp_mode, lp[0], freq, (float)srate);
     }
-    ret *= (*params[AM::param_ls_active] > 0.f) ? lsL.freq_gain(freq, (float)srate) : 1;
-    ret *= (*params[AM::param_hs_active] > 0.f) ? hsL.freq_gain(freq, (float)srate) : 1;
+    ret *= (*params[AM::param_ls_active] > 0.f) ? ls.freq_gain(0, freq, (float)srate) : 1;
+    ret *= (*params[AM::param_hs_active] > 0.f) ? hs.freq_gain(0, freq, (float)srate) : 1;
     for (int i = 0; i < PeakBands; i++)
-        ret *= (*params[AM::param_p1_active + i * params_per_band] > 0.f) ? pL[i].freq_gain(freq, (float)srate) : 1;
+        ret *= (*params[AM::param_p1_active + i * params_per_band] > 0.f) ? peaks[i].freq_gain(0, freq, (float)srate) : 1;
     return ret;
 }
 
@@ -1164,13 +1101,14 @@ void vocoder_audio_module::params_changed()
             float step = (log10(to) - _freq) / (bands - i) * (1 + tilt);
             float f = pow(10, _freq + (0.5 * step));
             bandfreq[_i] = f;
-            detector[0][0][_i].set_bp_rbj(f, _q, (double)srate);
+            detector[0][0].set_bp_rbj(_i, f, _q, (double)srate);
+            dsp::biquad_coeffs coeffs = detector[0][0].get_coeffs(_i);
             for (int j = 0; j < order; j++) {
                 if (j)
-                    detector[0][j][_i].copy_coeffs(detector[0][0][_i]);
-                detector[1][j][_i].copy_coeffs(detector[0][0][_i]);
-                modulator[0][j][_i].copy_coeffs(detector[0][0][_i]);
-                modulator[1][j][_i].copy_coeffs(detector[0][0][_i]);
+                    detector[0][j].copy_coeffs(_i, coeffs);
+                detector[1][j].copy_coeffs(_i, coeffs);
+                modulator[0][j].copy_coeffs(_i, coeffs);
+                modulator[1][j].copy_coeffs(_i, coeffs);
             }
             freq = pow(10, _freq + step);
         }
@@ -1205,6 +1143,19 @@ uint32_t vocoder_audio_module::process(uint32_t offset, uint32_t numsamples, uin
             ++offset;
         }
     } else {
+        // band settings don't change within a call
+        double noise[32], volume[32], mod[32], panL[32], panR[32];
+        for (int i = 0; i < bands; i++) {
+            noise[i]  = *params[param_noise0 + i * band_params];
+            volume[i] = *params[param_volume0 + i * band_params];
+            mod[i]    = *params[param_mod0 + i * band_params];
+            float pan = *params[param_pan0 + i * band_params];
+            panL[i]   = pan > 0 ? -pan + 1 : 1;
+            panR[i]   = pan < 0 ? pan + 1 : 1;
+        }
+        bool link = *params[param_link] > 0.5;
+        bool detectors = *params[param_detectors] > 0.5;
+        float levelling = (float)order / 2 + 4;
         // process
         while(offset < numsamples) {
             // cycle through samples
@@ -1225,56 +1176,61 @@ uint32_t vocoder_audio_module::process(uint32_t offset, uint32_t numsamples, uin
             double nL = (float)rand() / (float)RAND_MAX;
             double nR = (float)rand() / (float)RAND_MAX;
             
+            // all bands run side by side through the filter banks
+            double mL_[32], mR_[32], cL_[32], cR_[32];
+            for (int i = 0; i < bands; i++) {
+                mL_[i] = mL;
+                mR_[i] = mR;
+                cL_[i] = cL + nL * noise[i];
+                cR_[i] = cR + nR * noise[i];
+            }
+            for (int j = 0; j < order; j++) {
+                // filter modulator
+                if (link) {
+                    for (int i = 0; i < bands; i++)
+                        mL_[i] = std::max(mL_[i], mR_[i]);
+                    detector[0][j].process(mL_, bands);
+                    memcpy(mR_, mL_, bands * sizeof(double));
+                } else {
+                    detector[0][j].process(mL_, bands);
+                    detector[1][j].process(mR_, bands);
+                }
+                // filter carrier with noise
+                modulator[0][j].process(cL_, bands);
+                modulator[1][j].process(cR_, bands);
+            }
+            
             for (int i = 0; i < bands; i++) {
-                double mL_ = mL;
-                double mR_ = mR;
-                double cL_ = cL + nL * *params[param_noise0 + i * band_params];
-                double cR_ = cR + nR * *params[param_noise0 + i * band_params];
-                
                 if ((solo && *params[param_solo0 + i * band_params]) || !solo) {
-                    for (int j = 0; j < order; j++) {
-                        // filter modulator
-                        if (*params[param_link] > 0.5) {
-                            mL_ = detector[0][j][i].process(std::max(mL_, mR_));
-                            mR_ = mL_;
-                        } else {
-                            mL_ = detector[0][j][i].process(mL_);
-                            mR_ = detector[1][j][i].process(mR_);
-                        }
-                        // filter carrier with noise
-                        cL_ = modulator[0][j][i].process(cL_);
-                        cR_ = modulator[1][j][i].process(cR_);
-                    }
                     // level by envelope with levelling
-                    cL_ *= env_mods[0][i] * ((float)order / 2 + 4) * 4;
-                    cR_ *= env_mods[1][i] * ((float)order / 2 + 4) * 4;
+                    double bandL = cL_[i] * (env_mods[0][i] * levelling * 4);
+                    double bandR = cR_[i] * (env_mods[1][i] * levelling * 4);
                     
                     // add band volume setting
-                    cL_ *= *params[param_volume0 + i * band_params];
-                    cR_ *= *params[param_volume0 + i * band_params];
+                    bandL *= volume[i];
+                    bandR *= volume[i];
                     
                     // add filtered modulator
-                    cL_ += mL_ * *params[param_mod0 + i * band_params];
-                    cR_ += mR_ * *params[param_mod0 + i * band_params];
+                    bandL += mL_[i] * mod[i];
+                    bandR += mR_[i] * mod[i];
                     
                     // Balance
-                    cL_ *= (*params[param_pan0 + i * band_params] > 0
-                         ? -*params[param_pan0 + i * band_params] + 1 : 1);
-                    cR_ *= (*params[param_pan0 + i * band_params] < 0
-                          ? *params[param_pan0 + i * band_params] + 1 : 1);
+                    bandL *= panL[i];
+                    bandR *= panR[i];
                     
                     // add to outputs with proc level
-                    pL += cL_ * *params[param_proc];
-                    pR += cR_ * *params[param_proc];
+                    pL += bandL * *params[param_proc];
+                    pR += bandR * *params[param_proc];
                 }
                 // LED
-                if (*params[param_detectors] > 0.5)
+                if (detectors)
                     if (env_mods[0][i] + env_mods[1][i] > led[i])
                         led[i] = env_mods[0][i] + env_mods[1][i];
                     
                 // advance envelopes
-                env_mods[0][i] = _sanitize((fabs(mL_) > env_mods[0][i] ? attack : release) * (env_mods[0][i] - fabs(mL_)) + fabs(mL_));
-                env_mods[1][i] = _sanitize((fabs(mR_) > env_mods[1][i] ? attack : release) * (env_mods[1][i] - fabs(mR_)) + fabs(mR_));
+                double aL = fabs(mL_[i]), aR = fabs(mR_[i]);
+                env_mods[0][i] = _sanitize((aL > env_mods[0][i] ? attack : release) * (env_mods[0][i] - aL) + aL);
+                env_mods[1][i] = _sanitize((aR > env_mods[1][i] ? attack : release) * (env_mods[1][i] - aR) + aR);
             }
             
             outL = pL;
@@ -1322,15 +1278,14 @@ uint32_t vocoder_audio_module::process(uint32_t offset, uint32_t numsamples, uin
             // next sample
             ++offset;
         } // cycle trough samples
+        _analyzer.publish();
         bypass.crossfade(ins, outs, 2, orig_offset, orig_numsamples);
         // clean up
-        for (int i = 0; i < bands; i++) {
-            for (int j = 0; j < order; j++) {
-                detector[0][j][i].sanitize();
-                detector[1][j][i].sanitize();
-                modulator[0][j][i].sanitize();
-                modulator[1][j][i].sanitize();
-            }
+        for (int j = 0; j < order; j++) {
+            detector[0][j].sanitize();
+            detector[1][j].sanitize();
+            modulator[0][j].sanitize();
+            modulator[1][j].sanitize();
         }
     }
     
@@ -1370,7 +1325,7 @@ bool vocoder_audio_module::get_graph(int index, int subindex, int phase, float *
             double freq = 20.0 * pow (20000.0 / 20.0, i * 1.0 / points);
             float level = 1;
             for (int j = 0; j < order; j++)
-                level *= detector[0][0][subindex].freq_gain(freq, srate);
+                level *= detector[0][0].freq_gain(subindex, freq, srate);
             level *= *params[param_volume0 + subindex * band_params];
             data[i] = dB_grid(level, 256, 0.4);
             if (!drawn && freq > bandfreq[subindex]) {
@@ -64,15 +64,18 @@ void limiter_audio_module::deactivate()
 }
 void limiter_audio_module::set_srates()
 {
+    // like the lookahead, the round trip latency of the oversampler (up
+    // to 61 samples at 16x) isn't reported or compensated in the crossfade
     if (params[param_oversampling]) {
-        resampler[0].set_params(srate, *params[param_oversampling], 2);
-        resampler[1].set_params(srate, *params[param_oversampling], 2);
-        limiter.set_sample_rate(srate * *params[param_oversampling]);
+        resampler[0].set_params(*params[param_oversampling]);
+        resampler[1].set_params(*params[param_oversampling]);
+        limiter.set_sample_rate(srate * resampler[0].get_factor());
     }
 }
 void limiter_audio_module::params_changed()
 {
     limiter.set_params(*params[param_limit], *params[param_attack], *params[param_release], 1.f, *params[param_asc], pow(0.5, (*params[param_asc_coeff] - 0.5) * 2 * -1), true);
+    limiter.set_engine(*params[param_engine], *params[param_true_peak] > 0.5f);
     if( *params[param_attack] != attack_old) {
         attack_old = *params[param_attack];
         limiter.reset();
@@ -94,6 +97,8 @@ void limiter_audio_module::set_sample_rate(uint32_t sr)
     int meter[] = {param_meter_inL, param_meter_inR,  param_meter_outL, param_meter_outR, -param_att};
     int clip[] = {param_clip_inL, param_clip_inR, param_clip_outL, param_clip_outR, -1};
     meters.init(params, meter, clip, 5, srate);
+    // allocate for the highest oversampling, so params_changed() never allocates
+    limiter.set_max_sample_rate(srate * dsp::oversampler::round_factor(param_props[param_oversampling].max));
     set_srates();
 }
 
@@ -106,8 +111,9 @@ uint32_t limiter_audio_module::process(uint32_t offset, uint32_t numsamples, uin
     if(bypassed) {
         // everything bypassed
         while(offset < numsamples) {
-            outs[0][offset] = ins[0][offset];
-            outs[1][offset] = ins[1][offset];
+            float inL = ins[0][offset], inR = ins[1][offset];
+            outs[0][offset] = inL;
+            outs[1][offset] = inR;
             float values[] = {0, 0, 0, 0, 1};
             meters.process(values);
             ++offset;
@@ -115,67 +121,81 @@ uint32_t limiter_audio_module::process(uint32_t offset, uint32_t numsamples, uin
         asc_led    = 0.f;
     } else {
         asc_led   -= std::min(asc_led, numsamples);
+        bypass.save_dry(ins, 2, orig_offset, orig_numsamples);
 
         // allocate fickdich on the stack before entering loop
         STACKALLOC(float, fickdich, limiter.overall_buffer_size);
+        int over = resampler[0].get_factor();
         while(offset < numsamples) {
-            // cycle through samples
-            float inL = ins[0][offset];
-            float inR = ins[1][offset];
+            // cycle through chunks of samples
+            enum { CHUNK = 64 };
+            uint32_t n = std::min(numsamples - offset, (uint32_t)CHUNK);
+            float inL[CHUNK], inR[CHUNK], att[CHUNK];
+            float upL[CHUNK * dsp::oversampler::MAX_FACTOR], upR[CHUNK * dsp::oversampler::MAX_FACTOR];
             // in level
-            inR *= *params[param_level_in];
-            inL *= *params[param_level_in];
-            // out vars
-            float outL = inL;
-            float outR = inR;
+            for (uint32_t i = 0; i < n; i++) {
+                inL[i] = ins[0][offset + i] * *params[param_level_in];
+                inR[i] = ins[1][offset + i] * *params[param_level_in];
+            }
             
             // upsampling
-            double *samplesL = resampler[0].upsample((double)outL);
-            double *samplesR = resampler[1].upsample((double)outR);
-            
-            float tmpL;
-            float tmpR;
+            resampler[0].upsample(inL, upL, n);
+            resampler[1].upsample(inR, upR, n);
             
             // process gain reduction
-            for (int i = 0; i < *params[param_oversampling]; i ++) {
-                tmpL = samplesL[i];
-                tmpR = samplesR[i];
-                limiter.process(tmpL, tmpR, fickdich);
-                samplesL[i] = tmpL;
-                samplesR[i] = tmpR;
+            if (limiter.engine == dsp::lookahead_limiter::ENGINE_WINDOW) {
+                // the window engine limits the whole chunk at once
+                limiter.process_block(upL, upR, NULL, n * over);
                 if(limiter.get_asc())
                     asc_led = srate >> 3;
+                float chunk_att = limiter.get_attenuation();
+                for (uint32_t i = 0; i < n; i++)
+                    att[i] = chunk_att;
+            } else {
+                for (uint32_t i = 0; i < n; i++) {
+                    for (int o = i * over; o < (int)(i + 1) * over; o++) {
+                        limiter.process(upL[o], upR[o], fickdich);
+                        if(limiter.get_asc())
+                            asc_led = srate >> 3;
+                    }
+                    att[i] = limiter.get_attenuation();
+                }
             }
             
             // downsampling
-            outL = resampler[0].downsample(samplesL);
-            outR = resampler[1].downsample(samplesR);
+            resampler[0].downsample(upL, upL, n);
+            resampler[1].downsample(upR, upR, n);
             
-            // should never be used. but hackers are paranoid by default.
-            // so we make sure NOTHING is above limit
-            outL = std::min(std::max(outL, -*params[param_limit]), *params[param_limit]);
-            outR = std::min(std::max(outR, -*params[param_limit]), *params[param_limit]);
-
-            // autolevel
-            if (*params[param_auto_level]) {
-                outL /= *params[param_limit];
-                outR /= *params[param_limit];
-            }
+            for (uint32_t i = 0; i < n; i++) {
+                float outL = upL[i];
+                float outR = upR[i];
+                
+                // should never be used. but hackers are paranoid by default.
+                // so we make sure NOTHING is above limit
+                outL = std::min(std::max(outL, -*params[param_limit]), *params[param_limit]);
+                outR = std::min(std::max(outR, -*params[param_limit]), *params[param_limit]);
+
+                // autolevel
+                if (*params[param_auto_level]) {
+                    outL /= *params[param_limit];
+                    outR /= *params[param_limit];
+                }
 
-            // out level
-            outL *= *params[param_level_out];
-            outR *= *params[param_level_out];
+                // out level
+                outL *= *params[param_level_out];
+                outR *= *params[param_level_out];
 
-            // send to output
-            outs[0][offset] = outL;
-            outs[1][offset] = outR;
+                // send to output
+                outs[0][offset + i] = outL;
+                outs[1][offset + i] = outR;
 
-            float values[] = {inL, inR, outL, outR, bypassed ? (float)1.0 : (float)limiter.get_attenuation()};
-            meters.process (values);
+                float values[] = {inL[i], inR[i], outL, outR, att[i]};
+                meters.process (values);
+            }
 
-            // next sample
-            ++offset;
-        } // cycle trough samples
+            // next chunk
+            offset += n;
+        } // cycle trough chunks
         bypass.crossfade(ins, outs, 2, orig_offset, orig_numsamples);
     } // process (no bypass)
     meters.fall(numsamples);
@@ -262,21 +282,29 @@ void multibandlimiter_audio_module::params_changed()
     crossover.set_filter(1, *params[param_freq1]);
     crossover.set_filter(2, *params[param_freq2]);
     
-    // set the params of all strips
-    float rel;
-    for (int i = 0; i < strips; i++) {
-        rel = *params[param_release] *  pow(0.25, *params[param_release0 + i] * -1);
-        rel = (*params[param_minrel] > 0.5) ? std::max(2500 * (1.f / (i ? *params[param_freq0 + i - 1] : 30)), rel) : rel;
-        weight[i] = pow(0.25, *params[param_weight0 + i] * -1);
-        strip[i].set_params(*params[param_limit], *params[param_attack], rel, weight[i], *params[param_asc], pow(0.5, (*params[param_asc_coeff] - 0.5) * 2 * -1), false);
-        *params[param_effrelease0 + i] = rel;
+    // set the params of all strips and the broadband limiter (skipped if
+    // only the levels, the solo switches or the bypass changed)
+    if (is_param_range_dirty(param_freq0, param_minrel) || is_param_range_dirty(param_weight0, param_release3)
+        || is_param_range_dirty(param_asc, param_oversampling)) {
+        float rel;
+        for (int i = 0; i < strips; i++) {
+            rel = *params[param_release] *  pow(0.25, *params[param_release0 + i] * -1);
+            rel = (*params[param_minrel] > 0.5) ? std::max(2500 * (1.f / (i ? *params[param_freq0 + i - 1] : 30)), rel) : rel;
+            weight[i] = pow(0.25, *params[param_weight0 + i] * -1);
+            strip[i].set_params(*params[param_limit], *params[param_attack], rel, weight[i], *params[param_asc], pow(0.5, (*params[param_asc_coeff] - 0.5) * 2 * -1), false);
+            *params[param_effrelease0 + i] = rel;
+        }
+        broadband.set_params(*params[param_limit], *params[param_attack], rel, 1.f, *params[param_asc], pow(0.5, (*params[param_asc_coeff] - 0.5) * 2 * -1));
     }
     
-    // set broadband limiter
-    broadband.set_params(*params[param_limit], *params[param_attack], rel, 1.f, *params[param_asc], pow(0.5, (*params[param_asc_coeff] - 0.5) * 2 * -1));
+    // the output is the broadband sum, so only the broadband limiter
+    // needs the true peak detection
+    for (int j = 0; j < strips; j ++)
+        strip[j].set_engine(*params[param_engine]);
+    broadband.set_engine(*params[param_engine], *params[param_true_peak] > 0.5f);
     
-    if (over != *params[param_oversampling]) {
-        over = *params[param_oversampling];
+    if (over != dsp::oversampler::round_factor(*params[param_oversampling])) {
+        over = dsp::oversampler::round_factor(*params[param_oversampling]);
         set_srates();
     }
     
@@ -307,6 +335,14 @@ void multibandlimiter_audio_module::params_changed()
 void multibandlimiter_audio_module::set_sample_rate(uint32_t sr)
 {
     srate = sr;
+    // allocate everything for the highest oversampling, so that changing
+    // the oversampling in params_changed() doesn't allocate
+    uint32_t max_srate = srate * dsp::oversampler::round_factor(param_props[param_oversampling].max);
+    for (int j = 0; j < strips; j ++)
+        strip[j].set_max_sample_rate(max_srate);
+    broadband.set_max_sample_rate(max_srate);
+    free(buffer);
+    buffer = (float*) calloc((int)(max_srate * (100.f / 1000.f) * channels) + channels, sizeof(float));
     set_srates();
     int meter[] = {param_meter_inL, param_meter_inR,  param_meter_outL, param_meter_outR, -param_att0, -param_att1, -param_att2, -param_att3};
     int clip[] = {param_clip_inL, param_clip_inR, param_clip_outL, param_clip_outR, -1, -1, -1, -1};
@@ -319,12 +355,13 @@ void multibandlimiter_audio_module::set_srates()
     crossover.set_sample_rate(srate);
     for (int j = 0; j < strips; j ++) {
         strip[j].set_sample_rate(srate * over);
-        resampler[j][0].set_params(srate, over, 2);
-        resampler[j][1].set_params(srate, over, 2);
+        resampler[j][0].set_params(over);
+        resampler[j][1].set_params(over);
     }
-    // rebuild buffer
+    // clear buffer (allocated in set_sample_rate)
     overall_buffer_size = (int)(srate * (100.f / 1000.f) * channels * over) + channels; // buffer size max attack rate
-    buffer = (float*) calloc(overall_buffer_size, sizeof(float));
+    if (buffer)
+        memset(buffer, 0, overall_buffer_size * sizeof(float));
     pos = 0;
 }
 
@@ -360,209 +397,189 @@ uint32_t multibandlimiter_audio_module::process(uint32_t offset, uint32_t numsam
         // allocate fickdich on the stack before entering loop to avoid buffer overflow
         STACKALLOC(float, fickdich, broadband.overall_buffer_size);
         while(offset < numsamples) {
-            float inL  = 0.f; // input
-            float inR  = 0.f;
-            float outL = 0.f; // final output
-            float outR = 0.f;
+            // cycle through chunks of samples
+            enum { CHUNK = 16, MAX_OVER = CHUNK * dsp::oversampler::MAX_FACTOR };
+            uint32_t n = std::min(numsamples - offset, (uint32_t)CHUNK);
+            float inL[CHUNK], inR[CHUNK]; // input
+            float bandL[strips][CHUNK], bandR[strips][CHUNK];
+            float overL[strips][MAX_OVER], overR[strips][MAX_OVER];
+            float resL[MAX_OVER], resR[MAX_OVER];
+            float coeff[MAX_OVER]; // multiband coefficients (window engine)
+            float att[CHUNK][strips];
             float tmpL = 0.f; // used for temporary purposes
             float tmpR = 0.f;
-            double overL[strips * 16];
-            double overR[strips * 16];
-            double resL[16];
-            double resR[16];
             
             bool asc_active = false;
             
-            // cycle through samples
-            if(!_sanitize) {
-                inL = ins[0][offset];
-                inR = ins[1][offset];
+            // cycle through samples. The input stays muted until the
+            // multiband buffer has been filled once (pos moves by channels
+            // for every upsampled sample, see below)
+            bool mute = _sanitize;
+            unsigned int mute_pos = pos;
+            for (uint32_t i = 0; i < n; i++) {
+                // in level
+                inL[i] = mute ? 0.f : ins[0][offset + i] * *params[param_level_in];
+                inR[i] = mute ? 0.f : ins[1][offset + i] * *params[param_level_in];
+                
+                // process crossover
+                float xin[] = {inL[i], inR[i]};
+                crossover.process(xin);
+                for (int j = 0; j < strips; j++) {
+                    bandL[j][i] = crossover.get_value(0, j);
+                    bandR[j][i] = crossover.get_value(1, j);
+                }
+                for (int o = 0; o < over && mute; o++) {
+                    mute_pos = (mute_pos + channels) % buffer_size;
+                    if(mute_pos == 0) mute = false;
+                }
             }
-            // in level
-            inR *= *params[param_level_in];
-            inL *= *params[param_level_in];
-            
-            //if(!(cnt%50)) printf("i: %.5f\n", inL);
             
-            // process crossover
-            float xin[] = {inL, inR};
-            crossover.process(xin);
-            
-            // cycle over strips
-            for (int i = 0; i < strips; i++) {
-                // upsample
-                double *samplesL = resampler[i][0].upsample((double)crossover.get_value(0, i));
-                double *samplesR = resampler[i][1].upsample((double)crossover.get_value(1, i));
-                // copy to cache
-                memcpy(&overL[i * 16], samplesL, sizeof(double) * over);
-                memcpy(&overR[i * 16], samplesR, sizeof(double) * over);
-                //if(!(cnt%200)) printf("u0: %.5f\n", overL[i*16]);
+            // upsample all strips
+            for (int j = 0; j < strips; j++) {
+                resampler[j][0].upsample(bandL[j], overL[j], n);
+                resampler[j][1].upsample(bandR[j], overR[j], n);
             }
             
             // cycle over upsampled samples
-            for (int o = 0; o < over; o++) {
-                tmpL = 0.f;
-                tmpR = 0.f;
-                resL[o] = 0;
-                resR[o] = 0;
-                
-                // cycle over strips for multiband coefficient
-                
-                // -------------------------------------------
-                // The Multiband Coefficient
-                //
-                // The Multiband Coefficient tries to make sure, that after
-                // summing up the 4 limited strips, the signal does not raise
-                // above the limit. It works as a correction factor. Because
-                // we use this concept, we can introduce a weighting to each
-                // strip.
-                // a1, a2, a3, ... : signals in strips
-                // then a1 + a2 + a3 + ... might raise above the limit, because
-                // the strips will be limited and the filters, which produced
-                // the signals from source signals, are not complete precisely.
-                // Morethough, external signals might be added in here in future
-                // versions.
-                //
-                // So introduce correction factor:
-                // Sum( a_i * weight_i) = limit / multi_coeff
-                //
-                // The multi_coeff now can be used in each strip i, to calculate
-                // the real limit for strip i according to the signals in the
-                // other strips and the weighting of the own strip i.
-                // strip_limit_i = limit * multicoeff * weight_i
-                //
-                // -------------------------------------------
-                
-                
-                for (int i = 0; i < strips; i++) {
-                    // sum up for multiband coefficient
-                    int p = i * 16 + o;
-                    tmpL += ((fabs(overL[p]) > *params[param_limit]) ? *params[param_limit] * (fabs(overL[p]) / overL[p]) : overL[p]) * weight[i];
-                    tmpR += ((fabs(overR[p]) > *params[param_limit]) ? *params[param_limit] * (fabs(overR[p]) / overR[p]) : overR[p]) * weight[i];
+            bool window = broadband.engine == dsp::lookahead_limiter::ENGINE_WINDOW;
+            for (uint32_t i = 0; i < n; i++) {
+                for (int o = i * over; o < (int)(i + 1) * over; o++) {
+                    tmpL = 0.f;
+                    tmpR = 0.f;
+                    resL[o] = 0;
+                    resR[o] = 0;
+                    
+                    // cycle over strips for multiband coefficient
+                    
+                    // -------------------------------------------
+                    // The Multiband Coefficient
+                    //
+                    // The Multiband Coefficient tries to make sure, that after
+                    // summing up the 4 limited strips, the signal does not raise
+                    // above the limit. It works as a correction factor. Because
+                    // we use this concept, we can introduce a weighting to each
+                    // strip.
+                    // a1, a2, a3, ... : signals in strips
+                    // then a1 + a2 + a3 + ... might raise above the limit, because
+                    // the strips will be limited and the filters, which produced
+                    // the signals from source signals, are not complete precisely.
+                    // Morethough, external signals might be added in here in future
+                    // versions.
+                    //
+                    // So introduce correction factor:
+                    // Sum( a_i * weight_i) = limit / multi_coeff
+                    //
+                    // The multi_coeff now can be used in each strip i, to calculate
+                    // the real limit for strip i according to the signals in the
+                    // other strips and the weighting of the own strip i.
+                    // strip_limit_i = limit * multicoeff * weight_i
+                    //
+                    // -------------------------------------------
+                    
+                    
+                    for (int j = 0; j < strips; j++) {
+                        // sum up for multiband coefficient
+                        float l = overL[j][o], r = overR[j][o];
+                        tmpL += ((fabs(l) > *params[param_limit]) ? *params[param_limit] * (fabs(l) / l) : l) * weight[j];
+                        tmpR += ((fabs(r) > *params[param_limit]) ? *params[param_limit] * (fabs(r) / r) : r) * weight[j];
+                    }
+                    
+                    // write multiband coefficient to buffer
+                    buffer[pos] = coeff[o] = std::min((float)(*params[param_limit] / std::max(fabs(tmpL), fabs(tmpR))), 1.0f);
+                    
+                    // step forward in multiband buffer
+                    pos = (pos + channels) % buffer_size;
+                    if(pos == 0) _sanitize = false;
+                    
+                    // the window engine limits the whole chunk below
+                    if (window)
+                        continue;
+                    
+                    // limit and add up strips
+                    for (int j = 0; j < strips; j++) {
+                        strip[j].process(overL[j][o], overR[j][o], buffer);
+                        if (solo[j] || no_solo) {
+                            // add
+                            resL[o] += overL[j][o];
+                            resR[o] += overR[j][o];
+                            // flash the asc led?
+                            asc_active = asc_active || strip[j].get_asc();
+                        }
+                    }
+                    
+                    // process broadband limiter
+                    broadband.process(resL[o], resR[o], fickdich);
+                    asc_active = asc_active || broadband.get_asc();
                 }
-                
-                // write multiband coefficient to buffer
-                buffer[pos] = std::min((float)(*params[param_limit] / std::max(fabs(tmpL), fabs(tmpR))), 1.0f);
-                
-                // step forward in multiband buffer
-                pos = (pos + channels) % buffer_size;
-                if(pos == 0) _sanitize = false;
-                
-                // limit and add up strips
-                for (int i = 0; i < strips; i++) {
-                    int p = i * 16 + o;
-                    //if(!(cnt%200) and !o) printf("u1: %.5f\n", overL[p]);
-                    // limit
-                    tmpL = (float)overL[p];
-                    tmpR = (float)overR[p];
-                    //if(!(cnt%200)) printf("1: %.5f\n", tmpL);
-                    strip[i].process(tmpL, tmpR, buffer);
-                    //if(!(cnt%200)) printf("2: %.5f\n\n", tmpL);
-                    if (solo[i] || no_solo) {
-                        // add
-                        resL[o] += (double)tmpL;
-                        resR[o] += (double)tmpR;
-                        // flash the asc led?
-                        asc_active = asc_active || strip[i].get_asc();
+                if (window)
+                    continue;
+                batt = broadband.get_attenuation();
+                for (int j = 0; j < strips; j++)
+                    att[i][j] = strip[j].get_attenuation() * batt;
+            }
+            
+            if (window) {
+                // limit and add up the strips a chunk at a time, then the
+                // broadband signal
+                uint32_t len = n * over;
+                for (int j = 0; j < strips; j++) {
+                    strip[j].process_block(overL[j], overR[j], coeff, len);
+                    if (solo[j] || no_solo) {
+                        for (uint32_t o = 0; o < len; o++) {
+                            resL[o] += overL[j][o];
+                            resR[o] += overR[j][o];
+                        }
+                        asc_active = asc_active || strip[j].get_asc();
                     }
                 }
-                
-                // process broadband limiter
-                tmpL = resL[o];
-                tmpR = resR[o];
-                broadband.process(tmpL, tmpR, fickdich);
-                resL[o] = (double)tmpL;
-                resR[o] = (double)tmpR;
+                broadband.process_block(resL, resR, NULL, len);
                 asc_active = asc_active || broadband.get_asc();
+                batt = broadband.get_attenuation();
+                for (int j = 0; j < strips; j++) {
+                    float a = strip[j].get_attenuation() * batt;
+                    for (uint32_t i = 0; i < n; i++)
+                        att[i][j] = a;
+                }
             }
             
             // downsampling
-            outL = (float)resampler[0][0].downsample(resL);
-            outR = (float)resampler[0][1].downsample(resR);
-            
-            //if(!(cnt%50)) printf("o: %.5f %.5f\n\n", outL, resL[0]);
-            
-            // should never be used. but hackers are paranoid by default.
-            // so we make sure NOTHING is above limit
-            outL = std::min(std::max(outL, -*params[param_limit]), *params[param_limit]);
-            outR = std::min(std::max(outR, -*params[param_limit]), *params[param_limit]);
+            resampler[0][0].downsample(resL, resL, n);
+            resampler[0][1].downsample(resR, resR, n);
             
             // light led
             if(asc_active)  {
                 asc_led = srate >> 3;
             }
             
-            // autolevel
-            if (*params[param_auto_level]) {
-                outL /= *params[param_limit];
-                outR /= *params[param_limit];
-            }
+            for (uint32_t i = 0; i < n; i++) {
+                // should never be used. but hackers are paranoid by default.
+                // so we make sure NOTHING is above limit
+                float outL = std::min(std::max(resL[i], -*params[param_limit]), *params[param_limit]);
+                float outR = std::min(std::max(resR[i], -*params[param_limit]), *params[param_limit]);
+                
+                // autolevel
+                if (*params[param_auto_level]) {
+                    outL /= *params[param_limit];
+                    outR /= *params[param_limit];
+                }
 
-            // out level
-            outL *= *params[param_level_out];
-            outR *= *params[param_level_out];
+                // out level
+                outL *= *params[param_level_out];
+                outR *= *params[param_level_out];
 
-            // send to output
-            outs[0][offset] = outL;
-            outs[1][offset] = outR;
+                // send to output
+                outs[0][offset + i] = outL;
+                outs[1][offset + i] = outR;
 
-            // next sample
-            ++offset;
-            
-            batt = broadband.get_attenuation();
-            
-            float values[] = {inL, inR, outL, outR,
-                bypassed ? (float)1.0 : (float)strip[0].get_attenuation() * batt,
-                bypassed ? (float)1.0 : (float)strip[1].get_attenuation() * batt,
-                bypassed ? (float)1.0 : (float)strip[2].get_attenuation() * batt,
-                bypassed ? (float)1.0 : (float)strip[3].get_attenuation() * batt};
-            meters.process(values);
-            
-            
-            
-            //for (int i = 0; i < strips; i++) {
-                //left  = crossover.get_value(0, i);
-                //right = crossover.get_value(1, i);
-                
-                //// remember filtered values for limiting
-                //// (we need multiband_coeff before we can call the limiter bands)
-                //_tmpL[i] = left;
-                //_tmpR[i] = right;
-
-                //// sum up for multiband coefficient
-                //sum_left += ((fabs(left) > *params[param_limit]) ? *params[param_limit] * (fabs(left) / left) : left) * weight[i];
-                //sum_right += ((fabs(right) > *params[param_limit]) ? *params[param_limit] * (fabs(right) / right) : right) * weight[i];
-            //} // process single strip with filter
-
-            //// write multiband coefficient to buffer
-            //buffer[pos] = std::min(*params[param_limit] / std::max(fabs(sum_left), fabs(sum_right)), 1.0);
-
-            //for (int i = 0; i < strips; i++) {
-                //// process gain reduction
-                //strip[i].process(_tmpL[i], _tmpR[i], buffer);
-                //// sum up output of limiters
-                //if (solo[i] || no_solo) {
-                    //outL += _tmpL[i];
-                    //outR += _tmpR[i];
-                //}
-                //asc_active = asc_active || strip[i].get_asc();
-            //} // process single strip again for limiter
-            //float fickdich[0];
-            //broadband.process(outL, outR, fickdich);
-            //asc_active = asc_active || broadband.get_asc();
-            
-            //// should never be used. but hackers are paranoid by default.
-            //// so we make sure NOTHING is above limit
-            //outL = std::max(outL, -*params[param_limit]);
-            //outL = std::min(outL, *params[param_limit]);
-            //outR = std::max(outR, -*params[param_limit]);
-            //outR = std::min(outR, *params[param_limit]);
+                float values[] = {inL[i], inR[i], outL, outR,
+                    att[i][0], att[i][1], att[i][2], att[i][3]};
+                meters.process(values);
+            }
             
-            //if(asc_active)  {
-                //asc_led = srate >> 3;
-            //}
-            cnt++;
-        } // cycle trough samples
+            // next chunk
+            offset += n;
+            cnt += n;
+        } // cycle trough chunks
         bypass.crossfade(ins, outs, 2, orig_offset, orig_numsamples);
     } // process (no bypass)
     if (params[param_asc_led] != NULL) *params[param_asc_led] = asc_led;
@@ -674,8 +691,14 @@ void sidechainlimiter_audio_module::params_changed()
     // set broadband limiter
     broadband.set_params(*params[param_limit], *params[param_attack], rel, 1.f, *params[param_asc], pow(0.5, (*params[param_asc_coeff] - 0.5) * 2 * -1));
     
-    if (over != *params[param_oversampling]) {
-        over = *params[param_oversampling];
+    // the output is the broadband sum, so only the broadband limiter
+    // needs the true peak detection
+    for (int j = 0; j < strips; j ++)
+        strip[j].set_engine(*params[param_engine]);
+    broadband.set_engine(*params[param_engine], *params[param_true_peak] > 0.5f);
+    
+    if (over != dsp::oversampler::round_factor(*params[param_oversampling])) {
+        over = dsp::oversampler::round_factor(*params[param_oversampling]);
         set_srates();
     }
     
@@ -706,6 +729,14 @@ void sidechainlimiter_audio_module::params_changed()
 void sidechainlimiter_audio_module::set_sample_rate(uint32_t sr)
 {
     srate = sr;
+    // allocate everything for the highest oversampling, so that changing
+    // the oversampling in params_changed() doesn't allocate
+    uint32_t max_srate = srate * dsp::oversampler::round_factor(param_props[param_oversampling].max);
+    for (int j = 0; j < strips; j ++)
+        strip[j].set_max_sample_rate(max_srate);
+    broadband.set_max_sample_rate(max_srate);
+    free(buffer);
+    buffer = (float*) calloc((int)(max_srate * (100.f / 1000.f) * channels) + channels, sizeof(float));
     set_srates();
     int meter[] = {param_meter_inL, param_meter_inR, param_meter_scL, param_meter_scR, param_meter_outL, param_meter_outR, -param_att0, -param_att1, -param_att2, -param_att3, -param_att_sc};
     int clip[] = {param_clip_inL, param_clip_inR, -1, -1, param_clip_outL, param_clip_outR, -1, -1, -1, -1, -1};
@@ -718,12 +749,13 @@ void sidechainlimiter_audio_module::set_srates()
     crossover.set_sample_rate(srate);
     for (int j = 0; j < strips; j ++) {
         strip[j].set_sample_rate(srate * over);
-        resampler[j][0].set_params(srate, over, 2);
-        resampler[j][1].set_params(srate, over, 2);
+        resampler[j][0].set_params(over);
+        resampler[j][1].set_params(over);
     }
-    // rebuild buffer
+    // clear buffer (allocated in set_sample_rate)
     overall_buffer_size = (int)(srate * (100.f / 1000.f) * channels * over) + channels; // buffer size max attack rate
-    buffer = (float*) calloc(overall_buffer_size, sizeof(float));
+    if (buffer)
+        memset(buffer, 0, overall_buffer_size * sizeof(float));
     pos = 0;
 }
 
@@ -759,154 +791,167 @@ uint32_t sidechainlimiter_audio_module::process(uint32_t offset, uint32_t numsam
         // allocate fickdich on the stack before loops to avoid buffer overflow
         STACKALLOC(float, fickdich, broadband.overall_buffer_size);
         while(offset < numsamples) {
-            float inL  = 0.f; // input
-            float inR  = 0.f;
-            float scL  = 0.f;
-            float scR  = 0.f;
-            float outL = 0.f; // final output
-            float outR = 0.f;
+            // cycle through chunks of samples
+            enum { CHUNK = 16, MAX_OVER = CHUNK * dsp::oversampler::MAX_FACTOR };
+            uint32_t n = std::min(numsamples - offset, (uint32_t)CHUNK);
+            float inL[CHUNK], inR[CHUNK]; // input
+            float scL[CHUNK], scR[CHUNK];
+            float bandL[strips][CHUNK], bandR[strips][CHUNK];
+            float overL[strips][MAX_OVER], overR[strips][MAX_OVER];
+            float resL[MAX_OVER], resR[MAX_OVER];
+            float coeff[MAX_OVER]; // multiband coefficients (window engine)
+            float att[CHUNK][strips];
             float tmpL = 0.f; // used for temporary purposes
             float tmpR = 0.f;
-            double overL[strips * 16];
-            double overR[strips * 16];
-            double resL[16];
-            double resR[16];
             
             bool asc_active = false;
             
-            // cycle through samples
-            if(!_sanitize) {
-                inL = ins[0][offset];
-                inR = ins[1][offset];
-                scL = ins[2] ? ins[2][offset] : 0;
-                scR = ins[3] ? ins[3][offset] : 0;
+            // cycle through samples. The input stays muted until the
+            // multiband buffer has been filled once (pos moves by channels
+            // for every upsampled sample, see below)
+            bool mute = _sanitize;
+            unsigned int mute_pos = pos;
+            for (uint32_t i = 0; i < n; i++) {
+                // in level
+                inL[i] = mute ? 0.f : ins[0][offset + i] * *params[param_level_in];
+                inR[i] = mute ? 0.f : ins[1][offset + i] * *params[param_level_in];
+                scL[i] = (mute || !ins[2]) ? 0.f : ins[2][offset + i] * *params[param_level_sc];
+                scR[i] = (mute || !ins[3]) ? 0.f : ins[3][offset + i] * *params[param_level_sc];
+                
+                // process crossover
+                float xin[] = {inL[i], inR[i]};
+                crossover.process(xin);
+                for (int j = 0; j < strips - 1; j++) {
+                    bandL[j][i] = crossover.get_value(0, j);
+                    bandR[j][i] = crossover.get_value(1, j);
+                }
+                bandL[strips - 1][i] = scL[i];
+                bandR[strips - 1][i] = scR[i];
+                for (int o = 0; o < over && mute; o++) {
+                    mute_pos = (mute_pos + channels) % buffer_size;
+                    if(mute_pos == 0) mute = false;
+                }
             }
             
-            // in level
-            inR *= *params[param_level_in];
-            inL *= *params[param_level_in];
-            
-            scR *= *params[param_level_sc];
-            scL *= *params[param_level_sc];
-            
-            //if(!(cnt%50)) printf("i: %.5f\n", inL);
-            
-            // process crossover
-            float xin[] = {inL, inR};
-            crossover.process(xin);
-            
-            // cycle over strips
-            for (int i = 0; i < strips; i++) {
-                double *samplesR, *samplesL;
-                // upsample
-                if (i < strips - 1) {
-                    samplesL = resampler[i][0].upsample((double)crossover.get_value(0, i));
-                    samplesR = resampler[i][1].upsample((double)crossover.get_value(1, i));
-                } else {
-                    samplesL = resampler[i][0].upsample((double)scL);
-                    samplesR = resampler[i][1].upsample((double)scR);
-                }
-                // copy to cache
-                memcpy(&overL[i * 16], samplesL, sizeof(double) * over);
-                memcpy(&overR[i * 16], samplesR, sizeof(double) * over);
-                //if(!(cnt%200)) printf("u0: %.5f\n", overL[i*16]);
+            // upsample all strips
+            for (int j = 0; j < strips; j++) {
+                resampler[j][0].upsample(bandL[j], overL[j], n);
+                resampler[j][1].upsample(bandR[j], overR[j], n);
             }
             
             // cycle over upsampled samples
-            for (int o = 0; o < over; o++) {
-                tmpL = 0.f;
-                tmpR = 0.f;
-                resL[o] = 0;
-                resR[o] = 0;
-                
-                // cycle over strips for multiband coefficient
-                for (int i = 0; i < strips; i++) {
-                    // sum up for multiband coefficient
-                    int p = i * 16 + o;
-                    tmpL += ((fabs(overL[p]) > *params[param_limit]) ? *params[param_limit] * (fabs(overL[p]) / overL[p]) : overL[p]) * weight[i];
-                    tmpR += ((fabs(overR[p]) > *params[param_limit]) ? *params[param_limit] * (fabs(overR[p]) / overR[p]) : overR[p]) * weight[i];
+            bool window = broadband.engine == dsp::lookahead_limiter::ENGINE_WINDOW;
+            for (uint32_t i = 0; i < n; i++) {
+                for (int o = i * over; o < (int)(i + 1) * over; o++) {
+                    tmpL = 0.f;
+                    tmpR = 0.f;
+                    resL[o] = 0;
+                    resR[o] = 0;
+                    
+                    // cycle over strips for multiband coefficient
+                    for (int j = 0; j < strips; j++) {
+                        // sum up for multiband coefficient
+                        float l = overL[j][o], r = overR[j][o];
+                        tmpL += ((fabs(l) > *params[param_limit]) ? *params[param_limit] * (fabs(l) / l) : l) * weight[j];
+                        tmpR += ((fabs(r) > *params[param_limit]) ? *params[param_limit] * (fabs(r) / r) : r) * weight[j];
+                    }
+                    
+                    // write multiband coefficient to buffer
+                    buffer[pos] = coeff[o] = std::min((float)(*params[param_limit] / std::max(fabs(tmpL), fabs(tmpR))), 1.0f);
+                    
+                    // step forward in multiband buffer
+                    pos = (pos + channels) % buffer_size;
+                    if(pos == 0) _sanitize = false;
+                    
+                    // the window engine limits the whole chunk below
+                    if (window)
+                        continue;
+                    
+                    // limit and add up strips
+                    for (int j = 0; j < strips; j++) {
+                        strip[j].process(overL[j][o], overR[j][o], buffer);
+                        if (solo[j] || no_solo) {
+                            // add
+                            resL[o] += overL[j][o];
+                            resR[o] += overR[j][o];
+                            // flash the asc led?
+                            asc_active = asc_active || strip[j].get_asc();
+                        }
+                    }
+                    
+                    // process broadband limiter
+                    broadband.process(resL[o], resR[o], fickdich);
+                    asc_active = asc_active || broadband.get_asc();
                 }
-                
-                // write multiband coefficient to buffer
-                buffer[pos] = std::min((float)(*params[param_limit] / std::max(fabs(tmpL), fabs(tmpR))), 1.0f);
-                
-                // step forward in multiband buffer
-                pos = (pos + channels) % buffer_size;
-                if(pos == 0) _sanitize = false;
-                
-                // limit and add up strips
-                for (int i = 0; i < strips; i++) {
-                    int p = i * 16 + o;
-                    //if(!(cnt%200) and !o) printf("u1: %.5f\n", overL[p]);
-                    // limit
-                    tmpL = (float)overL[p];
-                    tmpR = (float)overR[p];
-                    //if(!(cnt%200)) printf("1: %.5f\n", tmpL);
-                    strip[i].process(tmpL, tmpR, buffer);
-                    //if(!(cnt%200)) printf("2: %.5f\n\n", tmpL);
-                    if (solo[i] || no_solo) {
-                        // add
-                        resL[o] += (double)tmpL;
-                        resR[o] += (double)tmpR;
-                        // flash the asc led?
-                        asc_active = asc_active || strip[i].get_asc();
+                if (window)
+                    continue;
+                batt = broadband.get_attenuation();
+                for (int j = 0; j < strips; j++)
+                    att[i][j] = strip[j].get_attenuation() * batt;
+            }
+            
+            if (window) {
+                // limit and add up the strips a chunk at a time, then the
+                // broadband signal
+                uint32_t len = n * over;
+                for (int j = 0; j < strips; j++) {
+                    strip[j].process_block(overL[j], overR[j], coeff, len);
+                    if (solo[j] || no_solo) {
+                        for (uint32_t o = 0; o < len; o++) {
+                            resL[o] += overL[j][o];
+                            resR[o] += overR[j][o];
+                        }
+                        asc_active = asc_active || strip[j].get_asc();
                     }
                 }
-                
-                // process broadband limiter
-                tmpL = resL[o];
-                tmpR = resR[o];
-                broadband.process(tmpL, tmpR, fickdich);
-                resL[o] = (double)tmpL;
-                resR[o] = (double)tmpR;
+                broadband.process_block(resL, resR, NULL, len);
                 asc_active = asc_active || broadband.get_asc();
+                batt = broadband.get_attenuation();
+                for (int j = 0; j < strips; j++) {
+                    float a = strip[j].get_attenuation() * batt;
+                    for (uint32_t i = 0; i < n; i++)
+                        att[i][j] = a;
+                }
             }
             
             // downsampling
-            outL = (float)resampler[0][0].downsample(resL);
-            outR = (float)resampler[0][1].downsample(resR);
-            
-            //if(!(cnt%50)) printf("o: %.5f %.5f\n\n", outL, resL[0]);
-            
-            // should never be used. but hackers are paranoid by default.
-            // so we make sure NOTHING is above limit
-            outL = std::min(std::max(outL, -*params[param_limit]), *params[param_limit]);
-            outR = std::min(std::max(outR, -*params[param_limit]), *params[param_limit]);
+            resampler[0][0].downsample(resL, resL, n);
+            resampler[0][1].downsample(resR, resR, n);
             
             // light led
             if(asc_active)  {
                 asc_led = srate >> 3;
             }
             
-            // autolevel
-            if (*params[param_auto_level]) {
-                outL /= *params[param_limit];
-                outR /= *params[param_limit];
-            }
+            for (uint32_t i = 0; i < n; i++) {
+                // should never be used. but hackers are paranoid by default.
+                // so we make sure NOTHING is above limit
+                float outL = std::min(std::max(resL[i], -*params[param_limit]), *params[param_limit]);
+                float outR = std::min(std::max(resR[i], -*params[param_limit]), *params[param_limit]);
+                
+                // autolevel
+                if (*params[param_auto_level]) {
+                    outL /= *params[param_limit];
+                    outR /= *params[param_limit];
+                }
 
-            // out level
-            outL *= *params[param_level_out];
-            outR *= *params[param_level_out];
+                // out level
+                outL *= *params[param_level_out];
+                outR *= *params[param_level_out];
 
-            // send to output
-            outs[0][offset] = outL;
-            outs[1][offset] = outR;
+                // send to output
+                outs[0][offset + i] = outL;
+                outs[1][offset + i] = outR;
 
-            // next sample
-            ++offset;
-            
-            batt = broadband.get_attenuation();
-            
-            float values[] = {inL, inR, scL, scR, outL, outR,
-                bypassed ? (float)1.0 : (float)strip[0].get_attenuation() * batt,
-                bypassed ? (float)1.0 : (float)strip[1].get_attenuation() * batt,
-                bypassed ? (float)1.0 : (float)strip[2].get_attenuation() * batt,
-                bypassed ? (float)1.0 : (float)strip[3].get_attenuation() * batt,
-                bypassed ? (float)1.0 : (float)strip[4].get_attenuation() * batt};
-            meters.process(values);
+                float values[] = {inL[i], inR[i], scL[i], scR[i], outL, outR,
+                    att[i][0], att[i][1], att[i][2], att[i][3], att[i][4]};
+                meters.process(values);
+            }
             
-            cnt++;
-        } // cycle trough samples
+            // next chunk
+            offset += n;
+            cnt += n;
+        } // cycle trough chunks
         bypass.crossfade(ins, outs, 2, orig_offset, orig_numsamples);
     } // process (no bypass)
     if (params[param_asc_led] != NULL) *params[param_asc_led] = asc_led;
@@ -35,6 +35,7 @@ FORWARD_DECLARE_METADATA(pitch)
 using namespace calf_plugins;
 
 pitch_audio_module::pitch_audio_module()
+: transform(BufferSizeBits)
 {
 }
 
@@ -54,10 +55,10 @@ void pitch_audio_module::params_changed()
 void pitch_audio_module::activate()
 {
     write_ptr = 0;
-    for (size_t i = 0; i < 2 * BufferSize; ++i)
-        waveform[i] = spectrum[i] = autocorr[i] = 0;
+    for (size_t i = 0; i <= BufferSize / 2; ++i)
+        spectrum[i] = power[i] = 0;
     for (size_t i = 0; i < BufferSize; ++i)
-        inputbuf[i] = 0;
+        inputbuf[i] = waveform[i] = autocorr[i] = 0;
 }
 
 void pitch_audio_module::deactivate()
@@ -79,22 +80,17 @@ void pitch_audio_module::recompute()
     }
     sumsquares[BufferSize] = sumsquares_acc;
         //waveform[i] = inputbuf[(i + write_ptr) & (BufferSize - 1)];
-    transform.calculate(waveform, spectrum, false);
-    pfft::complex temp[2 * BufferSize];
-    for (int i = 0; i < 2 * BufferSize; ++i)
-    {
-        float val = std::abs(spectrum[i]);
-        temp[i] = val * val;
-    }
-        //temp[i] = spectrum[i] * std::conj(spectrum[i]);
-    transform.calculate(temp, autocorr, true);
+    transform.forward_real(waveform, spectrum);
+    for (int i = 0; i <= BufferSize / 2; ++i)
+        power[i] = std::norm(spectrum[i]);
+    transform.inverse_real(power, autocorr);
     sumsquares_last = sumsquares_acc;
     float maxpt = 0;
     int maxpos = -1;
     int i;
     for (i = 2; i < BufferSize / 2; ++i)
     {
-        float mag = 2.0 * autocorr[i].real() / (sumsquares[BufferSize] + sumsquares[BufferSize - i] - sumsquares[i]);
+        float mag = 2.0 * autocorr[i] / (sumsquares[BufferSize] + sumsquares[BufferSize - i] - sumsquares[i]);
         magarr[i] = mag;
         if (mag > maxpt)
         {
@@ -138,7 +134,7 @@ bool pitch_audio_module::get_graph(int index, int subindex, int phase, float *da
         context->set_source_rgba(1, 0, 0);
         for (int i = 0; i < points; i++)
         {
-            float ac = autocorr[i * (BufferSize / 2 - 1) / (points - 1)].real();
+            float ac = autocorr[i * (BufferSize / 2 - 1) / (points - 1)];
             if (ac >= 0)
                 data[i] = sqrt(ac / sumsquares_last);
             else
@@ -506,9 +506,6 @@ uint32_t analyzer_audio_module::process(uint32_t offset, uint32_t numsamples, ui
         ppos += 2;
         ppos %= (phase_buffer_size - 2);
         
-        // analyzer
-        _analyzer.process(L, R);
-        
         // meter
         meter_L = L;
         meter_R = R;
@@ -518,6 +515,8 @@ uint32_t analyzer_audio_module::process(uint32_t offset, uint32_t numsamples, ui
         if(outs[1])
             outs[1][i] = R;
     }
+    // analyzer
+    _analyzer.process(ins[0] + offset, ins[ins[1]?1:0] + offset, numsamples);
     // draw meters
     SET_IF_CONNECTED(clip_L);
     SET_IF_CONNECTED(clip_R);
@@ -20,6 +20,7 @@
  */
 #include <calf/giface.h>
 #include <calf/modules_synths.h>
+#include <calf/wavecache.h>
 
 using namespace dsp;
 using namespace calf_plugins;
@@ -35,6 +36,8 @@ monosynth_audio_module::monosynth_audio_module()
 , inertia_pitchbend(1)
 , inertia_pressure(64)
 {
+    // the mod matrix only writes the modulated destinations
+    dsp::zero(moddest, moddest_count);
 }
 
 void monosynth_audio_module::reset()
@@ -76,6 +79,9 @@ void monosynth_audio_module::activate()
 
 waveform_family<MONOSYNTH_WAVE_BITS> *monosynth_audio_module::waves;
 
+/// Bump when any of the waveforms below change, so that cached copies get regenerated
+#define MONOSYNTH_WAVE_CACHE_VERSION 1
+
 void monosynth_audio_module::precalculate_waves(progress_report_iface *reporter)
 {
     float data[1 << MONOSYNTH_WAVE_BITS];
@@ -87,6 +93,10 @@ void monosynth_audio_module::precalculate_waves(progress_report_iface *reporter)
     static waveform_family<MONOSYNTH_WAVE_BITS> waves_data[wave_count];
     waves = waves_data;
     
+    waveform_cache cache("monosynth", MONOSYNTH_WAVE_CACHE_VERSION);
+    if (cache.open() && cache.read(waves, wave_count))
+        return;
+    
     enum { S = 1 << MONOSYNTH_WAVE_BITS, HS = S / 2, QS = S / 4, QS3 = 3 * QS };
     float iQS = 1.0 / QS;
     
@@ -201,6 +211,11 @@ void monosynth_audio_module::precalculate_waves(progress_report_iface *reporter)
     }
     normalize_waveform(data, S);
     waves[wave_test8].make(bl, data);
+    if (cache.create())
+    {
+        cache.write(waves, wave_count);
+        cache.commit();
+    }
     if (reporter)
         reporter->report_progress(100, "");
     
@@ -810,6 +825,7 @@ uint32_t monosynth_audio_module::process(uint32_t offset, uint32_t nsamples, uin
     uint32_t op = offset;
     uint32_t op_end = offset + nsamples;
     int had_data = 0;
+    check_plan();
     while(op < op_end) {
         if (output_pos == 0) 
             calculate_step();
@@ -0,0 +1,248 @@
+/* Calf DSP Library Utility Application - calfjackhost
+ * Offline (file to file) rendering of a rack, without a JACK server.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+#include <calf/offline_render.h>
+#include <calf/primitives.h>
+#include <calf/wavfile.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+using namespace std;
+using namespace calf_utils;
+using namespace calf_plugins;
+
+namespace {
+
+/// Buffer feeding input N of a plugin from a source with count channels - a
+/// mono source feeds both inputs of a stereo plugin, other missing inputs get silence
+inline float *route(std::vector<float *> &source, int input, float *silence)
+{
+    if (input < (int)source.size())
+        return source[input];
+    if (input == 1 && source.size() == 1)
+        return source[0];
+    return silence;
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+offline_renderer::offline_renderer()
+{
+    next_file = 0;
+    failures = 0;
+}
+
+void offline_renderer::load_session(const char *name)
+{
+    preset_list pl;
+    pl.load(name, true);
+    for (unsigned int i = 0; i < pl.plugins.size(); i++)
+    {
+        preset_list::plugin_snapshot &ps = pl.plugins[i];
+        rack_entry entry;
+        entry.type = ps.type;
+        entry.preset = pl.presets[ps.preset_offset];
+        entry.has_preset = true;
+        entry.automation_entries = ps.automation_entries;
+        rack.push_back(entry);
+    }
+}
+
+void offline_renderer::add_plugin(const string &type, const string &preset_name)
+{
+    rack_entry entry;
+    entry.type = type;
+    entry.preset_name = preset_name;
+    rack.push_back(entry);
+}
+
+void offline_renderer::add_file(const string &in_name, const string &out_name)
+{
+    files.push_back(make_pair(in_name, out_name));
+}
+
+void offline_renderer::create_chain(jack_client &client, std::vector<jack_host *> &chain)
+{
+    ptlock lock(create_mutex);
+    for (unsigned int i = 0; i < rack.size(); i++)
+    {
+        rack_entry &entry = rack[i];
+        jack_host *jh = create_jack_host(&client, entry.type.c_str(), entry.type, NULL);
+        if (!jh)
+            throw text_exception("Unknown plugin name \"" + entry.type + "\"");
+        chain.push_back(jh);
+        jh->init_module();
+        if (entry.has_preset)
+            entry.preset.activate(jh);
+        else if (!entry.preset_name.empty())
+        {
+            string id = jh->metadata->get_id();
+            bool found = false;
+            for (int builtin = 0; builtin < 2 && !found; builtin++)
+            {
+                preset_vector &pvec = (builtin ? get_builtin_presets() : get_user_presets()).presets;
+                for (unsigned int j = 0; j < pvec.size() && !found; j++)
+                {
+                    if (pvec[j].name == entry.preset_name && pvec[j].plugin == id)
+                    {
+                        pvec[j].activate(jh);
+                        found = true;
+                    }
+                }
+            }
+            if (!found)
+                fprintf(stderr, "Unknown preset: %s\n", entry.preset_name.c_str());
+        }
+        for (unsigned int j = 0; j < entry.automation_entries.size(); j++)
+            jh->configure(entry.automation_entries[j].first.c_str(), entry.automation_entries[j].second.c_str());
+    }
+}
+
+void offline_renderer::destroy_chain(std::vector<jack_host *> &chain)
+{
+    for (unsigned int i = 0; i < chain.size(); i++)
+    {
+        audio_module_iface *module = chain[i]->module;
+        // there are no JACK ports to unregister
+        chain[i]->client = NULL;
+        delete chain[i];
+        delete module;
+    }
+    chain.clear();
+}
+
+void offline_renderer::render_file(const string &in_name, const string &out_name)
+{
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+
+    wav_reader reader;
+    reader.open(in_name);
+
+    // never opened, only provides the sample rate and the deferred deletion of automation maps
+    jack_client client;
+    client.sample_rate = reader.sample_rate;
+    std::vector<jack_host *> chain;
+    std::vector<float> storage;
+    try {
+        create_chain(client, chain);
+
+        // file buffers first, then the outputs of every plugin, then silence for unconnected inputs
+        int buffer_count = reader.channels + 1;
+        for (unsigned int i = 0; i < chain.size(); i++)
+            buffer_count += chain[i]->out_count;
+        storage.resize(buffer_count * block_size);
+        float *next_buffer = &storage[0];
+        std::vector<float *> source;
+        for (int c = 0; c < reader.channels; c++, next_buffer += block_size)
+            source.push_back(next_buffer);
+        std::vector<float *> file_buffers = source;
+        float *silence = &storage[(buffer_count - 1) * block_size];
+        for (unsigned int i = 0; i < chain.size(); i++)
+        {
+            jack_host *jh = chain[i];
+            for (int j = 0; j < jh->in_count; j++)
+                jh->ins[j] = route(source, j, silence);
+            source.clear();
+            for (int j = 0; j < jh->out_count; j++, next_buffer += block_size)
+                source.push_back(jh->outs[j] = next_buffer);
+        }
+        if (source.empty())
+            throw text_exception("The last plugin in the rack has no audio outputs");
+
+        wav_writer writer;
+        writer.open(out_name, source.size(), reader.sample_rate);
+        uint32_t total = 0;
+        while(uint32_t len = reader.read(&file_buffers[0], block_size))
+        {
+            for (unsigned int i = 0; i < chain.size(); i++)
+            {
+                jack_host *jh = chain[i];
+                jh->module->check_params_changed(jh->changed);
+                jh->changed = false;
+                jh->process_part(0, len);
+                jh->module->params_reset();
+            }
+            writer.write(&source[0], len);
+            total += len;
+        }
+        writer.close();
+
+        gettimeofday(&end, NULL);
+        double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+        printf("Rendered %s -> %s (%0.2fs of audio in %0.2fs)\n", in_name.c_str(), out_name.c_str(), total / (double)reader.sample_rate, elapsed);
+    }
+    catch(...)
+    {
+        destroy_chain(chain);
+        throw;
+    }
+    destroy_chain(chain);
+}
+
+void offline_renderer::render_files()
+{
+    while(true)
+    {
+        int file = next_file++;
+        if (file >= (int)files.size())
+            break;
+        try {
+            render_file(files[file].first, files[file].second);
+        }
+        catch(std::exception &e)
+        {
+            fprintf(stderr, "Cannot render '%s': %s\n", files[file].first.c_str(), e.what());
+            failures++;
+        }
+    }
+}
+
+void *offline_renderer::render_thread(void *arg)
+{
+    ((offline_renderer *)arg)->render_files();
+    return NULL;
+}
+
+int offline_renderer::run(int extra_threads)
+{
+    if (rack.empty())
+    {
+        fprintf(stderr, "No plugins to render through - use --load or list the plugins on the command line\n");
+        return files.size();
+    }
+    next_file = 0;
+    failures = 0;
+    extra_threads = std::max(0, std::min(extra_threads, (int)files.size() - 1));
+    std::vector<pthread_t> threads;
+    for (int i = 0; i < extra_threads; i++)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, render_thread, this))
+            break;
+        threads.push_back(thread);
+    }
+    render_files();
+    for (unsigned int i = 0; i < threads.size(); i++)
+        pthread_join(threads[i], NULL);
+    return failures;
+}
@@ -22,8 +22,15 @@
 
 #include <calf/giface.h>
 #include <calf/organ.h>
+#include <calf/wavecache.h>
 #include <iostream>
 #include <algorithm>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if CALF_AVX2_DISPATCH
+#include <immintrin.h>
+#endif
 
 using namespace std;
 using namespace dsp;
@@ -36,7 +43,9 @@ FORWARD_DECLARE_METADATA(organ)
 organ_audio_module::organ_audio_module()
 : drawbar_organ(&par_values)
 {
-    var_map_curve = "2\n0 1\n1 1\n"; // XXXKF hacky bugfix
+    // the host does not always send the configure variables (e.g. the benchmark
+    // does not), so the keytrack points must not be left uninitialised
+    configure("map_curve", NULL);
 }
 
 void organ_audio_module::activate()
@@ -231,7 +240,7 @@ static void padsynth(bandlimiter<ORGAN_WAVE_BITS> blSrc, bandlimiter<ORGAN_BIG_W
     
     // limit is 1/2 of the number of harmonics of the original wave
     result.make_from_spectrum(blDest, foldover, ORGAN_WAVE_SIZE >> (1 + ORGAN_BIG_WAVE_SHIFT));
-    memcpy(result.original, result.begin()->second, sizeof(result.original));
+    memcpy(result.original, result.tables, sizeof(result.original));
     #if 0
     blDest.compute_waveform(result);
     normalize_waveform(result, ORGAN_BIG_WAVE_SIZE);
@@ -241,6 +250,9 @@ static void padsynth(bandlimiter<ORGAN_WAVE_BITS> blSrc, bandlimiter<ORGAN_BIG_W
     #endif
 }
 
+/// Bump when any of the waveforms below change, so that cached copies get regenerated
+#define ORGAN_WAVE_CACHE_VERSION 1
+
 #define LARGE_WAVEFORM_PROGRESS() do { if (reporter) { progress += 100; reporter->report_progress(floor(progress / totalwaves), "Precalculating large waveforms"); } } while(0)
 
 void organ_voice_base::update_pitch()
@@ -260,6 +272,13 @@ void organ_voice_base::precalculate_waves(progress_report_iface *reporter)
         organ_voice_base::waves = &waves;
         organ_voice_base::big_waves = &big_waves;
         
+        waveform_cache cache("organ", ORGAN_WAVE_CACHE_VERSION);
+        if (cache.open() && cache.read(waves, wave_count_small) && cache.read(big_waves, wave_count_big))
+        {
+            inited = true;
+            return;
+        }
+        
         float progress = 0.0;
         int totalwaves = 1 + wave_count_big;
         if (reporter)
@@ -501,6 +520,12 @@ void organ_voice_base::precalculate_waves(progress_report_iface *reporter)
         padsynth(bl, blBig, big_waves[wave_choir3 - wave_count_small], 50, 10);
         LARGE_WAVEFORM_PROGRESS();
         
+        if (cache.create())
+        {
+            cache.write(waves, wave_count_small);
+            cache.write(big_waves, wave_count_big);
+            cache.commit();
+        }
         inited = true;
     }
 }
@@ -509,6 +534,7 @@ organ_voice_base::organ_voice_base(organ_parameters *_parameters, int &_sample_r
 : parameters(_parameters)
 , sample_rate_ref(_sample_rate_ref)
 , released_ref(_released_ref)
+, rel_age_const(0.f)
 {
     note = -1;
 }
@@ -705,8 +731,16 @@ void organ_voice::update_pitch()
 }
 
 void organ_voice::render_block(int snapshot) {
-    if (note == -1)
+    if (!start_block())
         return;
+    render_drawbars();
+    finish_block();
+}
+
+bool organ_voice::start_block()
+{
+    if (note == -1)
+        return false;
 
     dsp::zero(&output_buffer[0][0], Channels * BlockSize);
     dsp::zero(&aux_buffers[1][0][0], 2 * Channels * BlockSize);
@@ -714,15 +748,19 @@ void organ_voice::render_block(int snapshot) {
     {
         if (use_percussion())
             render_percussion_to(output_buffer, BlockSize);
-        return;
+        return false;
     }
 
     inertia_pitchbend.set_inertia(parameters->pitch_bend);
     inertia_pitchbend.step();
     update_pitch();
+    return true;
+}
+
+void organ_voice::render_drawbars()
+{
     dsp::fixed_point<int, 20> tphase, tdphase;
     unsigned int foldvalue = parameters->foldvalue * inertia_pitchbend.get_last();
-    int vibrato_mode = fastf2i_drm(parameters->lfo_mode);
     for (int h = 0; h < 9; h++)
     {
         float amp = parameters->drawbars[h];
@@ -781,7 +819,46 @@ void organ_voice::render_block(int snapshot) {
             }
         }
     }
-    
+}
+
+void organ_voice::setup_drawbars(organ_voice_bank &bank, int index)
+{
+    // the same calculations as in render_drawbars
+    unsigned int foldvalue = parameters->foldvalue * inertia_pitchbend.get_last();
+    for (int h = 0; h < 9; h++)
+    {
+        if (!bank.drawbars[h].enabled)
+            continue;
+        dsp::fixed_point<int, 24> hm = dsp::fixed_point<int, 24>(parameters->multiplier[h]);
+        int waveid = (int)parameters->waveforms[h];
+        if (waveid < 0 || waveid >= wave_count)
+            waveid = 0;
+
+        uint32_t rate = (dphase * hm).get();
+        if (waveid >= wave_count_small)
+        {
+            float *data = (*big_waves)[waveid - wave_count_small].get_level(rate >> (ORGAN_BIG_WAVE_BITS - ORGAN_WAVE_BITS + ORGAN_BIG_WAVE_SHIFT));
+            hm.set(hm.get() >> ORGAN_BIG_WAVE_SHIFT);
+            bank.set_oscillator(h, index, data, (phase * hm).get() + parameters->phaseshift[h], rate >> ORGAN_BIG_WAVE_SHIFT);
+        }
+        else
+        {
+            unsigned int foldback = 0;
+            while (rate > foldvalue)
+            {
+                rate >>= 1;
+                foldback++;
+            }
+            hm.set(hm.get() >> foldback);
+            float *data = (*waves)[waveid].get_level(rate);
+            bank.set_oscillator(h, index, data, (uint32_t)((uint32_t)((phase * hm).get()) + parameters->phaseshift[h]), rate);
+        }
+    }
+}
+
+void organ_voice::finish_block()
+{
+    int vibrato_mode = fastf2i_drm(parameters->lfo_mode);
     bool is_quad = parameters->quad_env >= 0.5f;
     
     expression.set_inertia(parameters->cutoff);
@@ -918,7 +995,13 @@ void organ_voice::note_off(int /* vel */)
 
 void organ_voice::steal()
 {
+    // the percussion is released too, at the same rate as in note_off
     perc_released = true;
+    if (pamp.get_active())
+    {
+        pamp.reinit();
+    }
+    rel_age_const = pamp.get() * ((1.0/44100.0)/0.03);
     finishing = true;
     stolen = true;
 }
@@ -937,6 +1020,182 @@ void organ_voice::reset()
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
+// The bank renderers keep the table position as integer and 20-bit
+// fractional part, which is the same as the 32-bit (small waves) or 64-bit
+// (big waves) fixed point phase of render_drawbars modulo the table size.
+// The interpolation is done in single precision (fixed_point's
+// lerp_table_lookup_float uses double), which is more than twice as fast
+// with SIMD and differs from render_drawbars by rounding errors only.
+
+void organ_voice_bank::setup(organ_parameters *parameters)
+{
+    routings_used = 0;
+    for (int h = 0; h < Drawbars; h++)
+    {
+        drawbar &db = drawbars[h];
+        float amp = parameters->drawbars[h];
+        int waveid = (int)parameters->waveforms[h];
+        if (waveid < 0 || waveid >= wave_count)
+            waveid = 0;
+        if (waveid >= wave_count_small)
+        {
+            db.tables = organ_voice_base::get_big_wave(waveid - wave_count_small).tables;
+            db.mask = ORGAN_BIG_WAVE_SIZE - 1;
+        }
+        else
+        {
+            db.tables = organ_voice_base::get_wave(waveid).tables;
+            db.mask = ORGAN_WAVE_SIZE - 1;
+        }
+        db.enabled = amp >= small_value<float>() && db.tables;
+        db.routing = dsp::fastf2i_drm(parameters->routing[h]);
+        db.ampl = amp * 0.5f * (1 - parameters->pan[h]);
+        db.ampr = amp * 0.5f * (1 + parameters->pan[h]);
+        if (db.enabled)
+            routings_used |= 1 << db.routing;
+    }
+}
+
+#if !defined(__SSE2__)
+static void render_drawbar_scalar(organ_voice_bank &bank, int h, int from, int to)
+{
+    const organ_voice_bank::drawbar &db = bank.drawbars[h];
+    float (*out)[organ_voice_bank::Channels][organ_voice_bank::MaxVoices] = bank.output[db.routing];
+    for (int v = from; v < to; v++)
+    {
+        const float *data = db.tables + bank.level[h][v];
+        uint32_t pos = bank.pos_int[h][v], frac = bank.pos_frac[h][v];
+        uint32_t delta = bank.delta_int[h][v], dfrac = bank.delta_frac[h][v];
+        float ampl = bank.ampl[h][v], ampr = bank.ampr[h][v];
+        for (int i = 0; i < organ_voice_bank::BlockSize; i++)
+        {
+            float wv = data[pos] + (data[pos + 1] - data[pos]) * (frac * (1.0f / (1 << 20)));
+            out[i][0][v] += wv * ampl;
+            out[i][1][v] += wv * ampr;
+            frac += dfrac;
+            pos = (pos + delta + (frac >> 20)) & db.mask;
+            frac &= 0xFFFFF;
+        }
+    }
+}
+#else
+static void render_drawbar_sse2(organ_voice_bank &bank, int h, int voices)
+{
+    const organ_voice_bank::drawbar &db = bank.drawbars[h];
+    float (*out)[organ_voice_bank::Channels][organ_voice_bank::MaxVoices] = bank.output[db.routing];
+    const float *tables = db.tables;
+    const __m128i mask = _mm_set1_epi32(db.mask), frac_mask = _mm_set1_epi32(0xFFFFF);
+    const __m128 frac_scale = _mm_set1_ps(1.0f / (1 << 20));
+    for (int v = 0; v < voices; v += 4)
+    {
+        __m128i pos = _mm_loadu_si128((const __m128i *)&bank.pos_int[h][v]), frac = _mm_loadu_si128((const __m128i *)&bank.pos_frac[h][v]);
+        __m128i delta = _mm_loadu_si128((const __m128i *)&bank.delta_int[h][v]), dfrac = _mm_loadu_si128((const __m128i *)&bank.delta_frac[h][v]);
+        __m128i level = _mm_loadu_si128((const __m128i *)&bank.level[h][v]);
+        __m128 ampl = _mm_loadu_ps(&bank.ampl[h][v]), ampr = _mm_loadu_ps(&bank.ampr[h][v]);
+        for (int i = 0; i < organ_voice_bank::BlockSize; i++)
+        {
+            // no gathers in SSE2, so the table values are fetched one by one
+            int32_t idx[4];
+            _mm_storeu_si128((__m128i *)idx, _mm_add_epi32(level, pos));
+            __m128 a = _mm_setr_ps(tables[idx[0]], tables[idx[1]], tables[idx[2]], tables[idx[3]]);
+            __m128 d = _mm_sub_ps(_mm_setr_ps(tables[idx[0] + 1], tables[idx[1] + 1], tables[idx[2] + 1], tables[idx[3] + 1]), a);
+            __m128 wv = _mm_add_ps(a, _mm_mul_ps(d, _mm_mul_ps(_mm_cvtepi32_ps(frac), frac_scale)));
+            _mm_storeu_ps(&out[i][0][v], _mm_add_ps(_mm_loadu_ps(&out[i][0][v]), _mm_mul_ps(wv, ampl)));
+            _mm_storeu_ps(&out[i][1][v], _mm_add_ps(_mm_loadu_ps(&out[i][1][v]), _mm_mul_ps(wv, ampr)));
+            frac = _mm_add_epi32(frac, dfrac);
+            pos = _mm_and_si128(_mm_add_epi32(_mm_add_epi32(pos, delta), _mm_srli_epi32(frac, 20)), mask);
+            frac = _mm_and_si128(frac, frac_mask);
+        }
+    }
+}
+#endif
+
+#if CALF_AVX2_DISPATCH
+__attribute__((target("avx2")))
+static void render_drawbar_avx2(organ_voice_bank &bank, int h, int voices)
+{
+    const organ_voice_bank::drawbar &db = bank.drawbars[h];
+    float (*out)[organ_voice_bank::Channels][organ_voice_bank::MaxVoices] = bank.output[db.routing];
+    const float *tables = db.tables;
+    const __m256i mask = _mm256_set1_epi32(db.mask), frac_mask = _mm256_set1_epi32(0xFFFFF);
+    const __m256 frac_scale = _mm256_set1_ps(1.0f / (1 << 20));
+    for (int v = 0; v < voices; v += 8)
+    {
+        __m256i pos = _mm256_loadu_si256((const __m256i *)&bank.pos_int[h][v]), frac = _mm256_loadu_si256((const __m256i *)&bank.pos_frac[h][v]);
+        __m256i delta = _mm256_loadu_si256((const __m256i *)&bank.delta_int[h][v]), dfrac = _mm256_loadu_si256((const __m256i *)&bank.delta_frac[h][v]);
+        __m256i level = _mm256_loadu_si256((const __m256i *)&bank.level[h][v]);
+        __m256 ampl = _mm256_loadu_ps(&bank.ampl[h][v]), ampr = _mm256_loadu_ps(&bank.ampr[h][v]);
+        for (int i = 0; i < organ_voice_bank::BlockSize; i++)
+        {
+            __m256i idx = _mm256_add_epi32(level, pos);
+            __m256 a = _mm256_i32gather_ps(tables, idx, 4);
+            __m256 d = _mm256_sub_ps(_mm256_i32gather_ps(tables + 1, idx, 4), a);
+            __m256 wv = _mm256_add_ps(a, _mm256_mul_ps(d, _mm256_mul_ps(_mm256_cvtepi32_ps(frac), frac_scale)));
+            _mm256_storeu_ps(&out[i][0][v], _mm256_add_ps(_mm256_loadu_ps(&out[i][0][v]), _mm256_mul_ps(wv, ampl)));
+            _mm256_storeu_ps(&out[i][1][v], _mm256_add_ps(_mm256_loadu_ps(&out[i][1][v]), _mm256_mul_ps(wv, ampr)));
+            frac = _mm256_add_epi32(frac, dfrac);
+            pos = _mm256_and_si256(_mm256_add_epi32(_mm256_add_epi32(pos, delta), _mm256_srli_epi32(frac, 20)), mask);
+            frac = _mm256_and_si256(frac, frac_mask);
+        }
+    }
+}
+#endif
+
+void organ_voice_bank::render(int voices)
+{
+    // unused oscillators up to the next multiple of the vector size are silent
+    int lanes = (voices + 7) & ~7;
+    for (int v = voices; v < lanes; v++)
+        for (int h = 0; h < Drawbars; h++)
+            set_oscillator(h, v, NULL, 0, 0);
+    for (int r = 0; r < 3; r++)
+    {
+        if (!(routings_used & (1 << r)))
+            continue;
+        for (int i = 0; i < BlockSize; i++)
+            for (int c = 0; c < Channels; c++)
+                dsp::zero(output[r][i][c], lanes);
+    }
+    for (int h = 0; h < Drawbars; h++)
+    {
+        if (!drawbars[h].enabled)
+            continue;
+#if CALF_AVX2_DISPATCH
+        if (cpu_has_avx2())
+        {
+            render_drawbar_avx2(*this, h, lanes);
+            continue;
+        }
+#endif
+#if defined(__SSE2__)
+        render_drawbar_sse2(*this, h, lanes);
+#else
+        render_drawbar_scalar(*this, h, 0, voices);
+#endif
+    }
+}
+
+void organ_voice_bank::get_output(float (*const *aux)[BlockSize][Channels], int voices)
+{
+    // read the bank output in order, it's bigger than the voice buffers
+    for (int r = 0; r < 3; r++)
+    {
+        if (!(routings_used & (1 << r)))
+            continue;
+        for (int i = 0; i < BlockSize; i++)
+        {
+            for (int c = 0; c < Channels; c++)
+            {
+                const float *src = output[r][i][c];
+                for (int v = 0; v < voices; v++)
+                    aux[v][r][i][c] = src[v];
+            }
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
 void drawbar_organ::update_params()
 {
     parameters->perc_decay_const = dsp::decay::calc_exp_constant(1.0 / 1024.0, 0.001 * parameters->percussion_time * sample_rate);
@@ -1031,42 +1290,77 @@ void organ_voice_base::perc_note_on(int note, int vel)
     fm_amp.set(fm_keytrack * (1.0f + (vel - 127) * parameters->percussion_vel2fm / 127.0));
 }
 
+/// Parse the map_curve configure variable into keytrack points
+static void parse_map_curve(const char *value, float (*keytrack)[2])
+{
+    stringstream ss(value);
+    int i = 0;
+    float x = 0, y = 1;
+    if (*value)
+    {
+        int points;
+        ss >> points;
+        for (i = 0; i < points; i++)
+        {
+            static const int whites[] = { 0, 2, 4, 5, 7, 9, 11 };
+            ss >> x >> y;
+            int wkey = (int)(x * 71);
+            x = whites[wkey % 7] + 12 * (wkey / 7);
+            keytrack[i][0] = x;
+            keytrack[i][1] = y;
+            // cout << "(" << x << ", " << y << ")" << endl;
+        }
+    }
+    // pad with constant Y
+    for (; i < ORGAN_KEYTRACK_POINTS; i++) {
+        keytrack[i][0] = x;
+        keytrack[i][1] = y;
+    }
+}
+
+static const char default_map_curve[] = "2\n0 1\n1 1\n";
+
 char *organ_audio_module::configure(const char *key, const char *value)
 {
     if (!strcmp(key, "map_curve"))
     {
         if (!value)
-            value = "2\n0 1\n1 1\n";
+            value = default_map_curve;
         var_map_curve = value;
-        stringstream ss(value);
-        int i = 0;
-        float x = 0, y = 1;
-        if (*value)
-        {
-            int points;
-            ss >> points;
-            for (i = 0; i < points; i++)
-            {
-                static const int whites[] = { 0, 2, 4, 5, 7, 9, 11 };
-                ss >> x >> y;
-                int wkey = (int)(x * 71);
-                x = whites[wkey % 7] + 12 * (wkey / 7);
-                parameters->percussion_keytrack[i][0] = x;
-                parameters->percussion_keytrack[i][1] = y;
-                // cout << "(" << x << ", " << y << ")" << endl;
-            }
-        }
-        // pad with constant Y
-        for (; i < ORGAN_KEYTRACK_POINTS; i++) {
-            parameters->percussion_keytrack[i][0] = x;
-            parameters->percussion_keytrack[i][1] = y;
-        }
+        parse_map_curve(value, parameters->percussion_keytrack);
         return NULL;
     }
     cout << "Set unknown configure value " << key << " to " << value << endl;
     return NULL;
 }
 
+/// Parsed map_curve; the text is swapped with var_map_curve, so that the
+/// old one is freed together with this object, outside of the audio thread
+struct organ_map_curve_state: public configure_state
+{
+    organ_audio_module *module;
+    std::string text;
+    float keytrack[ORGAN_KEYTRACK_POINTS][2];
+    virtual void apply()
+    {
+        module->var_map_curve.swap(text);
+        memcpy(module->parameters->percussion_keytrack, keytrack, sizeof(keytrack));
+    }
+};
+
+configure_state *organ_audio_module::prepare_configure(const char *key, const char *value)
+{
+    if (strcmp(key, "map_curve"))
+        return NULL;
+    if (!value)
+        value = default_map_curve;
+    organ_map_curve_state *state = new organ_map_curve_state;
+    state->module = this;
+    state->text = value;
+    parse_map_curve(value, state->keytrack);
+    return state;
+}
+
 void organ_audio_module::send_configures(send_configure_iface *sci)
 {
     sci->send_configure("map_curve", var_map_curve.c_str());
@@ -1077,11 +1371,91 @@ void organ_audio_module::deactivate()
     
 }
 
+void drawbar_organ::render_to(float (*output)[2], int nsamples)
+{
+    if (!use_voice_bank || render_pool || nsamples > organ_voice_bank::MaxSampleRun)
+    {
+        basic_synth::render_to(output, nsamples);
+        return;
+    }
+    typedef dsp::block_voice<organ_voice> block_organ_voice;
+    enum { BlockSize = organ_voice_bank::BlockSize };
+    int count = active_voices.size();
+    assert(count <= organ_voice_bank::MaxVoices);
+    block_organ_voice *voices[organ_voice_bank::MaxVoices];
+    int pos[organ_voice_bank::MaxVoices], bank_voices[organ_voice_bank::MaxVoices];
+    for (int v = 0; v < count; v++)
+    {
+        voices[v] = (block_organ_voice *)active_voices.items[v];
+        pos[v] = 0;
+    }
+    bank.setup(parameters);
+    // Each voice goes through its blocks the same way as in
+    // block_voice::render_to, but the drawbars of all the voices that need
+    // a new block are rendered together. The blocks of different voices
+    // don't need to start at the same sample.
+    bool more = true;
+    while(more)
+    {
+        more = false;
+        int nbank = 0;
+        for (int v = 0; v < count; v++)
+        {
+            block_organ_voice *voice = voices[v];
+            int ncopy = std::min<int>(BlockSize - voice->read_ptr, nsamples - pos[v]);
+            memcpy(bank.voice_output[v][pos[v]], voice->output_buffer[voice->read_ptr], ncopy * sizeof(voice->output_buffer[0]));
+            pos[v] += ncopy;
+            voice->read_ptr += ncopy;
+            if (pos[v] < nsamples)
+            {
+                voice->read_ptr = 0;
+                if (voice->start_block())
+                {
+                    voice->setup_drawbars(bank, nbank);
+                    bank_voices[nbank++] = v;
+                }
+                more = true;
+            }
+        }
+        if (!nbank)
+            continue;
+        bank.render(nbank);
+        float (*aux[organ_voice_bank::MaxVoices])[BlockSize][2];
+        for (int i = 0; i < nbank; i++)
+            aux[i] = voices[bank_voices[i]]->get_aux_buffers();
+        bank.get_output(aux, nbank);
+        for (int i = 0; i < nbank; i++)
+            voices[bank_voices[i]]->finish_block();
+    }
+    // mix the voices and remove the finished ones in the same order as basic_synth::render_to
+    int order[organ_voice_bank::MaxVoices];
+    for (int v = 0; v < count; v++)
+        order[v] = v;
+    for (int i = 0; i < count; )
+    {
+        int v = order[i];
+        float (*vout)[2] = bank.voice_output[v];
+        for (int j = 0; j < nsamples; j++)
+        {
+            output[j][0] += vout[j][0];
+            output[j][1] += vout[j][1];
+        }
+        if (!voices[v]->get_active())
+        {
+            active_voices.erase(i);
+            unused_voices.add(voices[v]);
+            order[i] = order[--count];
+            continue;
+        }
+        i++;
+    }
+}
+
 void drawbar_organ::render_separate(float *output[], int nsamples)
 {
     float buf[MAX_SAMPLE_RUN][2];
     dsp::zero(&buf[0][0], 2 * nsamples);
-    basic_synth::render_to(buf, nsamples);
+    render_to(buf, nsamples);
     if (dsp::fastf2i_drm(parameters->lfo_mode) == organ_voice_base::lfomode_global)
     {
         for (int i = 0; i < nsamples; i += 64)
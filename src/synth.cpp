@@ -19,10 +19,224 @@
  * Boston, MA  02110-1301  USA
  */
 #include <calf/synth.h>
+#include <algorithm>
+#include <atomic>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 using namespace dsp;
 using namespace std;
 
+namespace dsp {
+
+/// Worker threads for basic_synth::render_to. The voices are split into
+/// contiguous parts, one for each worker thread plus one for the calling
+/// (audio) thread. Every part is mixed into its own buffer, and the buffers
+/// are added to the output in part order, so the result does not depend on
+/// the timing of the threads.
+class voice_render_pool
+{
+    struct part
+    {
+        voice_render_pool *pool;
+        pthread_t thread;
+        dsp::voice **voices;
+        int count;
+        float (*buffer)[2];
+    };
+    /// Number of worker threads that are running
+    int threads;
+    int max_samples;
+    /// threads + 1 parts, the last one is rendered by the calling thread
+    part *parts;
+    float (*buffers)[2];
+    /// Length of the current job
+    int nsamples;
+    pthread_mutex_t mutex;
+    pthread_cond_t start_cond, done_cond;
+    /// Incremented for every job (protected by mutex)
+    uint32_t serial;
+    bool quit;
+    /// Number of worker threads still rendering the current job
+    std::atomic<int> pending;
+    /// The scheduling class of the calling thread has been given to the workers
+    bool sched_copied;
+
+    static void *worker(void *arg);
+    void run_worker(part &p);
+    void render_part(part &p);
+    void copy_sched();
+public:
+    voice_render_pool(int _threads, int _max_samples);
+    ~voice_render_pool();
+    int get_threads() const { return threads; }
+    int get_max_samples() const { return max_samples; }
+    /// Render count voices (count > 1, nsamples <= max_samples) and add them to output
+    void render(dsp::voice **voices, int count, float (*output)[2], int _nsamples);
+};
+
+};
+
+voice_render_pool::voice_render_pool(int _threads, int _max_samples)
+: threads(0)
+, max_samples(_max_samples)
+, nsamples(0)
+, serial(0)
+, quit(false)
+, pending(0)
+, sched_copied(false)
+{
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&start_cond, NULL);
+    pthread_cond_init(&done_cond, NULL);
+    parts = new part[_threads + 1];
+    buffers = new float[(_threads + 1) * max_samples][2];
+    for (int i = 0; i <= _threads; i++)
+    {
+        parts[i].pool = this;
+        parts[i].voices = NULL;
+        parts[i].count = 0;
+        parts[i].buffer = buffers + i * max_samples;
+    }
+    for (int i = 0; i < _threads; i++)
+    {
+        if (pthread_create(&parts[i].thread, NULL, worker, &parts[i]))
+            break;
+        threads++;
+    }
+}
+
+voice_render_pool::~voice_render_pool()
+{
+    pthread_mutex_lock(&mutex);
+    quit = true;
+    pthread_cond_broadcast(&start_cond);
+    pthread_mutex_unlock(&mutex);
+    for (int i = 0; i < threads; i++)
+        pthread_join(parts[i].thread, NULL);
+    pthread_cond_destroy(&done_cond);
+    pthread_cond_destroy(&start_cond);
+    pthread_mutex_destroy(&mutex);
+    delete []buffers;
+    delete []parts;
+}
+
+void *voice_render_pool::worker(void *arg)
+{
+    part *p = (part *)arg;
+    p->pool->run_worker(*p);
+    return NULL;
+}
+
+void voice_render_pool::run_worker(part &p)
+{
+    uint32_t seen = 0;
+    pthread_mutex_lock(&mutex);
+    while(true)
+    {
+        while (serial == seen && !quit)
+            pthread_cond_wait(&start_cond, &mutex);
+        if (quit)
+            break;
+        seen = serial;
+        // a job may leave some of the workers idle
+        if (!p.count)
+            continue;
+        pthread_mutex_unlock(&mutex);
+        render_part(p);
+        bool last = pending.fetch_sub(1, std::memory_order_acq_rel) == 1;
+        pthread_mutex_lock(&mutex);
+        if (last)
+            pthread_cond_signal(&done_cond);
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+void voice_render_pool::render_part(part &p)
+{
+    float (*buf)[2] = p.buffer;
+    for (int i = 0; i < nsamples; i++)
+        buf[i][0] = buf[i][1] = 0.f;
+    for (int i = 0; i < p.count; i++)
+        p.voices[i]->render_to(buf, nsamples);
+}
+
+void voice_render_pool::copy_sched()
+{
+    // the workers should run at the same (realtime) priority as the audio thread
+    int policy;
+    struct sched_param param;
+    if (!pthread_getschedparam(pthread_self(), &policy, &param) && policy != SCHED_OTHER)
+    {
+        for (int i = 0; i < threads; i++)
+            pthread_setschedparam(parts[i].thread, policy, &param);
+    }
+    sched_copied = true;
+}
+
+void voice_render_pool::render(dsp::voice **voices, int count, float (*output)[2], int _nsamples)
+{
+    if (!sched_copied)
+        copy_sched();
+    int nparts = std::min(threads + 1, count);
+    pthread_mutex_lock(&mutex);
+    nsamples = _nsamples;
+    for (int i = 0; i < threads; i++)
+    {
+        if (i < nparts - 1)
+        {
+            parts[i].voices = voices + count * i / nparts;
+            parts[i].count = count * (i + 1) / nparts - count * i / nparts;
+        }
+        else
+            parts[i].count = 0;
+    }
+    pending.store(nparts - 1, std::memory_order_relaxed);
+    serial++;
+    pthread_cond_broadcast(&start_cond);
+    pthread_mutex_unlock(&mutex);
+
+    part &own = parts[threads];
+    own.voices = voices + count * (nparts - 1) / nparts;
+    own.count = count - count * (nparts - 1) / nparts;
+    render_part(own);
+
+    // the other parts usually take about as long as this one, so spin
+    // for a while before going to sleep
+    for (int i = 0; i < 1000 && pending.load(std::memory_order_acquire); i++)
+    {
+#if defined(__SSE2__)
+        _mm_pause();
+#endif
+    }
+    if (pending.load(std::memory_order_acquire))
+    {
+        pthread_mutex_lock(&mutex);
+        while (pending.load(std::memory_order_acquire))
+            pthread_cond_wait(&done_cond, &mutex);
+        pthread_mutex_unlock(&mutex);
+    }
+
+    for (int p = 0; p < nparts - 1; p++)
+    {
+        float (*buf)[2] = parts[p].buffer;
+        for (int i = 0; i < nsamples; i++)
+        {
+            output[i][0] += buf[i][0];
+            output[i][1] += buf[i][1];
+        }
+    }
+    for (int i = 0; i < nsamples; i++)
+    {
+        output[i][0] += own.buffer[i][0];
+        output[i][1] += own.buffer[i][1];
+    }
+}
+
 void basic_synth::init_voices(int count)
 {
     allocated_voices.init(count);
@@ -202,6 +416,20 @@ void basic_synth::control_change(int ctl, int val)
 
 void basic_synth::render_to(float (*output)[2], int nsamples)
 {
+    if (render_pool && active_voices.size() > 1 && nsamples <= render_pool->get_max_samples()) {
+        render_pool->render(active_voices.begin(), active_voices.size(), output, nsamples);
+        // eliminate voices that aren't sounding anymore
+        for (dsp::voice **i = active_voices.begin(); i != active_voices.end(); ) {
+            dsp::voice *v = *i;
+            if (!v->get_active()) {
+                i = active_voices.erase(i);
+                unused_voices.add(v);
+                continue;
+            }
+            i++;
+        }
+        return;
+    }
     // render voices, eliminate ones that aren't sounding anymore
     for (dsp::voice **i = active_voices.begin(); i != active_voices.end(); ) {
         dsp::voice *v = *i;
@@ -215,8 +443,34 @@ void basic_synth::render_to(float (*output)[2], int nsamples)
     }
 } 
 
+void basic_synth::set_render_threads(int threads, int max_samples)
+{
+    threads = std::max(0, std::min<int>(threads, MaxRenderThreads));
+    if (render_pool && render_pool->get_threads() == threads && render_pool->get_max_samples() == max_samples)
+        return;
+    delete render_pool;
+    render_pool = threads ? new voice_render_pool(threads, max_samples) : NULL;
+    // no point in keeping a pool that could not start any threads
+    if (render_pool && !render_pool->get_threads()) {
+        delete render_pool;
+        render_pool = NULL;
+    }
+}
+
+int basic_synth::get_render_threads() const
+{
+    return render_pool ? render_pool->get_threads() : 0;
+}
+
+int basic_synth::default_render_threads()
+{
+    const char *threads = getenv("CALF_VOICE_THREADS");
+    return threads ? std::max(0, std::min<int>(atoi(threads), MaxRenderThreads)) : 0;
+}
+
 basic_synth::~basic_synth()
 {
+    delete render_pool;
     for (voice_array::iterator i = allocated_voices.begin(); i != allocated_voices.end(); ++i)
         delete *i;
 }
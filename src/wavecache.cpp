@@ -0,0 +1,233 @@
+/* Calf DSP Library
+ * Persistent cache of precalculated waveform families
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02111-1307, USA.
+ */
+#include <config.h>
+#include <calf/wavecache.h>
+#include <cstdlib>
+#include <cstring>
+#ifndef _MSC_VER
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace dsp;
+
+/// Bump when the file layout changes
+#define WAVEFORM_CACHE_FORMAT 2
+
+static const char waveform_cache_magic[8] = { 'C', 'A', 'L', 'F', 'W', 'A', 'V', 'E' };
+
+/// FNV-1a style hash over 32-bit words, in four interleaved lanes so that
+/// checking a large file is not limited by the multiply latency. word is
+/// the index of the first word within the stream.
+static void update_checksum(uint64_t lanes[4], uint64_t word, const void *data, size_t bytes)
+{
+    const uint32_t *p = (const uint32_t *)data;
+    size_t count = bytes / sizeof(uint32_t);
+    for (size_t i = 0; i < count; i++)
+    {
+        uint64_t &h = lanes[(word + i) & 3];
+        h = (h ^ p[i]) * 0x100000001b3ULL;
+    }
+}
+
+static void init_checksum(uint64_t lanes[4])
+{
+    for (int i = 0; i < 4; i++)
+        lanes[i] = 0xcbf29ce484222325ULL + i;
+}
+
+static uint64_t finish_checksum(const uint64_t lanes[4])
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < 4; i++)
+        h = (h ^ lanes[i]) * 0x100000001b3ULL;
+    return h;
+}
+
+waveform_cache::waveform_cache(const char *_name, uint32_t _version)
+: name(_name)
+, version(_version)
+, map_data(NULL)
+, map_size(0)
+, read_pos(0)
+, attached(false)
+, out(NULL)
+, out_size(0)
+, out_failed(false)
+{
+}
+
+waveform_cache::~waveform_cache()
+{
+    if (out)
+    {
+        fclose(out);
+        remove(out_name.c_str());
+    }
+    if (!attached)
+        unmap();
+}
+
+string waveform_cache::get_dir(bool create)
+{
+    string dir;
+    const char *xdg_cache = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    if (xdg_cache && *xdg_cache)
+        dir = xdg_cache;
+    else if (home && *home)
+        dir = string(home) + "/.cache";
+    else
+        return string();
+#ifndef _MSC_VER
+    if (create)
+        mkdir(dir.c_str(), 0755);
+#endif
+    dir += "/calf";
+#ifndef _MSC_VER
+    if (create && mkdir(dir.c_str(), 0755) && errno != EEXIST)
+        return string();
+#endif
+    return dir;
+}
+
+void waveform_cache::unmap()
+{
+#ifndef _MSC_VER
+    if (map_data)
+        munmap((void *)map_data, map_size);
+#endif
+    map_data = NULL;
+    map_size = 0;
+    read_pos = 0;
+}
+
+bool waveform_cache::open()
+{
+#ifdef _MSC_VER
+    return false;
+#else
+    unmap();
+    string dir = get_dir(false);
+    if (dir.empty())
+        return false;
+    int fd = ::open((dir + "/" + name + ".wavecache").c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+    struct stat st;
+    void *data = MAP_FAILED;
+    if (!fstat(fd, &st) && st.st_size >= (off_t)sizeof(header))
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+    map_data = (const char *)data;
+    map_size = st.st_size;
+
+    const header *hdr = (const header *)map_data;
+    uint64_t lanes[4];
+    init_checksum(lanes);
+    update_checksum(lanes, 0, map_data + sizeof(header), map_size - sizeof(header));
+    if (memcmp(hdr->magic, waveform_cache_magic, sizeof(hdr->magic)) || hdr->format != WAVEFORM_CACHE_FORMAT
+        || hdr->version != version || hdr->data_size != map_size - sizeof(header)
+        || hdr->checksum != finish_checksum(lanes))
+    {
+        unmap();
+        return false;
+    }
+    read_pos = sizeof(header);
+    return true;
+#endif
+}
+
+const void *waveform_cache::read_block(size_t bytes)
+{
+    if (bytes > map_size - read_pos)
+        return NULL;
+    const void *ptr = map_data + read_pos;
+    read_pos += bytes;
+    return ptr;
+}
+
+bool waveform_cache::create()
+{
+#ifdef _MSC_VER
+    return false;
+#else
+    string dir = get_dir(true);
+    if (dir.empty() || out)
+        return false;
+    // written under a unique name, so that several processes generating the
+    // same waveforms at the same time don't write into each other's files
+    char pid[32];
+    sprintf(pid, ".%d.tmp", (int)getpid());
+    out_name = dir + "/" + name + ".wavecache" + pid;
+    out = fopen(out_name.c_str(), "wb");
+    if (!out)
+        return false;
+    header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    out_size = 0;
+    out_failed = fwrite(&hdr, sizeof(hdr), 1, out) != 1;
+    init_checksum(out_checksum);
+    return true;
+#endif
+}
+
+void waveform_cache::write_block(const void *data, size_t bytes)
+{
+    if (!out || out_failed)
+        return;
+    update_checksum(out_checksum, out_size / sizeof(uint32_t), data, bytes);
+    out_size += bytes;
+    out_failed = fwrite(data, 1, bytes, out) != bytes;
+}
+
+bool waveform_cache::commit()
+{
+#ifdef _MSC_VER
+    return false;
+#else
+    if (!out)
+        return false;
+    header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, waveform_cache_magic, sizeof(hdr.magic));
+    hdr.format = WAVEFORM_CACHE_FORMAT;
+    hdr.version = version;
+    hdr.data_size = out_size;
+    hdr.checksum = finish_checksum(out_checksum);
+    if (!out_failed)
+        out_failed = fseek(out, 0, SEEK_SET) || fwrite(&hdr, sizeof(hdr), 1, out) != 1;
+    if (fclose(out))
+        out_failed = true;
+    out = NULL;
+    if (out_failed || rename(out_name.c_str(), (get_dir(false) + "/" + name + ".wavecache").c_str()))
+    {
+        remove(out_name.c_str());
+        return false;
+    }
+    return true;
+#endif
+}
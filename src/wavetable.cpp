@@ -26,6 +26,12 @@
 #include <calf/giface.h>
 #include <calf/modules_synths.h>
 #include <iostream>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if CALF_AVX2_DISPATCH
+#include <immintrin.h>
+#endif
 
 FORWARD_DECLARE_METADATA(wavetable)
 
@@ -33,9 +39,121 @@ using namespace dsp;
 using namespace calf_plugins;
 using namespace std;
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// The block renderers put consecutive output samples in the vector lanes
+// and go through the 8 sub-sample positions in the same order as get(), so
+// they produce exactly the same values as get().
+
+#if CALF_AVX2_DISPATCH
+__attribute__((target("avx2")))
+static unsigned int wavetable_get_block_avx2(wavetable_oscillator &osc, float *output, const uint16_t *slices, unsigned int nsamples)
+{
+    enum { SCALE = wavetable_oscillator::SCALE, MASK = wavetable_oscillator::MASK };
+    uint32_t cphasedelta = osc.phasedelta >> 3;
+    const int *base = (const int *)osc.tables;
+    const __m256i sample_offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(osc.phasedelta));
+    const __m256i frac_mask = _mm256_set1_epi32(SCALE - 1), slice_mask = _mm256_set1_epi32(255), mask = _mm256_set1_epi32(MASK);
+    const __m256 frac_scale = _mm256_set1_ps(1.0f / SCALE);
+    unsigned int i = 0;
+    for (; i + 8 <= nsamples; i += 8)
+    {
+        __m256i slice = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(slices + i)));
+        // offsets of the two tables in 16-bit units
+        __m256i row = _mm256_slli_epi32(_mm256_srli_epi32(slice, 8), 8);
+        __m256i row2 = _mm256_add_epi32(row, _mm256_set1_epi32(256));
+        __m256 fracslice = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(slice, slice_mask)), _mm256_set1_ps(1.0f / 256.0f));
+        __m256i cphase = _mm256_add_epi32(_mm256_set1_epi32(osc.phase), sample_offsets);
+        __m256 value1 = _mm256_setzero_ps(), value2 = _mm256_setzero_ps();
+        for (int j = 0; j < 8; j++)
+        {
+            __m256i wpos = _mm256_srli_epi32(cphase, 32 - 8);
+            __m256i wpos2 = _mm256_and_si256(_mm256_add_epi32(wpos, _mm256_set1_epi32(1)), mask);
+            __m256 frac = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(cphase, frac_mask)), frac_scale);
+            // 32-bit gathers, the value is in the low 16 bits
+            __m256 a = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(_mm256_i32gather_epi32(base, _mm256_add_epi32(row, wpos), 2), 16), 16));
+            __m256 b = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(_mm256_i32gather_epi32(base, _mm256_add_epi32(row, wpos2), 2), 16), 16));
+            __m256 c = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(_mm256_i32gather_epi32(base, _mm256_add_epi32(row2, wpos), 2), 16), 16));
+            __m256 d = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(_mm256_i32gather_epi32(base, _mm256_add_epi32(row2, wpos2), 2), 16), 16));
+            value1 = _mm256_add_ps(value1, _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), frac)));
+            value2 = _mm256_add_ps(value2, _mm256_add_ps(c, _mm256_mul_ps(_mm256_sub_ps(d, c), frac)));
+            cphase = _mm256_add_epi32(cphase, _mm256_set1_epi32(cphasedelta));
+        }
+        __m256 value = _mm256_add_ps(value1, _mm256_mul_ps(_mm256_sub_ps(value2, value1), fracslice));
+        _mm256_storeu_ps(output + i, _mm256_mul_ps(value, _mm256_set1_ps((1.0f / 8.0f) * (1.0f / 32768.0f))));
+        osc.phase += 8 * osc.phasedelta;
+    }
+    return i;
+}
+#endif
+
+#if defined(__SSE2__)
+static unsigned int wavetable_get_block_sse2(wavetable_oscillator &osc, float *output, const uint16_t *slices, unsigned int nsamples)
+{
+    enum { SCALE = wavetable_oscillator::SCALE, MASK = wavetable_oscillator::MASK };
+    uint32_t phasedelta = osc.phasedelta, cphasedelta = phasedelta >> 3;
+    const __m128i sample_offsets = _mm_setr_epi32(0, phasedelta, 2 * phasedelta, 3 * phasedelta);
+    const __m128i frac_mask = _mm_set1_epi32(SCALE - 1);
+    const __m128 frac_scale = _mm_set1_ps(1.0f / SCALE);
+    unsigned int i = 0;
+    for (; i + 4 <= nsamples; i += 4)
+    {
+        // no gathers in SSE2, so the table values are fetched one by one
+        const int16_t *waveform[4], *waveform2[4];
+        for (int k = 0; k < 4; k++)
+        {
+            waveform[k] = osc.tables[slices[i + k] >> 8];
+            waveform2[k] = osc.tables[(slices[i + k] >> 8) + 1];
+        }
+        __m128 fracslice = _mm_mul_ps(_mm_setr_ps(slices[i] & 255, slices[i + 1] & 255, slices[i + 2] & 255, slices[i + 3] & 255), _mm_set1_ps(1.0f / 256.0f));
+        uint32_t phase = osc.phase;
+        __m128i cphase = _mm_add_epi32(_mm_set1_epi32(phase), sample_offsets);
+        __m128 value1 = _mm_setzero_ps(), value2 = _mm_setzero_ps();
+        for (int j = 0; j < 8; j++)
+        {
+            uint32_t wpos[4], wpos2[4];
+            for (int k = 0; k < 4; k++)
+            {
+                wpos[k] = (phase + k * phasedelta + j * cphasedelta) >> (32 - 8);
+                wpos2[k] = (wpos[k] + 1) & MASK;
+            }
+            __m128 frac = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(cphase, frac_mask)), frac_scale);
+            __m128 a = _mm_cvtepi32_ps(_mm_setr_epi32(waveform[0][wpos[0]], waveform[1][wpos[1]], waveform[2][wpos[2]], waveform[3][wpos[3]]));
+            __m128 b = _mm_cvtepi32_ps(_mm_setr_epi32(waveform[0][wpos2[0]], waveform[1][wpos2[1]], waveform[2][wpos2[2]], waveform[3][wpos2[3]]));
+            __m128 c = _mm_cvtepi32_ps(_mm_setr_epi32(waveform2[0][wpos[0]], waveform2[1][wpos[1]], waveform2[2][wpos[2]], waveform2[3][wpos[3]]));
+            __m128 d = _mm_cvtepi32_ps(_mm_setr_epi32(waveform2[0][wpos2[0]], waveform2[1][wpos2[1]], waveform2[2][wpos2[2]], waveform2[3][wpos2[3]]));
+            value1 = _mm_add_ps(value1, _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), frac)));
+            value2 = _mm_add_ps(value2, _mm_add_ps(c, _mm_mul_ps(_mm_sub_ps(d, c), frac)));
+            cphase = _mm_add_epi32(cphase, _mm_set1_epi32(cphasedelta));
+        }
+        __m128 value = _mm_add_ps(value1, _mm_mul_ps(_mm_sub_ps(value2, value1), fracslice));
+        _mm_storeu_ps(output + i, _mm_mul_ps(value, _mm_set1_ps((1.0f / 8.0f) * (1.0f / 32768.0f))));
+        osc.phase += 4 * phasedelta;
+    }
+    return i;
+}
+#endif
+
+void wavetable_oscillator::get_block(float *output, const uint16_t *slices, unsigned int nsamples)
+{
+    unsigned int done = 0;
+#if CALF_AVX2_DISPATCH
+    if (cpu_has_avx2())
+        done = wavetable_get_block_avx2(*this, output, slices, nsamples);
+#endif
+#if defined(__SSE2__)
+    if (!done)
+        done = wavetable_get_block_sse2(*this, output, slices, nsamples);
+#endif
+    for (unsigned int i = done; i < nsamples; i++)
+        output[i] = get(slices[i]);
+}
+
 wavetable_voice::wavetable_voice()
 {
     sample_rate = -1;
+    // the mod matrix only writes the modulated destinations
+    dsp::zero(moddest, wavetable_metadata::moddest_count);
 }
 
 void wavetable_voice::set_params_ptr(wavetable_audio_module *_parent, int _srate)
@@ -71,8 +189,8 @@ void wavetable_voice::note_on(int note, int vel)
         envs[i].set(*params[md::par_eg1attack + o] * s, *params[md::par_eg1decay + o] * s, *params[md::par_eg1sustain + o], *params[md::par_eg1release + o] * s, sample_rate / BlockSize, *params[md::par_eg1fade + o] * s); 
         envs[i].note_on();
     }
-    float modsrc[wavetable_metadata::modsrc_count] = { 1.f, velocity, parent->inertia_pressure.get_last(), parent->modwheel_value, (float)envs[0].value, (float)envs[1].value, (float)envs[2].value, 0.5f+0.5f*lfo1.last, 0.5f+0.5f*lfo2.last, (float)((note - 60) / 12.0)};
-    parent->calculate_modmatrix(moddest, md::moddest_count, modsrc);
+    float src[wavetable_metadata::modsrc_count] = { 1.f, velocity, parent->inertia_pressure.get_last(), parent->modwheel_value, (float)envs[0].value, (float)envs[1].value, (float)envs[2].value, 0.5f+0.5f*lfo1.last, 0.5f+0.5f*lfo2.last, (float)((note - 60) / 12.0)};
+    parent->calculate_modmatrix(moddest, md::moddest_count, src);
     calc_derived_dests(0);
 
     float oscshift[2] = { moddest[md::moddest_o1shift], moddest[md::moddest_o2shift] };
@@ -91,10 +209,15 @@ void wavetable_voice::steal()
 }
 
 void wavetable_voice::render_block(int current_snapshot)
+{
+    start_block();
+    parent->calculate_modmatrix(moddest, wavetable_metadata::moddest_count, modsrc);
+    finish_block(current_snapshot);
+}
+
+void wavetable_voice::start_block()
 {
     typedef wavetable_metadata md;
-    
-    const float step = 1.f / BlockSize;
 
     float s = 0.001;
     float scl[EnvCount];
@@ -114,9 +237,18 @@ void wavetable_voice::render_block(int current_snapshot)
     lfo1.last = lfo1.get();
     lfo2.last = lfo2.get();
 
-    float modsrc[wavetable_metadata::modsrc_count] = { 1.f, velocity, parent->inertia_pressure.get_last(), parent->modwheel_value, (float)envs[0].value * scl[0], (float)envs[1].value * scl[1], (float)envs[2].value * scl[2], 0.5f+0.5f*lfo1.last, 0.5f+0.5f*lfo2.last, dsp::clip<float>(note / 120.0, 0.f, 1.f)};
-    parent->calculate_modmatrix(moddest, md::moddest_count, modsrc);
-    calc_derived_dests(envs[0].value * scl[0] * scl[0]);
+    float src[wavetable_metadata::modsrc_count] = { 1.f, velocity, parent->inertia_pressure.get_last(), parent->modwheel_value, (float)envs[0].value * scl[0], (float)envs[1].value * scl[1], (float)envs[2].value * scl[2], 0.5f+0.5f*lfo1.last, 0.5f+0.5f*lfo2.last, dsp::clip<float>(note / 120.0, 0.f, 1.f)};
+    memcpy(modsrc, src, sizeof(modsrc));
+    amp_env = envs[0].value * scl[0] * scl[0];
+}
+
+void wavetable_voice::finish_block(int current_snapshot)
+{
+    typedef wavetable_metadata md;
+
+    const float step = 1.f / BlockSize;
+
+    calc_derived_dests(amp_env);
 
     int ospc = md::par_o2level - md::par_o1level;
     float pb = moddest[md::moddest_pitch] + parent->control_snapshots[current_snapshot].pitchbend;
@@ -131,13 +263,27 @@ void wavetable_voice::render_block(int current_snapshot)
     }
     float osstep[2] = { (oscshift[0] - last_oscshift[0]) * step, (oscshift[1] - last_oscshift[1]) * step };
     float oastep[2] = { (cur_oscamp[0] - last_oscamp[0]) * step, (cur_oscamp[1] - last_oscamp[1]) * step };
+    float osc_output[OscCount][BlockSize];
+    for (int j = 0; j < OscCount; j++) {
+        uint16_t slices[BlockSize];
+        float shift = last_oscshift[j];
+        for (int i = 0; i < BlockSize; i++) {
+            float o = shift * 0.01;
+            slices[i] = dsp::clip(fastf2i_drm(o * 127.0 * 256), 0, 127 * 256);
+            shift += osstep[j];
+        }
+        if (parent->simd_oscillators)
+            oscs[j].get_block(osc_output[j], slices, BlockSize);
+        else {
+            for (int i = 0; i < BlockSize; i++)
+                osc_output[j][i] = oscs[j].get(slices[i]);
+        }
+    }
     for (int i = 0; i < BlockSize; i++) {        
         float value = 0.f;
 
         for (int j = 0; j < OscCount; j++) {
-            float o = last_oscshift[j] * 0.01;
-            value += last_oscamp[j] * oscs[j].get(dsp::clip(fastf2i_drm(o * 127.0 * 256), 0, 127 * 256));
-            last_oscshift[j] += osstep[j];
+            value += last_oscamp[j] * osc_output[j][i];
             last_oscamp[j] += oastep[j];
         }
         
@@ -216,10 +362,13 @@ wavetable_audio_module::wavetable_audio_module()
 , inertia_pitchbend(64)
 , inertia_pressure(64)
 {
-    init_voices(36);
+    init_voices(MaxVoices);
+    set_render_threads(default_render_threads(), MAX_SAMPLE_RUN);
     last_voice = (wavetable_voice *)allocated_voices.items[0];
 
     panic_flag = false;
+    simd_oscillators = true;
+    batch_modmatrix = true;
     modwheel_value = 0.;
     for (int i = 0; i < 129; i += 8)
     {
@@ -613,6 +762,73 @@ void wavetable_audio_module::control_change(int channel, int controller, int val
         modwheel_value = value * (1.0 / 127.0f);
 }
 
+void wavetable_audio_module::render_to(float (*output)[2], int nsamples)
+{
+    if (!batch_modmatrix || render_pool)
+    {
+        basic_synth::render_to(output, nsamples);
+        return;
+    }
+    typedef dsp::block_voice<wavetable_voice> block_wavetable_voice;
+    enum { BlockSize = wavetable_voice::BlockSize };
+    int count = active_voices.size();
+    assert(count <= MaxVoices);
+    block_wavetable_voice *voices[MaxVoices];
+    int pos[MaxVoices], snapshot[MaxVoices];
+    for (int v = 0; v < count; v++)
+    {
+        voices[v] = (block_wavetable_voice *)active_voices.items[v];
+        pos[v] = snapshot[v] = 0;
+    }
+    // Each voice goes through its blocks the same way as in
+    // block_voice::render_to, but the mod matrix is calculated for all the
+    // voices that need a new block at once.
+    bool more = true;
+    while(more)
+    {
+        more = false;
+        int nbatch = 0;
+        int batch[MaxVoices];
+        float *batch_src[MaxVoices], *batch_dest[MaxVoices];
+        for (int v = 0; v < count; v++)
+        {
+            block_wavetable_voice *voice = voices[v];
+            int ncopy = std::min<int>(BlockSize - voice->read_ptr, nsamples - pos[v]);
+            for (int i = 0; i < ncopy; i++)
+            {
+                output[pos[v] + i][0] += voice->output_buffer[voice->read_ptr + i][0];
+                output[pos[v] + i][1] += voice->output_buffer[voice->read_ptr + i][1];
+            }
+            pos[v] += ncopy;
+            voice->read_ptr += ncopy;
+            if (pos[v] < nsamples)
+            {
+                voice->read_ptr = 0;
+                voice->start_block();
+                batch[nbatch] = v;
+                batch_src[nbatch] = voice->get_modsrc();
+                batch_dest[nbatch] = voice->get_moddest();
+                nbatch++;
+                more = true;
+            }
+        }
+        if (!nbatch)
+            continue;
+        calculate_modmatrix_batch(batch_dest, moddest_count, batch_src, nbatch);
+        for (int i = 0; i < nbatch; i++)
+            voices[batch[i]]->finish_block(snapshot[batch[i]]++);
+    }
+    for (dsp::voice **i = active_voices.begin(); i != active_voices.end(); ) {
+        dsp::voice *v = *i;
+        if (!v->get_active()) {
+            i = active_voices.erase(i);
+            unused_voices.add(v);
+            continue;
+        }
+        i++;
+    }
+}
+
 const dsp::modulation_entry *wavetable_audio_module::get_default_mod_matrix_value(int row) const
 {
     static modulation_entry row0(modsrc_env1, mod_matrix_metadata::map_positive, modsrc_none, 50, moddest_o1shift);